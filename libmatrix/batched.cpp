@@ -0,0 +1,467 @@
+#include "libmatrix/batched.h"
+#include "libmatrix/blas.h"
+#include "libmatrix/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#if !defined(MX_NO_SIMD) && defined(__x86_64__) && ( defined(__GNUC__) || defined(__clang__) )
+#define MX_BATCHED_X86
+#endif
+
+#if !defined(__GNUC__) && !defined(__clang__)
+#error "batched.cpp is written against the GCC / Clang vector extensions"
+#endif
+#define MX_BATCHED_INLINE inline __attribute__((always_inline))
+
+namespace mx
+{
+
+template<typename T>
+BasicBatchedMatrix<T>::BasicBatchedMatrix() : _batch(0), _n_row(0), _n_col(0) {}
+
+template<typename T>
+BasicBatchedMatrix<T>::BasicBatchedMatrix( int batch, int row, int col )
+    : _batch(batch), _n_row(row), _n_col(col)
+{
+    assert( batch>=0 && row>=0 && col>=0 );
+    _data.assign( (size_t)n_group() * group_stride(), T(0) );
+
+    /// the padding lanes of the last group hold identity matrices, so factoring
+    /// them is harmless and no inf / nan runs through the vector registers
+    if( _batch % LANES == 0 ) return;
+    T* last = group( n_group()-1 );
+    for( int i=0; i<std::min( row, col ); i++ )
+        for( int l=_batch % LANES; l<LANES; l++ )
+            last[ ( i*col + i )*LANES + l ] = T(1);
+}
+
+template<typename T>
+BasicBatchedMatrix<T>::BasicBatchedMatrix( const std::vector< BasicMatrix<T> >& mats )
+    : BasicBatchedMatrix( (int)mats.size(),
+                          mats.empty() ? 0 : mats[0].n_row(),
+                          mats.empty() ? 0 : mats[0].n_col() )
+{
+    for( int b=0; b<_batch; b++ )
+        set( b, mats[b] );
+}
+
+template<typename T>
+void BasicBatchedMatrix<T>::set( int b, const BasicMatrix<T>& mat )
+{
+    assert( b>=0 && b<_batch );
+    assert( mat.n_row()==_n_row && mat.n_col()==_n_col );
+    T* dst = group( b / LANES ) + b % LANES;
+    const T* src = mat.data();
+    for( int i=0; i<_n_row*_n_col; i++ )
+        dst[ i*LANES ] = src[i];
+}
+
+template<typename T>
+BasicMatrix<T> BasicBatchedMatrix<T>::get( int b ) const
+{
+    assert( b>=0 && b<_batch );
+    BasicMatrix<T> mat( _n_row, _n_col );
+    const T* src = group( b / LANES ) + b % LANES;
+    T* dst = mat.data();
+    for( int i=0; i<_n_row*_n_col; i++ )
+        dst[i] = src[ i*LANES ];
+    return mat;
+}
+
+namespace
+{
+
+/// one group of lanes as a GCC / Clang vector: entry (i,j) of every lane of a group
+/// is one LaneVec at a + (i*n+j)*W, the compiler maps it onto zmm, ymm or xmm
+/// registers depending on the target of the kernel it is inlined into
+template<typename T>
+struct LaneVec;
+template<>
+struct LaneVec<double>
+{
+    typedef double type __attribute__((vector_size(64), aligned(sizeof(double)), __may_alias__));
+    typedef std::int64_t bits;
+    typedef bits mask __attribute__((vector_size(64)));
+};
+template<>
+struct LaneVec<float>
+{
+    typedef float type __attribute__((vector_size(64), aligned(sizeof(float)), __may_alias__));
+    typedef std::int32_t bits;
+    typedef bits mask __attribute__((vector_size(64)));
+};
+
+#define MX_LANES(T, p) ( *(typename LaneVec<T>::type*)(p) )
+#define MX_CLANES(T, p) ( *(const typename LaneVec<T>::type*)(p) )
+
+/// gcc 12 breaks on vector compares under target("avx512f"), so the per-lane
+/// decisions are made on the bits: for non-negative floats the order of the bit
+/// patterns is the order of the values, and a difference shifted right by
+/// the sign bit gives an all-ones / all-zeros lane mask
+
+/// swap len lane groups of x and y in the lanes set in pick
+template<typename T>
+MX_BATCHED_INLINE void lanes_swap( int len, const typename LaneVec<T>::mask& pick, T* x, T* y )
+{
+    typedef typename LaneVec<T>::type V;
+    typedef typename LaneVec<T>::mask M;
+    constexpr int W = BasicBatchedMatrix<T>::LANES;
+    for( int j=0; j<len; j++ )
+    {
+        M xj = (M)MX_CLANES( T, x + j*W );
+        M yj = (M)MX_CLANES( T, y + j*W );
+        MX_LANES( T, x + j*W ) = (V)( ( yj & pick ) | ( xj & ~pick ) );
+        MX_LANES( T, y + j*W ) = (V)( ( xj & pick ) | ( yj & ~pick ) );
+    }
+}
+
+/// all ones in the lanes where idx equals i; the swaps below are done for every
+/// candidate row, testing the mask for any set lane costs more than the swap
+template<typename T>
+MX_BATCHED_INLINE void lanes_equal( const typename LaneVec<T>::mask& idx, int i, typename LaneVec<T>::mask& eq )
+{
+    typedef typename LaneVec<T>::mask M;
+    typedef typename LaneVec<T>::bits B;
+    M diff = idx ^ B(i);
+    eq = ~( ( diff | -diff ) >> ( 8*sizeof(T) - 1 ) );
+}
+
+template<typename T>
+MX_BATCHED_INLINE void lu_group( int n, T* a, int* piv, int* fail )
+{
+    typedef typename LaneVec<T>::type V;
+    typedef typename LaneVec<T>::mask M;
+    typedef typename LaneVec<T>::bits B;
+    constexpr int W = BasicBatchedMatrix<T>::LANES;
+    for( int k=0; k<n; k++ )
+    {
+        T* ak = a + k*n*W;
+
+        /// per-lane pivot search without branches, on |a(i,k)| as integers
+        const int shift = 8*sizeof(T) - 1;
+        const M abs_bits = M{} + std::numeric_limits<B>::max();
+        M best = (M)MX_CLANES( T, ak + k*W ) & abs_bits;
+        M idx = M{} + B(k);
+        for( int i=k+1; i<n; i++ )
+        {
+            M val = (M)MX_CLANES( T, a + (i*n+k)*W ) & abs_bits;
+            M gt = ( best - val ) >> shift;
+            best = ( val & gt ) | ( best & ~gt );
+            idx = ( B(i) & gt ) | ( idx & ~gt );
+        }
+
+        /// the pivot rows differ from lane to lane: each candidate row is swapped
+        /// with row k under the mask of the lanes that picked it, which keeps the
+        /// swaps in whole registers instead of scattering single entries
+        for( int i=k+1; i<n; i++ )
+        {
+            M pick;
+            lanes_equal<T>( idx, i, pick );
+            lanes_swap( n, pick, ak, a + i*n*W );
+        }
+
+        /// a zero pivot only marks its lane, the division goes on with 1
+        T r[W];
+        for( int l=0; l<W; l++ )
+        {
+            piv[k*W+l] = (int)idx[l];
+            T pivot = ak[k*W+l];
+            fail[l] |= ( pivot==T(0) );
+            r[l] = T(1) / ( pivot==T(0) ? T(1) : pivot );
+        }
+        V rv = MX_CLANES( T, r );
+        for( int i=k+1; i<n; i++ )
+        {
+            T* ai = a + i*n*W;
+            V lik = MX_CLANES( T, ai + k*W ) * rv;
+            MX_LANES( T, ai + k*W ) = lik;
+            for( int j=k+1; j<n; j++ )
+                MX_LANES( T, ai + j*W ) -= lik * MX_CLANES( T, ak + j*W );
+        }
+    }
+}
+
+template<typename T>
+MX_BATCHED_INLINE void chole_group( int n, T* a, int* fail )
+{
+    /// left-looking A = L L^t in the lower triangle, as FixedLinearSolver::chole_decomp
+    typedef typename LaneVec<T>::type V;
+    constexpr int W = BasicBatchedMatrix<T>::LANES;
+    for( int j=0; j<n; j++ )
+    {
+        T* aj = a + j*n*W;
+        V d = MX_CLANES( T, aj + j*W );
+        for( int k=0; k<j; k++ )
+        {
+            V ajk = MX_CLANES( T, aj + k*W );
+            d -= ajk * ajk;
+        }
+
+        /// a lane that is not positive definite goes on with 1 on the diagonal
+        T ljj[W], r[W];
+        for( int l=0; l<W; l++ )
+        {
+            bool bad = !( d[l] > T(0) );
+            fail[l] |= bad;
+            ljj[l] = std::sqrt( bad ? T(1) : d[l] );
+            r[l] = T(1) / ljj[l];
+        }
+        MX_LANES( T, aj + j*W ) = MX_CLANES( T, ljj );
+        V rv = MX_CLANES( T, r );
+        for( int i=j+1; i<n; i++ )
+        {
+            T* ai = a + i*n*W;
+            V sum = MX_CLANES( T, ai + j*W );
+            for( int k=0; k<j; k++ )
+                sum -= MX_CLANES( T, ai + k*W ) * MX_CLANES( T, aj + k*W );
+            MX_LANES( T, ai + j*W ) = sum * rv;
+        }
+    }
+}
+
+/// x_i -= sum a(i,j) x_j over j in [j0, j1), on the k columns of the right-hand sides
+template<typename T>
+MX_BATCHED_INLINE void lanes_substitute( int n, int k, const T* a, int i, int j0, int j1, bool trans, T* x )
+{
+    typedef typename LaneVec<T>::type V;
+    constexpr int W = BasicBatchedMatrix<T>::LANES;
+    T* xi = x + i*k*W;
+    for( int j=j0; j<j1; j++ )
+    {
+        V aij = MX_CLANES( T, a + ( trans ? j*n+i : i*n+j )*W );
+        const T* xj = x + j*k*W;
+        for( int c=0; c<k; c++ )
+            MX_LANES( T, xi + c*W ) -= aij * MX_CLANES( T, xj + c*W );
+    }
+}
+
+template<typename T>
+MX_BATCHED_INLINE void lanes_divide( int n, int k, const T* a, int i, T* x )
+{
+    typedef typename LaneVec<T>::type V;
+    constexpr int W = BasicBatchedMatrix<T>::LANES;
+    V aii = MX_CLANES( T, a + (i*n+i)*W );
+    for( int c=0; c<k; c++ )
+        MX_LANES( T, x + (i*k+c)*W ) /= aii;
+}
+
+template<typename T>
+MX_BATCHED_INLINE void solve_lu_group( int n, int k, const T* a, const int* piv, T* x )
+{
+    /// P b, L y = P b, U x = y on the n x k right-hand sides of every lane,
+    /// row i is swapped with row piv[i] by the same masked swaps as the factorization
+    typedef typename LaneVec<T>::mask M;
+    constexpr int W = BasicBatchedMatrix<T>::LANES;
+    for( int i=0; i<n; i++ )
+    {
+        M idx;
+        for( int l=0; l<W; l++ )
+            idx[l] = piv[i*W+l];
+        for( int m=i+1; m<n; m++ )
+        {
+            M pick;
+            lanes_equal<T>( idx, m, pick );
+            lanes_swap( k, pick, x + i*k*W, x + m*k*W );
+        }
+    }
+    for( int i=1; i<n; i++ )
+        lanes_substitute( n, k, a, i, 0, i, false, x );
+    for( int i=n-1; i>=0; i-- )
+    {
+        lanes_substitute( n, k, a, i, i+1, n, false, x );
+        lanes_divide( n, k, a, i, x );
+    }
+}
+
+template<typename T>
+MX_BATCHED_INLINE void solve_chole_group( int n, int k, const T* a, T* x )
+{
+    /// L y = b, L^t x = y, L^t is read off the rows of L
+    for( int i=0; i<n; i++ )
+    {
+        lanes_substitute( n, k, a, i, 0, i, false, x );
+        lanes_divide( n, k, a, i, x );
+    }
+    for( int i=n-1; i>=0; i-- )
+    {
+        lanes_substitute( n, k, a, i, i+1, n, true, x );
+        lanes_divide( n, k, a, i, x );
+    }
+}
+
+template<typename T>
+struct BatchedKernels
+{
+    void (*lu)( int n, T* a, int* piv, int* fail );
+    void (*chole)( int n, T* a, int* fail );
+    void (*solve_lu)( int n, int k, const T* a, const int* piv, T* x );
+    void (*solve_chole)( int n, int k, const T* a, T* x );
+};
+
+/// the same kernels compiled once per instruction set, the group loops are
+/// inlined into each copy so the lane loops get the wider registers
+#define MX_BATCHED_KERNELS(SUFFIX, TARGET) \
+    template<typename T> TARGET \
+    void lu_group_##SUFFIX( int n, T* a, int* piv, int* fail ) \
+    { lu_group( n, a, piv, fail ); } \
+    template<typename T> TARGET \
+    void chole_group_##SUFFIX( int n, T* a, int* fail ) \
+    { chole_group( n, a, fail ); } \
+    template<typename T> TARGET \
+    void solve_lu_group_##SUFFIX( int n, int k, const T* a, const int* piv, T* x ) \
+    { solve_lu_group( n, k, a, piv, x ); } \
+    template<typename T> TARGET \
+    void solve_chole_group_##SUFFIX( int n, int k, const T* a, T* x ) \
+    { solve_chole_group( n, k, a, x ); } \
+    template<typename T> \
+    const BatchedKernels<T>& batched_kernels_##SUFFIX() \
+    { \
+        static const BatchedKernels<T> kernels = { lu_group_##SUFFIX<T>, chole_group_##SUFFIX<T>, \
+            solve_lu_group_##SUFFIX<T>, solve_chole_group_##SUFFIX<T> }; \
+        return kernels; \
+    }
+
+MX_BATCHED_KERNELS(generic, )
+#ifdef MX_BATCHED_X86
+MX_BATCHED_KERNELS(avx2, __attribute__((target("avx2,fma"))))
+MX_BATCHED_KERNELS(avx512, __attribute__((target("avx512f"))))
+#endif
+
+template<typename T>
+const BatchedKernels<T>& batched_kernels()
+{
+#ifdef MX_BATCHED_X86
+    switch( simd_level() )
+    {
+    case SIMD_AVX512: return batched_kernels_avx512<T>();
+    case SIMD_AVX2: return batched_kernels_avx2<T>();
+    default: break;
+    }
+#endif
+    return batched_kernels_generic<T>();
+}
+
+/// groups are cheap for small n, so each task takes a run of them
+void parallel_groups( int n_group, const std::function<void(int, int)>& task )
+{
+    ThreadPool& pool = thread_pool();
+    int n_tasks = std::min( n_group, 4*pool.size() );
+    if( n_tasks<=1 )
+    {
+        task( 0, n_group );
+        return;
+    }
+    int width = ( n_group + n_tasks - 1 )/n_tasks;
+    n_tasks = ( n_group + width - 1 )/width;
+    pool.parallel_for( n_tasks, [&]( int t )
+    {
+        int g0 = t*width;
+        task( g0, std::min( n_group, g0+width ) );
+    } );
+}
+
+}
+
+template<typename T>
+BasicBatchedLinearSolver<T>::BasicBatchedLinearSolver() : status(EMPTY) {}
+
+template<typename T>
+BasicBatchedLinearSolver<T>::BasicBatchedLinearSolver( const MatrixType& mat )
+{
+    set_matrix( mat );
+}
+
+template<typename T>
+void BasicBatchedLinearSolver<T>::set_matrix( const MatrixType& mat )
+{
+    assert( mat.n_row()==mat.n_col() );
+    _mat = mat;
+    perm.assign( (size_t)_mat.n_group() * _mat.n_row() * LANES, 0 );
+    info.assign( _mat.batch(), 0 );
+    status = MAT_SET;
+}
+
+template<typename T>
+int BasicBatchedLinearSolver<T>::lu_decomp_partial()
+{
+    assert( status!=EMPTY );
+    if( status!=MAT_SET ) return -1;
+
+    const BatchedKernels<T>& kernels = batched_kernels<T>();
+    int n = _mat.n_row();
+    int batch = _mat.batch();
+    parallel_groups( _mat.n_group(), [&]( int g0, int g1 )
+    {
+        for( int g=g0; g<g1; g++ )
+        {
+            int fail[LANES] = {};
+            kernels.lu( n, _mat.group( g ), perm.data() + (size_t)g*n*LANES, fail );
+            for( int l=0; l<LANES && g*LANES+l<batch; l++ )
+                info[ g*LANES+l ] = fail[l] ? -1 : 0;
+        }
+    } );
+    status = LU_SUCCESS;
+    return std::count( info.begin(), info.end(), -1 ) ? -1 : 0;
+}
+
+template<typename T>
+int BasicBatchedLinearSolver<T>::chole_decomp()
+{
+    assert( status!=EMPTY );
+    if( status!=MAT_SET ) return -1;
+
+    const BatchedKernels<T>& kernels = batched_kernels<T>();
+    int n = _mat.n_row();
+    int batch = _mat.batch();
+    parallel_groups( _mat.n_group(), [&]( int g0, int g1 )
+    {
+        for( int g=g0; g<g1; g++ )
+        {
+            int fail[LANES] = {};
+            kernels.chole( n, _mat.group( g ), fail );
+            for( int l=0; l<LANES && g*LANES+l<batch; l++ )
+                info[ g*LANES+l ] = fail[l] ? -1 : 0;
+        }
+    } );
+    status = CHOLE_SUCCESS;
+    return std::count( info.begin(), info.end(), -1 ) ? -1 : 0;
+}
+
+template<typename T>
+void BasicBatchedLinearSolver<T>::solve_inplace( MatrixType& b ) const
+{
+    assert( status==LU_SUCCESS || status==CHOLE_SUCCESS );
+    assert( b.batch()==_mat.batch() && b.n_row()==_mat.n_row() );
+
+    const BatchedKernels<T>& kernels = batched_kernels<T>();
+    int n = _mat.n_row();
+    int k = b.n_col();
+    parallel_groups( _mat.n_group(), [&]( int g0, int g1 )
+    {
+        for( int g=g0; g<g1; g++ )
+        {
+            if( status==LU_SUCCESS )
+                kernels.solve_lu( n, k, _mat.group( g ), perm.data() + (size_t)g*n*LANES, b.group( g ) );
+            else
+                kernels.solve_chole( n, k, _mat.group( g ), b.group( g ) );
+        }
+    } );
+}
+
+template<typename T>
+typename BasicBatchedLinearSolver<T>::MatrixType BasicBatchedLinearSolver<T>::solve( const MatrixType& b ) const
+{
+    MatrixType x = b;
+    solve_inplace( x );
+    return x;
+}
+
+template class BasicBatchedMatrix<float>;
+template class BasicBatchedMatrix<double>;
+template class BasicBatchedLinearSolver<float>;
+template class BasicBatchedLinearSolver<double>;
+
+}
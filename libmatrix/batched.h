@@ -0,0 +1,104 @@
+#ifndef _MX_BATCHED_H
+#define _MX_BATCHED_H
+
+#include <cassert>
+#include <vector>
+
+#include "matrix.h"
+#include "lu.h"
+#include "scalar.h"
+
+namespace mx
+{
+
+/// many row x col matrices of the same size in an interleaved "batch-lane" layout:
+/// the batch is cut into groups of LANES matrices, and inside a group entry (i,j)
+/// of every matrix sits in one contiguous run of LANES values, so one SIMD register
+/// holds the same entry of LANES different matrices; instantiated for float and double
+template<typename T>
+class BasicBatchedMatrix
+{
+public:
+    /// one 64-byte vector of entries, fixed so the layout does not depend on the CPU
+    static constexpr int LANES = 64 / sizeof(T);
+
+private:
+    int _batch;
+    int _n_row;
+    int _n_col;
+    std::vector<T> _data;
+
+public:
+    BasicBatchedMatrix();
+    BasicBatchedMatrix( int batch, int row, int col );
+    BasicBatchedMatrix( const std::vector< BasicMatrix<T> >& mats );
+
+    int batch() const { return _batch; }
+    int n_row() const { return _n_row; }
+    int n_col() const { return _n_col; }
+    /// groups of LANES matrices, the last one padded
+    int n_group() const { return ( _batch + LANES - 1 ) / LANES; }
+    int group_stride() const { return _n_row * _n_col * LANES; }
+    T* group( int g ) { return _data.data() + (size_t)g * group_stride(); }
+    const T* group( int g ) const { return _data.data() + (size_t)g * group_stride(); }
+
+    T& operator()( int b, int row, int col )
+    {
+        assert( b>=0 && b<_batch && row>=0 && row<_n_row && col>=0 && col<_n_col );
+        return group( b / LANES )[ ( row*_n_col + col )*LANES + b % LANES ];
+    }
+    T operator()( int b, int row, int col ) const
+    {
+        assert( b>=0 && b<_batch && row>=0 && row<_n_row && col>=0 && col<_n_col );
+        return group( b / LANES )[ ( row*_n_col + col )*LANES + b % LANES ];
+    }
+    /// copy one matrix in or out of the batch
+    void set( int b, const BasicMatrix<T>& mat );
+    BasicMatrix<T> get( int b ) const;
+};
+
+/// LU with partial pivoting / Cholesky of every matrix of a square BasicBatchedMatrix,
+/// all the matrices of a group are factored in lockstep, one per SIMD lane, and the
+/// groups are spread over thread_pool(); pivots, factors and conventions follow
+/// LinearSolver: perm[k] is the row swapped with row k, L has a unit diagonal
+template<typename T>
+class BasicBatchedLinearSolver
+{
+public:
+    typedef BasicBatchedMatrix<T> MatrixType;
+    static constexpr int LANES = MatrixType::LANES;
+
+private:
+    MatrixType _mat;
+    LinearSolverStatus status;
+    /// per group, perm[k] of every lane interleaved like the entries
+    std::vector<int> perm;
+    /// per matrix, 0 on success and -1 on a zero pivot / non positive definite matrix
+    std::vector<int> info;
+
+public:
+    BasicBatchedLinearSolver();
+    BasicBatchedLinearSolver( const MatrixType& mat );
+    void set_matrix( const MatrixType& mat );
+    LinearSolverStatus get_status() const { return status; }
+    const MatrixType& matrix_lu() const { return _mat; }
+    const std::vector<int>& get_info() const { return info; }
+
+    /// both return 0 when every matrix was factored and -1 if any one failed,
+    /// get_info() tells which; the other matrices are still usable
+    int lu_decomp_partial();
+    int chole_decomp();
+
+    /// solve A_b X_b = B_b for every matrix of the batch, B is batch x n x k
+    void solve_inplace( MatrixType& b ) const;
+    MatrixType solve( const MatrixType& b ) const;
+};
+
+typedef BasicBatchedMatrix<double> BatchedMatrix;
+typedef BasicBatchedMatrix<float> BatchedMatrixF;
+typedef BasicBatchedLinearSolver<double> BatchedLinearSolver;
+typedef BasicBatchedLinearSolver<float> BatchedLinearSolverF;
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+#include "libmatrix/blas.h"
+
+#include <algorithm>
+
+namespace mx
+{
+
+namespace
+{
+
+/// diagonal block edge of the blocked triangular solves
+constexpr int TRSM_NB = 64;
+
+template<typename T>
+void trsm_left_unblocked( bool lower, bool trans, bool unit_diag, int m, int n,
+                          const T* t, int ldt, T* b, int ldb )
+{
+    /// row-by-row substitution, each step is an axpy over a contiguous row of B;
+    /// T is always walked along its rows: op(T) = T gathers from the solved rows,
+    /// op(T) = T^t scatters each solved row into the rows still to come
+    bool forward = ( lower != trans );
+    for( int s=0; s<m; s++ )
+    {
+        int i = forward ? s : m-1-s;
+        const T* ti = t + i*ldt;
+        T* bi = b + i*ldb;
+        if( !trans && n==1 )
+        {
+            int j_beg = forward ? 0 : i+1;
+            int j_end = forward ? i : m;
+            bi[0] -= dot( j_end-j_beg, ti + j_beg, 1, b + j_beg*ldb, ldb );
+        }
+        else if( !trans )
+        {
+            int j_beg = forward ? 0 : i+1;
+            int j_end = forward ? i : m;
+            for( int j=j_beg; j<j_end; j++ )
+            {
+                if( ti[j]==T(0) ) continue;
+                const T* bj = b + j*ldb;
+                for( int c=0; c<n; c++ )
+                    bi[c] -= ti[j] * bj[c];
+            }
+        }
+        if( !unit_diag )
+        {
+            T r = T(1) / ( trans ? scalar_conj( ti[i] ) : ti[i] );
+            for( int c=0; c<n; c++ )
+                bi[c] *= r;
+        }
+        if( trans && n==1 && !ScalarTraits<T>::is_complex )
+        {
+            int j_beg = forward ? i+1 : 0;
+            int j_end = forward ? m : i;
+            axpy( j_end-j_beg, -bi[0], ti + j_beg, 1, b + j_beg*ldb, ldb );
+        }
+        else if( trans )
+        {
+            int j_beg = forward ? i+1 : 0;
+            int j_end = forward ? m : i;
+            for( int j=j_beg; j<j_end; j++ )
+            {
+                if( ti[j]==T(0) ) continue;
+                T tij = scalar_conj( ti[j] );
+                T* bj = b + j*ldb;
+                for( int c=0; c<n; c++ )
+                    bj[c] -= tij * bi[c];
+            }
+        }
+    }
+}
+
+template<typename T>
+void trsm_right_unblocked( bool lower, bool trans, bool unit_diag, int m, int n,
+                           const T* t, int ldt, T* b, int ldb )
+{
+    /// x * op(T) = b for each row x of B, op(T) upper goes forward, lower backward
+    auto t_at = [&]( int i, int j ){ return trans ? scalar_conj( t[j*ldt+i] ) : t[i*ldt+j]; };
+    bool forward = ( lower == trans );
+    for( int r=0; r<m; r++ )
+    {
+        T* x = b + r*ldb;
+        for( int s=0; s<n; s++ )
+        {
+            int j = forward ? s : n-1-s;
+            T sum = x[j];
+            if( forward )
+                for( int l=0; l<j; l++ ) sum -= x[l] * t_at( l, j );
+            else
+                for( int l=j+1; l<n; l++ ) sum -= x[l] * t_at( l, j );
+            x[j] = unit_diag ? sum : sum / t_at( j, j );
+        }
+    }
+}
+
+}
+
+template<typename T>
+T dot( int n, const T* x, int incx, const T* y, int incy )
+{
+    /// four partial sums break the add latency chain
+    T s0 = T(0), s1 = T(0), s2 = T(0), s3 = T(0);
+    int i = 0;
+    if( incx==1 && incy==1 )
+    {
+        for( ; i+4<=n; i+=4 )
+        {
+            s0 += x[i] * y[i];
+            s1 += x[i+1] * y[i+1];
+            s2 += x[i+2] * y[i+2];
+            s3 += x[i+3] * y[i+3];
+        }
+    }
+    for( ; i<n; i++ )
+        s0 += x[i*incx] * y[i*incy];
+    return (s0+s1) + (s2+s3);
+}
+
+template<typename T>
+void axpy( int n, NoDeduce<T> alpha, const T* x, int incx, T* y, int incy )
+{
+    if( incx==1 && incy==1 )
+    {
+        for( int i=0; i<n; i++ )
+            y[i] += alpha * x[i];
+        return;
+    }
+    for( int i=0; i<n; i++ )
+        y[i*incy] += alpha * x[i*incx];
+}
+
+template<typename T>
+void trsm_left( bool lower, bool trans, bool unit_diag, int m, int n,
+                const T* t, int ldt, T* b, int ldb )
+{
+    if( m<=0 || n<=0 ) return;
+
+    /// diagonal blocks by substitution, everything off the diagonal through gemm
+    bool forward = ( lower != trans );
+    for( int s=0; s<m; s+=TRSM_NB )
+    {
+        int kb = std::min( TRSM_NB, m-s );
+        int k0 = forward ? s : m-s-kb;
+        const T* tkk = t + k0*ldt + k0;
+        trsm_left_unblocked( lower, trans, unit_diag, kb, n, tkk, ldt, b + k0*ldb, ldb );
+
+        /// rows still to be solved: below the block going forward, above it going backward
+        int r0 = forward ? k0+kb : 0;
+        int rows = forward ? m-k0-kb : k0;
+        if( rows==0 ) continue;
+        const T* trk = trans ? t + k0*ldt + r0 : t + r0*ldt + k0;
+        gemm( trans, false, rows, n, kb, T(-1), trk, ldt, b + k0*ldb, ldb, T(1), b + r0*ldb, ldb );
+    }
+}
+
+template<typename T>
+void trsm_right( bool lower, bool trans, bool unit_diag, int m, int n,
+                 const T* t, int ldt, T* b, int ldb )
+{
+    if( m<=0 || n<=0 ) return;
+
+    /// column blocks of B by substitution, the columns still to solve through gemm
+    bool forward = ( lower == trans );
+    for( int s=0; s<n; s+=TRSM_NB )
+    {
+        int kb = std::min( TRSM_NB, n-s );
+        int k0 = forward ? s : n-s-kb;
+        trsm_right_unblocked( lower, trans, unit_diag, m, kb, t + k0*ldt + k0, ldt, b + k0, ldb );
+
+        int c0 = forward ? k0+kb : 0;
+        int cols = forward ? n-k0-kb : k0;
+        if( cols==0 ) continue;
+        const T* tkc = trans ? t + c0*ldt + k0 : t + k0*ldt + c0;
+        gemm( false, trans, m, cols, kb, T(-1), b + k0, ldb, tkc, ldt, T(1), b + c0, ldb );
+    }
+}
+
+template<typename T>
+void syrk_lower( int n, int k, NoDeduce<T> alpha, const T* a, int lda,
+                 NoDeduce<T> beta, T* c, int ldc )
+{
+    if( n<=0 ) return;
+
+    /// C = alpha*A*A^t + beta*C on the lower triangle only, the strictly upper part is left as is
+    T tile[TRSM_NB*TRSM_NB];
+    for( int i0=0; i0<n; i0+=TRSM_NB )
+    {
+        int ib = std::min( TRSM_NB, n-i0 );
+        gemm( false, true, ib, i0, k, alpha, a + i0*lda, lda, a, lda, beta, c + i0*ldc, ldc );
+
+        gemm( false, true, ib, ib, k, alpha, a + i0*lda, lda, a + i0*lda, lda, T(0), tile, ib );
+        for( int i=0; i<ib; i++ )
+        {
+            T* ci = c + (i0+i)*ldc + i0;
+            for( int j=0; j<=i; j++ )
+                ci[j] = ( beta==T(0) ? T(0) : beta*ci[j] ) + tile[i*ib+j];
+        }
+    }
+}
+
+#define MX_INSTANTIATE_BLAS(T) \
+    template T dot<T>( int, const T*, int, const T*, int ); \
+    template void axpy<T>( int, T, const T*, int, T*, int ); \
+    template void trsm_left<T>( bool, bool, bool, int, int, const T*, int, T*, int ); \
+    template void trsm_right<T>( bool, bool, bool, int, int, const T*, int, T*, int ); \
+    template void syrk_lower<T>( int, int, T, const T*, int, T, T*, int );
+MX_INSTANTIATE_BLAS(float)
+MX_INSTANTIATE_BLAS(double)
+MX_INSTANTIATE_BLAS(std::complex<float>)
+MX_INSTANTIATE_BLAS(std::complex<double>)
+
+}
@@ -0,0 +1,82 @@
+#ifndef _MX_BLAS_H
+#define _MX_BLAS_H
+
+#include "scalar.h"
+
+namespace mx
+{
+
+/// every routine here is instantiated for float, double, std::complex<float> and
+/// std::complex<double>; for complex entries op(X) = X^t means the conjugate transpose
+
+    /* in gemm.cpp */
+/// C = alpha * op(A) * op(B) + beta * C on row-major buffers,
+/// op(A) is m x k, op(B) is k x n, op(X) = X^t when trans_x is set,
+/// large products run on thread_pool()
+template<typename T>
+void gemm( bool trans_a, bool trans_b, int m, int n, int k,
+           NoDeduce<T> alpha, const T* a, int lda,
+           const T* b, int ldb,
+           NoDeduce<T> beta, T* c, int ldc );
+/// name of the micro-kernel picked at run time: "generic", "avx2" or "avx512"
+const char* gemm_kernel_name();
+/// widest vector extension usable on this CPU, capped by MX_GEMM_ARCH
+enum SimdLevel
+{
+    SIMD_GENERIC,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+SimdLevel simd_level();
+
+    /* in blas.cpp */
+/// sum of x[i] * y[i], no conjugation
+template<typename T>
+T dot( int n, const T* x, int incx, const T* y, int incy );
+/// y += alpha * x
+template<typename T>
+void axpy( int n, NoDeduce<T> alpha, const T* x, int incx, T* y, int incy );
+/// solve op(T) * X = B in place of the m x n block B, T is m x m lower or upper
+/// triangular, unit_diag treats the diagonal of T as ones without reading it
+template<typename T>
+void trsm_left( bool lower, bool trans, bool unit_diag, int m, int n,
+                const T* t, int ldt, T* b, int ldb );
+/// solve X * op(T) = B in place of the m x n block B, T is n x n triangular
+template<typename T>
+void trsm_right( bool lower, bool trans, bool unit_diag, int m, int n,
+                 const T* t, int ldt, T* b, int ldb );
+/// lower triangle of C = alpha * A * A^t + beta * C, A is n x k
+template<typename T>
+void syrk_lower( int n, int k, NoDeduce<T> alpha, const T* a, int lda,
+                 NoDeduce<T> beta, T* c, int ldc );
+
+    /* in lu.cpp */
+/// apply the row swaps ipiv[k0:k0+kb) of an n-row matrix to the columns [c0, c1)
+template<typename T>
+void lu_swap_rows( int n, T* a, int lda, const int* ipiv, int k0, int kb, int c0, int c1 );
+/// partial pivoting LU of the panel a[ k0:n, k0:k0+kb ], ipiv[k] is the row swapped
+/// with row k and the swaps only touch the panel columns; -1 on a zero pivot
+template<typename T>
+int lu_panel_partial( int n, T* a, int lda, int* ipiv, int k0, int kb, bool recurse );
+
+    /* in qr.cpp */
+/// Householder QR of the m x n block a in place: R on and above the diagonal, the
+/// reflectors H_j = I - tau_j v_j v_j^* below it with their unit heads implied.
+/// Panels of block_size columns are factored column by column and applied to the
+/// trailing matrix in the compact WY form I - V T V^*, three GEMMs per panel
+template<typename T>
+void qr_blocked( int m, int n, T* a, int lda, T* tau, int block_size );
+/// QR with column pivoting A P = Q R in the same storage, jpvt[j] the column of A
+/// moved to column j, each pivot the column of largest remaining norm. Within a block
+/// of block_size steps only the chosen columns and pivot rows are updated, the rest of
+/// the matrix once per block by GEMM
+template<typename T>
+void qr_pivoted( int m, int n, T* a, int lda, T* tau, int* jpvt, int block_size );
+/// B = Q^* B ( adjoint ) or Q B for the m x k block B, Q made of the first kq
+/// reflectors of a factorization by qr_blocked or qr_pivoted
+template<typename T>
+void qr_apply( bool adjoint, int m, int kq, const T* a, int lda, const T* tau, T* b, int k, int ldb, int block_size );
+
+}
+
+#endif
@@ -0,0 +1,626 @@
+#include "libmatrix/matrix_file.h"
+#include "libmatrix/scalar.h"
+#include "libmatrix/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace mx
+{
+
+namespace
+{
+
+/// a chunk handed to one task is at least this long, smaller blocks are parsed serially
+constexpr std::size_t PARSE_CHUNK = 1 << 20;
+/// bytes of formatted text one task produces per round
+constexpr std::size_t FORMAT_CHUNK = 1 << 20;
+
+inline bool is_space( char c )
+{
+    return c==' ' || c=='\n' || c=='\t' || c=='\r' || c=='\v' || c=='\f';
+}
+
+/// number of tokens starting in [beg, end), beg is at white space or the start of a token
+std::size_t count_tokens( const char* beg, const char* end )
+{
+    std::size_t n = 0;
+    bool prev_space = true;
+    for( const char* p=beg; p<end; p++ )
+    {
+        bool space = is_space( *p );
+        n += ( prev_space && !space );
+        prev_space = space;
+    }
+    return n;
+}
+
+/// one real number, from_chars takes no leading '+' so it is skipped here
+template<typename T>
+const char* parse_real( const char* p, const char* end, T& val )
+{
+    if( p<end && *p=='+' ) p++;
+    auto res = std::from_chars( p, end, val );
+    if( res.ec!=std::errc() ) return nullptr;
+    return res.ptr;
+}
+
+template<typename T>
+const char* parse_entry( const char* p, const char* end, T& val )
+{
+    return parse_real( p, end, val );
+}
+
+/// (re,im) as written by operator<<, or a plain real number
+template<typename T>
+const char* parse_entry( const char* p, const char* end, std::complex<T>& val )
+{
+    T re = T(0), im = T(0);
+    if( p<end && *p=='(' )
+    {
+        p = parse_real( p+1, end, re );
+        if( !p || p>=end || *p!=',' ) return nullptr;
+        p = parse_real( p+1, end, im );
+        if( !p || p>=end || *p!=')' ) return nullptr;
+        p++;
+    }
+    else
+    {
+        p = parse_real( p, end, re );
+        if( !p ) return nullptr;
+    }
+    val = std::complex<T>( re, im );
+    return p;
+}
+
+/// parse n tokens from p into dst, returns the end of the last one or nullptr
+template<typename T>
+const char* parse_tokens( const char* p, const char* end, T* dst, std::size_t n )
+{
+    for( std::size_t i=0; i<n; i++ )
+    {
+        while( p<end && is_space( *p ) ) p++;
+        p = parse_entry( p, end, dst[i] );
+        if( !p || ( p<end && !is_space( *p ) ) ) return nullptr;
+    }
+    return p;
+}
+
+template<typename T>
+char* format_real( char* p, char* end, T val, int precision )
+{
+    return std::to_chars( p, end, val, std::chars_format::general, precision ).ptr;
+}
+
+template<typename T>
+char* format_entry( char* p, char* end, T val, int precision )
+{
+    return format_real( p, end, val, precision );
+}
+
+template<typename T>
+char* format_entry( char* p, char* end, std::complex<T> val, int precision )
+{
+    *p++ = '(';
+    p = format_real( p, end, val.real(), precision );
+    *p++ = ',';
+    p = format_real( p, end, val.imag(), precision );
+    *p++ = ')';
+    return p;
+}
+
+/// value field and symmetry of a SPARSE or MatrixMarket file; SPARSE entries are
+/// written like DENSE ones, FIELD_NATIVE
+enum SparseField { FIELD_NATIVE, FIELD_REAL, FIELD_COMPLEX, FIELD_PATTERN };
+enum SparseSymmetry { SYM_GENERAL, SYM_SYMMETRIC, SYM_SKEW, SYM_HERMITIAN };
+
+struct SparseHeader
+{
+    int n_row = 0;
+    int n_col = 0;
+    std::size_t nnz = 0;
+    /// 1 for the 1-based MatrixMarket indices
+    int base = 0;
+    SparseField field = FIELD_NATIVE;
+    SparseSymmetry symmetry = SYM_GENERAL;
+
+    int tokens_per_entry() const { return field==FIELD_PATTERN ? 2 : ( field==FIELD_COMPLEX ? 4 : 3 ); }
+};
+
+const char* skip_space( const char* p, const char* end )
+{
+    while( p<end && is_space( *p ) ) p++;
+    return p;
+}
+
+/// the white space separated token at p, in lower case
+std::string lower_token( const char*& p, const char* end )
+{
+    const char* beg = p;
+    while( p<end && !is_space( *p ) ) p++;
+    std::string tok( beg, p );
+    for( char& c : tok )
+        c = (char)std::tolower( (unsigned char)c );
+    return tok;
+}
+
+template<typename I>
+const char* parse_int( const char* p, const char* end, I& val )
+{
+    p = skip_space( p, end );
+    auto res = std::from_chars( p, end, val );
+    if( res.ec!=std::errc() ) return nullptr;
+    return res.ptr;
+}
+
+/// the header of a SPARSE or MatrixMarket file, returns the start of the entries or nullptr
+const char* parse_sparse_header( const char* p, const char* end, SparseHeader& h )
+{
+    const char mm[] = "%%MatrixMarket";
+    if( (std::size_t)( end-p )>=sizeof(mm)-1 && std::memcmp( p, mm, sizeof(mm)-1 )==0 )
+    {
+        p += sizeof(mm)-1;
+        std::string tok[4];
+        for( int t=0; t<4; t++ )
+        {
+            while( p<end && ( *p==' ' || *p=='\t' ) ) p++;
+            tok[t] = lower_token( p, end );
+        }
+        if( tok[0]!="matrix" || tok[1]!="coordinate" )
+        {
+            std::cerr << "Error: only MatrixMarket coordinate matrices are read as sparse" << std::endl;
+            return nullptr;
+        }
+        if( tok[2]=="real" || tok[2]=="double" || tok[2]=="integer" ) h.field = FIELD_REAL;
+        else if( tok[2]=="complex" ) h.field = FIELD_COMPLEX;
+        else if( tok[2]=="pattern" ) h.field = FIELD_PATTERN;
+        else return nullptr;
+        if( tok[3]=="general" ) h.symmetry = SYM_GENERAL;
+        else if( tok[3]=="symmetric" ) h.symmetry = SYM_SYMMETRIC;
+        else if( tok[3]=="skew-symmetric" ) h.symmetry = SYM_SKEW;
+        else if( tok[3]=="hermitian" ) h.symmetry = SYM_HERMITIAN;
+        else return nullptr;
+        h.base = 1;
+
+        /// comment and blank lines up to the size line
+        while( true )
+        {
+            while( p<end && *p!='\n' ) p++;
+            p = skip_space( p, end );
+            if( p>=end || *p!='%' ) break;
+        }
+        if( !( p = parse_int( p, end, h.n_row ) ) || !( p = parse_int( p, end, h.n_col ) )
+            || !( p = parse_int( p, end, h.nnz ) ) ) return nullptr;
+    }
+    else
+    {
+        /// "n_row n_col SPARSE nnz"
+        if( !( p = parse_int( p, end, h.n_row ) ) || !( p = parse_int( p, end, h.n_col ) ) ) return nullptr;
+        p = skip_space( p, end );
+        const char* type = p;
+        while( p<end && !is_space( *p ) ) p++;
+        if( std::string( type, p )!="SPARSE" || !( p = parse_int( p, end, h.nnz ) ) ) return nullptr;
+    }
+    if( h.n_row<=0 || h.n_col<=0 ) return nullptr;
+    return p;
+}
+
+template<typename T, typename R>
+void set_complex( T& val, R re, R ) { val = T( re ); }
+
+template<typename T, typename R>
+void set_complex( std::complex<T>& val, R re, R im ) { val = std::complex<T>( re, im ); }
+
+/// n entries "row col [value]" of the file's field
+template<typename T>
+const char* parse_sparse_entries( const char* p, const char* end, const SparseHeader& h, std::size_t n,
+                                  int* rows, int* cols, T* vals )
+{
+    typedef RealType<T> R;
+    for( std::size_t e=0; e<n; e++ )
+    {
+        if( !( p = parse_int( p, end, rows[e] ) ) || !( p = parse_int( p, end, cols[e] ) ) ) return nullptr;
+        rows[e] -= h.base;
+        cols[e] -= h.base;
+        if( rows[e]<0 || rows[e]>=h.n_row || cols[e]<0 || cols[e]>=h.n_col ) return nullptr;
+        if( h.field==FIELD_PATTERN )
+        {
+            vals[e] = T(1);
+            continue;
+        }
+        p = skip_space( p, end );
+        if( h.field==FIELD_NATIVE )
+            p = parse_entry( p, end, vals[e] );
+        else
+        {
+            R re = R(0), im = R(0);
+            p = parse_real( p, end, re );
+            if( p && h.field==FIELD_COMPLEX )
+                p = parse_real( skip_space( p, end ), end, im );
+            set_complex( vals[e], re, im );
+        }
+        if( !p || ( p<end && !is_space( *p ) ) ) return nullptr;
+    }
+    return p;
+}
+
+}
+
+DenseReader::DenseReader()
+:   _pos(nullptr), _end(nullptr), _n_row(0), _n_col(0), _rows_read(0), _bytes_per_entry(24.0)
+{
+}
+
+int DenseReader::open( const char* file_name )
+{
+    if( _file.open( file_name )!=0 )
+    {
+        std::cerr << "Cannot open file: " << file_name << std::endl;
+        return -1;
+    }
+    _pos = static_cast<const char*>( _file.data() );
+    _end = _pos + _file.size();
+    _rows_read = 0;
+
+    /// "n_row n_col DENSE"
+    int dims[2] = { 0, 0 };
+    for( int d=0; d<2; d++ )
+    {
+        while( _pos<_end && is_space( *_pos ) ) _pos++;
+        auto res = std::from_chars( _pos, _end, dims[d] );
+        if( res.ec!=std::errc() ) break;
+        _pos = res.ptr;
+    }
+    while( _pos<_end && is_space( *_pos ) ) _pos++;
+    const char* type = _pos;
+    while( _pos<_end && !is_space( *_pos ) ) _pos++;
+    if( std::string( type, _pos )!="DENSE" )
+    {
+        std::cerr << "Error: " << file_name << " is not a DENSE matrix file" << std::endl;
+        return -1;
+    }
+    _n_row = dims[0];
+    _n_col = dims[1];
+    if( _n_row<=0 || _n_col<=0 )
+    {
+        std::cerr << "Error: " << file_name << ": bad dimensions" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+template<typename T>
+int DenseReader::read_rows( T* dst, int max_rows )
+{
+    int rows = std::min( max_rows, _n_row - _rows_read );
+    if( rows<=0 ) return 0;
+    std::size_t need = (std::size_t)rows * _n_col;
+
+    ThreadPool& pool = thread_pool();
+    const char* begin = static_cast<const char*>( _file.data() );
+    while( true )
+    {
+        /// a window of the text that should hold the rows, cut after a token; the
+        /// last block takes the rest of the file
+        const char* win_end = _end;
+        if( _rows_read + rows < _n_row )
+        {
+            double guess = 1.25*_bytes_per_entry*need + 4096;
+            if( guess < (double)( _end - _pos ) )
+            {
+                win_end = _pos + (std::size_t)guess;
+                while( win_end<_end && !is_space( *win_end ) ) win_end++;
+            }
+        }
+
+        /// chunk boundaries moved forward onto white space, so no token is split
+        std::size_t bytes = win_end - _pos;
+        int n_chunks = (int)std::max<std::size_t>( 1, std::min<std::size_t>( bytes/PARSE_CHUNK, 4*pool.size() ) );
+        std::vector<const char*> cut( n_chunks+1 );
+        cut[0] = _pos;
+        cut[n_chunks] = win_end;
+        for( int c=1; c<n_chunks; c++ )
+        {
+            const char* p = std::max( cut[c-1], _pos + bytes*c/n_chunks );
+            while( p<win_end && !is_space( *p ) ) p++;
+            cut[c] = p;
+        }
+
+        std::vector<std::size_t> first( n_chunks+1, 0 );
+        auto count = [&]( int c ){ first[c+1] = count_tokens( cut[c], cut[c+1] ); };
+        if( n_chunks>1 )
+            pool.parallel_for( n_chunks, count );
+        else
+            count( 0 );
+        for( int c=0; c<n_chunks; c++ )
+            first[c+1] += first[c];
+
+        if( first[n_chunks] < need )
+        {
+            if( win_end==_end )
+            {
+                std::cerr << "Error: DENSE file ends after " << first[n_chunks] + (std::size_t)_rows_read*_n_col
+                          << " of " << (std::size_t)_n_row*_n_col << " entries" << std::endl;
+                return -1;
+            }
+            _bytes_per_entry *= 2;
+            continue;
+        }
+
+        /// each chunk parses its share of the first `need` tokens straight into dst
+        std::atomic<bool> failed( false );
+        const char* last_end = _pos;
+        auto parse = [&]( int c )
+        {
+            if( first[c]>=need ) return;
+            std::size_t n = std::min( first[c+1], need ) - first[c];
+            const char* p = parse_tokens( cut[c], cut[c+1], dst + first[c], n );
+            if( !p ) failed = true;
+            else if( first[c]+n==need ) last_end = p;
+        };
+        if( n_chunks>1 )
+            pool.parallel_for( n_chunks, parse );
+        else
+            parse( 0 );
+        if( failed )
+        {
+            std::cerr << "Error: malformed entry in DENSE file" << std::endl;
+            return -1;
+        }
+
+        _bytes_per_entry = std::max( 1.0, (double)( last_end - _pos ) / need );
+        _pos = last_end;
+        _rows_read += rows;
+        _file.release( _pos - begin );
+        return rows;
+    }
+}
+
+template<typename T>
+int write_dense_file( const char* file_name, const T* data, int n_row, int n_col, int precision )
+{
+    assert( n_row>0 && n_col>0 && precision>0 );
+    std::ofstream ofs( file_name, std::ios::binary | std::ios::trunc );
+    if( !ofs.is_open() )
+    {
+        std::cerr << "Cannot open file: " << file_name << std::endl;
+        return -1;
+    }
+    ofs << n_row << " " << n_col << " DENSE\n";
+
+    /// the same text as "os << setprecision(precision) << x << ' '" per entry and a
+    /// newline per row; each task formats a block of rows into its own buffer and
+    /// the buffers of a round are written in order
+    ThreadPool& pool = thread_pool();
+    std::size_t max_entry = 2*( precision + 12 ) + 4;
+    int block = (int)std::max<std::size_t>( 1, FORMAT_CHUNK / ( max_entry * n_col ) );
+    int n_tasks = std::max( 1, 2*pool.size() );
+    std::vector<std::string> bufs( n_tasks );
+    for( int r0=0; r0<n_row; r0+=block*n_tasks )
+    {
+        auto format = [&]( int t )
+        {
+            int b0 = r0 + t*block;
+            int b1 = std::min( n_row, b0+block );
+            std::string& buf = bufs[t];
+            if( b0>=b1 ) { buf.clear(); return; }
+            buf.resize( (std::size_t)( b1-b0 ) * ( n_col*max_entry + 1 ) );
+            char* p = &buf[0];
+            char* end = p + buf.size();
+            for( int i=b0; i<b1; i++ )
+            {
+                const T* row = data + (std::size_t)i*n_col;
+                for( int j=0; j<n_col; j++ )
+                {
+                    p = format_entry( p, end, row[j], precision );
+                    *p++ = ' ';
+                }
+                *p++ = '\n';
+            }
+            buf.resize( p - &buf[0] );
+        };
+        pool.parallel_for( n_tasks, format );
+        for( int t=0; t<n_tasks; t++ )
+            ofs.write( bufs[t].data(), bufs[t].size() );
+    }
+    ofs.close();
+    if( !ofs )
+    {
+        std::cerr << "Error: failed to write " << file_name << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+bool is_sparse_matrix_file( const char* file_name )
+{
+    std::ifstream ifs( file_name, std::ios::binary );
+    char head[256];
+    ifs.read( head, sizeof(head) );
+    std::string text( head, (std::size_t)ifs.gcount() );
+    if( text.compare( 0, 14, "%%MatrixMarket" )==0 ) return true;
+    std::istringstream iss( text );
+    long n_row, n_col;
+    std::string type;
+    return ( iss >> n_row >> n_col >> type ) && type=="SPARSE";
+}
+
+template<typename T>
+int read_sparse_file( const char* file_name, int& n_row, int& n_col,
+                      std::vector<int>& rows, std::vector<int>& cols, std::vector<T>& vals )
+{
+    MappedFile file;
+    if( file.open( file_name )!=0 )
+    {
+        std::cerr << "Cannot open file: " << file_name << std::endl;
+        return -1;
+    }
+    const char* pos = static_cast<const char*>( file.data() );
+    const char* end = pos + file.size();
+    SparseHeader h;
+    if( !( pos = parse_sparse_header( pos, end, h ) ) )
+    {
+        std::cerr << "Error: " << file_name << " has no valid SPARSE or MatrixMarket header" << std::endl;
+        return -1;
+    }
+    if( h.field==FIELD_COMPLEX && !ScalarTraits<T>::is_complex )
+    {
+        std::cerr << "Error: cannot read a complex matrix file into a real matrix" << std::endl;
+        return -1;
+    }
+
+    /// chunks cut at line ends, one entry per line, so every chunk starts on an entry
+    ThreadPool& pool = thread_pool();
+    std::size_t bytes = end - pos;
+    int n_chunks = (int)std::max<std::size_t>( 1, std::min<std::size_t>( bytes/PARSE_CHUNK, 4*pool.size() ) );
+    std::vector<const char*> cut( n_chunks+1 );
+    cut[0] = pos;
+    cut[n_chunks] = end;
+    for( int c=1; c<n_chunks; c++ )
+    {
+        const char* p = std::max( cut[c-1], pos + bytes*c/n_chunks );
+        while( p<end && *p!='\n' ) p++;
+        cut[c] = p;
+    }
+
+    int k = h.tokens_per_entry();
+    std::vector<std::size_t> first( n_chunks+1, 0 );
+    std::atomic<bool> failed( false );
+    auto count = [&]( int c )
+    {
+        std::size_t tokens = count_tokens( cut[c], cut[c+1] );
+        if( tokens%k!=0 ) failed = true;
+        first[c+1] = tokens/k;
+    };
+    if( n_chunks>1 )
+        pool.parallel_for( n_chunks, count );
+    else
+        count( 0 );
+    for( int c=0; c<n_chunks; c++ )
+        first[c+1] += first[c];
+    if( failed || first[n_chunks]!=h.nnz )
+    {
+        std::cerr << "Error: " << file_name << " holds " << first[n_chunks] << " entries, the header says "
+                  << h.nnz << std::endl;
+        return -1;
+    }
+
+    rows.resize( h.nnz );
+    cols.resize( h.nnz );
+    vals.resize( h.nnz );
+    auto parse = [&]( int c )
+    {
+        std::size_t f = first[c];
+        if( !parse_sparse_entries( cut[c], cut[c+1], h, first[c+1]-f, rows.data()+f, cols.data()+f, vals.data()+f ) )
+            failed = true;
+    };
+    if( n_chunks>1 )
+        pool.parallel_for( n_chunks, parse );
+    else
+        parse( 0 );
+    if( failed )
+    {
+        std::cerr << "Error: malformed or out of range entry in " << file_name << std::endl;
+        return -1;
+    }
+
+    /// the stored triangle of a symmetric file and the mirror of its off diagonal part
+    if( h.symmetry!=SYM_GENERAL )
+    {
+        std::size_t n = h.nnz;
+        for( std::size_t e=0; e<n; e++ )
+        {
+            if( rows[e]==cols[e] ) continue;
+            T v = vals[e];
+            if( h.symmetry==SYM_SKEW ) v = -v;
+            else if( h.symmetry==SYM_HERMITIAN ) v = scalar_conj( v );
+            rows.push_back( cols[e] );
+            cols.push_back( rows[e] );
+            vals.push_back( v );
+        }
+    }
+    n_row = h.n_row;
+    n_col = h.n_col;
+    return 0;
+}
+
+template<typename T>
+int write_sparse_file( const char* file_name, int n_row, int n_col, const int* ptr,
+                       const int* idx, const T* val, bool by_col, int precision )
+{
+    assert( n_row>0 && n_col>0 && precision>0 );
+    std::ofstream ofs( file_name, std::ios::binary | std::ios::trunc );
+    if( !ofs.is_open() )
+    {
+        std::cerr << "Cannot open file: " << file_name << std::endl;
+        return -1;
+    }
+    int n_outer = by_col ? n_col : n_row;
+    std::size_t nnz = ptr[n_outer];
+    ofs << n_row << " " << n_col << " SPARSE " << nnz << "\n";
+
+    /// rounds of outer index blocks formatted concurrently and written in order, as
+    /// in write_dense_file
+    ThreadPool& pool = thread_pool();
+    std::size_t max_line = 2*( precision + 12 ) + 4 + 24;
+    std::size_t per_outer = std::max<std::size_t>( 1, nnz/n_outer );
+    int block = (int)std::max<std::size_t>( 1, FORMAT_CHUNK / ( max_line * per_outer ) );
+    int n_tasks = std::max( 1, 2*pool.size() );
+    std::vector<std::string> bufs( n_tasks );
+    for( int o0=0; o0<n_outer; o0+=block*n_tasks )
+    {
+        auto format = [&]( int t )
+        {
+            int b0 = std::min( n_outer, o0 + t*block );
+            int b1 = std::min( n_outer, b0+block );
+            std::string& buf = bufs[t];
+            buf.resize( (std::size_t)( ptr[b1]-ptr[b0] ) * max_line );
+            char* p = &buf[0];
+            char* end = p + buf.size();
+            for( int o=b0; o<b1; o++ )
+            {
+                for( int e=ptr[o]; e<ptr[o+1]; e++ )
+                {
+                    p = std::to_chars( p, end, by_col ? idx[e] : o ).ptr;
+                    *p++ = ' ';
+                    p = std::to_chars( p, end, by_col ? o : idx[e] ).ptr;
+                    *p++ = ' ';
+                    p = format_entry( p, end, val[e], precision );
+                    *p++ = '\n';
+                }
+            }
+            buf.resize( p - &buf[0] );
+        };
+        pool.parallel_for( n_tasks, format );
+        for( int t=0; t<n_tasks; t++ )
+            ofs.write( bufs[t].data(), bufs[t].size() );
+    }
+    ofs.close();
+    if( !ofs )
+    {
+        std::cerr << "Error: failed to write " << file_name << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+#define MX_INSTANTIATE_DENSE_IO(T) \
+    template int DenseReader::read_rows<T>( T*, int ); \
+    template int write_dense_file<T>( const char*, const T*, int, int, int ); \
+    template int read_sparse_file<T>( const char*, int&, int&, std::vector<int>&, std::vector<int>&, std::vector<T>& ); \
+    template int write_sparse_file<T>( const char*, int, int, const int*, const int*, const T*, bool, int );
+MX_INSTANTIATE_DENSE_IO(float)
+MX_INSTANTIATE_DENSE_IO(double)
+MX_INSTANTIATE_DENSE_IO(std::complex<float>)
+MX_INSTANTIATE_DENSE_IO(std::complex<double>)
+
+}
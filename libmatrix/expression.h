@@ -0,0 +1,377 @@
+#ifndef _MX_EXPRESSION_H
+#define _MX_EXPRESSION_H
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+#include "matrix.h"
+#include "blas.h"
+#include "thread_pool.h"
+
+namespace mx
+{
+
+/// lazy matrix arithmetic: +, -, unary -, scalar * and / build a tree of expression
+/// nodes instead of matrices. Assigning the tree to a BasicMatrix, or calling eval(),
+/// runs one fused loop over the destination; norm() reduces straight off the tree.
+/// A product is the one node that cannot be fused: it runs GEMM, straight into the
+/// destination when it is assigned on its own, else once into a buffer of its own.
+///
+/// Operands are held by view when they are lvalue matrices or views, so a tree must not
+/// outlive them, and by value when they are temporaries.
+/// how a destination is touched by the operands of the expression assigned to it
+enum ExprAlias
+{
+    ALIAS_NONE,     /// no operand shares entries with it
+    ALIAS_SAME,     /// some operand is exactly the destination, fine element by element
+    ALIAS_OVERLAP   /// anything else, the expression has to be evaluated aside first
+};
+
+/// base of every expression node E, which provides value_type, n_row(), n_col(),
+/// coeff(i,j), prepare() before the first coeff(), alias( dst ) and
+/// view( tmp ), the node as a view, evaluated into tmp if it has no storage
+template<typename E>
+class MatrixExpr
+{
+public:
+    const E& self() const { return static_cast<const E&>( *this ); }
+    int n_row() const { return self().n_row(); }
+    int n_col() const { return self().n_col(); }
+    std::tuple<int, int> size() const { return { n_row(), n_col() }; }
+
+    /// one entry, evaluates a product first; for loops assign the expression instead
+    auto operator()( int row, int col ) const
+    {
+        assert( row>=0 && row<n_row() && col>=0 && col<n_col() );
+        self().prepare();
+        return self().coeff( row, col );
+    }
+    auto eval() const { return BasicMatrix<typename E::value_type>( *this ); }
+    auto transpose() const { return eval().transpose(); }
+
+    /// lp-norm of the entries as BasicMatrix::norm, computed without a temporary
+    auto norm( int p=2 ) const
+    {
+        typedef RealType<typename E::value_type> R;
+        const E& e = self();
+        e.prepare();
+        R res = R(0);
+        for( int i=0; i<n_row(); i++ )
+        {
+            for( int j=0; j<n_col(); j++ )
+            {
+                auto x = e.coeff( i, j );
+                if( p<=0 ) res = std::max( res, std::abs( x ) );
+                else if( p==1 ) res += std::abs( x );
+                else if( p==2 ) res += scalar_abs2( x );
+                else res += std::pow( std::abs( x ), p );
+            }
+        }
+        if( p<=1 ) return res;
+        if( p==2 ) return std::sqrt( res );
+        return std::pow( res, R(1)/p );
+    }
+    auto norm_1() const { return norm( 1 ); }
+    auto norm_inf() const { return norm( 0 ); }
+};
+
+/// an operand that is an lvalue matrix or a view, entries read in place
+template<typename T>
+class ExprView : public MatrixExpr< ExprView<T> >
+{
+    BasicConstMatrixView<T> _v;
+
+public:
+    typedef T value_type;
+    ExprView( const BasicConstMatrixView<T>& v ) : _v(v) {}
+    int n_row() const { return _v.n_row(); }
+    int n_col() const { return _v.n_col(); }
+    T coeff( int i, int j ) const { return _v.data()[ (size_t)i*_v.ld() + j ]; }
+    void prepare() const {}
+    ExprAlias alias( const BasicConstMatrixView<T>& dst ) const
+    {
+        if( _v.n_row()==0 || dst.n_row()==0 ) return ALIAS_NONE;
+        const T* beg = _v.data();
+        const T* end = beg + (size_t)( _v.n_row()-1 )*_v.ld() + _v.n_col();
+        const T* dst_beg = dst.data();
+        const T* dst_end = dst_beg + (size_t)( dst.n_row()-1 )*dst.ld() + dst.n_col();
+        if( end<=dst_beg || dst_end<=beg ) return ALIAS_NONE;
+        if( beg==dst_beg && _v.ld()==dst.ld() && _v.size()==dst.size() ) return ALIAS_SAME;
+        return ALIAS_OVERLAP;
+    }
+    BasicConstMatrixView<T> view( BasicMatrix<T>& ) const { return _v; }
+};
+
+/// an operand that was a temporary matrix, kept alive inside the expression
+template<typename T>
+class ExprOwned : public MatrixExpr< ExprOwned<T> >
+{
+    BasicMatrix<T> _mat;
+
+public:
+    typedef T value_type;
+    ExprOwned( BasicMatrix<T>&& mat ) : _mat( std::move( mat ) ) {}
+    int n_row() const { return _mat.n_row(); }
+    int n_col() const { return _mat.n_col(); }
+    T coeff( int i, int j ) const { return _mat.data()[ (size_t)i*_mat.n_col() + j ]; }
+    void prepare() const {}
+    ExprAlias alias( const BasicConstMatrixView<T>& ) const { return ALIAS_NONE; }
+    BasicConstMatrixView<T> view( BasicMatrix<T>& ) const { return _mat.view(); }
+};
+
+struct ExprAdd { template<typename T> T operator()( const T& x, const T& y ) const { return x + y; } };
+struct ExprSub { template<typename T> T operator()( const T& x, const T& y ) const { return x - y; } };
+struct ExprNeg { template<typename T> T operator()( const T& x, const T& ) const { return -x; } };
+struct ExprScale { template<typename T> T operator()( const T& x, const T& s ) const { return s * x; } };
+struct ExprDivide { template<typename T> T operator()( const T& x, const T& s ) const { return x / s; } };
+
+/// entrywise op( l, r ) of two operands of the same size
+template<typename Op, typename L, typename R>
+class ExprBinary : public MatrixExpr< ExprBinary<Op,L,R> >
+{
+    L _l;
+    R _r;
+
+public:
+    typedef typename L::value_type value_type;
+    static_assert( std::is_same<value_type, typename R::value_type>::value, "operands of different scalar types" );
+
+    ExprBinary( L&& l, R&& r ) : _l( std::move( l ) ), _r( std::move( r ) )
+    {
+        assert( _l.n_row()==_r.n_row() && _l.n_col()==_r.n_col() );
+    }
+    int n_row() const { return _l.n_row(); }
+    int n_col() const { return _l.n_col(); }
+    value_type coeff( int i, int j ) const { return Op()( _l.coeff( i, j ), _r.coeff( i, j ) ); }
+    void prepare() const { _l.prepare(); _r.prepare(); }
+    ExprAlias alias( const BasicConstMatrixView<value_type>& dst ) const { return std::max( _l.alias( dst ), _r.alias( dst ) ); }
+    BasicConstMatrixView<value_type> view( BasicMatrix<value_type>& tmp ) const;
+};
+
+/// entrywise op( e, s ) with a scalar s
+template<typename Op, typename E>
+class ExprUnary : public MatrixExpr< ExprUnary<Op,E> >
+{
+public:
+    typedef typename E::value_type value_type;
+
+private:
+    E _e;
+    value_type _s;
+
+public:
+    ExprUnary( E&& e, value_type s ) : _e( std::move( e ) ), _s(s) {}
+    int n_row() const { return _e.n_row(); }
+    int n_col() const { return _e.n_col(); }
+    value_type coeff( int i, int j ) const { return Op()( _e.coeff( i, j ), _s ); }
+    void prepare() const { _e.prepare(); }
+    ExprAlias alias( const BasicConstMatrixView<value_type>& dst ) const { return _e.alias( dst ); }
+    BasicConstMatrixView<value_type> view( BasicMatrix<value_type>& tmp ) const;
+};
+
+/// l * r, evaluated by GEMM: into the destination by eval_into(), or into its own
+/// buffer by prepare() when it is part of a larger expression
+template<typename L, typename R>
+class ExprProduct : public MatrixExpr< ExprProduct<L,R> >
+{
+public:
+    typedef typename L::value_type value_type;
+    static_assert( std::is_same<value_type, typename R::value_type>::value, "operands of different scalar types" );
+
+private:
+    L _l;
+    R _r;
+    mutable BasicMatrix<value_type> _res;
+    mutable bool _done = false;
+
+public:
+    ExprProduct( L&& l, R&& r ) : _l( std::move( l ) ), _r( std::move( r ) )
+    {
+        assert( _l.n_col()==_r.n_row() );
+    }
+    int n_row() const { return _l.n_row(); }
+    int n_col() const { return _r.n_col(); }
+    value_type coeff( int i, int j ) const { return _res.data()[ (size_t)i*_res.n_col() + j ]; }
+    /// dst = l * r + beta * dst, dst must not overlap the operands
+    void eval_into( value_type* dst, int ldd, value_type beta ) const
+    {
+        BasicMatrix<value_type> tmp_l, tmp_r;
+        BasicConstMatrixView<value_type> a = _l.view( tmp_l );
+        BasicConstMatrixView<value_type> b = _r.view( tmp_r );
+        gemm( false, false, n_row(), n_col(), a.n_col(), value_type(1), a.data(), a.ld(), b.data(), b.ld(), beta, dst, ldd );
+    }
+    void prepare() const
+    {
+        if( _done ) return;
+        _res.resize( n_row(), n_col() );
+        eval_into( _res.data(), n_col(), value_type(0) );
+        _done = true;
+    }
+    ExprAlias alias( const BasicConstMatrixView<value_type>& dst ) const
+    {
+        return ( _l.alias( dst )!=ALIAS_NONE || _r.alias( dst )!=ALIAS_NONE ) ? ALIAS_OVERLAP : ALIAS_NONE;
+    }
+    BasicConstMatrixView<value_type> view( BasicMatrix<value_type>& ) const
+    {
+        prepare();
+        return _res.view();
+    }
+};
+
+template<typename T>
+struct IsExprProduct : std::false_type {};
+template<typename L, typename R>
+struct IsExprProduct< ExprProduct<L,R> > : std::true_type {};
+
+/// dst = e for a destination of the right size that e does not overlap; large
+/// destinations are filled by row blocks on thread_pool()
+template<typename T, typename E>
+void expr_assign( const BasicMatrixView<T>& dst, const E& e )
+{
+    assert( dst.n_row()==e.n_row() && dst.n_col()==e.n_col() );
+    if constexpr( IsExprProduct<E>::value )
+    {
+        e.eval_into( dst.data(), dst.ld(), T(0) );
+    }
+    else
+    {
+        e.prepare();
+        int row = dst.n_row(), col = dst.n_col(), ld = dst.ld();
+        T* d = dst.data();
+        auto rows = [&]( int i0, int i1 )
+        {
+            for( int i=i0; i<i1; i++ )
+            {
+                T* di = d + (size_t)i*ld;
+                for( int j=0; j<col; j++ )
+                    di[j] = e.coeff( i, j );
+            }
+        };
+        constexpr std::size_t PARALLEL_ENTRIES = 1 << 16;
+        ThreadPool& pool = thread_pool();
+        if( pool.size()<=1 || (std::size_t)row*col < PARALLEL_ENTRIES )
+        {
+            rows( 0, row );
+            return;
+        }
+        int n_blocks = std::min( row, 4*pool.size() );
+        pool.parallel_for( n_blocks, [&]( int b ){ rows( (int)( (long)row*b/n_blocks ), (int)( (long)row*(b+1)/n_blocks ) ); } );
+    }
+}
+
+template<typename Op, typename L, typename R>
+BasicConstMatrixView<typename ExprBinary<Op,L,R>::value_type> ExprBinary<Op,L,R>::view( BasicMatrix<value_type>& tmp ) const
+{
+    tmp.resize( n_row(), n_col() );
+    expr_assign( tmp.view(), *this );
+    return tmp.view();
+}
+
+template<typename Op, typename E>
+BasicConstMatrixView<typename ExprUnary<Op,E>::value_type> ExprUnary<Op,E>::view( BasicMatrix<value_type>& tmp ) const
+{
+    tmp.resize( n_row(), n_col() );
+    expr_assign( tmp.view(), *this );
+    return tmp.view();
+}
+
+/// the node an operand becomes: lvalue matrices and views are viewed, temporary
+/// matrices are moved in, expressions are copied or moved
+template<typename T>
+ExprView<T> make_expr( const BasicMatrix<T>& mat ) { return ExprView<T>( mat.view() ); }
+template<typename T>
+ExprOwned<T> make_expr( BasicMatrix<T>&& mat ) { return ExprOwned<T>( std::move( mat ) ); }
+template<typename T>
+ExprView<T> make_expr( const BasicConstMatrixView<T>& v ) { return ExprView<T>( v ); }
+template<typename E>
+E make_expr( const MatrixExpr<E>& e ) { return e.self(); }
+template<typename E>
+E make_expr( MatrixExpr<E>&& e ) { return std::move( static_cast<E&>( e ) ); }
+
+template<typename X>
+using ExprNode = decltype( make_expr( std::declval<X>() ) );
+
+/// only matrices, views and expressions take part in the operators below
+template<typename X, typename = void>
+struct IsExprOperand : std::false_type {};
+template<typename X>
+struct IsExprOperand< X, std::void_t< ExprNode<X> > > : std::true_type {};
+
+template<typename A, typename B>
+using EnableExpr2 = std::enable_if_t< IsExprOperand<A>::value && IsExprOperand<B>::value >;
+
+template<typename A, typename B, typename = EnableExpr2<A,B> >
+auto operator+( A&& a, B&& b )
+{
+    return ExprBinary< ExprAdd, ExprNode<A>, ExprNode<B> >( make_expr( std::forward<A>( a ) ), make_expr( std::forward<B>( b ) ) );
+}
+
+template<typename A, typename B, typename = EnableExpr2<A,B> >
+auto operator-( A&& a, B&& b )
+{
+    return ExprBinary< ExprSub, ExprNode<A>, ExprNode<B> >( make_expr( std::forward<A>( a ) ), make_expr( std::forward<B>( b ) ) );
+}
+
+template<typename A, typename B, typename = EnableExpr2<A,B> >
+auto operator*( A&& a, B&& b )
+{
+    return ExprProduct< ExprNode<A>, ExprNode<B> >( make_expr( std::forward<A>( a ) ), make_expr( std::forward<B>( b ) ) );
+}
+
+template<typename A>
+auto operator-( A&& a ) -> ExprUnary< ExprNeg, ExprNode<A> >
+{
+    typedef typename ExprNode<A>::value_type T;
+    return ExprUnary< ExprNeg, ExprNode<A> >( make_expr( std::forward<A>( a ) ), T(0) );
+}
+
+template<typename A>
+auto operator*( typename ExprNode<A>::value_type scalar, A&& a ) -> ExprUnary< ExprScale, ExprNode<A> >
+{
+    return ExprUnary< ExprScale, ExprNode<A> >( make_expr( std::forward<A>( a ) ), scalar );
+}
+
+template<typename A>
+auto operator*( A&& a, typename ExprNode<A>::value_type scalar ) -> ExprUnary< ExprScale, ExprNode<A> >
+{
+    return ExprUnary< ExprScale, ExprNode<A> >( make_expr( std::forward<A>( a ) ), scalar );
+}
+
+template<typename A>
+auto operator/( A&& a, typename ExprNode<A>::value_type scalar ) -> ExprUnary< ExprDivide, ExprNode<A> >
+{
+    return ExprUnary< ExprDivide, ExprNode<A> >( make_expr( std::forward<A>( a ) ), scalar );
+}
+
+template<typename T>
+template<typename E>
+BasicMatrix<T>::BasicMatrix( const MatrixExpr<E>& expr )
+:   BasicMatrix( expr.n_row(), expr.n_col() )
+{
+    expr_assign( view(), expr.self() );
+}
+
+template<typename T>
+template<typename E>
+BasicMatrix<T>& BasicMatrix<T>::operator=( const MatrixExpr<E>& expr )
+{
+    const E& e = expr.self();
+    if( e.alias( view() )==ALIAS_OVERLAP )
+        return *this = BasicMatrix( e );
+    if( _n_row!=e.n_row() || _n_col!=e.n_col() )
+        resize( e.n_row(), e.n_col() );
+    expr_assign( view(), e );
+    return *this;
+}
+
+template<typename E>
+std::ostream& operator<<( std::ostream& os, const MatrixExpr<E>& e )
+{
+    return os << e.eval();
+}
+
+}
+
+#endif
@@ -0,0 +1,204 @@
+#include "libmatrix/factor_cache.h"
+#include "libmatrix/matrix_file.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace mx
+{
+
+namespace
+{
+
+/// seed of the confirming checksum, any value other than checksum64's default
+constexpr std::uint64_t KEY_CHECK_SEED = 0x9e3779b97f4a7c15ULL;
+
+}
+
+template<typename T>
+BasicFactorCache<T>::BasicFactorCache( std::size_t max_bytes )
+:   _max_bytes( max_bytes )
+{
+}
+
+template<typename T>
+typename BasicFactorCache<T>::Key BasicFactorCache<T>::make_key( const MatrixType& mat, LinearSolverMode mode, real_type tol )
+{
+    Key key;
+    std::size_t bytes = (std::size_t)mat.n_row()*mat.n_col()*sizeof(T);
+    key.hash = checksum64( mat.data(), bytes );
+    key.check = checksum64( mat.data(), bytes, KEY_CHECK_SEED );
+    key.n = mat.n_row();
+    key.mode = mode;
+    /// only MIXED_LU and CHOLE read the tolerance, the LU modes share one entry for any tol
+    double t = ( mode==MIXED_LU || mode==CHOLE ) ? (double)tol : 0.0;
+    if( mode==CHOLE && !( t>0 ) ) t = 0.0;
+    std::memcpy( &key.tol_bits, &t, sizeof(t) );
+    return key;
+}
+
+template<typename T>
+std::string BasicFactorCache<T>::file_name( const Key& key ) const
+{
+    std::ostringstream os;
+    os << _dir << '/' << std::hex << key.hash << '_' << key.check << '_' << std::dec << key.n << '_' << (int)key.mode
+       << '_' << std::hex << key.tol_bits << ".mxf";
+    return os.str();
+}
+
+template<typename T>
+typename BasicFactorCache<T>::SolverPtr BasicFactorCache<T>::factor( const MatrixType& mat, LinearSolverMode mode, real_type tol )
+{
+    SolverPtr solver = std::make_shared<SolverType>( mat );
+    int ret = -1;
+    switch( mode )
+    {
+    case PARTIAL_LU:  ret = solver->lu_decomp_partial(); break;
+    case COMPLETE_LU: ret = solver->lu_decomp(); break;
+    case ROOK_LU:     ret = solver->lu_decomp_rook(); break;
+    case CALU:        ret = solver->lu_decomp_calu(); break;
+    case MIXED_LU:
+        solver->set_refine_tolerance( tol );
+        ret = solver->lu_decomp_mixed();
+        break;
+    case CHOLE:
+        ret = ( tol>0 ) ? solver->chole_decomp_pivoting( tol ) : solver->chole_decomp_tiled();
+        break;
+    default:
+        break;
+    }
+    if( ret!=0 ) return nullptr;
+    /// rank() is computed lazily, do it now so readers of a shared solver do not write to it
+    solver->rank();
+    return solver;
+}
+
+template<typename T>
+void BasicFactorCache<T>::make_room()
+{
+    auto it = _lru.end();
+    while( _stats.bytes>_max_bytes && it!=_lru.begin() )
+    {
+        --it;
+        if( it==_lru.begin() ) break;
+        auto found = _entries.find( *it );
+        if( found->second.loading ) continue;
+        _stats.bytes -= found->second.bytes;
+        _stats.evictions++;
+        _entries.erase( found );
+        it = _lru.erase( it );
+    }
+    _stats.entries = (long)_entries.size();
+}
+
+template<typename T>
+typename BasicFactorCache<T>::SolverPtr BasicFactorCache<T>::get( const MatrixType& mat, LinearSolverMode mode, real_type tol )
+{
+    if( mat.n_row()!=mat.n_col() || mat.n_row()==0 || mode==NONE ) return nullptr;
+    Key key = make_key( mat, mode, tol );
+
+    std::unique_lock<std::mutex> lock( _lock );
+    for( ;; )
+    {
+        auto found = _entries.find( key );
+        if( found==_entries.end() ) break;
+        if( !found->second.loading )
+        {
+            _stats.hits++;
+            _lru.splice( _lru.begin(), _lru, found->second.lru );
+            return found->second.solver;
+        }
+        _cond.wait( lock );
+    }
+    _stats.misses++;
+    _lru.push_front( key );
+    _entries[key] = Entry{ nullptr, 0, true, _lru.begin() };
+    std::string name = _dir.empty() ? std::string() : file_name( key );
+    lock.unlock();
+
+    SolverPtr solver;
+    bool from_disk = false, to_disk = false;
+    if( !name.empty() && std::ifstream( name ).good() )
+    {
+        solver = std::make_shared<SolverType>();
+        if( solver->load_factors( name.c_str() )==0 ) from_disk = true;
+        else solver = nullptr;
+    }
+    if( !solver )
+    {
+        solver = factor( mat, mode, tol );
+        to_disk = solver && !name.empty() && solver->save_factors( name.c_str() )==0;
+    }
+
+    lock.lock();
+    auto found = _entries.find( key );
+    if( !solver )
+    {
+        _lru.erase( found->second.lru );
+        _entries.erase( found );
+        _stats.entries = (long)_entries.size();
+    }
+    else
+    {
+        found->second.solver = solver;
+        found->second.bytes = solver->memory_bytes();
+        found->second.loading = false;
+        _lru.splice( _lru.begin(), _lru, found->second.lru );
+        _stats.bytes += found->second.bytes;
+        _stats.disk_loads += from_disk;
+        _stats.disk_writes += to_disk;
+        make_room();
+    }
+    _cond.notify_all();
+    return solver;
+}
+
+template<typename T>
+void BasicFactorCache<T>::set_directory( const std::string& dir )
+{
+    std::lock_guard<std::mutex> guard( _lock );
+    _dir = dir;
+}
+
+template<typename T>
+void BasicFactorCache<T>::set_max_bytes( std::size_t max_bytes )
+{
+    std::lock_guard<std::mutex> guard( _lock );
+    _max_bytes = max_bytes;
+    make_room();
+}
+
+template<typename T>
+void BasicFactorCache<T>::clear()
+{
+    /// entries still being factored belong to their get and stay until it finishes
+    std::lock_guard<std::mutex> guard( _lock );
+    for( auto it=_lru.begin(); it!=_lru.end(); )
+    {
+        auto found = _entries.find( *it );
+        if( found->second.loading )
+        {
+            ++it;
+            continue;
+        }
+        _stats.bytes -= found->second.bytes;
+        _entries.erase( found );
+        it = _lru.erase( it );
+    }
+    _stats.entries = (long)_entries.size();
+}
+
+template<typename T>
+FactorCacheStats BasicFactorCache<T>::stats()
+{
+    std::lock_guard<std::mutex> guard( _lock );
+    return _stats;
+}
+
+template class BasicFactorCache<float>;
+template class BasicFactorCache<double>;
+template class BasicFactorCache< std::complex<float> >;
+template class BasicFactorCache< std::complex<double> >;
+
+}
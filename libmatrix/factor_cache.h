@@ -0,0 +1,124 @@
+#ifndef _MX_FACTOR_CACHE_H
+#define _MX_FACTOR_CACHE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "lu.h"
+
+namespace mx
+{
+
+struct FactorCacheStats
+{
+    long hits = 0;
+    long misses = 0;
+    long evictions = 0;
+    long disk_loads = 0;
+    long disk_writes = 0;
+    long entries = 0;
+    std::size_t bytes = 0;
+};
+
+/// factored solvers shared between callers that solve with the same matrix, least
+/// recently used first out once the factors held pass max_bytes. A matrix is found by
+/// two independently seeded 64 bit checksums of its entries together with its size, the
+/// mode and the tolerance, so a hit costs two O(n^2) passes instead of an O(n^3)
+/// factorization. A hit is not confirmed entry by entry: two matrices agreeing in both
+/// checksums would share factors, a chance of about 2^-128 per pair. Concurrent gets of
+/// a matrix that is being factored wait for that factorization instead of repeating it,
+/// and the factorization itself runs outside the lock.
+/// With a directory set every new factorization is also written there by save_factors
+/// and a miss in memory is looked up on disk before factoring.
+/// The solvers handed out are shared: solve with them, but copy one before lu_update,
+/// chole_update or set_matrix; MIXED_LU solves record their refinement and may refactor,
+/// so they must not run concurrently on one solver.
+/// Instantiated in factor_cache.cpp for float, double and their complex forms
+template<typename T>
+class BasicFactorCache
+{
+public:
+    typedef BasicMatrix<T> MatrixType;
+    typedef BasicLinearSolver<T> SolverType;
+    typedef std::shared_ptr<SolverType> SolverPtr;
+    typedef RealType<T> real_type;
+
+private:
+    struct Key
+    {
+        std::uint64_t hash;
+        /// a second checksum under another seed, a collision of hash alone is no hit
+        std::uint64_t check;
+        int n;
+        LinearSolverMode mode;
+        std::uint64_t tol_bits;
+        bool operator==( const Key& k ) const
+        {
+            return hash==k.hash && check==k.check && n==k.n && mode==k.mode && tol_bits==k.tol_bits;
+        }
+    };
+    struct KeyHash
+    {
+        std::size_t operator()( const Key& k ) const
+        {
+            return (std::size_t)( k.hash ^ ( k.tol_bits*0x9e3779b97f4a7c15ULL ) ^ ( (std::uint64_t)k.n<<8 ) ^ k.mode );
+        }
+    };
+    struct Entry
+    {
+        SolverPtr solver;
+        std::size_t bytes;
+        /// set while the first get of the key factors it, the others wait on _cond
+        bool loading;
+        typename std::list<Key>::iterator lru;
+    };
+
+    std::size_t _max_bytes;
+    std::string _dir;
+    std::unordered_map<Key, Entry, KeyHash> _entries;
+    /// most recently used at the front
+    std::list<Key> _lru;
+    std::mutex _lock;
+    std::condition_variable _cond;
+    FactorCacheStats _stats;
+
+    static Key make_key( const MatrixType& mat, LinearSolverMode mode, real_type tol );
+    std::string file_name( const Key& key ) const;
+    static SolverPtr factor( const MatrixType& mat, LinearSolverMode mode, real_type tol );
+    /// drop unused entries from the back of the list until the factors fit
+    void make_room();
+
+public:
+    /// max_bytes bounds the memory_bytes() of the solvers held; the one most recently
+    /// added is kept even if it alone is larger
+    explicit BasicFactorCache( std::size_t max_bytes );
+    BasicFactorCache( const BasicFactorCache& ) = delete;
+    BasicFactorCache& operator=( const BasicFactorCache& ) = delete;
+
+    /// the solver of mat factored in mode, from the cache or factored now; tol is the
+    /// refinement tolerance of MIXED_LU and the stopping tolerance of a pivoted Cholesky
+    /// (CHOLE with tol>0, tiled Cholesky otherwise) and is ignored by the LU modes.
+    /// nullptr if mat is not square, mode is NONE or the factorization fails
+    SolverPtr get( const MatrixType& mat, LinearSolverMode mode=PARTIAL_LU, real_type tol=0 );
+    /// save_factors files go to dir, "" keeps the factors in memory only
+    void set_directory( const std::string& dir );
+    void set_max_bytes( std::size_t max_bytes );
+    /// forget every entry, solvers already handed out stay valid
+    void clear();
+    FactorCacheStats stats();
+};
+
+typedef BasicFactorCache<double> FactorCache;
+typedef BasicFactorCache<float> FactorCacheF;
+typedef BasicFactorCache< std::complex<double> > FactorCacheZ;
+typedef BasicFactorCache< std::complex<float> > FactorCacheC;
+
+}
+
+#endif
@@ -0,0 +1,380 @@
+#ifndef _MX_FIXED_MATRIX_H
+#define _MX_FIXED_MATRIX_H
+
+#include <cassert>
+#include <cmath>
+#include <initializer_list>
+
+#include "matrix.h"
+#include "lu.h"
+#include "scalar.h"
+
+namespace mx
+{
+
+/// R x C row-major matrix with inline storage, for hot loops over many small systems:
+/// no heap allocation, sizes known to the compiler so the inner loops are fully unrolled
+template<typename T, int R, int C>
+class FixedMatrix
+{
+    static_assert( R>0 && C>0, "FixedMatrix needs positive sizes" );
+    T _mat[R*C];
+
+public:
+    typedef T value_type;
+    typedef RealType<T> real_type;
+
+    FixedMatrix()
+    {
+#pragma GCC unroll 256
+        for( int i=0; i<R*C; i++ )
+            _mat[i] = T(0);
+    }
+    explicit FixedMatrix( T val )
+    {
+#pragma GCC unroll 256
+        for( int i=0; i<R*C; i++ )
+            _mat[i] = val;
+    }
+    FixedMatrix( std::initializer_list< std::initializer_list<T> > lists ) : FixedMatrix()
+    {
+        assert( (int)lists.size()==R );
+        int i = 0;
+        for( auto list : lists )
+        {
+            assert( (int)list.size()<=C );
+            int j = 0;
+            for( T val : list )
+                _mat[ i*C + j++ ] = val;
+            i++;
+        }
+    }
+    /// copies a dynamic matrix of the same size
+    explicit FixedMatrix( const BasicMatrix<T>& mat )
+    {
+        assert( mat.n_row()==R && mat.n_col()==C );
+        const T* src = mat.data();
+#pragma GCC unroll 256
+        for( int i=0; i<R*C; i++ )
+            _mat[i] = src[i];
+    }
+    /// copies into a dynamic matrix, so FixedMatrix can be handed to Matrix code and LinearSolver
+    operator BasicMatrix<T>() const
+    {
+        BasicMatrix<T> res( R, C );
+        T* dst = res.data();
+        for( int i=0; i<R*C; i++ )
+            dst[i] = _mat[i];
+        return res;
+    }
+    /// a view of the entries in place, e.g. a right-hand side for LinearSolver without a copy
+    operator BasicConstMatrixView<T>() const { return BasicConstMatrixView<T>( _mat, R, C, C ); }
+
+    static constexpr int n_row() { return R; }
+    static constexpr int n_col() { return C; }
+    std::tuple<int, int> size() const { return {R, C}; }
+    T* data() { return _mat; }
+    const T* data() const { return _mat; }
+
+    T& operator()( int row, int col )
+    {
+        assert( row>=0 && row<R && col>=0 && col<C );
+        return _mat[ row*C + col ];
+    }
+    T operator()( int row, int col ) const
+    {
+        assert( row>=0 && row<R && col>=0 && col<C );
+        return _mat[ row*C + col ];
+    }
+    T& operator()( int idx )
+    {
+        static_assert( C==1, "mat is not a vector" );
+        assert( idx>=0 && idx<R );
+        return _mat[ idx ];
+    }
+    T operator()( int idx ) const
+    {
+        static_assert( C==1, "mat is not a vector" );
+        assert( idx>=0 && idx<R );
+        return _mat[ idx ];
+    }
+
+    FixedMatrix<T,C,R> transpose() const
+    {
+        FixedMatrix<T,C,R> res;
+#pragma GCC unroll 16
+        for( int i=0; i<R; i++ )
+#pragma GCC unroll 16
+            for( int j=0; j<C; j++ )
+                res(j,i) = (*this)(i,j);
+        return res;
+    }
+    real_type norm() const
+    {
+        real_type res = 0;
+#pragma GCC unroll 256
+        for( int i=0; i<R*C; i++ )
+            res += std::abs( _mat[i] ) * std::abs( _mat[i] );
+        return std::sqrt( res );
+    }
+    void swap_row( int i, int j )
+    {
+#pragma GCC unroll 16
+        for( int k=0; k<C; k++ )
+            std::swap( _mat[ i*C + k ], _mat[ j*C + k ] );
+    }
+};
+
+template<typename T, int R, int C>
+FixedMatrix<T,R,C> operator+( const FixedMatrix<T,R,C>& mat1, const FixedMatrix<T,R,C>& mat2 )
+{
+    FixedMatrix<T,R,C> res;
+#pragma GCC unroll 256
+    for( int i=0; i<R*C; i++ )
+        res.data()[i] = mat1.data()[i] + mat2.data()[i];
+    return res;
+}
+
+template<typename T, int R, int C>
+FixedMatrix<T,R,C> operator-( const FixedMatrix<T,R,C>& mat1, const FixedMatrix<T,R,C>& mat2 )
+{
+    FixedMatrix<T,R,C> res;
+#pragma GCC unroll 256
+    for( int i=0; i<R*C; i++ )
+        res.data()[i] = mat1.data()[i] - mat2.data()[i];
+    return res;
+}
+
+template<typename T, int R, int C>
+FixedMatrix<T,R,C> operator*( NoDeduce<T> scalar, const FixedMatrix<T,R,C>& mat )
+{
+    FixedMatrix<T,R,C> res;
+#pragma GCC unroll 256
+    for( int i=0; i<R*C; i++ )
+        res.data()[i] = scalar * mat.data()[i];
+    return res;
+}
+
+template<typename T, int R, int K, int C>
+FixedMatrix<T,R,C> operator*( const FixedMatrix<T,R,K>& mat1, const FixedMatrix<T,K,C>& mat2 )
+{
+    /// i-k-j order, the inner loop runs along a row of mat2 and vectorizes
+    FixedMatrix<T,R,C> res;
+#pragma GCC unroll 16
+    for( int i=0; i<R; i++ )
+#pragma GCC unroll 16
+        for( int k=0; k<K; k++ )
+        {
+            T aik = mat1(i,k);
+#pragma GCC unroll 16
+            for( int j=0; j<C; j++ )
+                res(i,j) += aik * mat2(k,j);
+        }
+    return res;
+}
+
+template<typename T, int R, int C>
+std::ostream& operator<<( std::ostream& os, const FixedMatrix<T,R,C>& mat )
+{
+    return os << BasicMatrix<T>( mat );
+}
+
+/// LU / Cholesky for N x N systems with the same conventions as LinearSolver:
+/// perm[k] is the row swapped with row k, L has a unit diagonal and shares storage with U
+template<typename T, int N>
+class FixedLinearSolver
+{
+public:
+    typedef FixedMatrix<T,N,N> MatrixType;
+    typedef FixedMatrix<T,N,1> VectorType;
+    typedef RealType<T> real_type;
+
+private:
+    MatrixType _mat;
+    int perm[N];
+    LinearSolverStatus status;
+
+public:
+    FixedLinearSolver() : status(EMPTY) {}
+    FixedLinearSolver( const MatrixType& mat ) { set_matrix( mat ); }
+    void set_matrix( const MatrixType& mat )
+    {
+        _mat = mat;
+#pragma GCC unroll 16
+        for( int i=0; i<N; i++ )
+            perm[i] = i;
+        status = MAT_SET;
+    }
+    LinearSolverStatus get_status() const { return status; }
+    const MatrixType& matrix_lu() const { return _mat; }
+
+    int lu_decomp_partial()
+    {
+        /// right-looking LU with partial pivoting, the row updates are fully unrolled;
+        /// raw indexing keeps the asserts of operator() out of the inner loops
+        T* a = _mat.data();
+        for( int k=0; k<N; k++ )
+        {
+            int m = k;
+            real_type max_val = std::abs( a[k*N+k] );
+            for( int i=k+1; i<N; i++ )
+            {
+                real_type val = std::abs( a[i*N+k] );
+                if( val > max_val )
+                {
+                    max_val = val;
+                    m = i;
+                }
+            }
+            perm[k] = m;
+            if( m!=k ) _mat.swap_row( k, m );
+
+            T pivot = a[k*N+k];
+            if( pivot==T(0) ) return -1;
+            T r = T(1) / pivot;
+            for( int i=k+1; i<N; i++ )
+            {
+                T lik = a[i*N+k] * r;
+                a[i*N+k] = lik;
+#pragma GCC unroll 16
+                for( int j=k+1; j<N; j++ )
+                    a[i*N+j] -= lik * a[k*N+j];
+            }
+        }
+        status = LU_SUCCESS;
+        return 0;
+    }
+
+    int chole_decomp()
+    {
+        /// A = L L^* in the lower triangle, the upper triangle is left as is
+        T* a = _mat.data();
+        for( int j=0; j<N; j++ )
+        {
+            real_type d = scalar_real( a[j*N+j] );
+#pragma GCC unroll 16
+            for( int k=0; k<j; k++ )
+                d -= std::abs( a[j*N+k] ) * std::abs( a[j*N+k] );
+            if( d<=0 ) return -1;
+            real_type ljj = std::sqrt( d );
+            a[j*N+j] = ljj;
+            real_type r = real_type(1) / ljj;
+            for( int i=j+1; i<N; i++ )
+            {
+                T sum = a[i*N+j];
+#pragma GCC unroll 16
+                for( int k=0; k<j; k++ )
+                    sum -= a[i*N+k] * scalar_conj( a[j*N+k] );
+                a[i*N+j] = sum * r;
+            }
+        }
+        status = CHOLE_SUCCESS;
+        return 0;
+    }
+
+    void solve_vec_inplace( VectorType& vec ) const
+    {
+        assert( status==LU_SUCCESS || status==CHOLE_SUCCESS );
+        const T* a = _mat.data();
+        T* x = vec.data();
+        if( status==LU_SUCCESS )
+        {
+            /// P b, L y = P b, U x = y
+#pragma GCC unroll 16
+            for( int i=0; i<N; i++ )
+                if( perm[i]!=i ) std::swap( x[i], x[perm[i]] );
+            for( int i=1; i<N; i++ )
+            {
+                T sum = x[i];
+#pragma GCC unroll 16
+                for( int j=0; j<i; j++ )
+                    sum -= a[i*N+j] * x[j];
+                x[i] = sum;
+            }
+            for( int i=N-1; i>=0; i-- )
+            {
+                T sum = x[i];
+#pragma GCC unroll 16
+                for( int j=i+1; j<N; j++ )
+                    sum -= a[i*N+j] * x[j];
+                x[i] = sum / a[i*N+i];
+            }
+        }
+        else
+        {
+            /// L y = b, L^* x = y
+            for( int i=0; i<N; i++ )
+            {
+                T sum = x[i];
+#pragma GCC unroll 16
+                for( int j=0; j<i; j++ )
+                    sum -= a[i*N+j] * x[j];
+                x[i] = sum / a[i*N+i];
+            }
+            for( int i=N-1; i>=0; i-- )
+            {
+                T sum = x[i];
+#pragma GCC unroll 16
+                for( int j=i+1; j<N; j++ )
+                    sum -= scalar_conj( a[j*N+i] ) * x[j];
+                x[i] = sum / a[i*N+i];
+            }
+        }
+    }
+    VectorType solve_vec( const VectorType& b ) const
+    {
+        VectorType x = b;
+        solve_vec_inplace( x );
+        return x;
+    }
+
+    MatrixType get_lower() const
+    {
+        assert( status==LU_SUCCESS );
+        MatrixType res;
+#pragma GCC unroll 16
+        for( int i=0; i<N; i++ )
+        {
+            res(i,i) = T(1);
+#pragma GCC unroll 16
+            for( int j=0; j<i; j++ )
+                res(i,j) = _mat(i,j);
+        }
+        return res;
+    }
+    MatrixType get_upper() const
+    {
+        assert( status==LU_SUCCESS );
+        MatrixType res;
+#pragma GCC unroll 16
+        for( int i=0; i<N; i++ )
+#pragma GCC unroll 16
+            for( int j=i; j<N; j++ )
+                res(i,j) = _mat(i,j);
+        return res;
+    }
+    MatrixType get_chole() const
+    {
+        assert( status==CHOLE_SUCCESS );
+        MatrixType res;
+#pragma GCC unroll 16
+        for( int i=0; i<N; i++ )
+#pragma GCC unroll 16
+            for( int j=0; j<=i; j++ )
+                res(i,j) = _mat(i,j);
+        return res;
+    }
+    /// P A, the row permutation the LU factors reproduce
+    MatrixType permute( const MatrixType& mat ) const
+    {
+        assert( status==LU_SUCCESS );
+        MatrixType p_mat = mat;
+        for( int i=0; i<N; i++ )
+            if( perm[i]!=i ) p_mat.swap_row( i, perm[i] );
+        return p_mat;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,469 @@
+#include "libmatrix/blas.h"
+#include "libmatrix/thread_pool.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if !defined(MX_NO_SIMD) && defined(__x86_64__) && ( defined(__GNUC__) || defined(__clang__) )
+#define MX_GEMM_X86
+#include <immintrin.h>
+#endif
+
+namespace mx
+{
+
+namespace
+{
+
+/// cache blocking: a KC x NC panel of B stays in L3, a MC x KC block of A in L2,
+/// MC and NC are multiples of every MR / NR below
+constexpr int GEMM_MC = 96;
+constexpr int GEMM_KC = 256;
+constexpr int GEMM_NC = 2048;
+
+/// products below this many multiply-adds skip packing
+constexpr double GEMM_SMALL = 32.0*32.0*32.0;
+/// products below this many multiply-adds stay on the calling thread
+constexpr double GEMM_PARALLEL = 128.0*128.0*128.0;
+/// largest edge of the C tiles handed to the thread pool
+constexpr int GEMM_TILE = 768;
+/// largest MR * NR over all kernels
+constexpr int GEMM_MAX_TILE = 8*32;
+
+/// c[0:MR, 0:NR] += alpha * a * b, a is a packed MR x kc panel, b a packed kc x NR panel
+template<typename T>
+using GemmKernel = void (*)( int kc, const T* a, const T* b, T* c, int ldc, T alpha );
+
+template<typename T>
+struct GemmArch
+{
+    const char* name;
+    int mr;
+    int nr;
+    GemmKernel<T> kernel;
+};
+
+template<typename T, int MR, int NR>
+void gemm_kernel_generic( int kc, const T* a, const T* b, T* c, int ldc, T alpha )
+{
+    T acc[MR][NR] = {};
+    for( int p=0; p<kc; p++ )
+    {
+        for( int i=0; i<MR; i++ )
+            for( int j=0; j<NR; j++ )
+                acc[i][j] += a[i] * b[j];
+        a += MR;
+        b += NR;
+    }
+    for( int i=0; i<MR; i++ )
+        for( int j=0; j<NR; j++ )
+            c[i*ldc+j] += alpha * acc[i][j];
+}
+
+#ifdef MX_GEMM_X86
+
+__attribute__((target("avx2,fma")))
+void gemm_kernel_avx2( int kc, const double* a, const double* b, double* c, int ldc, double alpha )
+{
+    /// 6 x 8 tile held in 12 ymm accumulators
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+    for( int p=0; p<kc; p++ )
+    {
+        __m256d b0 = _mm256_loadu_pd( b );
+        __m256d b1 = _mm256_loadu_pd( b+4 );
+        __m256d ai;
+        ai = _mm256_broadcast_sd( a );   c00 = _mm256_fmadd_pd( ai, b0, c00 ); c01 = _mm256_fmadd_pd( ai, b1, c01 );
+        ai = _mm256_broadcast_sd( a+1 ); c10 = _mm256_fmadd_pd( ai, b0, c10 ); c11 = _mm256_fmadd_pd( ai, b1, c11 );
+        ai = _mm256_broadcast_sd( a+2 ); c20 = _mm256_fmadd_pd( ai, b0, c20 ); c21 = _mm256_fmadd_pd( ai, b1, c21 );
+        ai = _mm256_broadcast_sd( a+3 ); c30 = _mm256_fmadd_pd( ai, b0, c30 ); c31 = _mm256_fmadd_pd( ai, b1, c31 );
+        ai = _mm256_broadcast_sd( a+4 ); c40 = _mm256_fmadd_pd( ai, b0, c40 ); c41 = _mm256_fmadd_pd( ai, b1, c41 );
+        ai = _mm256_broadcast_sd( a+5 ); c50 = _mm256_fmadd_pd( ai, b0, c50 ); c51 = _mm256_fmadd_pd( ai, b1, c51 );
+        a += 6;
+        b += 8;
+    }
+
+    __m256d va = _mm256_set1_pd( alpha );
+    __m256d lo[6] = { c00, c10, c20, c30, c40, c50 };
+    __m256d hi[6] = { c01, c11, c21, c31, c41, c51 };
+    for( int i=0; i<6; i++ )
+    {
+        double* ci = c + i*ldc;
+        _mm256_storeu_pd( ci,   _mm256_fmadd_pd( va, lo[i], _mm256_loadu_pd( ci ) ) );
+        _mm256_storeu_pd( ci+4, _mm256_fmadd_pd( va, hi[i], _mm256_loadu_pd( ci+4 ) ) );
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void gemm_kernel_avx2( int kc, const float* a, const float* b, float* c, int ldc, float alpha )
+{
+    /// 6 x 16 tile held in 12 ymm accumulators
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+    for( int p=0; p<kc; p++ )
+    {
+        __m256 b0 = _mm256_loadu_ps( b );
+        __m256 b1 = _mm256_loadu_ps( b+8 );
+        __m256 ai;
+        ai = _mm256_broadcast_ss( a );   c00 = _mm256_fmadd_ps( ai, b0, c00 ); c01 = _mm256_fmadd_ps( ai, b1, c01 );
+        ai = _mm256_broadcast_ss( a+1 ); c10 = _mm256_fmadd_ps( ai, b0, c10 ); c11 = _mm256_fmadd_ps( ai, b1, c11 );
+        ai = _mm256_broadcast_ss( a+2 ); c20 = _mm256_fmadd_ps( ai, b0, c20 ); c21 = _mm256_fmadd_ps( ai, b1, c21 );
+        ai = _mm256_broadcast_ss( a+3 ); c30 = _mm256_fmadd_ps( ai, b0, c30 ); c31 = _mm256_fmadd_ps( ai, b1, c31 );
+        ai = _mm256_broadcast_ss( a+4 ); c40 = _mm256_fmadd_ps( ai, b0, c40 ); c41 = _mm256_fmadd_ps( ai, b1, c41 );
+        ai = _mm256_broadcast_ss( a+5 ); c50 = _mm256_fmadd_ps( ai, b0, c50 ); c51 = _mm256_fmadd_ps( ai, b1, c51 );
+        a += 6;
+        b += 16;
+    }
+
+    __m256 va = _mm256_set1_ps( alpha );
+    __m256 lo[6] = { c00, c10, c20, c30, c40, c50 };
+    __m256 hi[6] = { c01, c11, c21, c31, c41, c51 };
+    for( int i=0; i<6; i++ )
+    {
+        float* ci = c + i*ldc;
+        _mm256_storeu_ps( ci,   _mm256_fmadd_ps( va, lo[i], _mm256_loadu_ps( ci ) ) );
+        _mm256_storeu_ps( ci+8, _mm256_fmadd_ps( va, hi[i], _mm256_loadu_ps( ci+8 ) ) );
+    }
+}
+
+__attribute__((target("avx512f")))
+void gemm_kernel_avx512( int kc, const double* a, const double* b, double* c, int ldc, double alpha )
+{
+    /// 8 x 16 tile held in 16 zmm accumulators
+    __m512d acc[8][2];
+#pragma GCC unroll 8
+    for( int i=0; i<8; i++ )
+    {
+        acc[i][0] = _mm512_setzero_pd();
+        acc[i][1] = _mm512_setzero_pd();
+    }
+
+    for( int p=0; p<kc; p++ )
+    {
+        __m512d b0 = _mm512_loadu_pd( b );
+        __m512d b1 = _mm512_loadu_pd( b+8 );
+#pragma GCC unroll 8
+        for( int i=0; i<8; i++ )
+        {
+            __m512d ai = _mm512_set1_pd( a[i] );
+            acc[i][0] = _mm512_fmadd_pd( ai, b0, acc[i][0] );
+            acc[i][1] = _mm512_fmadd_pd( ai, b1, acc[i][1] );
+        }
+        a += 8;
+        b += 16;
+    }
+
+    __m512d va = _mm512_set1_pd( alpha );
+#pragma GCC unroll 8
+    for( int i=0; i<8; i++ )
+    {
+        double* ci = c + i*ldc;
+        _mm512_storeu_pd( ci,   _mm512_fmadd_pd( va, acc[i][0], _mm512_loadu_pd( ci ) ) );
+        _mm512_storeu_pd( ci+8, _mm512_fmadd_pd( va, acc[i][1], _mm512_loadu_pd( ci+8 ) ) );
+    }
+}
+
+__attribute__((target("avx512f")))
+void gemm_kernel_avx512( int kc, const float* a, const float* b, float* c, int ldc, float alpha )
+{
+    /// 8 x 32 tile held in 16 zmm accumulators
+    __m512 acc[8][2];
+#pragma GCC unroll 8
+    for( int i=0; i<8; i++ )
+    {
+        acc[i][0] = _mm512_setzero_ps();
+        acc[i][1] = _mm512_setzero_ps();
+    }
+
+    for( int p=0; p<kc; p++ )
+    {
+        __m512 b0 = _mm512_loadu_ps( b );
+        __m512 b1 = _mm512_loadu_ps( b+16 );
+#pragma GCC unroll 8
+        for( int i=0; i<8; i++ )
+        {
+            __m512 ai = _mm512_set1_ps( a[i] );
+            acc[i][0] = _mm512_fmadd_ps( ai, b0, acc[i][0] );
+            acc[i][1] = _mm512_fmadd_ps( ai, b1, acc[i][1] );
+        }
+        a += 8;
+        b += 32;
+    }
+
+    __m512 va = _mm512_set1_ps( alpha );
+#pragma GCC unroll 8
+    for( int i=0; i<8; i++ )
+    {
+        float* ci = c + i*ldc;
+        _mm512_storeu_ps( ci,    _mm512_fmadd_ps( va, acc[i][0], _mm512_loadu_ps( ci ) ) );
+        _mm512_storeu_ps( ci+16, _mm512_fmadd_ps( va, acc[i][1], _mm512_loadu_ps( ci+16 ) ) );
+    }
+}
+
+#endif
+
+SimdLevel select_simd_level()
+{
+#ifdef MX_GEMM_X86
+    /// MX_GEMM_ARCH=generic|avx2|avx512 caps the kernel, e.g. for testing
+    const char* env = std::getenv( "MX_GEMM_ARCH" );
+    bool allow_avx512 = !env || std::strcmp( env, "avx512" )==0;
+    bool allow_avx2 = allow_avx512 || std::strcmp( env, "avx2" )==0;
+
+    __builtin_cpu_init();
+    if( allow_avx512 && __builtin_cpu_supports( "avx512f" ) )
+        return SIMD_AVX512;
+    if( allow_avx2 && __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+        return SIMD_AVX2;
+#endif
+    return SIMD_GENERIC;
+}
+
+template<typename T>
+const GemmArch<T>& gemm_arch()
+{
+    const SimdLevel level = simd_level();
+    static const GemmArch<T> generic = { "generic", 4, 8, gemm_kernel_generic<T,4,8> };
+#ifdef MX_GEMM_X86
+    /// SIMD kernels for real types only, the float ones are as tall as the double
+    /// ones and twice as wide
+    if constexpr( !ScalarTraits<T>::is_complex )
+    {
+        constexpr int w = sizeof(double)/sizeof(T);
+        static const GemmArch<T> avx2 = { "avx2", 6, 8*w, gemm_kernel_avx2 };
+        static const GemmArch<T> avx512 = { "avx512", 8, 16*w, gemm_kernel_avx512 };
+        if( level==SIMD_AVX512 ) return avx512;
+        if( level==SIMD_AVX2 ) return avx2;
+    }
+#endif
+    (void)level;
+    return generic;
+}
+
+template<typename T>
+void pack_a( bool trans, int mc, int kc, const T* a, int lda, int mr, T* buf )
+{
+    /// MR-row micro-panels, each stored k-major, zero padded at the bottom edge
+    for( int ir=0; ir<mc; ir+=mr )
+    {
+        int rows = std::min( mr, mc-ir );
+        for( int p=0; p<kc; p++ )
+        {
+            for( int r=0; r<rows; r++ )
+                buf[r] = trans ? scalar_conj( a[p*lda + ir+r] ) : a[(ir+r)*lda + p];
+            for( int r=rows; r<mr; r++ )
+                buf[r] = T(0);
+            buf += mr;
+        }
+    }
+}
+
+template<typename T>
+void pack_b( bool trans, int kc, int nc, const T* b, int ldb, int nr, T* buf )
+{
+    /// NR-column micro-panels, each stored k-major, zero padded at the right edge
+    for( int jr=0; jr<nc; jr+=nr )
+    {
+        int cols = std::min( nr, nc-jr );
+        for( int p=0; p<kc; p++ )
+        {
+            if( !trans && cols==nr )
+                std::memcpy( buf, b + p*ldb + jr, nr*sizeof(T) );
+            else
+            {
+                for( int j=0; j<cols; j++ )
+                    buf[j] = trans ? scalar_conj( b[(jr+j)*ldb + p] ) : b[p*ldb + jr+j];
+                for( int j=cols; j<nr; j++ )
+                    buf[j] = T(0);
+            }
+            buf += nr;
+        }
+    }
+}
+
+template<typename T>
+void gemm_small( bool trans_a, bool trans_b, int m, int n, int k,
+                 T alpha, const T* a, int lda,
+                 const T* b, int ldb, T* c, int ldc )
+{
+    /// unpacked i-k-j loops for tiny and vector-shaped products
+    auto a_at = [&]( int i, int p ){ return trans_a ? scalar_conj( a[p*lda+i] ) : a[i*lda+p]; };
+    auto b_at = [&]( int p, int j ){ return trans_b ? scalar_conj( b[j*ldb+p] ) : b[p*ldb+j]; };
+    if( n==1 && !ScalarTraits<T>::is_complex )
+    {
+        /// matrix-vector: dots along the rows of A, or axpys when A is transposed
+        int incb = trans_b ? 1 : ldb;
+        if( !trans_a )
+            for( int i=0; i<m; i++ )
+                c[i*ldc] += alpha * dot( k, a + i*lda, 1, b, incb );
+        else
+            for( int p=0; p<k; p++ )
+                axpy( m, alpha * b[p*incb], a + p*lda, 1, c, ldc );
+        return;
+    }
+    for( int i=0; i<m; i++ )
+    {
+        T* ci = c + i*ldc;
+        if( trans_b )
+        {
+            for( int j=0; j<n; j++ )
+            {
+                T sum = T(0);
+                for( int p=0; p<k; p++ )
+                    sum += a_at( i, p ) * b_at( p, j );
+                ci[j] += alpha * sum;
+            }
+        }
+        else
+        {
+            for( int p=0; p<k; p++ )
+            {
+                T aip = alpha * a_at( i, p );
+                const T* bp = b + p*ldb;
+                for( int j=0; j<n; j++ )
+                    ci[j] += aip * bp[j];
+            }
+        }
+    }
+}
+
+template<typename T>
+void gemm_packed( bool trans_a, bool trans_b, int m, int n, int k,
+                  T alpha, const T* a, int lda,
+                  const T* b, int ldb, T* c, int ldc )
+{
+    /// C += alpha * op(A) * op(B) through packed panels and the micro-kernel
+    const GemmArch<T>& arch = gemm_arch<T>();
+    const int mr = arch.mr, nr = arch.nr;
+
+    /// per-thread packing buffers, reused across calls
+    thread_local std::vector<T> buf_a, buf_b;
+    buf_a.resize( GEMM_MC*GEMM_KC );
+    buf_b.resize( GEMM_KC*GEMM_NC );
+    T tile[GEMM_MAX_TILE];
+
+    for( int jc=0; jc<n; jc+=GEMM_NC )
+    {
+        int nc = std::min( GEMM_NC, n-jc );
+        for( int pc=0; pc<k; pc+=GEMM_KC )
+        {
+            int kc = std::min( GEMM_KC, k-pc );
+            const T* bp = trans_b ? b + jc*ldb + pc : b + pc*ldb + jc;
+            pack_b( trans_b, kc, nc, bp, ldb, nr, buf_b.data() );
+
+            for( int ic=0; ic<m; ic+=GEMM_MC )
+            {
+                int mc = std::min( GEMM_MC, m-ic );
+                const T* ap = trans_a ? a + pc*lda + ic : a + ic*lda + pc;
+                pack_a( trans_a, mc, kc, ap, lda, mr, buf_a.data() );
+
+                for( int jr=0; jr<nc; jr+=nr )
+                {
+                    int cols = std::min( nr, nc-jr );
+                    const T* pb = buf_b.data() + jr*kc;
+                    for( int ir=0; ir<mc; ir+=mr )
+                    {
+                        int rows = std::min( mr, mc-ir );
+                        const T* pa = buf_a.data() + ir*kc;
+                        T* cc = c + (ic+ir)*ldc + jc+jr;
+                        if( rows==mr && cols==nr )
+                        {
+                            arch.kernel( kc, pa, pb, cc, ldc, alpha );
+                            continue;
+                        }
+                        /// edge tile goes through a scratch tile
+                        std::fill( tile, tile + mr*nr, T(0) );
+                        arch.kernel( kc, pa, pb, tile, nr, alpha );
+                        for( int i=0; i<rows; i++ )
+                            for( int j=0; j<cols; j++ )
+                                cc[i*ldc+j] += tile[i*nr+j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+}
+
+SimdLevel simd_level()
+{
+    static const SimdLevel level = select_simd_level();
+    return level;
+}
+
+const char* gemm_kernel_name()
+{
+    return gemm_arch<double>().name;
+}
+
+template<typename T>
+void gemm( bool trans_a, bool trans_b, int m, int n, int k,
+           NoDeduce<T> alpha, const T* a, int lda,
+           const T* b, int ldb,
+           NoDeduce<T> beta, T* c, int ldc )
+{
+    if( m<=0 || n<=0 ) return;
+
+    /// C = beta*C first, the kernels only accumulate
+    if( beta==T(0) )
+    {
+        for( int i=0; i<m; i++ )
+            std::fill( c + i*ldc, c + i*ldc + n, T(0) );
+    }
+    else if( beta!=T(1) )
+    {
+        for( int i=0; i<m; i++ )
+            for( int j=0; j<n; j++ )
+                c[i*ldc+j] *= beta;
+    }
+    if( k<=0 || alpha==T(0) ) return;
+
+    if( m<4 || n<4 || (double)m*n*k < GEMM_SMALL )
+    {
+        gemm_small( trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, c, ldc );
+        return;
+    }
+
+    /// large products are cut into 2D tiles of C and spread over the thread pool
+    ThreadPool& pool = thread_pool();
+    if( pool.size()==1 || (double)m*n*k < GEMM_PARALLEL )
+    {
+        gemm_packed( trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, c, ldc );
+        return;
+    }
+
+    int tile = GEMM_TILE;
+    while( tile>GEMM_MC && (long)( (m+tile-1)/tile )*( (n+tile-1)/tile ) < 4*pool.size() )
+        tile /= 2;
+    int tiles_m = (m+tile-1)/tile, tiles_n = (n+tile-1)/tile;
+    pool.parallel_for( tiles_m*tiles_n, [&]( int t )
+    {
+        int i0 = (t/tiles_n)*tile, j0 = (t%tiles_n)*tile;
+        int mt = std::min( tile, m-i0 ), nt = std::min( tile, n-j0 );
+        const T* at = trans_a ? a + i0 : a + i0*lda;
+        const T* bt = trans_b ? b + j0*ldb : b + j0;
+        gemm_packed( trans_a, trans_b, mt, nt, k, alpha, at, lda, bt, ldb, c + i0*ldc + j0, ldc );
+    } );
+}
+
+#define MX_INSTANTIATE_GEMM(T) \
+    template void gemm<T>( bool, bool, int, int, int, T, const T*, int, const T*, int, T, T*, int );
+MX_INSTANTIATE_GEMM(float)
+MX_INSTANTIATE_GEMM(double)
+MX_INSTANTIATE_GEMM(std::complex<float>)
+MX_INSTANTIATE_GEMM(std::complex<double>)
+
+}
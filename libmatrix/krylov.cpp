@@ -0,0 +1,781 @@
+#include "libmatrix/krylov.h"
+#include "libmatrix/blas.h"
+#include "libmatrix/lu.h"
+#include "libmatrix/thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+
+namespace mx
+{
+
+namespace
+{
+
+/// vector entries per task; shorter vectors are worked on by the calling thread
+constexpr int VECTOR_CHUNK = 1 << 14;
+/// below this many matrix entries a dense product runs on the calling thread
+constexpr std::size_t GEMV_WORK = 1 << 15;
+/// IC(0) restarts with a larger diagonal shift at most this many times
+constexpr int ICHOL_MAX_SHIFTS = 40;
+
+int vector_parts( int n )
+{
+    if( n<2*VECTOR_CHUNK ) return 1;
+    return std::min( n/VECTOR_CHUNK, 4*thread_pool().size() );
+}
+
+/// fn( i0, i1 ) over blocks of [0, n), concurrently for long vectors
+template<typename F>
+void for_range( int n, F fn )
+{
+    int parts = vector_parts( n );
+    if( parts<=1 )
+    {
+        fn( 0, n );
+        return;
+    }
+    thread_pool().parallel_for( parts, [&]( int t ){
+        fn( (int)( (long)n*t/parts ), (int)( (long)n*(t+1)/parts ) );
+    } );
+}
+
+/// the sum of fn( i0, i1 ) over blocks of [0, n), added in block order so that the
+/// result does not depend on which thread finished first
+template<typename R, typename F>
+R reduce_range( int n, F fn )
+{
+    int parts = vector_parts( n );
+    if( parts<=1 ) return fn( 0, n );
+    std::vector<R> partial( parts );
+    thread_pool().parallel_for( parts, [&]( int t ){
+        partial[t] = fn( (int)( (long)n*t/parts ), (int)( (long)n*(t+1)/parts ) );
+    } );
+    R s = R(0);
+    for( int t=0; t<parts; t++ )
+        s += partial[t];
+    return s;
+}
+
+/// x^* y over n contiguous entries, four partial sums as in blas dot
+template<typename T>
+T dotc_serial( int n, const T* x, const T* y )
+{
+    T s0 = T(0), s1 = T(0), s2 = T(0), s3 = T(0);
+    int i = 0;
+    for( ; i+4<=n; i+=4 )
+    {
+        s0 += scalar_conj( x[i] ) * y[i];
+        s1 += scalar_conj( x[i+1] ) * y[i+1];
+        s2 += scalar_conj( x[i+2] ) * y[i+2];
+        s3 += scalar_conj( x[i+3] ) * y[i+3];
+    }
+    for( ; i<n; i++ )
+        s0 += scalar_conj( x[i] ) * y[i];
+    return (s0+s1) + (s2+s3);
+}
+
+template<typename T>
+T dotc( int n, const T* x, const T* y )
+{
+    return reduce_range<T>( n, [&]( int i0, int i1 ){
+        return dotc_serial( i1-i0, x+i0, y+i0 );
+    } );
+}
+
+template<typename T>
+RealType<T> norm2_sq( int n, const T* x )
+{
+    return reduce_range< RealType<T> >( n, [&]( int i0, int i1 ){
+        RealType<T> s = 0;
+        for( int i=i0; i<i1; i++ )
+            s += scalar_abs2( x[i] );
+        return s;
+    } );
+}
+
+/// r = b - r, for r holding A x on entry; returns ||r||^2
+template<typename T>
+RealType<T> sub_from( int n, const T* b, T* r )
+{
+    return reduce_range< RealType<T> >( n, [&]( int i0, int i1 ){
+        RealType<T> s = 0;
+        for( int i=i0; i<i1; i++ )
+        {
+            r[i] = b[i] - r[i];
+            s += scalar_abs2( r[i] );
+        }
+        return s;
+    } );
+}
+
+/// the CG step x += alpha p, r -= alpha q in one pass, returning the new ||r||^2
+template<typename T>
+RealType<T> cg_update( int n, T alpha, const T* p, const T* q, T* x, T* r )
+{
+    return reduce_range< RealType<T> >( n, [&]( int i0, int i1 ){
+        RealType<T> s = 0;
+        for( int i=i0; i<i1; i++ )
+        {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+            s += scalar_abs2( r[i] );
+        }
+        return s;
+    } );
+}
+
+/// p = z + beta p
+template<typename T>
+void xpay( int n, const T* z, T beta, T* p )
+{
+    for_range( n, [&]( int i0, int i1 ){
+        for( int i=i0; i<i1; i++ )
+            p[i] = z[i] + beta * p[i];
+    } );
+}
+
+template<typename T>
+void scale( int n, T alpha, T* x )
+{
+    for_range( n, [&]( int i0, int i1 ){
+        for( int i=i0; i<i1; i++ )
+            x[i] *= alpha;
+    } );
+}
+
+/// h_l = v_l^* w for the k rows v_l of v (leading dimension n): all k products in a
+/// single pass over w, each block of w read once while it is in cache
+template<typename T>
+void multi_dotc( int k, const T* v, int n, const T* w, T* h )
+{
+    int parts = vector_parts( n );
+    std::vector<T> partial( (std::size_t)parts*k );
+    auto block = [&]( int t ){
+        int i0 = (int)( (long)n*t/parts ), i1 = (int)( (long)n*(t+1)/parts );
+        for( int l=0; l<k; l++ )
+            partial[(std::size_t)t*k+l] = dotc_serial( i1-i0, v + (std::size_t)l*n + i0, w+i0 );
+    };
+    if( parts<=1 ) block( 0 );
+    else thread_pool().parallel_for( parts, block );
+    for( int l=0; l<k; l++ )
+    {
+        T s = T(0);
+        for( int t=0; t<parts; t++ )
+            s += partial[(std::size_t)t*k+l];
+        h[l] = s;
+    }
+}
+
+/// w -= sum_l h_l v_l in a single pass over w, returning the new ||w||^2
+template<typename T>
+RealType<T> multi_sub( int k, const T* v, int n, const T* h, T* w )
+{
+    return reduce_range< RealType<T> >( n, [&]( int i0, int i1 ){
+        for( int l=0; l<k; l++ )
+        {
+            T a = h[l];
+            const T* vl = v + (std::size_t)l*n;
+            for( int i=i0; i<i1; i++ )
+                w[i] -= a * vl[i];
+        }
+        RealType<T> s = 0;
+        for( int i=i0; i<i1; i++ )
+            s += scalar_abs2( w[i] );
+        return s;
+    } );
+}
+
+/// u = sum_l y_l v_l
+template<typename T>
+void combine( int k, const T* v, int n, const T* y, T* u )
+{
+    for_range( n, [&]( int i0, int i1 ){
+        std::fill( u+i0, u+i1, T(0) );
+        for( int l=0; l<k; l++ )
+        {
+            T a = y[l];
+            const T* vl = v + (std::size_t)l*n;
+            for( int i=i0; i<i1; i++ )
+                u[i] += a * vl[i];
+        }
+    } );
+}
+
+/// the rotation [c s; -conj(s) c] taking (a, b) to (r, 0), with c real
+template<typename T>
+void make_givens( T a, T b, RealType<T>& c, T& s )
+{
+    RealType<T> abs_a = std::abs( a ), abs_b = std::abs( b );
+    if( abs_b==0 )
+    {
+        c = 1;
+        s = T(0);
+        return;
+    }
+    if( abs_a==0 )
+    {
+        c = 0;
+        s = scalar_conj( b ) / abs_b;
+        return;
+    }
+    RealType<T> t = std::hypot( abs_a, abs_b );
+    c = abs_a / t;
+    s = ( a / abs_a ) * scalar_conj( b ) / t;
+}
+
+template<typename T>
+void apply_givens( RealType<T> c, T s, T& x, T& y )
+{
+    T tx = c*x + s*y;
+    y = -scalar_conj( s )*x + c*y;
+    x = tx;
+}
+
+/// diag(A)^-1 with zeros taken as 1, the operator owning the inverse
+template<typename T>
+BasicLinearOperator<T> jacobi_from( std::vector<T> d )
+{
+    int n = (int)d.size();
+    for( int i=0; i<n; i++ )
+        d[i] = ( d[i]==T(0) ) ? T(1) : T(1) / d[i];
+    auto inv = std::make_shared< std::vector<T> >( std::move( d ) );
+    return BasicLinearOperator<T>( n, [inv, n]( const T* x, T* y ){
+        const T* di = inv->data();
+        for_range( n, [&]( int i0, int i1 ){
+            for( int i=i0; i<i1; i++ )
+                y[i] = di[i] * x[i];
+        } );
+    } );
+}
+
+/// inverses of the diagonal blocks, fill_block( i0, m, blk ) writing the m x m block
+/// at (i0, i0) row major. Block b is stored at b*bs*bs
+template<typename T, typename F>
+BasicLinearOperator<T> block_jacobi_from( int n, int bs, F fill_block )
+{
+    assert( bs>0 );
+    bs = std::min( bs, std::max( n, 1 ) );
+    int nb = ( n+bs-1 ) / bs;
+    auto inv = std::make_shared< std::vector<T> >( (std::size_t)nb*bs*bs, T(0) );
+    thread_pool().parallel_for( nb, [&]( int b ){
+        int i0 = b*bs, m = std::min( bs, n-i0 );
+        BasicMatrix<T> blk( m, m );
+        fill_block( i0, m, blk.data() );
+        T* out = inv->data() + (std::size_t)b*bs*bs;
+        BasicLinearSolver<T> solver( blk );
+        if( solver.lu_decomp_partial()==0 )
+        {
+            BasicMatrix<T> eye( m, m );
+            for( int i=0; i<m; i++ )
+                eye( i, i ) = T(1);
+            BasicMatrix<T> bi = solver.solve( eye );
+            bool finite = true;
+            for( int e=0; e<m*m; e++ )
+                finite = finite && scalar_isfinite( bi.data()[e] );
+            if( finite )
+            {
+                std::copy( bi.data(), bi.data()+m*m, out );
+                return;
+            }
+        }
+        for( int i=0; i<m; i++ )
+            out[i*m+i] = ( blk( i, i )==T(0) ) ? T(1) : T(1) / blk( i, i );
+    } );
+    return BasicLinearOperator<T>( n, [inv, n, bs, nb]( const T* x, T* y ){
+        auto apply_block = [&]( int b ){
+            int i0 = b*bs, m = std::min( bs, n-i0 );
+            const T* bi = inv->data() + (std::size_t)b*bs*bs;
+            for( int i=0; i<m; i++ )
+                y[i0+i] = dot( m, bi + (std::size_t)i*m, 1, x+i0, 1 );
+        };
+        if( (std::size_t)n*bs<GEMV_WORK )
+        {
+            for( int b=0; b<nb; b++ )
+                apply_block( b );
+            return;
+        }
+        thread_pool().parallel_for( nb, apply_block );
+    } );
+}
+
+template<typename T>
+BasicSparseMatrix<T> as_csr( const BasicSparseMatrix<T>& mat )
+{
+    return ( mat.layout()==CSR ) ? mat : mat.to_layout( CSR );
+}
+
+/// IC(0) by rows on the lower triangle pattern (lptr, lidx), the diagonal last in each
+/// row: l_ik = ( a_ik - sum_{j<k} l_ij conj(l_kj) ) / l_kk. 0, or -1 at a pivot that
+/// is not positive
+template<typename T>
+int ichol_rows( int n, const std::vector<int>& lptr, const std::vector<int>& lidx,
+                std::vector<T>& lval, std::vector<int>& pos )
+{
+    for( int i=0; i<n; i++ )
+    {
+        int d = lptr[i+1]-1;
+        for( int p=lptr[i]; p<d; p++ )
+            pos[lidx[p]] = p;
+        for( int p=lptr[i]; p<d; p++ )
+        {
+            int k = lidx[p];
+            T s = lval[p];
+            /// the entries of row k left of its diagonal that row i has too, all of
+            /// them left of k and so already final in row i
+            for( int q=lptr[k]; q<lptr[k+1]-1; q++ )
+                if( pos[lidx[q]]>=0 ) s -= lval[pos[lidx[q]]] * scalar_conj( lval[q] );
+            lval[p] = s / lval[lptr[k+1]-1];
+        }
+        RealType<T> diag = scalar_real( lval[d] );
+        for( int p=lptr[i]; p<d; p++ )
+        {
+            diag -= scalar_abs2( lval[p] );
+            pos[lidx[p]] = -1;
+        }
+        if( !( diag>0 ) || !std::isfinite( diag ) ) return -1;
+        lval[d] = T( std::sqrt( diag ) );
+    }
+    return 0;
+}
+
+}
+
+template<typename T>
+BasicLinearOperator<T>::BasicLinearOperator( const MatrixType& mat )
+:   _n( mat.n_row() )
+{
+    assert( mat.n_row()==mat.n_col() );
+    const T* a = mat.data();
+    int n = _n;
+    _apply = [a, n]( const T* x, T* y ){
+        auto rows = [&]( int i0, int i1 ){
+            for( int i=i0; i<i1; i++ )
+                y[i] = dot( n, a + (std::size_t)i*n, 1, x, 1 );
+        };
+        ThreadPool& pool = thread_pool();
+        int parts = ( (std::size_t)n*n<GEMV_WORK ) ? 1 : std::min( n, 4*pool.size() );
+        if( parts<=1 )
+        {
+            rows( 0, n );
+            return;
+        }
+        pool.parallel_for( parts, [&]( int t ){
+            rows( (int)( (long)n*t/parts ), (int)( (long)n*(t+1)/parts ) );
+        } );
+    };
+}
+
+template<typename T>
+BasicLinearOperator<T>::BasicLinearOperator( const SparseMatrixType& mat )
+:   _n( mat.n_row() )
+{
+    assert( mat.n_row()==mat.n_col() );
+    const SparseMatrixType* a = &mat;
+    _apply = [a]( const T* x, T* y ){
+        a->multiply( x, 1, 1, y );
+    };
+}
+
+template<typename T>
+BasicLinearOperator<T> jacobi_preconditioner( const BasicMatrix<T>& mat )
+{
+    assert( mat.n_row()==mat.n_col() );
+    std::vector<T> d( mat.n_row() );
+    for( int i=0; i<mat.n_row(); i++ )
+        d[i] = mat( i, i );
+    return jacobi_from( std::move( d ) );
+}
+
+template<typename T>
+BasicLinearOperator<T> jacobi_preconditioner( const BasicSparseMatrix<T>& mat )
+{
+    assert( mat.n_row()==mat.n_col() );
+    std::vector<T> d( mat.n_row() );
+    for( int i=0; i<mat.n_row(); i++ )
+        d[i] = mat( i, i );
+    return jacobi_from( std::move( d ) );
+}
+
+template<typename T>
+BasicLinearOperator<T> block_jacobi_preconditioner( const BasicMatrix<T>& mat, int block_size )
+{
+    assert( mat.n_row()==mat.n_col() );
+    int n = mat.n_row();
+    const T* a = mat.data();
+    return block_jacobi_from<T>( n, block_size, [&]( int i0, int m, T* blk ){
+        for( int i=0; i<m; i++ )
+            std::copy( a + (std::size_t)(i0+i)*n + i0, a + (std::size_t)(i0+i)*n + i0 + m, blk + i*m );
+    } );
+}
+
+template<typename T>
+BasicLinearOperator<T> block_jacobi_preconditioner( const BasicSparseMatrix<T>& mat, int block_size )
+{
+    assert( mat.n_row()==mat.n_col() );
+    BasicSparseMatrix<T> csr = as_csr( mat );
+    const std::vector<int>& ptr = csr.ptr();
+    const std::vector<int>& idx = csr.idx();
+    const std::vector<T>& val = csr.val();
+    return block_jacobi_from<T>( csr.n_row(), block_size, [&]( int i0, int m, T* blk ){
+        for( int i=0; i<m; i++ )
+        {
+            /// the columns of row i0+i inside the block, a contiguous run of the row
+            int p = (int)( std::lower_bound( idx.begin()+ptr[i0+i], idx.begin()+ptr[i0+i+1], i0 ) - idx.begin() );
+            for( ; p<ptr[i0+i+1] && idx[p]<i0+m; p++ )
+                blk[i*m + idx[p]-i0] = val[p];
+        }
+    } );
+}
+
+template<typename T>
+BasicLinearOperator<T> ichol_preconditioner( const BasicSparseMatrix<T>& mat )
+{
+    typedef RealType<T> real_type;
+    assert( mat.n_row()==mat.n_col() );
+    BasicSparseMatrix<T> csr = as_csr( mat );
+    int n = csr.n_row();
+    const std::vector<int>& ptr = csr.ptr();
+    const std::vector<int>& idx = csr.idx();
+    const std::vector<T>& val = csr.val();
+
+    /// the lower triangle by rows with the diagonal always present, as the last entry
+    auto lptr = std::make_shared< std::vector<int> >( n+1, 0 );
+    auto lidx = std::make_shared< std::vector<int> >();
+    auto lval = std::make_shared< std::vector<T> >();
+    std::vector<real_type> shift_base( n, 1 );
+    for( int i=0; i<n; i++ )
+    {
+        T diag = T(0);
+        for( int p=ptr[i]; p<ptr[i+1] && idx[p]<=i; p++ )
+        {
+            if( idx[p]==i )
+            {
+                diag = val[p];
+                continue;
+            }
+            lidx->push_back( idx[p] );
+            lval->push_back( val[p] );
+        }
+        lidx->push_back( i );
+        lval->push_back( diag );
+        if( std::abs( diag )>0 ) shift_base[i] = std::abs( diag );
+        (*lptr)[i+1] = (int)lidx->size();
+    }
+
+    /// IC(0) of A + a diag(A) for a = 0, then 1e-3 doubling until it goes through
+    std::vector<T> a_val( *lval );
+    std::vector<int> pos( n, -1 );
+    real_type shift = 0;
+    for( int attempt=0; attempt<ICHOL_MAX_SHIFTS; attempt++ )
+    {
+        if( attempt>0 )
+        {
+            shift = ( shift==0 ) ? real_type(1e-3) : 2*shift;
+            *lval = a_val;
+            for( int i=0; i<n; i++ )
+                (*lval)[(*lptr)[i+1]-1] += shift * shift_base[i];
+            std::fill( pos.begin(), pos.end(), -1 );
+        }
+        if( ichol_rows( n, *lptr, *lidx, *lval, pos )==0 ) break;
+        if( attempt==ICHOL_MAX_SHIFTS-1 )
+        {
+            std::cerr << "ichol_preconditioner: no shift gives a factor, using Jacobi" << std::endl;
+            return jacobi_preconditioner( csr );
+        }
+    }
+
+    /// L y = x forward by rows, then L^* y = y backward with the rows of L as the
+    /// columns of L^*
+    return BasicLinearOperator<T>( n, [lptr, lidx, lval, n]( const T* x, T* y ){
+        const int* lp = lptr->data();
+        const int* li = lidx->data();
+        const T* lv = lval->data();
+        for( int i=0; i<n; i++ )
+        {
+            T s = x[i];
+            for( int p=lp[i]; p<lp[i+1]-1; p++ )
+                s -= lv[p] * y[li[p]];
+            y[i] = s / lv[lp[i+1]-1];
+        }
+        for( int i=n-1; i>=0; i-- )
+        {
+            T yi = y[i] / lv[lp[i+1]-1];
+            y[i] = yi;
+            for( int p=lp[i]; p<lp[i+1]-1; p++ )
+                y[li[p]] -= scalar_conj( lv[p] ) * yi;
+        }
+    } );
+}
+
+template<typename T>
+BasicKrylovSolver<T>::BasicKrylovSolver()
+:   _tol( std::is_same<real_type, float>::value ? real_type(1e-5) : real_type(1e-8) ),
+    _max_iters(1000),
+    _restart(30),
+    _iters(0),
+    _residual(0)
+{
+}
+
+template<typename T>
+BasicKrylovSolver<T>::BasicKrylovSolver( const OperatorType& op )
+:   BasicKrylovSolver()
+{
+    _op = op;
+}
+
+template<typename T>
+void BasicKrylovSolver<T>::set_operator( const OperatorType& op )
+{
+    _op = op;
+}
+
+template<typename T>
+void BasicKrylovSolver<T>::set_preconditioner( const OperatorType& precond )
+{
+    assert( precond.empty() || precond.n()==_op.n() );
+    _precond = precond;
+}
+
+template<typename T>
+void BasicKrylovSolver<T>::set_tolerance( real_type tol )
+{
+    _tol = tol;
+}
+
+template<typename T>
+void BasicKrylovSolver<T>::set_max_iterations( int max_iters )
+{
+    _max_iters = max_iters;
+}
+
+template<typename T>
+void BasicKrylovSolver<T>::set_restart( int restart )
+{
+    _restart = std::max( restart, 1 );
+}
+
+template<typename T>
+int BasicKrylovSolver<T>::cg_vec( const T* b, T* x, int& iters, real_type& residual )
+{
+    int n = _op.n();
+    iters = 0;
+    residual = 0;
+    real_type b_norm = std::sqrt( norm2_sq( n, b ) );
+    if( b_norm==0 )
+    {
+        std::fill( x, x+n, T(0) );
+        return 0;
+    }
+    real_type target = _tol * b_norm;
+    bool pre = !_precond.empty();
+    std::vector<T> r( n ), p( n ), q( n ), z( pre ? n : 0 );
+
+    _op.apply( x, r.data() );
+    real_type rr = sub_from( n, b, r.data() );
+    const T* zd = r.data();
+    real_type rz = rr;
+    if( pre )
+    {
+        _precond.apply( r.data(), z.data() );
+        zd = z.data();
+        rz = scalar_real( dotc( n, r.data(), zd ) );
+    }
+    std::copy( zd, zd+n, p.data() );
+
+    while( std::sqrt( rr )>target && iters<_max_iters )
+    {
+        _op.apply( p.data(), q.data() );
+        iters++;
+        real_type pq = scalar_real( dotc( n, p.data(), q.data() ) );
+        /// A or M^-1 is not positive definite along p
+        if( !( pq>0 ) || !( rz>0 ) ) break;
+        T alpha = T( rz / pq );
+        rr = cg_update( n, alpha, p.data(), q.data(), x, r.data() );
+        if( std::sqrt( rr )<=target ) break;
+        real_type rz_new = rr;
+        if( pre )
+        {
+            _precond.apply( r.data(), z.data() );
+            rz_new = scalar_real( dotc( n, r.data(), zd ) );
+        }
+        xpay( n, zd, T( rz_new / rz ), p.data() );
+        rz = rz_new;
+    }
+    residual = std::sqrt( rr ) / b_norm;
+    return ( residual<=_tol ) ? 0 : -1;
+}
+
+template<typename T>
+int BasicKrylovSolver<T>::gmres_vec( const T* b, T* x, int& iters, real_type& residual )
+{
+    int n = _op.n();
+    iters = 0;
+    residual = 0;
+    real_type b_norm = std::sqrt( norm2_sq( n, b ) );
+    if( b_norm==0 )
+    {
+        std::fill( x, x+n, T(0) );
+        return 0;
+    }
+    real_type target = _tol * b_norm;
+    bool pre = !_precond.empty();
+    int m = std::min( _restart, n );
+    /// the basis by rows, H by columns of m+1, the rotations and the rotated rhs
+    std::vector<T> v( (std::size_t)( m+1 )*n ), h( (std::size_t)( m+1 )*m ), h2( m+1 );
+    std::vector<real_type> cs( m );
+    std::vector<T> sn( m ), g( m+1 ), y( m ), u( n ), w( pre ? n : 0 );
+
+    _op.apply( x, v.data() );
+    real_type beta = std::sqrt( sub_from( n, b, v.data() ) );
+    while( beta>target && iters<_max_iters )
+    {
+        scale( n, T( 1/beta ), v.data() );
+        std::fill( g.begin(), g.end(), T(0) );
+        g[0] = beta;
+        int j = 0;
+        while( j<m && iters<_max_iters )
+        {
+            const T* vj = v.data() + (std::size_t)j*n;
+            T* vn = v.data() + (std::size_t)( j+1 )*n;
+            T* hj = h.data() + (std::size_t)j*( m+1 );
+            if( pre )
+            {
+                _precond.apply( vj, w.data() );
+                _op.apply( w.data(), vn );
+            }
+            else _op.apply( vj, vn );
+            iters++;
+
+            /// classical Gram-Schmidt twice: as stable as the modified one, but each
+            /// pass is one sweep over the basis instead of j+1
+            multi_dotc( j+1, v.data(), n, vn, hj );
+            multi_sub( j+1, v.data(), n, hj, vn );
+            multi_dotc( j+1, v.data(), n, vn, h2.data() );
+            real_type h_next = std::sqrt( multi_sub( j+1, v.data(), n, h2.data(), vn ) );
+            for( int i=0; i<=j; i++ )
+                hj[i] += h2[i];
+            hj[j+1] = h_next;
+
+            for( int i=0; i<j; i++ )
+                apply_givens( cs[i], sn[i], hj[i], hj[i+1] );
+            make_givens( hj[j], hj[j+1], cs[j], sn[j] );
+            apply_givens( cs[j], sn[j], hj[j], hj[j+1] );
+            apply_givens( cs[j], sn[j], g[j], g[j+1] );
+            j++;
+            /// an invariant subspace: the solution lies in the basis built so far
+            if( h_next==0 ) break;
+            scale( n, T( 1/h_next ), vn );
+            if( std::abs( g[j] )<=target ) break;
+        }
+
+        /// y = H^-1 g on the leading j x j triangle, x += M^-1 V y
+        for( int i=j-1; i>=0; i-- )
+        {
+            T s = g[i];
+            for( int l=i+1; l<j; l++ )
+                s -= h[(std::size_t)l*( m+1 ) + i] * y[l];
+            T d = h[(std::size_t)i*( m+1 ) + i];
+            y[i] = ( d==T(0) ) ? T(0) : s / d;
+        }
+        combine( j, v.data(), n, y.data(), u.data() );
+        if( pre )
+        {
+            _precond.apply( u.data(), w.data() );
+            axpy( n, T(1), w.data(), 1, x, 1 );
+        }
+        else axpy( n, T(1), u.data(), 1, x, 1 );
+
+        /// restart from the true residual, which the rotated rhs only estimates
+        _op.apply( x, v.data() );
+        real_type beta_new = std::sqrt( sub_from( n, b, v.data() ) );
+        /// no progress over a whole cycle: A is singular on the Krylov space
+        if( !( beta_new<beta ) && j==m )
+        {
+            beta = beta_new;
+            break;
+        }
+        beta = beta_new;
+    }
+    residual = beta / b_norm;
+    return ( residual<=_tol ) ? 0 : -1;
+}
+
+template<typename T>
+int BasicKrylovSolver<T>::solve_columns( const ConstViewType& b, MatrixType& x,
+                                         int (BasicKrylovSolver::*method)( const T*, T*, int&, real_type& ) )
+{
+    int n = _op.n();
+    assert( !_op.empty() && b.n_row()==n );
+    int k = b.n_col();
+    if( x.n_row()!=n || x.n_col()!=k ) x.resize( n, k );
+    _iters = 0;
+    _residual = 0;
+    int res = 0;
+    std::vector<T> bc( n ), xc( n );
+    for( int c=0; c<k; c++ )
+    {
+        for( int i=0; i<n; i++ )
+        {
+            bc[i] = b.data()[(std::size_t)i*b.ld() + c];
+            xc[i] = x( i, c );
+        }
+        int iters;
+        real_type residual;
+        if( (this->*method)( bc.data(), xc.data(), iters, residual )!=0 ) res = -1;
+        for( int i=0; i<n; i++ )
+            x( i, c ) = xc[i];
+        _iters = std::max( _iters, iters );
+        _residual = std::max( _residual, residual );
+    }
+    return res;
+}
+
+template<typename T>
+int BasicKrylovSolver<T>::cg( const ConstViewType& b, MatrixType& x )
+{
+    return solve_columns( b, x, &BasicKrylovSolver::cg_vec );
+}
+
+template<typename T>
+int BasicKrylovSolver<T>::gmres( const ConstViewType& b, MatrixType& x )
+{
+    return solve_columns( b, x, &BasicKrylovSolver::gmres_vec );
+}
+
+template<typename T>
+typename BasicKrylovSolver<T>::MatrixType BasicKrylovSolver<T>::solve_cg( const ConstViewType& b )
+{
+    MatrixType x;
+    cg( b, x );
+    return x;
+}
+
+template<typename T>
+typename BasicKrylovSolver<T>::MatrixType BasicKrylovSolver<T>::solve_gmres( const ConstViewType& b )
+{
+    MatrixType x;
+    gmres( b, x );
+    return x;
+}
+
+#define MX_INSTANTIATE_KRYLOV(T) \
+    template class BasicLinearOperator<T>; \
+    template class BasicKrylovSolver<T>; \
+    template BasicLinearOperator<T> jacobi_preconditioner( const BasicMatrix<T>& ); \
+    template BasicLinearOperator<T> jacobi_preconditioner( const BasicSparseMatrix<T>& ); \
+    template BasicLinearOperator<T> block_jacobi_preconditioner( const BasicMatrix<T>&, int ); \
+    template BasicLinearOperator<T> block_jacobi_preconditioner( const BasicSparseMatrix<T>&, int ); \
+    template BasicLinearOperator<T> ichol_preconditioner( const BasicSparseMatrix<T>& );
+
+MX_INSTANTIATE_KRYLOV(float)
+MX_INSTANTIATE_KRYLOV(double)
+MX_INSTANTIATE_KRYLOV(std::complex<float>)
+MX_INSTANTIATE_KRYLOV(std::complex<double>)
+
+}
@@ -0,0 +1,137 @@
+#ifndef _MX_KRYLOV_H
+#define _MX_KRYLOV_H
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "matrix.h"
+#include "scalar.h"
+#include "sparse_matrix.h"
+
+namespace mx
+{
+
+/// y = A x for an n x n operator known only by its product, the common interface of
+/// the Krylov solvers and their preconditioners. The dense and sparse constructors keep
+/// a reference: the matrix must outlive the operator and every copy of it
+template<typename T>
+class BasicLinearOperator
+{
+public:
+    typedef BasicMatrix<T> MatrixType;
+    typedef BasicSparseMatrix<T> SparseMatrixType;
+    /// apply( x, y ) writes the n entries of y, x and y never overlap
+    typedef std::function<void( const T* x, T* y )> ApplyFn;
+
+private:
+    int _n;
+    ApplyFn _apply;
+
+public:
+    BasicLinearOperator() : _n(0) {}
+    BasicLinearOperator( int n, ApplyFn apply ) : _n(n), _apply( std::move( apply ) ) {}
+
+    int n() const { return _n; }
+    bool empty() const { return !_apply; }
+    void apply( const T* x, T* y ) const { _apply( x, y ); }
+
+    /* in krylov.cpp */
+    /// a square dense matrix, rows split over thread_pool() once it is large
+    BasicLinearOperator( const MatrixType& mat );
+    /// a square sparse matrix in either layout, see BasicSparseMatrix::multiply
+    BasicLinearOperator( const SparseMatrixType& mat );
+};
+
+/// M^-1 = diag(A)^-1, zero diagonal entries taken as 1
+template<typename T>
+BasicLinearOperator<T> jacobi_preconditioner( const BasicMatrix<T>& mat );
+template<typename T>
+BasicLinearOperator<T> jacobi_preconditioner( const BasicSparseMatrix<T>& mat );
+/// M^-1 = the inverses of the diagonal blocks of A of size block_size (the last one
+/// smaller), formed once by LU and applied as small products over thread_pool(); a
+/// singular block falls back to its diagonal
+template<typename T>
+BasicLinearOperator<T> block_jacobi_preconditioner( const BasicMatrix<T>& mat, int block_size );
+template<typename T>
+BasicLinearOperator<T> block_jacobi_preconditioner( const BasicSparseMatrix<T>& mat, int block_size );
+/// M^-1 = (L L^*)^-1 with L the incomplete Cholesky factor of a Hermitian positive
+/// definite A on the pattern of its lower triangle, IC(0). A pivot that is not positive
+/// restarts the factorization of A + a diag(A) with a growing a, so a factor is always
+/// found; the operator owns L
+template<typename T>
+BasicLinearOperator<T> ichol_preconditioner( const BasicSparseMatrix<T>& mat );
+
+/// conjugate gradients and restarted GMRES on a BasicLinearOperator, the iterative
+/// counterpart of BasicLinearSolver for matrices too large to factor or known only by
+/// their product. Both stop once ||b - A x|| <= tol ||b|| for each column of b, or after
+/// max_iterations products with A. A preconditioner is any operator applying M^-1:
+/// CG uses it on both sides and needs it Hermitian positive definite, GMRES on the
+/// right so the residual it watches is the one of A x = b.
+/// The vector updates are fused so that each iteration makes as few passes over memory
+/// as the method allows, and run over thread_pool() for long vectors.
+/// Instantiated in krylov.cpp for float, double and their complex forms
+template<typename T>
+class BasicKrylovSolver
+{
+public:
+    typedef BasicLinearOperator<T> OperatorType;
+    typedef BasicMatrix<T> MatrixType;
+    typedef BasicConstMatrixView<T> ConstViewType;
+    typedef RealType<T> real_type;
+
+private:
+    OperatorType _op;
+    OperatorType _precond;
+    real_type _tol;
+    int _max_iters;
+    int _restart;
+    int _iters;
+    real_type _residual;
+
+    /// one column: x updated in place, the products and relative residual returned
+    int cg_vec( const T* b, T* x, int& iters, real_type& residual );
+    int gmres_vec( const T* b, T* x, int& iters, real_type& residual );
+    int solve_columns( const ConstViewType& b, MatrixType& x,
+                       int (BasicKrylovSolver::*method)( const T*, T*, int&, real_type& ) );
+
+public:
+    BasicKrylovSolver();
+    explicit BasicKrylovSolver( const OperatorType& op );
+    void set_operator( const OperatorType& op );
+    /// M^-1, or an empty operator for none
+    void set_preconditioner( const OperatorType& precond );
+    /// relative residual to reach, 1e-8 by default (1e-5 for float)
+    void set_tolerance( real_type tol );
+    /// products with A per column of b, 1000 by default
+    void set_max_iterations( int max_iters );
+    /// GMRES basis size before a restart, 30 by default
+    void set_restart( int restart );
+
+    /// A Hermitian positive definite. x is the starting guess if it has the shape of b
+    /// and starts from zero otherwise; 0 if every column converged, -1 if not
+    int cg( const ConstViewType& b, MatrixType& x );
+    /// any nonsingular A, same conventions as cg
+    int gmres( const ConstViewType& b, MatrixType& x );
+    MatrixType solve_cg( const ConstViewType& b );
+    MatrixType solve_gmres( const ConstViewType& b );
+
+    /// largest over the columns of the last solve
+    int get_iterations() const { return _iters; }
+    /// largest ||b - A x|| / ||b|| over the columns of the last solve
+    real_type get_residual() const { return _residual; }
+};
+
+typedef BasicLinearOperator<double> LinearOperator;
+typedef BasicLinearOperator<float> LinearOperatorF;
+typedef BasicLinearOperator< std::complex<double> > LinearOperatorZ;
+typedef BasicLinearOperator< std::complex<float> > LinearOperatorC;
+
+typedef BasicKrylovSolver<double> KrylovSolver;
+typedef BasicKrylovSolver<float> KrylovSolverF;
+typedef BasicKrylovSolver< std::complex<double> > KrylovSolverZ;
+typedef BasicKrylovSolver< std::complex<float> > KrylovSolverC;
+
+}
+
+#endif
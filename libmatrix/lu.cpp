@@ -1,33 +1,494 @@
 #include "lu.h"
+#include "blas.h"
+#include "matrix_file.h"
+#include "task_graph.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
 
 namespace mx
 {
 
-LinearSolver::LinearSolver()
+template<typename T>
+void lu_swap_rows( int n, T* a, int lda, const int* ipiv, int k0, int kb, int c0, int c1 )
+{
+    /// apply the row swaps of the panel at k0 to columns [c0, c1)
+    for( int k=k0; k<k0+kb && k<n-1; k++ )
+        if( ipiv[k]!=k )
+            std::swap_ranges( a + k*lda + c0, a + k*lda + c1, a + ipiv[k]*lda + c0 );
+}
+
+template<typename T>
+int lu_panel_partial( int n, T* a, int lda, int* ipiv, int k0, int kb, bool recurse )
+{
+    /// partial pivoting LU of the panel a[ k0:n, k0:k0+kb ], row swaps only
+    /// touch the panel columns; wide panels recurse on halves so most of the work is GEMM
+    if( recurse && kb>16 )
+    {
+        int k1 = k0 + kb/2;
+        int kb2 = k0+kb-k1;
+        if( lu_panel_partial( n, a, lda, ipiv, k0, k1-k0, recurse )!=0 ) return -1;
+        lu_swap_rows( n, a, lda, ipiv, k0, k1-k0, k1, k0+kb );
+        trsm_left( true, false, true, k1-k0, kb2, a + k0*lda + k0, lda, a + k0*lda + k1, lda );
+        gemm( false, false, n-k1, kb2, k1-k0, T(-1), a + k1*lda + k0, lda, a + k0*lda + k1, lda, T(1), a + k1*lda + k1, lda );
+        if( lu_panel_partial( n, a, lda, ipiv, k1, kb2, recurse )!=0 ) return -1;
+        lu_swap_rows( n, a, lda, ipiv, k1, kb2, k0, k1 );
+        return 0;
+    }
+
+    for( int k=k0; k<k0+kb && k<n-1; k++ )
+    {
+        int m = k;
+        RealType<T> max_val = std::abs( a[k*lda+k] );
+        for( int i=k+1; i<n; i++ )
+        {
+            if( std::abs( a[i*lda+k] ) > max_val )
+            {
+                max_val = std::abs( a[i*lda+k] );
+                m = i;
+            }
+        }
+        ipiv[k] = m;
+        if( m!=k )
+            std::swap_ranges( a + k*lda + k0, a + k*lda + k0+kb, a + m*lda + k0 );
+
+        T pivot = a[k*lda+k];
+        if( pivot==T(0) ) return -1;
+        for( int i=k+1; i<n; i++ )
+        {
+            T* ai = a + i*lda;
+            ai[k] = ai[k] / pivot;
+            for( int j=k+1; j<k0+kb; j++ )
+                ai[j] -= ai[k] * a[k*lda+j];
+        }
+    }
+    return 0;
+}
+
+namespace
+{
+
+/// refinement steps before MIXED_LU gives up and refactors in full precision
+constexpr int REFINE_MAX_ITERS = 30;
+
+/// default rank cutoff in units of n*eps*|u00|, rook pivots grow a little more than complete ones
+constexpr int RANK_EPS_FACTOR = 8;
+
+/// save_factors file: this header, perm and q_perm as int32, the n x n entries of
+/// _mat and for MIXED_LU the n x n low precision factors, all in native byte order
+struct FactorFileHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t dtype;
+    std::int64_t n;
+    std::uint32_t status;
+    std::uint32_t mode;
+    std::int64_t rank;
+    double norm_a;
+    double refine_tol;
+    std::uint64_t checksum;
+    std::uint64_t reserved;
+};
+static_assert( sizeof(FactorFileHeader)==72, "FactorFileHeader must be 72 bytes" );
+
+constexpr char FACTOR_FILE_MAGIC[8] = { 'M', 'X', 'F', 'A', 'C', 'T', 'O', 'R' };
+constexpr std::uint32_t FACTOR_FILE_VERSION = 1;
+
+/// the status / mode pairs save_factors can write
+bool factor_mode_valid( std::uint32_t status, std::uint32_t mode )
+{
+    if( status==CHOLE_SUCCESS ) return mode==CHOLE;
+    return status==LU_SUCCESS && ( mode==PARTIAL_LU || mode==COMPLETE_LU || mode==MIXED_LU
+                                   || mode==ROOK_LU || mode==CALU );
+}
+
+std::uint64_t factor_checksum( const std::vector<std::int32_t>& p, const std::vector<std::int32_t>& q,
+                               const void* mat, std::size_t mat_bytes, const void* low, std::size_t low_bytes )
+{
+    std::uint64_t h = checksum64( p.data(), p.size()*sizeof(std::int32_t) );
+    h = h*31 + checksum64( q.data(), q.size()*sizeof(std::int32_t) );
+    h = h*31 + checksum64( mat, mat_bytes );
+    return h*31 + checksum64( low, low_bytes );
+}
+
+template<typename T>
+int lu_blocked_partial( int n, T* a, int lda, int* ipiv, int block_size )
+{
+    /// right-looking blocked LU: panel factorization, row swaps, TRSM for the
+    /// U row block, GEMM for the trailing matrix
+    int nb = ( block_size>1 ) ? block_size : n;
+    for( int k0=0; k0<n; k0+=nb )
+    {
+        int kb = std::min( nb, n-k0 );
+        if( lu_panel_partial( n, a, lda, ipiv, k0, kb, block_size>1 )!=0 ) return -1;
+
+        /// apply the panel's row swaps left and right of it
+        lu_swap_rows( n, a, lda, ipiv, k0, kb, 0, k0 );
+        lu_swap_rows( n, a, lda, ipiv, k0, kb, k0+kb, n );
+
+        int k1 = k0+kb;
+        if( k1>=n ) break;
+        trsm_left( true, false, true, kb, n-k1, a + k0*lda + k0, lda, a + k0*lda + k1, lda );
+        gemm( false, false, n-k1, n-k1, kb, T(-1), a + k1*lda + k0, lda, a + k0*lda + k1, lda, T(1), a + k1*lda + k1, lda );
+    }
+    return 0;
+}
+
+template<typename T>
+void tslu_select( int m, int kb, T* buf, int* idx )
+{
+    /// GEPP on the m x kb row-major block buf, carrying idx along with the rows; the
+    /// first min(m, kb) entries of idx end up as the rows it picked, buf is scratch.
+    /// A zero column is skipped rather than failing, another block may still supply it
+    for( int k=0; k<std::min( m, kb ); k++ )
+    {
+        int p = k;
+        RealType<T> max_val = std::abs( buf[k*kb+k] );
+        for( int i=k+1; i<m; i++ )
+        {
+            if( std::abs( buf[i*kb+k] ) > max_val )
+            {
+                max_val = std::abs( buf[i*kb+k] );
+                p = i;
+            }
+        }
+        if( p!=k )
+        {
+            std::swap_ranges( buf + k*kb, buf + (k+1)*kb, buf + p*kb );
+            std::swap( idx[k], idx[p] );
+        }
+        T pivot = buf[k*kb+k];
+        if( pivot==T(0) ) continue;
+        for( int i=k+1; i<m; i++ )
+        {
+            T l = buf[i*kb+k] / pivot;
+            for( int j=k+1; j<kb; j++ )
+                buf[i*kb+j] -= l * buf[k*kb+j];
+        }
+    }
+}
+
+template<typename T>
+int lu_panel_calu( int n, T* a, int lda, int* ipiv, int k0, int kb )
+{
+    /// tournament pivoting for the panel a[ k0:n, k0:k0+kb ]: every row block picks kb
+    /// candidate rows by GEPP on a copy of itself, then pairs of candidate sets play off
+    /// up a binary tree, each round GEPP on the 2 kb original rows of the two sets. The
+    /// winners are swapped to the top and the panel is factored without pivoting, so
+    /// the blocks only meet once per tree level instead of once per column
+    ThreadPool& pool = thread_pool();
+    int m = n - k0;
+    int n_leaves = std::max( 1, std::min( m/(2*kb), std::max( 4, 2*pool.size() ) ) );
+    std::vector< std::vector<int> > cand( n_leaves );
+    auto play = [&]( std::vector<int>& rows )
+    {
+        int mr = (int)rows.size();
+        std::vector<T> buf( (size_t)mr*kb );
+        for( int i=0; i<mr; i++ )
+            std::copy( a + (size_t)rows[i]*lda + k0, a + (size_t)rows[i]*lda + k0 + kb, buf.data() + (size_t)i*kb );
+        tslu_select( mr, kb, buf.data(), rows.data() );
+        rows.resize( std::min( mr, kb ) );
+    };
+    auto leaf_begin = [&]( int b ){ return k0 + (int)( (long)m*b/n_leaves ); };
+
+    pool.parallel_for( n_leaves, [&]( int b )
+    {
+        for( int i=leaf_begin( b ); i<leaf_begin( b+1 ); i++ )
+            cand[b].push_back( i );
+        play( cand[b] );
+    } );
+    for( int step=1; step<n_leaves; step*=2 )
+    {
+        int n_games = ( n_leaves + 2*step - 1 ) / ( 2*step );
+        pool.parallel_for( n_games, [&]( int g )
+        {
+            int left = 2*g*step, right = left + step;
+            if( right>=n_leaves ) return;
+            cand[left].insert( cand[left].end(), cand[right].begin(), cand[right].end() );
+            play( cand[left] );
+        } );
+    }
+
+    /// bring the winners to rows k0.. in order, as a sequence of swaps of the panel rows
+    std::vector<int> row_at( m ), pos_of( m );
+    std::iota( row_at.begin(), row_at.end(), 0 );
+    std::iota( pos_of.begin(), pos_of.end(), 0 );
+    const std::vector<int>& win = cand[0];
+    for( int i=0; i<kb; i++ )
+    {
+        int p = pos_of[ win[i]-k0 ];
+        ipiv[k0+i] = k0 + p;
+        if( p==i ) continue;
+        std::swap_ranges( a + (size_t)( k0+i )*lda + k0, a + (size_t)( k0+i )*lda + k0 + kb, a + (size_t)( k0+p )*lda + k0 );
+        std::swap( row_at[i], row_at[p] );
+        pos_of[ row_at[i] ] = i;
+        pos_of[ row_at[p] ] = p;
+    }
+
+    /// LU of the kb x kb block without pivoting, then L21 = A21 U11^-1 by row blocks
+    T* d = a + (size_t)k0*lda + k0;
+    for( int k=0; k<kb; k++ )
+    {
+        T pivot = d[k*lda+k];
+        if( pivot==T(0) )
+        {
+            if( k0+k<n-1 ) return -1;
+            continue;
+        }
+        for( int i=k+1; i<kb; i++ )
+        {
+            d[i*lda+k] = d[i*lda+k] / pivot;
+            for( int j=k+1; j<kb; j++ )
+                d[i*lda+j] -= d[i*lda+k] * d[k*lda+j];
+        }
+    }
+    int k1 = k0 + kb;
+    if( k1>=n ) return 0;
+    int n_blocks = std::max( 1, std::min( ( n-k1 )/kb, 4*pool.size() ) );
+    pool.parallel_for( n_blocks, [&]( int b )
+    {
+        int r0 = k1 + (int)( (long)( n-k1 )*b/n_blocks );
+        int r1 = k1 + (int)( (long)( n-k1 )*( b+1 )/n_blocks );
+        trsm_right( false, false, false, r1-r0, kb, d, lda, a + (size_t)r0*lda + k0, lda );
+    } );
+    return 0;
+}
+
+template<typename T>
+int lu_blocked_calu( int n, T* a, int lda, int* ipiv, int block_size )
+{
+    /// lu_blocked_partial with the panels pivoted by tournament
+    int nb = ( block_size>1 ) ? block_size : n;
+    for( int k0=0; k0<n; k0+=nb )
+    {
+        int kb = std::min( nb, n-k0 );
+        if( lu_panel_calu( n, a, lda, ipiv, k0, kb )!=0 ) return -1;
+
+        lu_swap_rows( n, a, lda, ipiv, k0, kb, 0, k0 );
+        lu_swap_rows( n, a, lda, ipiv, k0, kb, k0+kb, n );
+
+        int k1 = k0+kb;
+        if( k1>=n ) break;
+        trsm_left( true, false, true, kb, n-k1, a + k0*lda + k0, lda, a + k0*lda + k1, lda );
+        gemm( false, false, n-k1, n-k1, kb, T(-1), a + k1*lda + k0, lda, a + k0*lda + k1, lda, T(1), a + k1*lda + k1, lda );
+    }
+    return 0;
+}
+
+template<typename T>
+int lu_logical_pivot( int n, T* a, int* perm, int* q_perm, bool rook )
+{
+    /// complete or rook pivoting LU of the n x n row-major a in place; an exchange only
+    /// swaps two entries of the index maps, logical (i,j) lives at a[ rows[i]*n + cols[j] ],
+    /// and the factors are gathered into logical order once at the end.
+    /// Complete pivoting keeps the max abs entry of every trailing column, refreshed by
+    /// the update that rewrites the column anyway, so a pivot is found in O(n); rook
+    /// pivoting keeps no summaries and scans one column and one row at a time until an
+    /// entry is the largest of both. Returns the number of nonzero pivots, the trailing
+    /// block after them is exactly zero and left as it is.
+    typedef RealType<T> R;
+    std::vector<int> rows( n ), cols( n );
+    std::iota( rows.begin(), rows.end(), 0 );
+    std::iota( cols.begin(), cols.end(), 0 );
+    std::iota( perm, perm + n, 0 );
+    std::iota( q_perm, q_perm + n, 0 );
+    auto at = [&]( int i, int j ) -> T& { return a[ (size_t)rows[i]*n + cols[j] ]; };
+
+    /// max abs of the trailing part of each physical column and its first logical row
+    std::vector<R> col_max( rook ? 0 : n, R(0) );
+    std::vector<int> col_arg( rook ? 0 : n, 0 );
+    if( !rook )
+    {
+        for( int i=0; i<n; i++ )
+            for( int j=0; j<n; j++ )
+                if( std::abs( a[ (size_t)i*n + j ] ) > col_max[j] )
+                {
+                    col_max[j] = std::abs( a[ (size_t)i*n + j ] );
+                    col_arg[j] = i;
+                }
+    }
+
+    int r = n;
+    for( int k=0; k<n; k++ )
+    {
+        int m = k, q = k;
+        if( k<n-1 && !rook )
+        {
+            /// ties go to the smallest row, then column, as a row-major scan would
+            R best = col_max[ cols[k] ];
+            m = col_arg[ cols[k] ];
+            for( int j=k+1; j<n; j++ )
+            {
+                R v = col_max[ cols[j] ];
+                if( v>best || ( v==best && col_arg[ cols[j] ]<m ) )
+                {
+                    best = v;
+                    m = col_arg[ cols[j] ];
+                    q = j;
+                }
+            }
+        }
+        else if( k<n-1 )
+        {
+            R best = std::abs( at(k,k) );
+            for( int i=k+1; i<n; i++ )
+                if( std::abs( at(i,q) ) > best ) { best = std::abs( at(i,q) ); m = i; }
+            for( bool by_row=true; ; by_row=!by_row )
+            {
+                int m2 = m, q2 = q;
+                R b2 = best;
+                if( by_row )
+                {
+                    for( int j=k; j<n; j++ )
+                        if( std::abs( at(m,j) ) > b2 ) { b2 = std::abs( at(m,j) ); q2 = j; }
+                }
+                else
+                {
+                    for( int i=k; i<n; i++ )
+                        if( std::abs( at(i,q) ) > b2 ) { b2 = std::abs( at(i,q) ); m2 = i; }
+                }
+                if( !( b2>best ) ) break;
+                best = b2;
+                m = m2;
+                q = q2;
+            }
+        }
+        std::swap( rows[k], rows[m] );
+        std::swap( cols[k], cols[q] );
+        perm[k] = m;
+        q_perm[k] = q;
+
+        T pivot = at(k,k);
+        if( pivot==T(0) )
+        {
+            r = k;
+            break;
+        }
+        if( k==n-1 ) break;
+
+        const T* ak = a + (size_t)rows[k]*n;
+        if( !rook )
+        {
+            for( int j=k+1; j<n; j++ )
+            {
+                col_max[ cols[j] ] = R(0);
+                col_arg[ cols[j] ] = k+1;
+            }
+        }
+        for( int i=k+1; i<n; i++ )
+        {
+            T* ai = a + (size_t)rows[i]*n;
+            T l = ai[ cols[k] ] / pivot;
+            ai[ cols[k] ] = l;
+            if( rook )
+            {
+                for( int j=k+1; j<n; j++ )
+                    ai[ cols[j] ] = ai[ cols[j] ] - l*ak[ cols[j] ];
+                continue;
+            }
+            for( int j=k+1; j<n; j++ )
+            {
+                int c = cols[j];
+                ai[c] = ai[c] - l*ak[c];
+                R v = std::abs( ai[c] );
+                if( v>col_max[c] )
+                {
+                    col_max[c] = v;
+                    col_arg[c] = i;
+                }
+            }
+        }
+    }
+
+    std::vector<T> res( (size_t)n*n );
+    for( int i=0; i<n; i++ )
+        for( int j=0; j<n; j++ )
+            res[ (size_t)i*n + j ] = at(i,j);
+    std::copy( res.begin(), res.end(), a );
+    return r;
+}
+
+}
+
+template<typename T>
+BasicLinearSolver<T>::BasicLinearSolver()
 :   status(EMPTY),
     mode(NONE),
-    abs_threshold(1e-16),
-    _rank(-1)
+    abs_threshold( RANK_EPS_FACTOR*std::numeric_limits<real_type>::epsilon() ),
+    _rank(-1),
+    block_size(128),
+    _norm_a(0.0),
+    refine_tol(0.0),
+    refine_iters(0),
+    _upd_limit(32)
 {
 }
 
-LinearSolver::LinearSolver( const Matrix& mat )
+template<typename T>
+BasicLinearSolver<T>::BasicLinearSolver( const MatrixType& mat )
 :   status(EMPTY),
     mode(NONE),
-    abs_threshold(1e-16),
-    _rank(-1)
+    abs_threshold( RANK_EPS_FACTOR*std::numeric_limits<real_type>::epsilon() ),
+    _rank(-1),
+    block_size(128),
+    _norm_a(0.0),
+    refine_tol(0.0),
+    refine_iters(0),
+    _upd_limit(32)
 {
     set_matrix(mat);
 }
 
-void LinearSolver::set_matrix( const Matrix& mat )
+template<typename T>
+BasicLinearSolver<T>::BasicLinearSolver( const SymMatrixType& mat )
+:   status(EMPTY),
+    mode(NONE),
+    abs_threshold( RANK_EPS_FACTOR*std::numeric_limits<real_type>::epsilon() ),
+    _rank(-1),
+    block_size(128),
+    _norm_a(0.0),
+    refine_tol(0.0),
+    refine_iters(0),
+    _upd_limit(32)
+{
+    set_matrix(mat);
+}
+
+template<typename T>
+void BasicLinearSolver<T>::set_matrix( const SymMatrixType& mat )
+{
+    int n = mat.n();
+    if( n<=0 ) return;
+
+    _mat = MatrixType();
+    _sym = mat;
+    perm.resize( n );
+    for( int i=0; i<n; i++ )
+        perm[i] = i;
+    q_perm = perm;
+
+    _rank = -1;
+    _mat_f.clear();
+    clear_updates();
+    mode = NONE;
+    status = MAT_SET;
+}
+
+template<typename T>
+void BasicLinearSolver<T>::set_matrix( const MatrixType& mat )
 {
     auto [row, col] = mat.size();
 
     if( row<=0 || col<=0 ) return;
-    if( row!=col ) return;
 
     _mat = mat;
+    _sym.resize( 0 );
     perm.resize( row );
     for( int i=0; i<row; i++ )
         perm[i] = i;
@@ -37,17 +498,22 @@ void LinearSolver::set_matrix( const Matrix& mat )
         q_perm[i] = i;
 
     _rank = -1;
+    _mat_f.clear();
+    _tau.clear();
+    clear_updates();
+    mode = NONE;
     status = MAT_SET;
 }
 
-int LinearSolver::find_max( int j )
+template<typename T>
+int BasicLinearSolver<T>::find_max( int j )
 {
     /// find the max_abs entris in mat[ j:end, j ]
     int max_idx = j;
-    double max_val = std::abs( _mat(j,j) );
+    real_type max_val = std::abs( _mat(j,j) );
     for( int i=j+1; i<_mat.n_row(); i++ )
     {
-        double val = std::abs( _mat(i,j) );
+        real_type val = std::abs( _mat(i,j) );
         if( val > max_val )
         {
             max_val = val;
@@ -57,18 +523,19 @@ int LinearSolver::find_max( int j )
     return max_idx;
 }
 
-std::tuple<int,int> LinearSolver::find_max_complete( int idx )
+template<typename T>
+std::tuple<int,int> BasicLinearSolver<T>::find_max_complete( int idx )
 {
     /// find the max_abs entris in mat[ idx:end, idx:end ]
     int max_i = idx;
     int max_j = idx;
-    double max_val = std::abs( _mat(idx,idx) );
+    real_type max_val = std::abs( _mat(idx,idx) );
     int n = _mat.n_row();
     for( int i=idx; i<n; i++ )
     {
         for( int j=idx; j<n; j++ )
         {
-            double val = std::abs( _mat(i,j) );
+            real_type val = std::abs( _mat(i,j) );
             if( val > max_val )
             {
                 max_val = val;
@@ -80,146 +547,328 @@ std::tuple<int,int> LinearSolver::find_max_complete( int idx )
     return std::make_tuple( max_i, max_j );
 }
 
-int LinearSolver::lu_decomp_partial()
+template<typename T>
+int BasicLinearSolver<T>::lu_decomp_partial()
 {
-    /// LU decompostition with partial pivoting
+    /// LU decompostition with partial pivoting, right-looking blocked
     auto [row, col] = _mat.size();
     assert( row>0 && col>0 );
     assert( row==col );
 
-    for( int k=0; k<row-1; k++ )
-    {
-        int m = find_max( k );
-        _mat.swap_row( k, m );
-        perm[k] = m;
+    if( lu_blocked_partial( row, _mat.data(), row, perm.data(), block_size )!=0 ) return -1;
+
+    status = LU_SUCCESS;
+    mode = PARTIAL_LU;
+    return 0;
+}
+
+template<typename T>
+int BasicLinearSolver<T>::lu_decomp_calu()
+{
+    /// LU decompostition with tournament pivoting, right-looking blocked
+    auto [row, col] = _mat.size();
+    assert( row>0 && col>0 );
+    assert( row==col );
+
+    if( lu_blocked_calu( row, _mat.data(), row, perm.data(), block_size )!=0 ) return -1;
+
+    status = LU_SUCCESS;
+    mode = CALU;
+    return 0;
+}
 
-        double pivot = _mat(k,k);
-        if( pivot==0.0 ) return -1;
-        for( int i=k+1; i<row; i++ )
-            _mat(i,k) = _mat(i,k) / pivot;
+template<typename T>
+int BasicLinearSolver<T>::lu_decomp_mixed()
+{
+    /// LU decomposition with partial pivoting of a low precision copy of A, A itself
+    /// stays in _mat for the full precision residuals of the refinement
+    auto [row, col] = _mat.size();
+    assert( row>0 && col>0 );
+    assert( row==col );
 
-        for( int i=k+1; i<row; i++ )
-            for( int j=k+1; j<col; j++ )
-                _mat(i,j) = _mat(i,j) - _mat(i,k)*_mat(k,j);
+    int n = row;
+    const T* a = _mat.data();
+    _mat_f.resize( (size_t)n*n );
+    _norm_a = 0.0;
+    for( int i=0; i<n; i++ )
+    {
+        real_type sum = 0.0;
+        for( int j=0; j<n; j++ )
+        {
+            sum += std::abs( a[i*n+j] );
+            _mat_f[i*n+j] = low_type( a[i*n+j] );
+        }
+        _norm_a = std::max( _norm_a, sum );
+    }
+
+    /// entries out of the low precision range or a singular factor: factor in full precision instead
+    bool ok = std::isfinite( _norm_a ) && _norm_a < std::numeric_limits< RealType<low_type> >::max();
+    if( ok && lu_blocked_partial( n, _mat_f.data(), n, perm.data(), block_size )==0 )
+    {
+        for( int i=0; i<n && ok; i++ )
+            ok = scalar_isfinite( _mat_f[i*n+i] );
+    }
+    else
+        ok = false;
+    if( !ok )
+    {
+        _mat_f.clear();
+        for( int i=0; i<n; i++ )
+            perm[i] = i;
+        return lu_decomp_partial();
     }
 
     status = LU_SUCCESS;
-    mode = PARTIAL_LU;
+    mode = MIXED_LU;
     return 0;
 }
 
-int LinearSolver::lu_decomp()
+template<typename T>
+int BasicLinearSolver<T>::lu_decomp_partial_tiled()
 {
-    /// LU decomposition with complete pivoting
+    /// LU decomposition with partial pivoting as a DAG of block_size tiles:
+    /// GETRF on a tile column, row swaps + TRSM on every tile column right of it,
+    /// GEMM on the trailing tiles. Tasks on lower tile columns run first, so the
+    /// next panel is factored while the rest of the trailing matrix is updated.
     auto [row, col] = _mat.size();
     assert( row>0 && col>0 );
     assert( row==col );
 
-    for( int k=0; k<row-1; k++ )
+    int n = row;
+    int nb = ( block_size>1 ) ? block_size : n;
+    int nt = (n+nb-1)/nb;
+    T* a = _mat.data();
+    std::atomic<bool> failed( false );
+
+    auto tile = [nt]( int i, int j ){ return (long)i*nt + j; };
+    auto column = [&]( int k, int j )
     {
-        auto [ m, n ] = find_max_complete( k );
-        _mat.swap_row( k, m );
-        _mat.swap_col( k, n );
-        perm[k] = m;
-        q_perm[k] = n;
+        std::vector<long> ids;
+        for( int i=k; i<nt; i++ ) ids.push_back( tile(i,j) );
+        return ids;
+    };
+
+    TaskGraph graph;
+    for( int k=0; k<nt; k++ )
+    {
+        int k0 = k*nb, kb = std::min( nb, n-k0 );
+        graph.add_task( [&, k0, kb]{
+            if( !failed && lu_panel_partial( n, a, n, perm.data(), k0, kb, block_size>1 )!=0 ) failed = true;
+        }, {}, column(k,k), 3*(nt-k)+2 );
+
+        for( int j=k+1; j<nt; j++ )
+        {
+            int j0 = j*nb, jb = std::min( nb, n-j0 );
+            graph.add_task( [&, k0, kb, j0, jb]{
+                if( failed ) return;
+                lu_swap_rows( n, a, n, perm.data(), k0, kb, j0, j0+jb );
+                trsm_left( true, false, true, kb, jb, a + k0*n + k0, n, a + k0*n + j0, n );
+            }, { tile(k,k) }, column(k,j), 3*(nt-j)+1 );
+        }
 
-        double pivot = _mat(k,k);
-        if( pivot==0.0 ) return -1;
-        for( int i=k+1; i<row; i++ )
-            _mat(i,k) = _mat(i,k) / pivot;
+        for( int i=k+1; i<nt; i++ )
+        {
+            for( int j=k+1; j<nt; j++ )
+            {
+                int i0 = i*nb, ib = std::min( nb, n-i0 );
+                int j0 = j*nb, jb = std::min( nb, n-j0 );
+                graph.add_task( [&, k0, kb, i0, ib, j0, jb]{
+                    if( failed ) return;
+                    gemm( false, false, ib, jb, kb, -1.0, a + i0*n + k0, n, a + k0*n + j0, n, 1.0, a + i0*n + j0, n );
+                }, { tile(i,k), tile(k,j) }, { tile(i,j) }, 3*(nt-j) );
+            }
+        }
 
-        for( int i=k+1; i<row; i++ )
-            for( int j=k+1; j<col; j++ )
-                _mat(i,j) = _mat(i,j) - _mat(i,k)*_mat(k,j);
+        /// the L tiles left of the panel take its swaps once nothing reads them any more
+        for( int j=0; j<k; j++ )
+        {
+            graph.add_task( [&, k0, kb, j]{
+                if( !failed ) lu_swap_rows( n, a, n, perm.data(), k0, kb, j*nb, j*nb+nb );
+            }, { tile(k,k) }, column(k,j), 0 );
+        }
     }
+    graph.execute();
+    if( failed ) return -1;
 
+    status = LU_SUCCESS;
+    mode = PARTIAL_LU;
+    return 0;
+}
+
+template<typename T>
+int BasicLinearSolver<T>::lu_decomp()
+{
+    /// LU decomposition with complete pivoting
+    auto [row, col] = _mat.size();
+    assert( row>0 && col>0 );
+    assert( row==col );
+
+    lu_logical_pivot( row, _mat.data(), perm.data(), q_perm.data(), false );
+    _rank = -1;
     status = LU_SUCCESS;
     mode = COMPLETE_LU;
     return 0;
 }
 
-int LinearSolver::find_max_pivot( int j )
+template<typename T>
+int BasicLinearSolver<T>::lu_decomp_rook()
+{
+    /// LU decomposition with rook pivoting
+    auto [row, col] = _mat.size();
+    assert( row>0 && col>0 );
+    assert( row==col );
+
+    lu_logical_pivot( row, _mat.data(), perm.data(), q_perm.data(), true );
+    _rank = -1;
+    status = LU_SUCCESS;
+    mode = ROOK_LU;
+    return 0;
+}
+
+template<typename T>
+int BasicLinearSolver<T>::find_max_pivot( int j )
 {
     /// find max diagonal element in _mat[ j:end, j:end ]
     int n = _mat.n_row();
     int max_idx = j;
-    double max_val = _mat(j,j);
+    real_type max_val = scalar_real( _mat(j,j) );
     for( j=j+1; j<n; j++ )
     {
-        if( _mat(j,j)>max_val )
+        if( scalar_real( _mat(j,j) )>max_val )
         {
-            max_val = _mat(j,j);
+            max_val = scalar_real( _mat(j,j) );
             max_idx = j;
         }
     }
     return max_idx;
 }
 
-int LinearSolver::chole_decomp_pivoting()
+template<typename T>
+int BasicLinearSolver<T>::chole_decomp_pivoting( real_type tol )
 {
-    /// Cholesky decomposition with pivoting
+    /// Cholesky decomposition with diagonal pivoting, blocked and in place on the lower
+    /// triangle as LAPACK pstrf: within a panel of block_size columns each pivot is the
+    /// largest remaining diagonal, found from the diagonal of A minus the squared norms
+    /// of the panel's L rows so far (the only workspace), and its column is computed
+    /// against the panel; the trailing matrix then takes one SYRK per panel.
+    /// Stops at rank r once the largest remaining diagonal is <= tol, the columns of L
+    /// after r are left zero and rank() reports r
     auto [row, col] = _mat.size();
     assert( row>0 && col>0 );
     assert( row==col );
 
-    Matrix res = Zeros( row );
+    int n = row;
+    T* a = _mat.data();
+    auto at = [&]( int i, int j ) -> T& { return a[ (size_t)i*n + j ]; };
 
-    for( int k=0; k<row; k++ )
-    {
-        int q = find_max_pivot( k );
+    real_type max_diag = 0;
+    for( int i=0; i<n; i++ )
+        max_diag = std::max( max_diag, scalar_real( at(i,i) ) );
+    if( tol<0 )
+        tol = n * std::numeric_limits<real_type>::epsilon() * max_diag;
 
-        if( _mat(q,q)<=0.0 )
+    auto swap_sym = [&]( int p, int q )
+    {
+        /// symmetric exchange of p<q touching the lower triangle only
+        std::swap_ranges( a + (size_t)p*n, a + (size_t)p*n + p, a + (size_t)q*n );
+        std::swap( at(p,p), at(q,q) );
+        for( int j=p+1; j<q; j++ )
         {
-            _rank = k;
-            return -1;
+            T t = at(j,p);
+            at(j,p) = scalar_conj( at(q,j) );
+            at(q,j) = scalar_conj( t );
         }
-
-        res.swap_col(k, q);
-        _mat.swap_col(k, q);
-        _mat.swap_row(k, q);
-        perm[k] = q;
-
-        res(k,k) = std::sqrt( _mat(k,k) );
-        double r = 1.0/res(k,k);
-        for( int j=k+1; j<col; j++ )
+        at(q,p) = scalar_conj( at(q,p) );
+        for( int j=q+1; j<n; j++ )
+            std::swap( at(j,p), at(j,q) );
+    };
+
+    int nb = ( block_size>1 ) ? block_size : n;
+    std::vector<real_type> work( n );
+    int r = n;
+    for( int k0=0; k0<n && r==n; k0+=nb )
+    {
+        int kb = std::min( nb, n-k0 );
+        std::fill( work.begin() + k0, work.end(), real_type(0) );
+        for( int k=k0; k<k0+kb; k++ )
         {
-            res(k,j) = r*_mat(k,j);
+            int q = k;
+            real_type d_max = -std::numeric_limits<real_type>::infinity();
+            for( int j=k; j<n; j++ )
+            {
+                if( k>k0 ) work[j] += scalar_real( at(j,k-1)*scalar_conj( at(j,k-1) ) );
+                real_type d = scalar_real( at(j,j) ) - work[j];
+                if( d>d_max )
+                {
+                    d_max = d;
+                    q = j;
+                }
+            }
+            if( !( d_max>tol ) )
+            {
+                r = k;
+                break;
+            }
+            perm[k] = q;
+            if( q!=k )
+            {
+                swap_sym( k, q );
+                std::swap( work[k], work[q] );
+            }
+
+            real_type d = std::sqrt( d_max );
+            at(k,k) = d;
+            const T* ak = a + (size_t)k*n;
+            for( int i=k+1; i<n; i++ )
+            {
+                T* ai = a + (size_t)i*n;
+                T sum = ai[k];
+                for( int l=k0; l<k; l++ )
+                    sum -= ai[l] * scalar_conj( ak[l] );
+                ai[k] = sum / d;
+            }
         }
-        for( int i=k+1; i<row; i++ )
-            for( int j=k+1; j<col; j++ )
-                _mat(i,j) = _mat(i,j) - res(k,i)*res(k,j);
 
+        int k1 = k0+kb;
+        if( r==n && k1<n )
+            syrk_lower( n-k1, kb, T(-1), a + (size_t)k1*n + k0, n, T(1), a + (size_t)k1*n + k1, n );
     }
 
-    for( int i=0; i<row; i++ )
-        for( int j=0; j<=i; j++)
-            _mat(i,j) = res(j,i);
+    for( int k=r; k<n; k++ )
+    {
+        perm[k] = k;
+        std::fill( a + (size_t)k*n + r, a + (size_t)k*n + k+1, T(0) );
+    }
 
+    _rank = r;
     status = CHOLE_SUCCESS;
+    mode = CHOLE;
     return 0;
 }
 
-int LinearSolver::chole_decomp()
+template<typename T>
+int BasicLinearSolver<T>::chole_decomp()
 {
     /// Cholesky decomposition
+    if( is_packed() ) return chole_packed();
     auto [row, col] = _mat.size();
     assert( row>0 && col>0 );
     assert( row==col );
 
     for( int i=0; i<row; i++ )
     {
-        if( _mat(i,i)<=0.0 ) return -1;
+        if( scalar_real( _mat(i,i) )<=0 ) return -1;
 
         for( int j=0; j<i+1; j++ )
         {
-            double sum = 0.0;
+            T sum = T(0);
             for( int k=0; k<j; k++ )
-                sum += _mat(i,k) * _mat(j,k);
+                sum += _mat(i,k) * scalar_conj( _mat(j,k) );
 
             if( i==j )
-                _mat(i,j) = sqrt( _mat(i,i) - sum );
+                _mat(i,j) = std::sqrt( scalar_real( _mat(i,i) - sum ) );
             else
-                _mat(i,j) = 1.0 / _mat(j,j) * ( _mat(i,j) - sum );
+                _mat(i,j) = T(1) / _mat(j,j) * ( _mat(i,j) - sum );
         }
     }
 
@@ -228,88 +877,267 @@ int LinearSolver::chole_decomp()
     return 0;
 }
 
+template<typename T>
+int BasicLinearSolver<T>::chole_packed()
+{
+    /// Cholesky decomposition in place of the packed lower triangle, row by row: the
+    /// rows of L are contiguous, so L(i,j) = ( A(i,j) - L(i,:j) L(j,:j)^* ) / L(j,j)
+    /// reads two contiguous runs
+    int n = _sym.n();
+    for( int i=0; i<n; i++ )
+    {
+        T* ri = _sym.row( i );
+        for( int j=0; j<=i; j++ )
+        {
+            const T* rj = _sym.row( j );
+            T sum = T(0);
+            for( int k=0; k<j; k++ )
+                sum += ri[k] * scalar_conj( rj[k] );
+
+            if( i==j )
+            {
+                real_type d = scalar_real( ri[i] - sum );
+                if( d <= 0 ) return -1;
+                ri[i] = std::sqrt( d );
+            }
+            else
+                ri[j] = ( ri[j] - sum ) / rj[j];
+        }
+    }
 
-Matrix LinearSolver::get_lower()
+    status = CHOLE_SUCCESS;
+    mode = CHOLE;
+    return 0;
+}
+
+template<typename T>
+int BasicLinearSolver<T>::chole_tile( int k0, int kb )
 {
+    /// Cholesky of the diagonal tile _mat[ k0:k0+kb, k0:k0+kb ], lower triangle only
+    int n = _mat.n_row();
+    T* a = _mat.data() + k0*n + k0;
+    for( int i=0; i<kb; i++ )
+    {
+        T* ai = a + i*n;
+        for( int j=0; j<=i; j++ )
+        {
+            const T* aj = a + j*n;
+            T sum = T(0);
+            for( int k=0; k<j; k++ )
+                sum += ai[k] * scalar_conj( aj[k] );
+
+            if( i==j )
+            {
+                real_type d = scalar_real( ai[i] - sum );
+                if( d <= 0 ) return -1;
+                ai[i] = std::sqrt( d );
+            }
+            else
+                ai[j] = ( ai[j] - sum ) / aj[j];
+        }
+    }
+    return 0;
+}
+
+template<typename T>
+int BasicLinearSolver<T>::chole_decomp_tiled()
+{
+    /// Cholesky decomposition as a DAG of block_size tiles: POTRF on the diagonal
+    /// tile, TRSM below it, SYRK / GEMM on the trailing lower tiles, lower tile
+    /// columns first so the next POTRF overlaps the trailing updates
     auto [row, col] = _mat.size();
     assert( row>0 && col>0 );
     assert( row==col );
 
-    Matrix res = Eye(row);
-    for( int i=1; i<row; i++ )
-        for( int j=0; j<i; j++ )
-            res(i,j) = _mat(i,j);
-    return res;
+    int n = row;
+    int nb = ( block_size>1 ) ? block_size : n;
+    int nt = (n+nb-1)/nb;
+    T* a = _mat.data();
+    std::atomic<bool> failed( false );
+    auto tile = [nt]( int i, int j ){ return (long)i*nt + j; };
+
+    TaskGraph graph;
+    for( int k=0; k<nt; k++ )
+    {
+        int k0 = k*nb, kb = std::min( nb, n-k0 );
+        graph.add_task( [&, k0, kb]{
+            if( !failed && chole_tile( k0, kb )!=0 ) failed = true;
+        }, {}, { tile(k,k) }, 3*(nt-k)+2 );
+
+        for( int i=k+1; i<nt; i++ )
+        {
+            int i0 = i*nb, ib = std::min( nb, n-i0 );
+            graph.add_task( [&, k0, kb, i0, ib]{
+                if( !failed ) trsm_right( true, true, false, ib, kb, a + k0*n + k0, n, a + i0*n + k0, n );
+            }, { tile(k,k) }, { tile(i,k) }, 3*(nt-k)+1 );
+        }
+
+        for( int j=k+1; j<nt; j++ )
+        {
+            int j0 = j*nb, jb = std::min( nb, n-j0 );
+            graph.add_task( [&, k0, kb, j0, jb]{
+                if( !failed ) syrk_lower( jb, kb, -1.0, a + j0*n + k0, n, 1.0, a + j0*n + j0, n );
+            }, { tile(j,k) }, { tile(j,j) }, 3*(nt-j) );
+
+            for( int i=j+1; i<nt; i++ )
+            {
+                int i0 = i*nb, ib = std::min( nb, n-i0 );
+                graph.add_task( [&, k0, kb, i0, ib, j0, jb]{
+                    if( !failed ) gemm( false, true, ib, jb, kb, -1.0, a + i0*n + k0, n, a + j0*n + k0, n, 1.0, a + i0*n + j0, n );
+                }, { tile(i,k), tile(j,k) }, { tile(i,j) }, 3*(nt-j) );
+            }
+        }
+    }
+    graph.execute();
+    if( failed ) return -1;
+
+    status = CHOLE_SUCCESS;
+    mode = CHOLE;
+    return 0;
 }
 
-Matrix LinearSolver::get_upper()
+template<typename T>
+int BasicLinearSolver<T>::qr_decomp()
 {
+    /// Householder QR, R and the reflectors in place
     auto [row, col] = _mat.size();
     assert( row>0 && col>0 );
-    assert( row==col );
 
-    Matrix res = Zeros(row);
-    for( int i=0; i<row; i++ )
-        for( int j=i; j<col; j++ )
-            res(i,j) = _mat(i,j);
-    return res;
+    /// panels past 64 columns spend more in their level-2 updates than the wider
+    /// GEMMs save
+    int k = std::min( row, col );
+    _tau.assign( k, T(0) );
+    qr_blocked( row, col, _mat.data(), col, _tau.data(), std::min( block_size, 64 ) );
+    for( int i=0; i<k; i++ )
+        if( _mat(i,i)==T(0) ) return -1;
+    for( int i=0; i<col; i++ )
+        q_perm[i] = i;
+    status = QR_SUCCESS;
+    mode = QR;
+    _rank = k;
+    return 0;
 }
 
-Matrix LinearSolver::get_chole()
+template<typename T>
+int BasicLinearSolver<T>::qr_decomp_pivoting( real_type tol )
 {
-    assert( status == CHOLE_SUCCESS );
-    int row = _mat.n_row();
-    Matrix res = Zeros(row);
-    for( int i=0; i<row; i++ )
-        for( int j=0; j<=i; j++ )
-            res(i,j) = _mat(i,j);
-    return res;
+    /// QR with column pivoting, |r_ii| non-increasing so the rank is a prefix of R
+    auto [row, col] = _mat.size();
+    assert( row>0 && col>0 );
+
+    /// narrow blocks: the pivot rows and F are updated by level-2 loops inside a block
+    int k = std::min( row, col );
+    _tau.assign( k, T(0) );
+    qr_pivoted( row, col, _mat.data(), col, _tau.data(), q_perm.data(), std::min( block_size, 32 ) );
+    if( tol<0 ) tol = std::max( row, col ) * std::numeric_limits<real_type>::epsilon();
+    real_type threshold = tol * std::abs( _mat(0,0) );
+    _rank = 0;
+    while( _rank<k && std::abs( _mat(_rank,_rank) )>threshold )
+        _rank++;
+    status = QR_SUCCESS;
+    mode = PIVOTED_QR;
+    return 0;
 }
 
-Matrix LinearSolver::solve_lower_triangular( const Matrix& b_vec )
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::solve_least_squares( const ConstViewType& b )
+{
+    /// B := Q^* B by the blocked reflectors, R11 z = B(0:r), x = P [ z; 0 ]
+    auto [row, col] = _mat.size();
+    assert( b.n_row()==row );
+    /// _tau is only filled by a QR attempt, a failed one has overwritten A
+    if( status==MAT_SET && _tau.empty() ) qr_decomp();
+    assert( status==QR_SUCCESS );
+
+    int k = b.n_col();
+    MatrixType qb = b.eval();
+    qr_apply( true, row, (int)_tau.size(), _mat.data(), col, _tau.data(), qb.data(), k, k, block_size );
+    int r = _rank;
+    trsm_left( false, false, false, r, k, _mat.data(), col, qb.data(), k );
+    MatrixType x( col, k );
+    for( int j=0; j<r; j++ )
+        std::copy( qb.data() + (std::size_t)j*k, qb.data() + (std::size_t)(j+1)*k, x.data() + (std::size_t)q_perm[j]*k );
+    return x;
+}
+
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::get_q()
+{
+    /// Q applied to the first min(m, n) columns of the identity
+    assert( status==QR_SUCCESS );
+    auto [row, col] = _mat.size();
+    int k = std::min( row, col );
+    MatrixType q( row, k );
+    for( int i=0; i<k; i++ )
+        q(i,i) = T(1);
+    qr_apply( false, row, k, _mat.data(), col, _tau.data(), q.data(), k, k, block_size );
+    return q;
+}
+
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::get_r()
+{
+    assert( status==QR_SUCCESS );
+    auto [row, col] = _mat.size();
+    int k = std::min( row, col );
+    MatrixType r( k, col );
+    for( int i=0; i<k; i++ )
+        for( int j=i; j<col; j++ )
+            r(i,j) = _mat(i,j);
+    return r;
+}
+
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::get_lower()
 {
     auto [row, col] = _mat.size();
     assert( row>0 && col>0 );
     assert( row==col );
-    assert( row==b_vec.n_row() );
 
-    Matrix x( row, 1 );
-    int r = rank();
-    for( int i=0; i<r; i++ )
-    {
-        x(i,0) += b_vec(i,0);
+    MatrixType res = Eye(row);
+    for( int i=1; i<row; i++ )
         for( int j=0; j<i; j++ )
-        {
-            x(i,0) -= _mat(i,j) * x(j,0);
-        }
-    }
-    return x;
+            res(i,j) = _mat(i,j);
+    return res;
 }
 
-Matrix LinearSolver::solve_upper_triangular( const Matrix& b_vec )
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::get_upper()
 {
     auto [row, col] = _mat.size();
     assert( row>0 && col>0 );
     assert( row==col );
-    assert( row==b_vec.n_row() );
 
-    Matrix x( row, 1 );
-    for( int i=row-1; i>=0; i-- )
+    MatrixType res = Zeros(row);
+    for( int i=0; i<row; i++ )
+        for( int j=i; j<col; j++ )
+            res(i,j) = _mat(i,j);
+    return res;
+}
+
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::get_chole()
+{
+    assert( status == CHOLE_SUCCESS );
+    int row = order();
+    MatrixType res = Zeros(row);
+    if( is_packed() )
     {
-        x(i,0) += b_vec(i,0);
-        for( int j=col-1; j>i; j-- )
-        {
-            x(i,0) -= _mat(i,j) * x(j,0);
-        }
-        x(i,0) /= _mat(i,i);
+        for( int i=0; i<row; i++ )
+            std::copy( _sym.row( i ), _sym.row( i ) + i+1, res.data() + (size_t)i*row );
+        return res;
     }
-    return x;
+    for( int i=0; i<row; i++ )
+        for( int j=0; j<=i; j++ )
+            res(i,j) = _mat(i,j);
+    return res;
 }
 
-Matrix LinearSolver::permute_vec( const Matrix& b )
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::permute_vec( const MatrixType& b )
 {
     /// swap for (Pb)
-    Matrix pb = b;
+    MatrixType pb = b;
     for( int i=0; i<pb.n_row()-1; i++ )
     {
         std::swap( pb(i), pb( perm[i] ) );
@@ -317,10 +1145,11 @@ Matrix LinearSolver::permute_vec( const Matrix& b )
     return pb;
 }
 
-Matrix LinearSolver::permute_vec_q( const Matrix& b )
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::permute_vec_q( const MatrixType& b )
 {
     /// swap for (Qb), Q is the column permutation matrix
-    Matrix pb = b;
+    MatrixType pb = b;
     for( int i=pb.n_row()-1; i>=0; i-- )
     {
         std::swap( pb(i), pb( q_perm[i] ) );
@@ -328,7 +1157,8 @@ Matrix LinearSolver::permute_vec_q( const Matrix& b )
     return pb;
 }
 
-Matrix LinearSolver::permute()
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::permute()
 {
     /// return the permutation matrix
     assert( status == LU_SUCCESS );
@@ -339,20 +1169,21 @@ Matrix LinearSolver::permute()
     for( int i=0; i<n; i++ )
         std::swap( p_vec[i], p_vec[ perm[i] ] );
 
-    Matrix p_mat = Zeros(n);
+    MatrixType p_mat = Zeros(n);
     for( int i=0; i<n; i++ )
-        p_mat(i,p_vec[i]) = 1.0;
+        p_mat(i,p_vec[i]) = T(1);
 
     return p_mat;
 }
 
-Matrix LinearSolver::permute( const Matrix& mat )
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::permute( const MatrixType& mat )
 {
     /// return P * A * Q
     assert( status == LU_SUCCESS );
     int n = perm.size();
 
-    Matrix p_mat = mat;
+    MatrixType p_mat = mat;
     for( int i=0; i<n; i++ )
         p_mat.swap_row(i,perm[i]);
     for( int i=0; i<n; i++ )
@@ -361,13 +1192,14 @@ Matrix LinearSolver::permute( const Matrix& mat )
     return p_mat;
 }
 
-Matrix LinearSolver::permute_chole( const Matrix& mat )
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::permute_chole( const MatrixType& mat )
 {
     /// return the P^t * A * P
     assert( status == CHOLE_SUCCESS );
     int n = perm.size();
 
-    Matrix p_mat = mat;
+    MatrixType p_mat = mat;
     for( int i=0; i<n; i++ )
         p_mat.swap_row(i,perm[i]);
     for( int i=0; i<n; i++ )
@@ -376,68 +1208,552 @@ Matrix LinearSolver::permute_chole( const Matrix& mat )
     return p_mat;
 }
 
-int LinearSolver::rank()
+template<typename T>
+int BasicLinearSolver<T>::rank()
 {
-    int size = _mat.n_row();
+    int size = order();
     if( _rank!=-1 ) return _rank;
-    if( mode!=COMPLETE_LU ) return size;
+    if( mode!=COMPLETE_LU && mode!=ROOK_LU ) return size;
 
-    double threshold = _mat(0,0) * abs_threshold * size;
+    real_type threshold = std::abs( _mat(0,0) ) * abs_threshold * size;
     for( int i=0; i<size; i++ )
         if( std::abs(_mat(i,i)) < threshold ) return _rank = i;
     return _rank = size;
 }
 
-Matrix LinearSolver::solve_vec_chole( const Matrix& b )
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::solve_vec_chole( const ConstViewType& b )
 {
-    auto [row, col] = _mat.size();
-    Matrix y( row, 1 );
-    Matrix x( row, 1 );
-    int r = rank();
+    /// the permutation is applied as index swaps, so the solve needs O(n) memory
+    assert( status==CHOLE_SUCCESS );
+    MatrixType x;
+    solve_vec( b, x );
+    return x;
+}
 
-    Matrix P_mat = Eye(row);
-    for( int i=0; i<row; i++ )
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::solve_vec( const ConstViewType& b )
+{
+    MatrixType x;
+    solve_vec( b, x );
+    return x;
+}
+
+template<typename T>
+void BasicLinearSolver<T>::solve_vec( const ConstViewType& b, MatrixType& x )
+{
+    /// x is only reallocated when it cannot hold b, so reusing it avoids any allocation
+    if( status==QR_SUCCESS )
+    {
+        x = solve_least_squares( b );
+        return;
+    }
+    assert( b.n_row()==order() && b.n_col()==1 );
+    if( x.n_row()!=b.n_row() || x.n_col()!=1 || x.is_mapped() ) x.resize( b.n_row(), 1 );
+    x.view().assign( b );
+    solve_vec_inplace( x );
+}
+
+template<typename T>
+void BasicLinearSolver<T>::solve_vec_inplace( MatrixType& x )
+{
+    assert( x.n_row()==order() && x.n_col()==1 );
+    assert( status==LU_SUCCESS || status==CHOLE_SUCCESS );
+    solve_block( x.data(), 1, 1 );
+}
+
+template<typename T>
+void BasicLinearSolver<T>::solve_block( T* x, int k, int ldx )
+{
+    /// solve in place for the n x k column block x of a row-major right-hand side
+    if( mode==MIXED_LU )
     {
-        P_mat.swap_col( perm[i], i );
+        solve_block_mixed( x, k, ldx );
+        return;
     }
+    if( is_packed() )
+    {
+        solve_block_packed( x, k, ldx );
+        return;
+    }
+    solve_block_factors( x, k, ldx );
+    if( _upd_u.n_col()>0 )
+        solve_block_updates( x, k, ldx );
+}
 
-    Matrix pb = P_mat.transpose()*b;
+template<typename T>
+void BasicLinearSolver<T>::solve_block_factors( T* x, int k, int ldx )
+{
+    /// the solve with the factors in _mat alone
+    int n = _mat.n_row();
+    int r = rank();
+    const T* a = _mat.data();
+    auto swap_rows = [&]( int i, int j ){ if( i!=j ) std::swap_ranges( x + i*ldx, x + i*ldx + k, x + j*ldx ); };
+    auto clear_rows = [&]( int i0 ){ for( int i=i0; i<n; i++ ) std::fill( x + i*ldx, x + i*ldx + k, T(0) ); };
 
-    /// solve L
-    for( int i=0; i<r; i++ )
+    if( status==LU_SUCCESS )
     {
-        y(i,0) += pb(i,0);
+        /// P b, L y = P b, U z = y, x = Q z
+        for( int i=0; i<n-1; i++ )
+            swap_rows( i, perm[i] );
+        clear_rows( r );
+        trsm_left( true, false, true, r, k, a, n, x, ldx );
+        trsm_left( false, false, false, r, k, a, n, x, ldx );
+        for( int i=n-1; i>=0; i-- )
+            swap_rows( i, q_perm[i] );
+    }
+    else
+    {
+        /// P^t b, L y = P^t b, L^* z = y, x = P z
+        for( int i=0; i<n; i++ )
+            swap_rows( i, perm[i] );
+        clear_rows( r );
+        trsm_left( true, false, false, r, k, a, n, x, ldx );
+        trsm_left( true, true, false, r, k, a, n, x, ldx );
+        for( int i=n-1; i>=0; i-- )
+            swap_rows( i, perm[i] );
+    }
+}
+
+template<typename T>
+void BasicLinearSolver<T>::solve_block_packed( T* x, int k, int ldx )
+{
+    /// L y = b by rows of L, then L^* x = y by rows of L as well: x(i) is final once
+    /// divided by L(i,i) and is then pushed into the rows above it
+    int n = _sym.n();
+    for( int i=0; i<n; i++ )
+    {
+        const T* ri = _sym.row( i );
+        T* xi = x + (size_t)i*ldx;
         for( int j=0; j<i; j++ )
         {
-            y(i,0) -= _mat(i,j) * y(j,0);
+            const T* xj = x + (size_t)j*ldx;
+            for( int c=0; c<k; c++ )
+                xi[c] -= ri[j] * xj[c];
         }
-        y(i,0) /= _mat(i,i);
+        for( int c=0; c<k; c++ )
+            xi[c] = xi[c] / ri[i];
     }
+    for( int i=n-1; i>=0; i-- )
+    {
+        const T* ri = _sym.row( i );
+        T* xi = x + (size_t)i*ldx;
+        for( int c=0; c<k; c++ )
+            xi[c] = xi[c] / scalar_conj( ri[i] );
+        for( int j=0; j<i; j++ )
+        {
+            T* xj = x + (size_t)j*ldx;
+            T l = scalar_conj( ri[j] );
+            for( int c=0; c<k; c++ )
+                xj[c] -= l * xi[c];
+        }
+    }
+}
 
-    /// solve L^*
-    for( int i=row-1; i>=0; i-- )
+template<typename T>
+int BasicLinearSolver<T>::chole_rank1( T* x, real_type sign )
+{
+    /// L L^* + sign x x^* by one Givens (sign>0) or hyperbolic (sign<0) rotation per
+    /// column of L, applied row by row so each row of L, full or packed, is read once
+    /// as a contiguous run: row i takes the rotations of the columns before it, then
+    /// defines the rotation of its own diagonal
+    int n = order();
+    auto row = [&]( int i ) -> T* { return is_packed() ? _sym.row( i ) : _mat.data() + (size_t)i*n; };
+    if( sign<0 )
     {
-        x(i,0) += y(i,0);
-        for( int j=row-1; j>i; j-- )
+        /// feasible iff |L^-1 x| < 1, checked first so a failure changes nothing
+        std::vector<T> p( x, x + n );
+        real_type norm2 = 0;
+        for( int i=0; i<n; i++ )
         {
-            x(i,0) -= _mat(j,i) * x(j,0);
+            const T* li = row( i );
+            for( int j=0; j<i; j++ )
+                p[i] -= li[j] * p[j];
+            p[i] = p[i] / li[i];
+            norm2 += scalar_real( p[i]*scalar_conj( p[i] ) );
         }
-        x(i,0) /= _mat(i,i);
+        if( !( norm2 < 1 ) ) return -1;
     }
 
-    return P_mat * x;
+    std::vector<real_type> c( n );
+    std::vector<T> s( n );
+    for( int i=0; i<n; i++ )
+    {
+        T* li = row( i );
+        T xi = x[i];
+        for( int j=0; j<i; j++ )
+        {
+            li[j] = ( li[j] + sign*scalar_conj( s[j] )*xi ) / c[j];
+            xi = c[j]*xi - s[j]*li[j];
+        }
+        real_type d = scalar_real( li[i] );
+        real_type r2 = d*d + sign*scalar_real( xi*scalar_conj( xi ) );
+        if( !( r2>0 ) ) return -1;
+        real_type r = std::sqrt( r2 );
+        c[i] = r/d;
+        s[i] = xi/d;
+        li[i] = r;
+    }
+    return 0;
 }
 
-Matrix LinearSolver::solve_vec( const Matrix& b )
+template<typename T>
+int BasicLinearSolver<T>::chole_update( const ConstViewType& x )
 {
-    assert( b.n_row()==_mat.n_row() );
-    if( status==LU_SUCCESS )
-        return permute_vec_q( solve_upper_triangular( solve_lower_triangular( permute_vec( b ) ) ) );
-    if( status==CHOLE_SUCCESS )
-        return solve_vec_chole( b );
+    assert( status==CHOLE_SUCCESS );
+    int n = order();
+    assert( x.n_row()==n );
+    if( rank()<n ) return -1;
+    std::vector<T> xc( n );
+    for( int c=0; c<x.n_col(); c++ )
+    {
+        for( int i=0; i<n; i++ )
+            xc[i] = x(i,c);
+        /// the factor is of P^t A P
+        for( int i=0; i<n; i++ )
+            std::swap( xc[i], xc[ perm[i] ] );
+        if( chole_rank1( xc.data(), real_type(1) )!=0 ) return -1;
+    }
+    return 0;
+}
+
+template<typename T>
+int BasicLinearSolver<T>::chole_downdate( const ConstViewType& x )
+{
+    assert( status==CHOLE_SUCCESS );
+    int n = order();
+    assert( x.n_row()==n );
+    if( rank()<n ) return -1;
+    std::vector<T> xc( n );
+    for( int c=0; c<x.n_col(); c++ )
+    {
+        for( int i=0; i<n; i++ )
+            xc[i] = x(i,c);
+        for( int i=0; i<n; i++ )
+            std::swap( xc[i], xc[ perm[i] ] );
+        if( chole_rank1( xc.data(), real_type(-1) )!=0 ) return -1;
+    }
+    return 0;
+}
+
+template<typename T>
+void BasicLinearSolver<T>::clear_updates()
+{
+    _upd_u = MatrixType();
+    _upd_v = MatrixType();
+    _upd_z = MatrixType();
+    _upd_c = MatrixType();
+    _upd_piv.clear();
+}
+
+template<typename T>
+int BasicLinearSolver<T>::refactor_updates()
+{
+    /// A = P^t L U Q^t from the factors, plus U V^*, factored again from scratch
+    int n = _mat.n_row();
+    MatrixType a = get_lower()*get_upper();
+    for( int i=n-1; i>=0; i-- )
+        a.swap_col( i, q_perm[i] );
+    for( int i=n-2; i>=0; i-- )
+        a.swap_row( i, perm[i] );
+    int k = _upd_u.n_col();
+    gemm( false, true, n, n, k, T(1), _upd_u.data(), k, _upd_v.data(), k, T(1), a.data(), n );
+    set_matrix( a );
+    return lu_decomp_partial();
+}
 
+template<typename T>
+int BasicLinearSolver<T>::lu_update( const ConstViewType& u, const ConstViewType& v )
+{
+    assert( status==LU_SUCCESS && mode!=MIXED_LU );
+    int n = _mat.n_row();
+    assert( u.n_row()==n && v.n_row()==n && u.n_col()==v.n_col() );
+    if( rank()<n ) return -1;
+
+    /// append the new columns to U, V and Z = A^-1 U
+    int k0 = _upd_u.n_col(), k = k0 + u.n_col();
+    auto append = [&]( MatrixType& m, const ConstViewType& cols )
+    {
+        MatrixType res( n, k );
+        if( k0>0 ) res.submatrix( 0, -1, 0, k0-1 ).assign( m );
+        res.submatrix( 0, -1, k0, -1 ).assign( cols );
+        m = std::move( res );
+    };
+    append( _upd_u, u );
+    append( _upd_v, v );
+    MatrixType z = u.eval();
+    solve_block_factors( z.data(), z.n_col(), z.n_col() );
+    append( _upd_z, z );
+    if( k>_upd_limit ) return refactor_updates()==0 ? 1 : -1;
+
+    /// C = I + V^* Z, refactor if its LU has a pivot lost in the cancellation
+    _upd_c.resize( k, k );
+    gemm( true, false, k, k, n, T(1), _upd_v.data(), k, _upd_z.data(), k, T(0), _upd_c.data(), k );
+    real_type scale = 1;
+    for( int i=0; i<k*k; i++ )
+        scale = std::max( scale, std::abs( _upd_c.data()[i] ) );
+    for( int i=0; i<k; i++ )
+        _upd_c(i,i) += T(1);
+    _upd_piv.resize( k );
+    bool stable = lu_blocked_partial( k, _upd_c.data(), k, _upd_piv.data(), block_size )==0;
+    real_type min_pivot = scale;
+    for( int i=0; i<k && stable; i++ )
+        min_pivot = std::min( min_pivot, std::abs( _upd_c(i,i) ) );
+    if( !stable || min_pivot < std::sqrt( std::numeric_limits<real_type>::epsilon() )*scale )
+        return refactor_updates()==0 ? 1 : -1;
+    return 0;
+}
+
+template<typename T>
+void BasicLinearSolver<T>::solve_block_updates( T* x, int k, int ldx )
+{
+    /// x = y - Z C^-1 V^* y for the solve y with the factors alone
+    int n = _mat.n_row(), m = _upd_u.n_col();
+    std::vector<T> w( (size_t)m*k );
+    gemm( true, false, m, k, n, T(1), _upd_v.data(), m, x, ldx, T(0), w.data(), k );
+    lu_swap_rows( m, w.data(), k, _upd_piv.data(), 0, m, 0, k );
+    trsm_left( true, false, true, m, k, _upd_c.data(), m, w.data(), k );
+    trsm_left( false, false, false, m, k, _upd_c.data(), m, w.data(), k );
+    gemm( false, false, n, k, m, T(-1), _upd_z.data(), m, w.data(), k, T(1), x, ldx );
+}
+
+template<typename T>
+std::size_t BasicLinearSolver<T>::memory_bytes() const
+{
+    std::size_t entries = (std::size_t)_mat.n_row()*_mat.n_col() + SymMatrixType::packed_size( _sym.n() )
+                        + (std::size_t)_upd_u.n_row()*_upd_u.n_col()*3 + (std::size_t)_upd_c.n_row()*_upd_c.n_col();
+    return ( entries + _tau.size() )*sizeof(T) + _mat_f.size()*sizeof(low_type) + ( perm.size() + q_perm.size() + _upd_piv.size() )*sizeof(int);
+}
+
+template<typename T>
+int BasicLinearSolver<T>::save_factors( const char* file_name ) const
+{
+    if( ( status!=LU_SUCCESS && status!=CHOLE_SUCCESS ) || is_packed() )
+    {
+        std::cerr << "save_factors: no factors in full storage to save" << std::endl;
+        return -1;
+    }
+    if( _upd_u.n_col()>0 )
+    {
+        std::cerr << "save_factors: lu_update terms pending, the factors are not those of the current matrix" << std::endl;
+        return -1;
+    }
+    int n = _mat.n_row();
+    std::vector<std::int32_t> p( perm.begin(), perm.end() ), q( q_perm.begin(), q_perm.end() );
+    std::size_t mat_bytes = (std::size_t)n*n*sizeof(T), low_bytes = _mat_f.size()*sizeof(low_type);
+
+    FactorFileHeader header;
+    std::memset( &header, 0, sizeof(header) );
+    std::memcpy( header.magic, FACTOR_FILE_MAGIC, 8 );
+    header.version = FACTOR_FILE_VERSION;
+    header.dtype = MatrixDTypeOf<T>::value;
+    header.n = n;
+    header.status = status;
+    header.mode = mode;
+    header.rank = _rank;
+    header.norm_a = _norm_a;
+    header.refine_tol = refine_tol;
+    header.checksum = factor_checksum( p, q, _mat.data(), mat_bytes, _mat_f.data(), low_bytes );
+
+    std::ofstream ofs( file_name, std::ios::binary | std::ios::trunc );
+    if( !ofs )
+    {
+        std::cerr << "Cannot open file " << file_name << std::endl;
+        return -1;
+    }
+    ofs.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+    ofs.write( reinterpret_cast<const char*>( p.data() ), p.size()*sizeof(std::int32_t) );
+    ofs.write( reinterpret_cast<const char*>( q.data() ), q.size()*sizeof(std::int32_t) );
+    ofs.write( reinterpret_cast<const char*>( _mat.data() ), mat_bytes );
+    ofs.write( reinterpret_cast<const char*>( _mat_f.data() ), low_bytes );
+    if( !ofs )
+    {
+        std::cerr << "Failed writing " << file_name << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+template<typename T>
+int BasicLinearSolver<T>::load_factors( const char* file_name )
+{
+    std::ifstream ifs( file_name, std::ios::binary );
+    FactorFileHeader header;
+    if( !ifs || !ifs.read( reinterpret_cast<char*>( &header ), sizeof(header) )
+        || std::memcmp( header.magic, FACTOR_FILE_MAGIC, 8 )!=0 || header.version!=FACTOR_FILE_VERSION
+        || header.dtype!=(std::uint32_t)MatrixDTypeOf<T>::value || header.n<=0
+        || !factor_mode_valid( header.status, header.mode ) )
+    {
+        std::cerr << "Not a factor file of this type: " << file_name << std::endl;
+        return -1;
+    }
+    int n = (int)header.n;
+    std::vector<std::int32_t> p( n ), q( n );
+    MatrixType mat( n, n );
+    std::vector<low_type> mat_f( header.mode==MIXED_LU ? (std::size_t)n*n : 0 );
+    std::size_t mat_bytes = (std::size_t)n*n*sizeof(T), low_bytes = mat_f.size()*sizeof(low_type);
+    ifs.read( reinterpret_cast<char*>( p.data() ), n*sizeof(std::int32_t) );
+    ifs.read( reinterpret_cast<char*>( q.data() ), n*sizeof(std::int32_t) );
+    ifs.read( reinterpret_cast<char*>( mat.data() ), mat_bytes );
+    ifs.read( reinterpret_cast<char*>( mat_f.data() ), low_bytes );
+    if( !ifs || factor_checksum( p, q, mat.data(), mat_bytes, mat_f.data(), low_bytes )!=header.checksum )
+    {
+        std::cerr << "Truncated or corrupted factor file " << file_name << std::endl;
+        return -1;
+    }
+
+    /// the factors replace the matrix wholesale, so set_matrix's copy is skipped
+    _mat = std::move( mat );
+    _sym.resize( 0 );
+    perm.assign( p.begin(), p.end() );
+    q_perm.assign( q.begin(), q.end() );
+    _mat_f = std::move( mat_f );
+    _tau.clear();
+    clear_updates();
+    status = (LinearSolverStatus)header.status;
+    mode = (LinearSolverMode)header.mode;
+    _rank = (int)header.rank;
+    _norm_a = (real_type)header.norm_a;
+    refine_tol = (real_type)header.refine_tol;
+    return 0;
+}
+
+template<typename T>
+void BasicLinearSolver<T>::solve_block_low( low_type* x, int k, int ldx )
+{
+    /// P b, L y = P b, U x = y with the low precision factors
+    int n = _mat.n_row();
+    const low_type* a = _mat_f.data();
+    for( int i=0; i<n-1; i++ )
+        if( perm[i]!=i )
+            std::swap_ranges( x + i*ldx, x + i*ldx + k, x + perm[i]*ldx );
+    trsm_left( true, false, true, n, k, a, n, x, ldx );
+    trsm_left( false, false, false, n, k, a, n, x, ldx );
+}
+
+template<typename T>
+void BasicLinearSolver<T>::solve_block_mixed( T* x, int k, int ldx )
+{
+    /// x = U^-1 L^-1 P b in low precision, then x += A^-1 (b - A x) with the residual
+    /// in full precision and the correction in low precision until every column meets
+    /// the tolerance; needs O(n k) workspace, so unlike the other modes it allocates
+    int n = _mat.n_row();
+    const T* a = _mat.data();
+    real_type tol = ( refine_tol>0 ) ? refine_tol : std::numeric_limits<real_type>::epsilon() * std::sqrt( (real_type)n );
+
+    std::vector<T> b( (size_t)n*k ), r( (size_t)n*k );
+    std::vector<low_type> d( (size_t)n*k );
+    for( int i=0; i<n; i++ )
+        for( int c=0; c<k; c++ )
+        {
+            b[i*k+c] = x[i*ldx+c];
+            d[i*k+c] = low_type( x[i*ldx+c] );
+        }
+    solve_block_low( d.data(), k, k );
+    for( int i=0; i<n; i++ )
+        for( int c=0; c<k; c++ )
+            x[i*ldx+c] = T( d[i*k+c] );
+
+    /// residual norm of the worst column relative to its bound, must keep shrinking
+    real_type prev = std::numeric_limits<real_type>::infinity();
+    std::vector<real_type> r_max( k ), x_max( k );
+    for( refine_iters=0; refine_iters<REFINE_MAX_ITERS; refine_iters++ )
+    {
+        r = b;
+        gemm( false, false, n, k, n, T(-1), a, n, x, ldx, T(1), r.data(), k );
+
+        std::fill( r_max.begin(), r_max.end(), 0.0 );
+        std::fill( x_max.begin(), x_max.end(), 0.0 );
+        for( int i=0; i<n; i++ )
+            for( int c=0; c<k; c++ )
+            {
+                r_max[c] = std::max( r_max[c], std::abs( r[i*k+c] ) );
+                x_max[c] = std::max( x_max[c], std::abs( x[i*ldx+c] ) );
+            }
+        real_type worst = 0.0;
+        for( int c=0; c<k; c++ )
+        {
+            /// written so that a NaN residual never passes as converged
+            real_type bound = tol * _norm_a * x_max[c];
+            if( !( r_max[c] <= bound ) )
+                worst = std::max( worst, std::isfinite( r_max[c] ) ? r_max[c]/bound : prev );
+        }
+        if( worst==0.0 ) return;
+        if( !( worst < 0.5*prev ) ) break;
+        prev = worst;
+
+        for( size_t i=0; i<d.size(); i++ )
+            d[i] = low_type( r[i] );
+        solve_block_low( d.data(), k, k );
+        for( int i=0; i<n; i++ )
+            for( int c=0; c<k; c++ )
+                x[i*ldx+c] += T( d[i*k+c] );
+    }
+
+    /// refinement stalled: A is too ill-conditioned for the low precision, factor it in full
+    refine_iters = -1;
+    _mat_f.clear();
+    _mat_f.shrink_to_fit();
+    for( int i=0; i<n; i++ )
+        perm[i] = i;
+    if( lu_decomp_partial()!=0 )
+    {
+        status = MAT_SET;
+        for( int i=0; i<n; i++ )
+            for( int c=0; c<k; c++ )
+                x[i*ldx+c] = std::numeric_limits<real_type>::quiet_NaN();
+        return;
+    }
+    for( int i=0; i<n; i++ )
+        for( int c=0; c<k; c++ )
+            x[i*ldx+c] = b[i*k+c];
+    solve_block( x, k, ldx );
+}
+
+template<typename T>
+typename BasicLinearSolver<T>::MatrixType BasicLinearSolver<T>::solve( const ConstViewType& b )
+{
+    /// solve A X = B for every column of the n x k block B with one pass of
+    /// blocked substitutions, column blocks are spread over the thread pool
+    if( status==QR_SUCCESS ) return solve_least_squares( b );
+    assert( b.n_row()==order() );
     assert( status==LU_SUCCESS || status==CHOLE_SUCCESS );
-    return Matrix();
+
+    MatrixType x = b.eval();
+    int k = b.n_col();
+    if( k==0 ) return x;
+    rank();
+
+    /// the refinement GEMMs are already threaded and a fallback refactors _mat,
+    /// so MIXED_LU solves the whole block at once
+    if( mode==MIXED_LU )
+    {
+        solve_block( x.data(), k, k );
+        return x;
+    }
+
+    ThreadPool& pool = thread_pool();
+    int width = std::max( 64, (k + pool.size() - 1)/pool.size() );
+    int n_blocks = (k + width - 1)/width;
+    pool.parallel_for( n_blocks, [&]( int t )
+    {
+        int c0 = t*width;
+        solve_block( x.data() + c0, std::min( width, k-c0 ), k );
+    } );
+    return x;
 }
 
+#define MX_INSTANTIATE_LU_PANEL(T) \
+    template void lu_swap_rows<T>( int, T*, int, const int*, int, int, int, int ); \
+    template int lu_panel_partial<T>( int, T*, int, int*, int, int, bool );
+MX_INSTANTIATE_LU_PANEL(float)
+MX_INSTANTIATE_LU_PANEL(double)
+MX_INSTANTIATE_LU_PANEL(std::complex<float>)
+MX_INSTANTIATE_LU_PANEL(std::complex<double>)
+
+template class BasicLinearSolver<float>;
+template class BasicLinearSolver<double>;
+template class BasicLinearSolver< std::complex<float> >;
+template class BasicLinearSolver< std::complex<double> >;
+
 }
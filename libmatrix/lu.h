@@ -2,6 +2,8 @@
 #define _MX_LU_H
 
 #include "matrix.h"
+#include "scalar.h"
+#include "sym_matrix.h"
 
 namespace mx
 {
@@ -10,54 +12,185 @@ enum LinearSolverStatus{
     EMPTY,
     MAT_SET,
     LU_SUCCESS,
-    CHOLE_SUCCESS
+    CHOLE_SUCCESS,
+    QR_SUCCESS
 };
 
 enum LinearSolverMode{
     NONE,
     PARTIAL_LU,
     COMPLETE_LU,
-    CHOLE
+    CHOLE,
+    MIXED_LU,
+    ROOK_LU,
+    CALU,
+    QR,
+    PIVOTED_QR
 };
 
-class LinearSolver
+/// LU / Cholesky factorizations and solves over BasicMatrix<T>, instantiated in lu.cpp
+/// for float, double, std::complex<float> and std::complex<double>; for complex T the
+/// Cholesky routines factor Hermitian matrices as L L^H. The QR routines also take
+/// rectangular matrices, the others need A square
+template<typename T>
+class BasicLinearSolver
 {
-    Matrix _mat;
+public:
+    typedef BasicMatrix<T> MatrixType;
+    typedef BasicSymMatrix<T> SymMatrixType;
+    /// right-hand sides are taken as views, so a column of a matrix is solved without a copy
+    typedef BasicConstMatrixView<T> ConstViewType;
+    typedef RealType<T> real_type;
+    typedef typename ScalarTraits<T>::low_type low_type;
+
+private:
+    MatrixType _mat;
+    /// set_matrix( SymMatrixType ) keeps the matrix and its Cholesky factor packed here
+    /// and leaves _mat empty
+    SymMatrixType _sym;
     LinearSolverStatus status;
     LinearSolverMode mode;
-    Matrix solve_lower_triangular( const Matrix& b_vec );
-    Matrix solve_upper_triangular( const Matrix& b_vec );
     std::vector<int> perm;
     std::vector<int> q_perm;
-    double abs_threshold;
+    real_type abs_threshold;
     int _rank;
+    int block_size;
+    /// MIXED_LU keeps A in _mat and its LU factors in the lower precision here
+    std::vector<low_type> _mat_f;
+    real_type _norm_a;
+    real_type refine_tol;
+    int refine_iters;
+    /// QR keeps R and the reflectors in _mat, their scalars here
+    std::vector<T> _tau;
+    /// low rank updates A + U V^* not folded into the LU factors yet, solved by
+    /// Sherman-Morrison-Woodbury: Z = A^-1 U and the LU factors of C = I + V^* Z
+    MatrixType _upd_u, _upd_v, _upd_z, _upd_c;
+    std::vector<int> _upd_piv;
+    int _upd_limit;
+    int chole_tile( int k0, int kb );
+    int chole_rank1( T* x, real_type sign );
+    void clear_updates();
+    int refactor_updates();
+    void solve_block_factors( T* x, int k, int ldx );
+    void solve_block_updates( T* x, int k, int ldx );
+    int chole_packed();
+    void solve_block_packed( T* x, int k, int ldx );
+    int order() const { return _sym.n()>0 ? _sym.n() : _mat.n_row(); }
+    void solve_block( T* x, int k, int ldx );
+    void solve_block_low( low_type* x, int k, int ldx );
+    void solve_block_mixed( T* x, int k, int ldx );
 
 public:
-    LinearSolver();
-    LinearSolver( const Matrix& mat );
-    void set_matrix( const Matrix& mat );
+    BasicLinearSolver();
+    BasicLinearSolver( const MatrixType& mat );
+    void set_matrix( const MatrixType& mat );
+    /// symmetric / Hermitian positive definite matrices in packed lower storage, half
+    /// the memory of a full matrix; only chole_decomp and the solves apply to them
+    BasicLinearSolver( const SymMatrixType& mat );
+    void set_matrix( const SymMatrixType& mat );
+    bool is_packed() const { return _sym.n()>0; }
+    /// complete pivoting, rank revealing: rank() counts the pivots above a threshold and
+    /// the solves work on that leading block. Exchanges are tracked as index maps, a
+    /// matrix whose trailing block becomes exactly zero stops there and still succeeds
     int lu_decomp();
+    /// rook pivoting: each pivot is the largest entry of both its row and column, found
+    /// by alternating row and column scans; cheaper than complete pivoting per step and
+    /// with the same perm / q_perm / rank() outputs
+    int lu_decomp_rook();
     int lu_decomp_partial();
+    int lu_decomp_partial_tiled();
+    /// communication-avoiding LU: the block_size pivots of a panel are chosen by a
+    /// reduction tree over row blocks (tournament pivoting) instead of one search per
+    /// column; perm is a row swap sequence like the partial pivoting one, the growth
+    /// factor is bounded less tightly but is as small in practice
+    int lu_decomp_calu();
+    /// partial pivoting LU in low_type (float for double), solves refine the low precision
+    /// solution against A in T and refactor in T when refinement does not converge
+    int lu_decomp_mixed();
     int chole_decomp();
-    int chole_decomp_pivoting();
-    Matrix get_lower();
-    Matrix get_upper();
-    Matrix get_chole();
+    int chole_decomp_tiled();
+    /// pivoted Cholesky P^t A P = L L^*, blocked and in place, for positive semidefinite
+    /// A: stops once no remaining diagonal exceeds tol, rank() is the number of columns
+    /// of L computed and the solves use that leading block; tol<0 picks n eps max(diag A)
+    int chole_decomp_pivoting( real_type tol=-1 );
+    /// Householder QR of the m x n matrix A, blocked by block_size columns with the
+    /// trailing matrix updated by GEMM through the compact WY form; -1 if a diagonal
+    /// entry of R is zero, like the LU routines on a zero pivot nothing is then solved
+    int qr_decomp();
+    /// QR with column pivoting A P = Q R, rank revealing: rank() counts the diagonal
+    /// entries of R above tol |r_00|, tol<0 picks max(m, n) eps
+    int qr_decomp_pivoting( real_type tol=-1 );
+    /// X minimizing ||A X - B|| column by column for the m x k block B, from Q^* B and
+    /// R; factors by qr_decomp first if only set_matrix was called. The solution is
+    /// unique for A of full column rank, otherwise it is the basic solution with
+    /// n - rank() zeros left by qr_decomp_pivoting
+    MatrixType solve_least_squares( const ConstViewType& b );
+    /// the thin factors of a QR factorization, Q m x min(m, n) with orthonormal columns
+    /// and R min(m, n) x n
+    MatrixType get_q();
+    MatrixType get_r();
+    /// after qr_decomp_pivoting column j of A P is column get_col_perm()[j] of A
+    const std::vector<int>& get_col_perm() const { return q_perm; }
+    MatrixType get_lower();
+    MatrixType get_upper();
+    MatrixType get_chole();
+    /// the packed Cholesky factor L of a packed matrix
+    const SymMatrixType& get_chole_packed() const { return _sym; }
     LinearSolverStatus get_status() { return status; }
-    Matrix solve_vec( const Matrix& b );
-    Matrix solve_vec_chole( const Matrix& b );
+    MatrixType solve_vec( const ConstViewType& b );
+    /// allocation-free forms: x is the caller's output buffer, or b is overwritten by x
+    void solve_vec( const ConstViewType& b, MatrixType& x );
+    void solve_vec_inplace( MatrixType& x );
+    MatrixType solve_vec_chole( const ConstViewType& b );
+    /// a QR factored A solves in the least squares sense, see solve_least_squares
+    MatrixType solve( const ConstViewType& b );
+    /// turn the Cholesky factor of A into that of A + X X^* / A - X X^* for the n x k
+    /// block X in O(n^2 k), full or packed storage; a downdate that would leave the
+    /// matrix not positive definite returns -1 and keeps the columns before it applied
+    int chole_update( const ConstViewType& x );
+    int chole_downdate( const ConstViewType& x );
+    /// A + U V^* (U V^t for real T) for n x k blocks U and V, on top of a partial, CALU,
+    /// complete or rook LU: kept beside the factors and applied by Sherman-Morrison-Woodbury
+    /// in every solve at O(n^2 k) now and O(n K) per solve for the K columns held.
+    /// Refactors with lu_decomp_partial once K passes the update limit or the small
+    /// capacitance matrix I + V^* A^-1 U loses accuracy; 0 when kept, 1 when refactored,
+    /// -1 if the updated matrix is singular
+    int lu_update( const ConstViewType& u, const ConstViewType& v );
+    void set_update_limit( int k ) { _upd_limit = k; }
+    /// columns of U held beside the LU factors
+    int get_update_rank() const { return _upd_u.n_col(); }
+    /// bytes held by the matrix, its factors and the pending updates
+    std::size_t memory_bytes() const;
+    /// the factors, permutations and mode of a factored full-storage solver in one
+    /// binary file with a checksum, read back by load_factors in place of set_matrix and
+    /// the decomposition. The factors alone describe A before any pending lu_update
+    /// terms, so with updates pending nothing is written. 0 on success, -1 otherwise
+    int save_factors( const char* file_name ) const;
+    int load_factors( const char* file_name );
     int find_max( int j );
     int find_max_pivot( int j );
     std::tuple<int,int> find_max_complete( int idx );
-    Matrix permute_vec( const Matrix& b );
-    Matrix permute_vec_q( const Matrix& b );
-    Matrix permute();
-    Matrix permute( const Matrix& mat );
-    Matrix permute_chole( const Matrix& mat );
+    MatrixType permute_vec( const MatrixType& b );
+    MatrixType permute_vec_q( const MatrixType& b );
+    MatrixType permute();
+    MatrixType permute( const MatrixType& mat );
+    MatrixType permute_chole( const MatrixType& mat );
     int rank();
-    Matrix matrix_lu() { return _mat; }
+    MatrixType matrix_lu() { return _mat; }
+    /// panel width / tile edge of the blocked and tiled factorizations, <=1 runs them unblocked
+    void set_block_size( int nb ) { block_size = nb; }
+    int get_block_size() const { return block_size; }
+    /// MIXED_LU stops refining once |b - A x|_inf <= tol * |A|_inf * |x|_inf, 0 picks eps * sqrt(n)
+    void set_refine_tolerance( real_type tol ) { refine_tol = tol; }
+    /// refinement steps taken by the last MIXED_LU solve, -1 if it fell back to a full precision LU
+    int get_refine_iterations() const { return refine_iters; }
 };
 
+typedef BasicLinearSolver<double> LinearSolver;
+typedef BasicLinearSolver<float> LinearSolverF;
+typedef BasicLinearSolver< std::complex<double> > LinearSolverZ;
+typedef BasicLinearSolver< std::complex<float> > LinearSolverC;
+
 }
 
 #endif
@@ -1,37 +1,41 @@
 #include "libmatrix/matrix.h"
+#include "libmatrix/sparse_matrix.h"
 
 namespace mx
 {
 
-void Matrix::print( std::ostream& os ) const
+template<typename T>
+void BasicMatrix<T>::print( std::ostream& os ) const
 {
     for( int i=0; i<_n_row; i++ )
     {
         for( int j=0; j<_n_col; j++ )
         {
-            os << std::setprecision(6) << std::setw(12) << _mat[ index(i,j) ];
+            os << std::setprecision(6) << std::setw(12) << data()[ index(i,j) ];
         }
         os << std::endl;
     }
 }
 
-Matrix::Matrix()
+template<typename T>
+BasicMatrix<T>::BasicMatrix()
 {
     _n_row = 0;
     _n_col = 0;
 }
 
-Matrix::Matrix( MatrixInitilizer mx_init )
+template<typename T>
+BasicMatrix<T>::BasicMatrix( MatrixInitilizer mx_init )
 {
     switch( mx_init.matrix_type )
     {
         case MatInit::ZEROS:
-            resize( mx_init.size, mx_init.size, 0.0 );
+            resize( mx_init.size, mx_init.size, T(0) );
             break;
         case MatInit::EYE:
-            resize( mx_init.size, mx_init.size, 0.0 );
+            resize( mx_init.size, mx_init.size, T(0) );
             for( int i=0; i<mx_init.size; i++ )
-                (*this)(i,i) = 1.0;
+                (*this)(i,i) = T(1);
             break;
         case MatInit::RAND:
             init_mat_random( mx_init.size, []{ return _mat_rng.rand_1000(); }  );
@@ -50,182 +54,314 @@ Matrix::Matrix( MatrixInitilizer mx_init )
     }
 }
 
-Matrix::Matrix( int row, int col, double val )
+template<typename T>
+BasicMatrix<T>::BasicMatrix( int row, int col, T val )
 {
     resize( row, col, val );
 }
 
-Matrix::Matrix( std::tuple<int,int> s, double val )
+template<typename T>
+BasicMatrix<T>::BasicMatrix( std::tuple<int,int> s, T val )
 {
     resize( std::get<0>(s), std::get<1>(s), val );
 }
 
-Matrix::Matrix( std::initializer_list<double> list )
+template<typename T>
+BasicMatrix<T>::BasicMatrix( std::initializer_list<T> list )
 {
     _n_row = list.size();
     _n_col = 1;
-    _mat.reserve( _n_row*_n_col );
+    _mat.reserve( (size_t)_n_row*_n_col );
     _mat.insert( _mat.end(), list.begin(), list.end() );
 }
 
-Matrix::Matrix( std::initializer_list< std::initializer_list<double> > lists )
+template<typename T>
+BasicMatrix<T>::BasicMatrix( std::initializer_list< std::initializer_list<T> > lists )
 {
     _n_row = lists.size();
     _n_col = 0;
     for( auto list : lists )
         if( _n_col < (int)list.size() ) _n_col = (int)list.size();
-    _mat.reserve( _n_row*_n_col );
+    _mat.reserve( (size_t)_n_row*_n_col );
 
     for( auto list : lists )
     {
         _mat.insert( _mat.end(), list.begin(), list.end() );
-        for( int i=list.size(); i<_n_col; i++ ) _mat.push_back(0.0);
+        for( int i=list.size(); i<_n_col; i++ ) _mat.push_back(T(0));
     }
 }
 
-Matrix::Matrix( std::vector< std::vector<double> > vecs )
+template<typename T>
+BasicMatrix<T>::BasicMatrix( std::vector< std::vector<T> > vecs )
 {
     _n_row = vecs.size();
     _n_col = 0;
     for( auto vec : vecs )
         if( _n_col < (int)vec.size() ) _n_col = (int)vec.size();
 
-    _mat.reserve( _n_row*_n_col );
+    _mat.reserve( (size_t)_n_row*_n_col );
     for( auto vec : vecs )
     {
         _mat.insert( _mat.end(), vec.begin(), vec.end() );
-        for( int i=vec.size(); i<_n_col; i++ ) _mat.push_back(0.0);
+        for( int i=vec.size(); i<_n_col; i++ ) _mat.push_back(T(0));
     }
 }
 
-Matrix::Matrix( const char* file_name )
+template<typename T>
+BasicMatrix<T>::BasicMatrix( const char* file_name )
 {
     read_from_file( file_name );
 }
 
-void Matrix::read_from_file( const char* file_name )
+template<typename T>
+BasicMatrix<T>::BasicMatrix( const char* file_name, FileAccess access )
 {
-    std::ifstream ifs( file_name );
-    if( !ifs.is_open() )
-    {
-        std::cerr << "Cannot open file: " << file_name << std::endl;
-        assert( false && "Failed to open file" );
-    }
+    if( access==FILE_MAP )
+        map_file( file_name );
+    else
+        read_from_file( file_name );
+}
 
-    int row, col;
-    std::string type;
-    ifs >> row >> col >> type;
-    assert( row>0 && col>0 );
-    if( type!="DENSE" ) std::cerr << "Error: only DENSE matrix is supported now!" << std::endl;
-    assert( type=="DENSE" );
+template<typename T>
+BasicMatrix<T>::BasicMatrix( const BasicMatrix& other )
+:   _n_row( other._n_row ),
+    _n_col( other._n_col ),
+    _mat( other.data(), other.data() + (size_t)other._n_row*other._n_col )
+{
+}
 
-    resize( row, col );
-    for( int i=0; i<row; i++ )
-        for( int j=0; j<col; j++ )
-            ifs >> (*this)(i,j);
-    ifs.close();
+template<typename T>
+BasicMatrix<T>::BasicMatrix( const BasicConstMatrixView<T>& view )
+:   _n_row( view.n_row() ),
+    _n_col( view.n_col() )
+{
+    _mat.reserve( (size_t)_n_row*_n_col );
+    for( int i=0; i<_n_row; i++ )
+        _mat.insert( _mat.end(), view.data() + (size_t)i*view.ld(), view.data() + (size_t)i*view.ld() + _n_col );
 }
-void Matrix::write_to_file( const char* file_name, int precision )
+
+template<typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator=( const BasicMatrix& other )
+{
+    if( this==&other ) return *this;
+    _mat.assign( other.data(), other.data() + (size_t)other._n_row*other._n_col );
+    _map.reset();
+    _mapped = nullptr;
+    _n_row = other._n_row;
+    _n_col = other._n_col;
+    return *this;
+}
+
+namespace
 {
-    assert( _n_row>0 && _n_col>0 );
-    assert( precision>0 );
 
-    std::ofstream ofs( file_name );
-    if( !ofs.is_open() )
+/// entries of a binary file whose dtype differs from the matrix: widened,
+/// narrowed or made complex, a complex file cannot go into a real matrix
+template<typename T, typename U>
+void convert_entries( const std::vector<char>& buf, T* dst, size_t n )
+{
+    if constexpr( ScalarTraits<U>::is_complex && !ScalarTraits<T>::is_complex )
+    {
+        (void)buf; (void)dst; (void)n;
+        std::cerr << "Error: cannot read a complex matrix file into a real matrix" << std::endl;
+        assert( false && "complex file into a real matrix" );
+    }
+    else
     {
-        std::cerr << "Cannot open file: " << file_name << std::endl;
-        assert( false && "Failed to open file" );
+        const U* src = reinterpret_cast<const U*>( buf.data() );
+        for( size_t i=0; i<n; i++ )
+            dst[i] = T( src[i] );
     }
+}
 
-    ofs << _n_row << " " << _n_col << " DENSE" << std::endl;
+}
 
-    for( int i=0; i<_n_row; i++ )
+template<typename T>
+void BasicMatrix<T>::read_from_file( const char* file_name )
+{
+    if( is_binary_matrix_file( file_name ) )
     {
-        for( int j=0; j<_n_col; j++ )
+        MatrixFileHeader header;
+        int ret = read_matrix_header( file_name, header );
+        assert( ret==0 && "Bad binary matrix file" );
+
+        resize( header.n_row, header.n_col );
+        size_t n = (size_t)_n_row*_n_col;
+        if( header.dtype==MatrixDTypeOf<T>::value )
         {
-            ofs << std::setprecision(precision) << (*this)(i,j) << " ";
+            ret = read_matrix_data( file_name, header, _mat.data() );
+            assert( ret==0 && "Bad binary matrix file" );
+            (void)ret;
+            return;
         }
-        ofs << std::endl;
+        std::vector<char> buf( n*dtype_size( header.dtype ) );
+        ret = read_matrix_data( file_name, header, buf.data() );
+        assert( ret==0 && "Bad binary matrix file" );
+        (void)ret;
+        switch( header.dtype )
+        {
+            case DTYPE_FLOAT32: convert_entries<T, float>( buf, _mat.data(), n ); break;
+            case DTYPE_FLOAT64: convert_entries<T, double>( buf, _mat.data(), n ); break;
+            case DTYPE_COMPLEX64: convert_entries<T, std::complex<float> >( buf, _mat.data(), n ); break;
+            case DTYPE_COMPLEX128: convert_entries<T, std::complex<double> >( buf, _mat.data(), n ); break;
+        }
+        return;
     }
-    ofs.close();
+
+    if( is_sparse_matrix_file( file_name ) )
+    {
+        BasicSparseMatrix<T> sparse;
+        int ret = sparse.read_from_file( file_name );
+        assert( ret==0 && "Failed to read SPARSE file" );
+        (void)ret;
+        *this = sparse.to_matrix();
+        return;
+    }
+
+    /// DENSE text, parsed in parallel straight into the entries
+    DenseReader reader;
+    int ret = reader.open( file_name );
+    assert( ret==0 && "Failed to read DENSE file" );
+    resize( reader.n_row(), reader.n_col() );
+    ret = reader.read_rows( data(), _n_row );
+    assert( ret==_n_row && "Failed to read DENSE file" );
+    (void)ret;
+}
+
+template<typename T>
+void BasicMatrix<T>::map_file( const char* file_name )
+{
+    MatrixFileHeader header;
+    if( !is_binary_matrix_file( file_name ) || read_matrix_header( file_name, header )!=0
+        || header.dtype!=MatrixDTypeOf<T>::value || header.layout!=ROW_MAJOR )
+    {
+        read_from_file( file_name );
+        return;
+    }
+
+    /// no checksum pass here, it would read the whole file; check_matrix_file() does it
+    auto map = std::make_shared<MappedFile>();
+    if( map->open( file_name )!=0 )
+    {
+        read_from_file( file_name );
+        return;
+    }
+    resize( 0, 0 );
+    _mat.shrink_to_fit();
+    _map = map;
+    _mapped = reinterpret_cast<T*>( static_cast<char*>( map->data() ) + header.data_offset );
+    _n_row = header.n_row;
+    _n_col = header.n_col;
+}
+
+template<typename T>
+void BasicMatrix<T>::write_to_binary( const char* file_name, MatrixLayout layout ) const
+{
+    assert( _n_row>0 && _n_col>0 );
+    int ret = write_matrix_file( file_name, data(), MatrixDTypeOf<T>::value, _n_row, _n_col, layout );
+    assert( ret==0 && "Failed to write file" );
+    (void)ret;
+}
+
+template<typename T>
+void BasicMatrix<T>::write_to_file( const char* file_name, int precision )
+{
+    assert( _n_row>0 && _n_col>0 );
+    assert( precision>0 );
+    int ret = write_dense_file( file_name, data(), _n_row, _n_col, precision );
+    assert( ret==0 && "Failed to write file" );
+    (void)ret;
 }
 
-double& Matrix::operator()( int row, int col )
+template<typename T>
+T& BasicMatrix<T>::operator()( int row, int col )
 {
-    return _mat[ index(row,col) ];
+    return data()[ index(row,col) ];
 }
-double& Matrix::operator()( int idx )
+template<typename T>
+T& BasicMatrix<T>::operator()( int idx )
 {
     assert( _n_col==1 && "mat is not a vector" );
     assert( idx>=0 && idx<_n_row );
-    return _mat[ idx ];
+    return data()[ idx ];
 }
 
-double Matrix::operator()( int row, int col ) const
+template<typename T>
+T BasicMatrix<T>::operator()( int row, int col ) const
 {
-    return _mat[ index(row,col) ];
+    return data()[ index(row,col) ];
 }
-double Matrix::operator()( int idx ) const
+template<typename T>
+T BasicMatrix<T>::operator()( int idx ) const
 {
     assert( _n_col==1 && "mat is not a vector" );
     assert( idx>=0 && idx<_n_row );
-    return _mat[ idx ];
+    return data()[ idx ];
 }
 
-void Matrix::resize( int row, int col, double val )
+template<typename T>
+void BasicMatrix<T>::resize( int row, int col, T val )
 {
+    _map.reset();
+    _mapped = nullptr;
     _mat.clear();
     _n_row = row;
     _n_col = col;
-    _mat.resize( row*col, val );
+    _mat.resize( (size_t)row*col, val );
 }
 
-int Matrix::size( int dim ) const
+template<typename T>
+int BasicMatrix<T>::size( int dim ) const
 {
     assert( dim==0 || dim==1 );
     return (dim==0) ? _n_row : _n_col;
 }
 
-Matrix Matrix::transpose() const
+template<typename T>
+BasicMatrix<T> BasicMatrix<T>::transpose() const
 {
     assert( _n_row>0 && _n_col>0 );
-    Matrix res(_n_col,_n_row);
+    BasicMatrix res(_n_col,_n_row);
     for( int i=0; i<_n_row; i++ )
         for( int j=0; j<_n_col; j++ )
             res(j,i) = (*this)(i,j);
     return res;
 }
 
+template<typename T>
 template<typename F>
-void Matrix::init_mat_random( int n, F&& rand )
+void BasicMatrix<T>::init_mat_random( int n, F&& rand )
 {
     resize( n, n );
     for( int i=0; i<n; i++ )
         for( int j=0; j<n; j++ )
-            _mat[ index(i,j) ] = rand();
+            data()[ index(i,j) ] = rand();
 }
 
+template<typename T>
 template<typename F>
-void Matrix::init_mat_rand_sym( int n, F&& rand )
+void BasicMatrix<T>::init_mat_rand_sym( int n, F&& rand )
 {
     init_mat_rand_low_tri( n, rand );
 
     for( int i=0; i<n-1; i++ )
         for( int j=i+1; j<n; j++ )
-            _mat[ index(i,j) ] = _mat[ index(j,i) ];
+            data()[ index(i,j) ] = data()[ index(j,i) ];
 }
 
+template<typename T>
 template<typename F>
-void Matrix::init_mat_rand_low_tri( int n, F&& rand )
+void BasicMatrix<T>::init_mat_rand_low_tri( int n, F&& rand )
 {
     resize( n, n );
     for( int i=0; i<n; i++ )
         for( int j=0; j<=i; j++ )
-            _mat[ index(i,j) ] = rand();
+            data()[ index(i,j) ] = rand();
 }
 
+template<typename T>
 template<typename F>
-void Matrix::init_mat_rand_spd( int n, F&& rand )
+void BasicMatrix<T>::init_mat_rand_spd( int n, F&& rand )
 {
     init_mat_rand_low_tri( n, rand );
     for( int i=0; i<n; i++ )
@@ -235,7 +371,7 @@ void Matrix::init_mat_rand_spd( int n, F&& rand )
 
     for( int i=0; i<n; i++ )
     {
-        double sum = 0.0;
+        T sum = T(0);
         for( int k=0; k<=i; k++ )
             sum += (*this)(i,k)*(*this)(i,k);
         (*this)(i,i) = sum;
@@ -247,59 +383,47 @@ void Matrix::init_mat_rand_spd( int n, F&& rand )
 
     /// avoid round-off error to ensure SPD
     for( int i=0; i<n; i++ )
-        (*this)(i,i) += 1e-12;
+        (*this)(i,i) += real_type(1e-12);
 }
 
-double Matrix::norm( int p )
+template<typename T>
+typename BasicMatrix<T>::real_type BasicMatrix<T>::norm( int p )
 {
     /// lp-norm, p<=0 for infinite form (max of abs of entries)
     if( p<=0 ) return norm_inf();
     if( p==1 ) return norm_1();
 
-    double res = 0.0;
+    real_type res = 0.0;
     for( int i=0; i<_n_row; i++ )
         for( int j=0; j<_n_col; j++ )
-            res += std::pow( (*this)(i,j), p );
+            res += std::pow( std::abs( (*this)(i,j) ), p );
 
     if( p==2 ) return std::sqrt( res );
 
-    return std::pow( res, 1.0/(double)p );
+    return std::pow( res, real_type(1)/p );
 }
 
-double Matrix::norm_1()
+template<typename T>
+typename BasicMatrix<T>::real_type BasicMatrix<T>::norm_1()
 {
     /// l1-norm is the sum of abs of all entries
-    double res = 0.0;
+    real_type res = 0.0;
     for( int i=0; i<_n_row; i++ )
         for( int j=0; j<_n_col; j++ )
             res += std::abs( (*this)(i,j) );
     return res;
 }
 
-double Matrix::norm_inf()
+template<typename T>
+typename BasicMatrix<T>::real_type BasicMatrix<T>::norm_inf()
 {
     /// return max of abs of entries
-    return std::abs( *(std::max_element( _mat.begin(), _mat.end(), [](double x, double y){ return std::abs(x)<std::abs(y); } )) );
-}
-
-Matrix Matrix::submatrix( int r_beg, int r_end, int c_beg, int c_end )
-{
-    /// return submatrix as new Matrix
-    if( r_beg<0 ) r_beg = _n_row + r_beg;
-    if( r_end<0 ) r_end = _n_row + r_end;
-    if( c_beg<0 ) c_beg = _n_col + c_beg;
-    if( c_end<0 ) c_end = _n_col + c_end;
-    assert( r_beg>=0 && r_beg<=r_end );
-    assert( c_beg>=0 && c_beg<=c_end );
-    int row = r_end-r_beg+1, col = c_end-c_beg+1;
-    Matrix sub( row, col );
-    for( int i=0; i<row; i++ )
-        for( int j=0; j<col; j++ )
-            sub(i,j) = (*this)( r_beg+i, c_beg+j );
-    return sub;
+    const T* a = data();
+    return std::abs( *(std::max_element( a, a + (size_t)_n_row*_n_col, [](const T& x, const T& y){ return std::abs(x)<std::abs(y); } )) );
 }
 
-void Matrix::swap_row( int i, int j )
+template<typename T>
+void BasicMatrix<T>::swap_row( int i, int j )
 {
     /// swap two rows
     assert( i>=0 && i<_n_row );
@@ -311,7 +435,8 @@ void Matrix::swap_row( int i, int j )
     }
 }
 
-void Matrix::swap_col( int i, int j )
+template<typename T>
+void BasicMatrix<T>::swap_col( int i, int j )
 {
     /// swap two columns
     assert( i>=0 && i<_n_col );
@@ -323,4 +448,9 @@ void Matrix::swap_col( int i, int j )
     }
 }
 
+template class BasicMatrix<float>;
+template class BasicMatrix<double>;
+template class BasicMatrix< std::complex<float> >;
+template class BasicMatrix< std::complex<double> >;
+
 }
@@ -8,49 +8,110 @@
 #include <functional>
 #include <algorithm>
 #include <fstream>
+#include <memory>
 
 #include "matrix_init.h"
+#include "matrix_file.h"
 #include "matrix_range.h"
+#include "matrix_view.h"
 #include "rand.h"
+#include "scalar.h"
 
 namespace mx
 {
 
-class Matrix
+/// how BasicMatrix( file_name, access ) gets at a binary matrix file
+enum FileAccess
 {
+    FILE_LOAD,  /// read into memory owned by the matrix
+    FILE_MAP    /// map the file and use its data in place, pages load on first touch
+};
+
+template<typename E>
+class MatrixExpr;
+
+/// dense row-major matrix of T, instantiated in matrix.cpp and operation.cpp for
+/// float, double, std::complex<float> and std::complex<double>
+template<typename T>
+class BasicMatrix
+{
+public:
+    typedef T value_type;
+    typedef RealType<T> real_type;
+
+private:
     int _n_row;
     int _n_col;
-    std::vector< double > _mat;
+    std::vector< T > _mat;
+    /// set while the entries live in a mapped binary file instead of _mat
+    std::shared_ptr<MappedFile> _map;
+    T* _mapped = nullptr;
     inline static RNG _mat_rng;
 
-    /* in basic.cpp */
+    /* in matrix.cpp */
 public:
-    Matrix();
-    Matrix( MatrixInitilizer mx_init );
-    Matrix( int row, int col, double val=0.0 );
-    Matrix( std::tuple<int,int>, double val=0.0 );
-    Matrix( std::initializer_list<double> list );
-    Matrix( std::initializer_list< std::initializer_list<double> > lists );
-    Matrix( std::vector< std::vector<double> > vecs );
-    Matrix( const char* file_name );
-    double& operator()( int row, int col );
-    double& operator()( int idx );
-    double operator()( int row, int col ) const;
-    double operator()( int idx ) const;
+    BasicMatrix();
+    BasicMatrix( MatrixInitilizer mx_init );
+    BasicMatrix( int row, int col, T val=T(0) );
+    BasicMatrix( std::tuple<int,int>, T val=T(0) );
+    BasicMatrix( std::initializer_list<T> list );
+    BasicMatrix( std::initializer_list< std::initializer_list<T> > lists );
+    BasicMatrix( std::vector< std::vector<T> > vecs );
+    BasicMatrix( const char* file_name );
+    BasicMatrix( const char* file_name, FileAccess access );
+    /// a copy of a mapped matrix owns its entries, writes to one never show in the other
+    BasicMatrix( const BasicMatrix& other );
+    BasicMatrix& operator=( const BasicMatrix& other );
+    BasicMatrix( BasicMatrix&& other ) = default;
+    BasicMatrix& operator=( BasicMatrix&& other ) = default;
+    /// entrywise conversion from another scalar type, e.g. to factor double data in float
+    template<typename U>
+    explicit BasicMatrix( const BasicMatrix<U>& other );
+    /// the entries of a view copied into a new matrix, same as view.eval()
+    explicit BasicMatrix( const BasicConstMatrixView<T>& view );
+    /// evaluate an expression of expression.h in one pass, see expr_assign()
+    template<typename E>
+    BasicMatrix( const MatrixExpr<E>& expr );
+    template<typename E>
+    BasicMatrix& operator=( const MatrixExpr<E>& expr );
+    T& operator()( int row, int col );
+    T& operator()( int idx );
+    T operator()( int row, int col ) const;
+    T operator()( int idx ) const;
     void print( std::ostream& os=std::cout ) const;
-    void resize( int row, int col, double val=0.0 );
-    void reserve( int row, int col ){ _mat.reserve( row*col ); }
+    void resize( int row, int col, T val=T(0) );
+    void reserve( int row, int col ){ _mat.reserve( (size_t)row*col ); }
     std::tuple<int, int> size() const { return {_n_row, _n_col}; }
     int size( int dim ) const;
     int n_row() const { return _n_row; }
     int n_col() const { return _n_col; }
-    Matrix transpose() const;
-    double norm( int p=2 );
-    double norm_1();
-    double norm_inf();
-    Matrix submatrix( int r_beg, int r_end, int c_beg, int c_end );
+    T* data() { return _map ? _mapped : _mat.data(); }
+    const T* data() const { return _map ? _mapped : _mat.data(); }
+    bool is_mapped() const { return (bool)_map; }
+    BasicMatrix transpose() const;
+    real_type norm( int p=2 );
+    real_type norm_1();
+    real_type norm_inf();
+    /// the whole matrix as a view, e.g. to pass it where a view is expected; views
+    /// are only taken of lvalues, a temporary would be gone before the view is used
+    BasicMatrixView<T> view() & { return BasicMatrixView<T>( data(), _n_row, _n_col, _n_col ); }
+    BasicConstMatrixView<T> view() const& { return BasicConstMatrixView<T>( data(), _n_row, _n_col, _n_col ); }
+    BasicConstMatrixView<T> view() && = delete;
+    /// rows [r_beg, r_end] and columns [c_beg, c_end], inclusive, negative counts from
+    /// the end; nothing is copied, call eval() on the view for a matrix of its own.
+    /// Of a temporary the block is returned as a matrix of its own
+    BasicMatrixView<T> submatrix( int r_beg, int r_end, int c_beg, int c_end ) & { return view().submatrix( r_beg, r_end, c_beg, c_end ); }
+    BasicConstMatrixView<T> submatrix( int r_beg, int r_end, int c_beg, int c_end ) const& { return view().submatrix( r_beg, r_end, c_beg, c_end ); }
+    BasicMatrix submatrix( int r_beg, int r_end, int c_beg, int c_end ) && { return submatrix( r_beg, r_end, c_beg, c_end ).eval(); }
+    /// DENSE text, binary, or SPARSE / MatrixMarket text expanded to a dense matrix,
+    /// told apart by the first bytes of the file
     void read_from_file( const char* file_name );
     void write_to_file( const char* file_name, int precision=16 );
+    /// binary format of matrix_file.h, full precision and no parsing
+    void write_to_binary( const char* file_name, MatrixLayout layout=ROW_MAJOR ) const;
+    /// use a row-major binary file of the same dtype in place, private copy-on-write;
+    /// any other file is loaded as by read_from_file
+    void map_file( const char* file_name );
     void swap_row( int i, int j );
     void swap_col( int i, int j );
 private:
@@ -65,24 +126,38 @@ private:
 
     /* inline functions */
 private:
-    int index(int row, int col) const
+    /// in size_t: a mapped file may hold more than INT_MAX entries
+    size_t index(int row, int col) const
     {
         assert( row>=0 && row<_n_row && col>=0 && col<_n_col );
-        return row*_n_col + col;
+        return (size_t)row*_n_col + col;
     }
 
 };
 
+template<typename T>
+template<typename U>
+BasicMatrix<T>::BasicMatrix( const BasicMatrix<U>& other )
+:   _n_row( other.n_row() ),
+    _n_col( other.n_col() ),
+    _mat( other.data(), other.data() + (size_t)other.n_row()*other.n_col() )
+{
+}
+
+typedef BasicMatrix<double> Matrix;
+typedef BasicMatrix<float> MatrixF;
+typedef BasicMatrix< std::complex<double> > MatrixZ;
+typedef BasicMatrix< std::complex<float> > MatrixC;
+
     /* in operation.cpp */
-std::ostream& operator<<( std::ostream& os, const Matrix& mat );
-Matrix operator+( const Matrix& mat1, const Matrix& mat2 );
-Matrix operator*( const Matrix& mat1, const Matrix& mat2 );
-Matrix operator-( const Matrix& mat1 );
-Matrix operator-( const Matrix& mat1, const Matrix& mat2 );
-Matrix operator*( double scalar, const Matrix& mat );
-Matrix operator*( const Matrix& mat, double scalar );
-Matrix operator/( const Matrix& mat, double scalar );
+template<typename T>
+std::ostream& operator<<( std::ostream& os, const BasicMatrix<T>& mat );
+template<typename T>
+std::ostream& operator<<( std::ostream& os, const BasicConstMatrixView<T>& mat );
 
 }
 
+/// + - * / on matrices and views, built lazily
+#include "expression.h"
+
 #endif
@@ -0,0 +1,367 @@
+#include "libmatrix/matrix_file.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MX_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mx
+{
+
+namespace
+{
+
+constexpr std::uint64_t PRIME1 = 11400714785074694791ULL;
+constexpr std::uint64_t PRIME2 = 14029467366897019727ULL;
+constexpr std::uint64_t PRIME3 = 1609587929392839161ULL;
+
+/// data moves through the streams in blocks of this size
+constexpr std::size_t IO_CHUNK = 1 << 24;
+
+inline std::uint64_t rotl( std::uint64_t x, int r ) { return ( x << r ) | ( x >> (64-r) ); }
+
+/// streaming form of checksum64, fed in pieces of any size
+class Checksum
+{
+    std::uint64_t v[4];
+    unsigned char tail[32];
+    std::size_t n_tail;
+    std::uint64_t total;
+
+    void stripe( const unsigned char* p )
+    {
+        for( int i=0; i<4; i++ )
+        {
+            std::uint64_t w;
+            std::memcpy( &w, p + 8*i, 8 );
+            v[i] = rotl( v[i] + w*PRIME2, 31 ) * PRIME1;
+        }
+    }
+
+public:
+    explicit Checksum( std::uint64_t seed=0 ) : n_tail(0), total(0)
+    {
+        v[0] = seed + PRIME1 + PRIME2;
+        v[1] = seed + PRIME2;
+        v[2] = seed;
+        v[3] = seed - PRIME1;
+    }
+    void update( const void* data, std::size_t bytes )
+    {
+        const unsigned char* p = static_cast<const unsigned char*>( data );
+        total += bytes;
+        if( n_tail>0 )
+        {
+            std::size_t take = std::min( bytes, 32-n_tail );
+            std::memcpy( tail + n_tail, p, take );
+            n_tail += take;
+            p += take;
+            bytes -= take;
+            if( n_tail<32 ) return;
+            stripe( tail );
+            n_tail = 0;
+        }
+        for( ; bytes>=32; p+=32, bytes-=32 )
+            stripe( p );
+        std::memcpy( tail, p, bytes );
+        n_tail = bytes;
+    }
+    std::uint64_t digest() const
+    {
+        std::uint64_t h = rotl( v[0], 1 ) + rotl( v[1], 7 ) + rotl( v[2], 12 ) + rotl( v[3], 18 );
+        h += total;
+        for( std::size_t i=0; i<n_tail; i++ )
+            h = rotl( h ^ ( tail[i]*PRIME3 ), 11 ) * PRIME1;
+        h ^= h >> 33;
+        h *= PRIME2;
+        h ^= h >> 29;
+        h *= PRIME3;
+        h ^= h >> 32;
+        return h;
+    }
+};
+
+std::uint64_t file_size( const char* file_name )
+{
+    std::ifstream ifs( file_name, std::ios::binary | std::ios::ate );
+    if( !ifs.is_open() ) return 0;
+    return (std::uint64_t)ifs.tellg();
+}
+
+}
+
+std::size_t dtype_size( std::uint32_t dtype )
+{
+    switch( dtype )
+    {
+        case DTYPE_FLOAT32: return 4;
+        case DTYPE_FLOAT64: return 8;
+        case DTYPE_COMPLEX64: return 8;
+        case DTYPE_COMPLEX128: return 16;
+        default: return 0;
+    }
+}
+
+std::uint64_t checksum64( const void* data, std::size_t bytes, std::uint64_t seed )
+{
+    Checksum sum( seed );
+    sum.update( data, bytes );
+    return sum.digest();
+}
+
+bool is_binary_matrix_file( const char* file_name )
+{
+    std::ifstream ifs( file_name, std::ios::binary );
+    char magic[8];
+    if( !ifs.read( magic, 8 ) ) return false;
+    return std::memcmp( magic, MATRIX_FILE_MAGIC, 8 )==0;
+}
+
+int read_matrix_header( const char* file_name, MatrixFileHeader& header )
+{
+    std::ifstream ifs( file_name, std::ios::binary );
+    if( !ifs.is_open() )
+    {
+        std::cerr << "Cannot open file: " << file_name << std::endl;
+        return -1;
+    }
+    if( !ifs.read( reinterpret_cast<char*>( &header ), sizeof(header) ) )
+    {
+        std::cerr << "Error: " << file_name << " is too short for a matrix header" << std::endl;
+        return -1;
+    }
+    ifs.close();
+
+    const char* error = nullptr;
+    std::size_t entry = dtype_size( header.dtype );
+    if( std::memcmp( header.magic, MATRIX_FILE_MAGIC, 8 )!=0 )
+        error = "not a binary matrix file";
+    else if( header.header_checksum!=checksum64( &header, offsetof( MatrixFileHeader, header_checksum ) ) )
+        error = "header checksum mismatch";
+    else if( header.byte_order!=MATRIX_FILE_BYTE_ORDER )
+        error = "file was written with the other byte order";
+    else if( header.version!=MATRIX_FILE_VERSION )
+        error = "unsupported file version";
+    else if( entry==0 )
+        error = "unknown dtype";
+    else if( header.layout!=ROW_MAJOR && header.layout!=COL_MAJOR )
+        error = "unknown layout";
+    else if( header.n_row<=0 || header.n_col<=0 || header.n_row>INT32_MAX || header.n_col>INT32_MAX )
+        error = "bad dimensions";
+    else if( (std::uint64_t)header.n_row*header.n_col > (std::uint64_t)PTRDIFF_MAX/entry )
+        error = "data larger than the address space";
+    else if( header.data_offset<sizeof(header) || header.data_offset % MATRIX_FILE_ALIGN!=0 )
+        error = "bad data offset";
+    else if( file_size( file_name ) < header.data_offset + (std::uint64_t)header.n_row*header.n_col*entry )
+        error = "file is shorter than its data";
+    if( error )
+    {
+        std::cerr << "Error: " << file_name << ": " << error << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int check_matrix_file( const char* file_name )
+{
+    MatrixFileHeader header;
+    if( read_matrix_header( file_name, header )!=0 ) return -1;
+
+    std::ifstream ifs( file_name, std::ios::binary );
+    ifs.seekg( header.data_offset );
+    std::uint64_t bytes = (std::uint64_t)header.n_row * header.n_col * dtype_size( header.dtype );
+    std::vector<char> buf( std::min<std::uint64_t>( bytes, IO_CHUNK ) );
+    Checksum sum;
+    for( std::uint64_t done=0; done<bytes; )
+    {
+        std::size_t len = std::min<std::uint64_t>( buf.size(), bytes-done );
+        if( !ifs.read( buf.data(), len ) ) return -1;
+        sum.update( buf.data(), len );
+        done += len;
+    }
+    if( sum.digest()!=header.checksum )
+    {
+        std::cerr << "Error: " << file_name << ": data checksum mismatch" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int write_matrix_file( const char* file_name, const void* data, std::uint32_t dtype,
+                       std::int64_t n_row, std::int64_t n_col, std::uint32_t layout )
+{
+    assert( n_row>0 && n_col>0 );
+    std::size_t entry = dtype_size( dtype );
+    assert( entry>0 );
+
+    std::ofstream ofs( file_name, std::ios::binary | std::ios::trunc );
+    if( !ofs.is_open() )
+    {
+        std::cerr << "Cannot open file: " << file_name << std::endl;
+        return -1;
+    }
+
+    /// the header goes in last, once the data checksum is known
+    std::vector<char> pad( MATRIX_FILE_ALIGN, 0 );
+    ofs.write( pad.data(), pad.size() );
+
+    const char* src = static_cast<const char*>( data );
+    std::uint64_t bytes = (std::uint64_t)n_row * n_col * entry;
+    Checksum sum;
+    if( layout==ROW_MAJOR )
+    {
+        for( std::uint64_t done=0; done<bytes; )
+        {
+            std::size_t len = std::min<std::uint64_t>( IO_CHUNK, bytes-done );
+            ofs.write( src + done, len );
+            sum.update( src + done, len );
+            done += len;
+        }
+    }
+    else
+    {
+        /// gather a few columns at a time
+        std::size_t col_bytes = n_row * entry;
+        std::int64_t n_cols_chunk = std::max<std::int64_t>( 1, IO_CHUNK / col_bytes );
+        std::vector<char> buf( std::min( n_cols_chunk, n_col ) * col_bytes );
+        for( std::int64_t c0=0; c0<n_col; c0+=n_cols_chunk )
+        {
+            std::int64_t cb = std::min( n_cols_chunk, n_col-c0 );
+            for( std::int64_t c=0; c<cb; c++ )
+                for( std::int64_t r=0; r<n_row; r++ )
+                    std::memcpy( buf.data() + ( c*n_row + r )*entry, src + ( r*n_col + c0 + c )*entry, entry );
+            ofs.write( buf.data(), cb*col_bytes );
+            sum.update( buf.data(), cb*col_bytes );
+        }
+    }
+
+    MatrixFileHeader header;
+    std::memset( &header, 0, sizeof(header) );
+    std::memcpy( header.magic, MATRIX_FILE_MAGIC, 8 );
+    header.version = MATRIX_FILE_VERSION;
+    header.byte_order = MATRIX_FILE_BYTE_ORDER;
+    header.dtype = dtype;
+    header.layout = layout;
+    header.n_row = n_row;
+    header.n_col = n_col;
+    header.data_offset = MATRIX_FILE_ALIGN;
+    header.checksum = sum.digest();
+    header.header_checksum = checksum64( &header, offsetof( MatrixFileHeader, header_checksum ) );
+    ofs.seekp( 0 );
+    ofs.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+    ofs.close();
+    if( !ofs )
+    {
+        std::cerr << "Error: failed to write " << file_name << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int read_matrix_data( const char* file_name, const MatrixFileHeader& header, void* data )
+{
+    std::ifstream ifs( file_name, std::ios::binary );
+    if( !ifs.is_open() )
+    {
+        std::cerr << "Cannot open file: " << file_name << std::endl;
+        return -1;
+    }
+    ifs.seekg( header.data_offset );
+
+    std::size_t entry = dtype_size( header.dtype );
+    std::uint64_t bytes = (std::uint64_t)header.n_row * header.n_col * entry;
+    char* dst = static_cast<char*>( data );
+    Checksum sum;
+    if( header.layout==ROW_MAJOR )
+    {
+        /// straight into the destination, checksummed while the chunk is still in cache
+        for( std::uint64_t done=0; done<bytes; )
+        {
+            std::size_t len = std::min<std::uint64_t>( IO_CHUNK, bytes-done );
+            if( !ifs.read( dst + done, len ) ) return -1;
+            sum.update( dst + done, len );
+            done += len;
+        }
+    }
+    else
+    {
+        std::int64_t n_row = header.n_row, n_col = header.n_col;
+        std::size_t col_bytes = n_row * entry;
+        std::int64_t n_cols_chunk = std::max<std::int64_t>( 1, IO_CHUNK / col_bytes );
+        std::vector<char> buf( std::min( n_cols_chunk, n_col ) * col_bytes );
+        for( std::int64_t c0=0; c0<n_col; c0+=n_cols_chunk )
+        {
+            std::int64_t cb = std::min( n_cols_chunk, n_col-c0 );
+            if( !ifs.read( buf.data(), cb*col_bytes ) ) return -1;
+            sum.update( buf.data(), cb*col_bytes );
+            for( std::int64_t c=0; c<cb; c++ )
+                for( std::int64_t r=0; r<n_row; r++ )
+                    std::memcpy( dst + ( r*n_col + c0 + c )*entry, buf.data() + ( c*n_row + r )*entry, entry );
+        }
+    }
+    if( sum.digest()!=header.checksum )
+    {
+        std::cerr << "Error: " << file_name << ": data checksum mismatch" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+MappedFile::MappedFile() : _base(nullptr), _length(0) {}
+
+MappedFile::~MappedFile()
+{
+#ifdef MX_HAVE_MMAP
+    if( _base ) munmap( _base, _length );
+#endif
+}
+
+void MappedFile::release( std::size_t end )
+{
+#ifdef MX_HAVE_MMAP
+    std::size_t page = sysconf( _SC_PAGESIZE );
+    end = std::min( end, _length ) / page * page;
+    if( _base && end>0 ) madvise( _base, end, MADV_DONTNEED );
+#else
+    (void)end;
+#endif
+}
+
+int MappedFile::open( const char* file_name )
+{
+#ifdef MX_HAVE_MMAP
+    assert( _base==nullptr );
+    int fd = ::open( file_name, O_RDONLY );
+    if( fd<0 ) return -1;
+    struct stat st;
+    if( fstat( fd, &st )!=0 || st.st_size==0 )
+    {
+        ::close( fd );
+        return -1;
+    }
+    /// PROT_WRITE on a private mapping of a read-only descriptor is allowed:
+    /// written pages become anonymous copies; MAP_NORESERVE so that a file larger
+    /// than memory is not refused for the copies it will never make
+    void* base = mmap( nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE, fd, 0 );
+    ::close( fd );
+    if( base==MAP_FAILED ) return -1;
+    _base = base;
+    _length = st.st_size;
+    return 0;
+#else
+    (void)file_name;
+    return -1;
+#endif
+}
+
+}
@@ -0,0 +1,160 @@
+#ifndef _MX_MATRIX_FILE_H
+#define _MX_MATRIX_FILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <complex>
+#include <vector>
+
+namespace mx
+{
+
+/// binary matrix file, version 1:
+///   bytes [0, 64)            MatrixFileHeader, native byte order
+///   bytes [64, data_offset)  zero padding, data_offset is a multiple of 4096
+///   bytes [data_offset, ..)  n_row*n_col entries of dtype in the given layout
+/// the data starts on a page boundary so that a row-major file can be mapped and
+/// used in place; checksum covers the data bytes, header_checksum the 56 bytes before it
+
+enum MatrixDType : std::uint32_t
+{
+    DTYPE_FLOAT32 = 0,
+    DTYPE_FLOAT64 = 1,
+    DTYPE_COMPLEX64 = 2,
+    DTYPE_COMPLEX128 = 3
+};
+
+enum MatrixLayout : std::uint32_t
+{
+    ROW_MAJOR = 0,
+    COL_MAJOR = 1
+};
+
+struct MatrixFileHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t dtype;
+    std::uint32_t layout;
+    std::int64_t n_row;
+    std::int64_t n_col;
+    std::uint64_t data_offset;
+    std::uint64_t checksum;
+    std::uint64_t header_checksum;
+};
+static_assert( sizeof(MatrixFileHeader)==64, "MatrixFileHeader must be 64 bytes" );
+
+constexpr char MATRIX_FILE_MAGIC[8] = { 'M', 'X', 'M', 'A', 'T', 'R', 'I', 'X' };
+constexpr std::uint32_t MATRIX_FILE_VERSION = 1;
+constexpr std::uint32_t MATRIX_FILE_BYTE_ORDER = 0x01020304;
+constexpr std::uint64_t MATRIX_FILE_ALIGN = 4096;
+
+template<typename T> struct MatrixDTypeOf;
+template<> struct MatrixDTypeOf<float> { static constexpr MatrixDType value = DTYPE_FLOAT32; };
+template<> struct MatrixDTypeOf<double> { static constexpr MatrixDType value = DTYPE_FLOAT64; };
+template<> struct MatrixDTypeOf< std::complex<float> > { static constexpr MatrixDType value = DTYPE_COMPLEX64; };
+template<> struct MatrixDTypeOf< std::complex<double> > { static constexpr MatrixDType value = DTYPE_COMPLEX128; };
+
+    /* in matrix_file.cpp */
+/// bytes of one entry of dtype, 0 for an unknown dtype
+std::size_t dtype_size( std::uint32_t dtype );
+/// 64-bit hash of a byte range, four independent lanes so it runs near memory speed;
+/// another seed gives an independent hash of the same bytes
+std::uint64_t checksum64( const void* data, std::size_t bytes, std::uint64_t seed=0 );
+/// true if the first bytes of the file are the binary magic
+bool is_binary_matrix_file( const char* file_name );
+/// read and validate the header: magic, version, byte order, dtype, sizes against
+/// the file length and header_checksum; prints the reason and returns -1 on failure
+int read_matrix_header( const char* file_name, MatrixFileHeader& header );
+/// full check of a binary file, header and data checksum, 0 if it is intact
+int check_matrix_file( const char* file_name );
+/// write header, padding and the data of a row-major n_row x n_col buffer,
+/// transposed on the way out for COL_MAJOR; returns 0 or -1
+int write_matrix_file( const char* file_name, const void* data, std::uint32_t dtype,
+                       std::int64_t n_row, std::int64_t n_col, std::uint32_t layout );
+/// read the data of a validated file into a row-major buffer of the file's dtype,
+/// verifies the checksum, returns 0 or -1
+int read_matrix_data( const char* file_name, const MatrixFileHeader& header, void* data );
+
+/// a whole file mapped copy-on-write (MAP_PRIVATE): the pages are read from the file
+/// on first touch and a write gives the process its own copy, the file is never changed
+class MappedFile
+{
+    void* _base;
+    std::size_t _length;
+
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+    /// 0 on success, -1 if the file cannot be opened or mapped
+    int open( const char* file_name );
+    void* data() const { return _base; }
+    std::size_t size() const { return _length; }
+    /// give back the pages of bytes [0, end) that are no longer needed, for one pass
+    /// over a file larger than memory; untouched or rewritten pages read again from the file
+    void release( std::size_t end );
+};
+
+    /* in dense_io.cpp */
+/// DENSE text files, "n_row n_col DENSE" followed by the entries row by row,
+/// separated by any white space; complex entries are written as (re,im)
+
+/// reads a DENSE file as a sequence of row blocks: the file is mapped, each block is
+/// cut at white space into chunks, the chunks are counted and then parsed with
+/// std::from_chars concurrently on thread_pool(), and the consumed pages are released
+class DenseReader
+{
+    MappedFile _file;
+    const char* _pos;
+    const char* _end;
+    int _n_row;
+    int _n_col;
+    int _rows_read;
+    double _bytes_per_entry;
+
+public:
+    DenseReader();
+    /// map the file and parse the header line, 0 on success and -1 otherwise
+    int open( const char* file_name );
+    int n_row() const { return _n_row; }
+    int n_col() const { return _n_col; }
+    int rows_read() const { return _rows_read; }
+    /// parse the next rows, at most max_rows, into the row-major buffer dst of
+    /// max_rows x n_col(); returns the number of rows read, 0 once all are read,
+    /// -1 on a malformed or truncated file
+    template<typename T>
+    int read_rows( T* dst, int max_rows );
+};
+
+/// write n_row x n_col row-major entries as a DENSE file with the given significant
+/// digits; blocks of rows are formatted with std::to_chars concurrently; returns 0 or -1
+template<typename T>
+int write_dense_file( const char* file_name, const T* data, int n_row, int n_col, int precision );
+
+/// SPARSE text files, "n_row n_col SPARSE nnz" followed by nnz lines "row col value"
+/// with 0-based indices, and MatrixMarket coordinate files, "%%MatrixMarket matrix
+/// coordinate real|integer|complex|pattern general|symmetric|skew-symmetric|hermitian",
+/// '%' comment lines, "n_row n_col nnz" and nnz lines of 1-based entries
+
+/// true if the file starts with a SPARSE or MatrixMarket header
+bool is_sparse_matrix_file( const char* file_name );
+/// the entries of a SPARSE or MatrixMarket file as triplets in file order, the lines
+/// cut into chunks and parsed concurrently as in DenseReader; the mirror of each off
+/// diagonal entry of a symmetric, skew-symmetric or hermitian file is added.
+/// 0 on success, -1 on a malformed file or a complex file read into a real T
+template<typename T>
+int read_sparse_file( const char* file_name, int& n_row, int& n_col,
+                      std::vector<int>& rows, std::vector<int>& cols, std::vector<T>& vals );
+/// write compressed rows as a SPARSE file: entries ptr[i] .. ptr[i+1]-1 of outer index i
+/// have inner indices idx[] and values val[]; by_col swaps row and column, for columns
+/// compressed. 0 or -1
+template<typename T>
+int write_sparse_file( const char* file_name, int n_row, int n_col, const int* ptr,
+                       const int* idx, const T* val, bool by_col, int precision );
+
+}
+
+#endif
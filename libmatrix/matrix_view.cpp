@@ -0,0 +1,138 @@
+#include "libmatrix/matrix.h"
+
+#include <cmath>
+
+namespace mx
+{
+
+template<typename T>
+BasicConstMatrixView<T>::BasicConstMatrixView( const BasicMatrix<T>& mat )
+:   _data( mat.data() ), _n_row( mat.n_row() ), _n_col( mat.n_col() ), _ld( mat.n_col() )
+{
+}
+
+template<typename T>
+BasicMatrixView<T>::BasicMatrixView( BasicMatrix<T>& mat )
+:   Base( mat.data(), mat.n_row(), mat.n_col(), mat.n_col() )
+{
+}
+
+template<typename T>
+BasicMatrix<T> BasicConstMatrixView<T>::eval() const
+{
+    return BasicMatrix<T>( *this );
+}
+
+template<typename T>
+BasicMatrix<T> BasicConstMatrixView<T>::transpose() const
+{
+    assert( _n_row>0 && _n_col>0 );
+    BasicMatrix<T> res( _n_col, _n_row );
+    for( int i=0; i<_n_row; i++ )
+        for( int j=0; j<_n_col; j++ )
+            res(j,i) = (*this)(i,j);
+    return res;
+}
+
+template<typename T>
+typename BasicConstMatrixView<T>::real_type BasicConstMatrixView<T>::norm( int p ) const
+{
+    /// lp-norm of the entries as BasicMatrix::norm, p<=0 for the max of abs
+    if( p<=0 ) return norm_inf();
+    if( p==1 ) return norm_1();
+
+    real_type res = 0.0;
+    for( int i=0; i<_n_row; i++ )
+        for( int j=0; j<_n_col; j++ )
+            res += std::pow( std::abs( (*this)(i,j) ), p );
+
+    if( p==2 ) return std::sqrt( res );
+
+    return std::pow( res, real_type(1)/p );
+}
+
+template<typename T>
+typename BasicConstMatrixView<T>::real_type BasicConstMatrixView<T>::norm_1() const
+{
+    real_type res = 0.0;
+    for( int i=0; i<_n_row; i++ )
+        for( int j=0; j<_n_col; j++ )
+            res += std::abs( (*this)(i,j) );
+    return res;
+}
+
+template<typename T>
+typename BasicConstMatrixView<T>::real_type BasicConstMatrixView<T>::norm_inf() const
+{
+    real_type res = 0.0;
+    for( int i=0; i<_n_row; i++ )
+        for( int j=0; j<_n_col; j++ )
+            res = std::max( res, std::abs( (*this)(i,j) ) );
+    return res;
+}
+
+template<typename T>
+void BasicMatrixView<T>::assign( const BasicConstMatrixView<T>& src ) const
+{
+    assert( src.size()==this->size() );
+    for( int i=0; i<this->_n_row; i++ )
+        std::copy( src.data() + (size_t)i*src.ld(), src.data() + (size_t)i*src.ld() + this->_n_col,
+                   data() + (size_t)i*this->_ld );
+}
+
+template<typename T>
+void BasicMatrixView<T>::fill( T val ) const
+{
+    for( int i=0; i<this->_n_row; i++ )
+        std::fill( data() + (size_t)i*this->_ld, data() + (size_t)i*this->_ld + this->_n_col, val );
+}
+
+template<typename T>
+const BasicMatrixView<T>& BasicMatrixView<T>::operator+=( const BasicConstMatrixView<T>& other ) const
+{
+    assert( other.size()==this->size() );
+    for( int i=0; i<this->_n_row; i++ )
+        for( int j=0; j<this->_n_col; j++ )
+            (*this)(i,j) += other(i,j);
+    return *this;
+}
+
+template<typename T>
+const BasicMatrixView<T>& BasicMatrixView<T>::operator-=( const BasicConstMatrixView<T>& other ) const
+{
+    assert( other.size()==this->size() );
+    for( int i=0; i<this->_n_row; i++ )
+        for( int j=0; j<this->_n_col; j++ )
+            (*this)(i,j) -= other(i,j);
+    return *this;
+}
+
+template<typename T>
+const BasicMatrixView<T>& BasicMatrixView<T>::operator*=( T scalar ) const
+{
+    for( int i=0; i<this->_n_row; i++ )
+        for( int j=0; j<this->_n_col; j++ )
+            (*this)(i,j) *= scalar;
+    return *this;
+}
+
+template<typename T>
+void BasicMatrixView<T>::swap_row( int i, int j ) const
+{
+    assert( i>=0 && i<this->_n_row );
+    assert( j>=0 && j<this->_n_row );
+    if( i==j ) return;
+    std::swap_ranges( data() + (size_t)i*this->_ld, data() + (size_t)i*this->_ld + this->_n_col,
+                      data() + (size_t)j*this->_ld );
+}
+
+template class BasicConstMatrixView<float>;
+template class BasicConstMatrixView<double>;
+template class BasicConstMatrixView< std::complex<float> >;
+template class BasicConstMatrixView< std::complex<double> >;
+template class BasicMatrixView<float>;
+template class BasicMatrixView<double>;
+template class BasicMatrixView< std::complex<float> >;
+template class BasicMatrixView< std::complex<double> >;
+
+}
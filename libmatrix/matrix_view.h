@@ -0,0 +1,140 @@
+#ifndef _MX_MATRIX_VIEW_H
+#define _MX_MATRIX_VIEW_H
+
+#include <cassert>
+#include <tuple>
+
+#include "scalar.h"
+
+namespace mx
+{
+
+template<typename T>
+class BasicMatrix;
+
+/// read-only window on row-major entries owned elsewhere: entry (i,j) is data[i*ld + j];
+/// copying a view copies the pointer, eval() copies the entries into a BasicMatrix.
+/// A view is only valid while the matrix it looks at is alive and not resized.
+template<typename T>
+class BasicConstMatrixView
+{
+public:
+    typedef T value_type;
+    typedef RealType<T> real_type;
+
+protected:
+    const T* _data;
+    int _n_row;
+    int _n_col;
+    int _ld;
+
+public:
+    BasicConstMatrixView() : _data(nullptr), _n_row(0), _n_col(0), _ld(0) {}
+    BasicConstMatrixView( const T* data, int row, int col, int ld )
+    :   _data(data), _n_row(row), _n_col(col), _ld(ld)
+    {
+        assert( row>=0 && col>=0 && ld>=col );
+    }
+    /// the whole matrix
+    BasicConstMatrixView( const BasicMatrix<T>& mat );
+
+    T operator()( int row, int col ) const
+    {
+        assert( row>=0 && row<_n_row && col>=0 && col<_n_col );
+        return _data[ (size_t)row*_ld + col ];
+    }
+    T operator()( int idx ) const
+    {
+        assert( _n_col==1 && "view is not a vector" );
+        assert( idx>=0 && idx<_n_row );
+        return _data[ (size_t)idx*_ld ];
+    }
+    std::tuple<int, int> size() const { return {_n_row, _n_col}; }
+    int n_row() const { return _n_row; }
+    int n_col() const { return _n_col; }
+    /// distance between the starts of two rows
+    int ld() const { return _ld; }
+    const T* data() const { return _data; }
+    /// rows follow each other without a gap
+    bool is_contiguous() const { return _ld==_n_col || _n_row<=1; }
+
+    /// rows [r_beg, r_end] and columns [c_beg, c_end], inclusive, negative counts from the end
+    BasicConstMatrixView submatrix( int r_beg, int r_end, int c_beg, int c_end ) const
+    {
+        bounds( _n_row, _n_col, r_beg, r_end, c_beg, c_end );
+        return BasicConstMatrixView( _data + (size_t)r_beg*_ld + c_beg, r_end-r_beg+1, c_end-c_beg+1, _ld );
+    }
+
+    /* in matrix_view.cpp */
+    BasicMatrix<T> eval() const;
+    BasicMatrix<T> transpose() const;
+    real_type norm( int p=2 ) const;
+    real_type norm_1() const;
+    real_type norm_inf() const;
+
+protected:
+    /// resolve the inclusive, possibly negative bounds of submatrix()
+    static void bounds( int n_row, int n_col, int& r_beg, int& r_end, int& c_beg, int& c_end )
+    {
+        if( r_beg<0 ) r_beg = n_row + r_beg;
+        if( r_end<0 ) r_end = n_row + r_end;
+        if( c_beg<0 ) c_beg = n_col + c_beg;
+        if( c_end<0 ) c_end = n_col + c_end;
+        assert( r_beg>=0 && r_beg<=r_end && r_end<n_row );
+        assert( c_beg>=0 && c_beg<=c_end && c_end<n_col );
+    }
+};
+
+/// writable window, also usable wherever a BasicConstMatrixView is expected; writes go
+/// straight to the viewed matrix
+template<typename T>
+class BasicMatrixView : public BasicConstMatrixView<T>
+{
+    typedef BasicConstMatrixView<T> Base;
+
+public:
+    BasicMatrixView() {}
+    BasicMatrixView( T* data, int row, int col, int ld ) : Base( data, row, col, ld ) {}
+    BasicMatrixView( BasicMatrix<T>& mat );
+
+    T& operator()( int row, int col ) const
+    {
+        assert( row>=0 && row<this->_n_row && col>=0 && col<this->_n_col );
+        return data()[ (size_t)row*this->_ld + col ];
+    }
+    T& operator()( int idx ) const
+    {
+        assert( this->_n_col==1 && "view is not a vector" );
+        assert( idx>=0 && idx<this->_n_row );
+        return data()[ (size_t)idx*this->_ld ];
+    }
+    T* data() const { return const_cast<T*>( this->_data ); }
+
+    BasicMatrixView submatrix( int r_beg, int r_end, int c_beg, int c_end ) const
+    {
+        Base::bounds( this->_n_row, this->_n_col, r_beg, r_end, c_beg, c_end );
+        return BasicMatrixView( data() + (size_t)r_beg*this->_ld + c_beg, r_end-r_beg+1, c_end-c_beg+1, this->_ld );
+    }
+
+    /* in matrix_view.cpp */
+    /// copy the entries of a view of the same size, the two must not overlap
+    void assign( const BasicConstMatrixView<T>& src ) const;
+    void fill( T val ) const;
+    const BasicMatrixView& operator+=( const BasicConstMatrixView<T>& other ) const;
+    const BasicMatrixView& operator-=( const BasicConstMatrixView<T>& other ) const;
+    const BasicMatrixView& operator*=( T scalar ) const;
+    void swap_row( int i, int j ) const;
+};
+
+typedef BasicMatrixView<double> MatrixView;
+typedef BasicMatrixView<float> MatrixViewF;
+typedef BasicMatrixView< std::complex<double> > MatrixViewZ;
+typedef BasicMatrixView< std::complex<float> > MatrixViewC;
+typedef BasicConstMatrixView<double> ConstMatrixView;
+typedef BasicConstMatrixView<float> ConstMatrixViewF;
+typedef BasicConstMatrixView< std::complex<double> > ConstMatrixViewZ;
+typedef BasicConstMatrixView< std::complex<float> > ConstMatrixViewC;
+
+}
+
+#endif
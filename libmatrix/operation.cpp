@@ -1,84 +1,36 @@
 #include "libmatrix/matrix.h"
+#include "libmatrix/blas.h"
 
 namespace mx
 {
 
-Matrix operator+( const Matrix& mat1, const Matrix& mat2 )
-{
-    assert( mat1.size()==mat2.size() );
-    auto [row, col] = mat1.size();
-    Matrix res( row, col );
-    for( int i=0; i<row; i++ )
-        for( int j=0; j<col; j++ )
-            res(i,j) = mat1(i,j) + mat2(i,j);
-
-    return res;
-}
-
-Matrix operator-( const Matrix& mat1 )
-{
-    auto [row, col] = mat1.size();
-    Matrix res( row, col );
-    for( int i=0; i<row; i++ )
-        for( int j=0; j<col; j++ )
-            res(i,j) = -mat1(i,j);
-    return res;
-}
-
-Matrix operator-( const Matrix& mat1, const Matrix& mat2 )
-{
-    assert( mat1.size()==mat2.size() );
-    auto [row, col] = mat1.size();
-    Matrix res( row, col );
-    for( int i=0; i<row; i++ )
-        for( int j=0; j<col; j++ )
-            res(i,j) = mat1(i,j) - mat2(i,j);
-
-    return res;
-}
-
-Matrix operator*( const Matrix& mat1, const Matrix& mat2 )
-{
-    assert( mat1.n_col()==mat2.n_row() );
-    int row = mat1.n_row(), col = mat2.n_col(), len = mat1.n_col();
-    Matrix res( row, col );
-    for( int i=0; i<row; i++ )
-        for( int j=0; j<col; j++ )
-            for( int k=0; k<len; k++ )
-                res(i,j) += mat1(i,k) * mat2(k,j);
-    return res;
-}
-
-Matrix operator*( double scalar, const Matrix& mat )
-{
-    auto [row, col] = mat.size();
-    Matrix res( row, col );
-    for( int i=0; i<row; i++ )
-        for( int j=0; j<col; j++ )
-                res(i,j) = scalar * mat(i,j);
-    return res;
-}
-
+/// the arithmetic operators are expression templates in expression.h
 
-Matrix operator*( const Matrix& mat, double scalar )
+template<typename T>
+std::ostream& operator<<( std::ostream& os, const BasicConstMatrixView<T>& mat )
 {
-    return scalar*mat;
-}
-
-Matrix operator/( const Matrix& mat, double scalar )
-{
-    auto [row, col] = mat.size();
-    Matrix res( row, col );
-    for( int i=0; i<row; i++ )
-        for( int j=0; j<col; j++ )
-                res(i,j) = mat(i,j) / scalar;
-    return res;
+    for( int i=0; i<mat.n_row(); i++ )
+    {
+        for( int j=0; j<mat.n_col(); j++ )
+            os << std::setprecision(6) << std::setw(12) << mat(i,j);
+        os << std::endl;
+    }
+    return os;
 }
 
-std::ostream& operator<<( std::ostream& os, const Matrix& mat )
+template<typename T>
+std::ostream& operator<<( std::ostream& os, const BasicMatrix<T>& mat )
 {
     mat.print(os);
     return os;
 }
 
+#define MX_INSTANTIATE_OPERATIONS(T) \
+    template std::ostream& operator<<( std::ostream&, const BasicMatrix<T>& ); \
+    template std::ostream& operator<<( std::ostream&, const BasicConstMatrixView<T>& );
+MX_INSTANTIATE_OPERATIONS(float)
+MX_INSTANTIATE_OPERATIONS(double)
+MX_INSTANTIATE_OPERATIONS(std::complex<float>)
+MX_INSTANTIATE_OPERATIONS(std::complex<double>)
+
 }
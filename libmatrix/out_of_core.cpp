@@ -0,0 +1,491 @@
+#include "out_of_core.h"
+#include "blas.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace mx
+{
+
+namespace
+{
+
+/// tiles kept in flight ahead of the one being used
+constexpr int PREFETCH_DEPTH = 16;
+
+/// a known sequence of tile reads, the next few are kept loading in the background
+class TileSchedule
+{
+    TileCache& _cache;
+    std::vector<long> _order;
+    std::size_t _next;
+    std::size_t _issued;
+    std::size_t _depth;
+
+public:
+    TileSchedule( TileCache& cache )
+    :   _cache(cache), _next(0), _issued(0),
+        _depth( std::min<std::size_t>( PREFETCH_DEPTH, ( cache.capacity() - 2 )/2 ) )
+    {
+    }
+    void reset( std::vector<long> order )
+    {
+        _order = std::move( order );
+        _next = 0;
+        _issued = 0;
+        ahead();
+    }
+    void ahead()
+    {
+        for( ; _issued<_order.size() && _issued<_next+_depth; _issued++ )
+            _cache.prefetch( _order[_issued] );
+    }
+    /// acquire the next tile of the sequence for reading, it has to be id
+    template<typename T>
+    const T* next( long id )
+    {
+        assert( _next<_order.size() && _order[_next]==id );
+        _next++;
+        ahead();
+        return static_cast<const T*>( _cache.acquire( id, TileCache::READ ) );
+    }
+};
+
+/// Cholesky of the n x n lower triangle of a, as chole_tile in lu.cpp
+template<typename T>
+int chole_block( int n, T* a, int lda )
+{
+    for( int i=0; i<n; i++ )
+    {
+        T* ai = a + i*lda;
+        for( int j=0; j<=i; j++ )
+        {
+            const T* aj = a + j*lda;
+            T sum = T(0);
+            for( int k=0; k<j; k++ )
+                sum += ai[k] * scalar_conj( aj[k] );
+
+            if( i==j )
+            {
+                RealType<T> d = scalar_real( ai[i] - sum );
+                if( d <= 0 ) return -1;
+                ai[i] = std::sqrt( d );
+            }
+            else
+                ai[j] = ( ai[j] - sum ) / aj[j];
+        }
+    }
+    return 0;
+}
+
+}
+
+template<typename T>
+BasicOutOfCoreSolver<T>::BasicOutOfCoreSolver()
+:   _cache_bytes( std::size_t(1) << 30 ),
+    status(EMPTY),
+    mode(NONE)
+{
+}
+
+template<typename T>
+BasicOutOfCoreSolver<T>::BasicOutOfCoreSolver( std::size_t cache_bytes )
+:   _cache_bytes(cache_bytes),
+    status(EMPTY),
+    mode(NONE)
+{
+}
+
+template<typename T>
+int BasicOutOfCoreSolver<T>::open_tiles()
+{
+    if( _file.dtype()!=MatrixDTypeOf<T>::value )
+    {
+        std::cerr << "Error: tile file holds another dtype" << std::endl;
+        _file.close();
+        return -1;
+    }
+    perm.resize( _file.n() );
+    if( _file.read_perm( perm.data() )!=0 )
+    {
+        std::cerr << "Error: cannot read the pivots of the tile file" << std::endl;
+        _file.close();
+        return -1;
+    }
+    switch( _file.state() )
+    {
+        case TILES_LU: status = LU_SUCCESS; mode = PARTIAL_LU; break;
+        case TILES_CHOLE: status = CHOLE_SUCCESS; mode = CHOLE; break;
+        default: status = MAT_SET; mode = NONE; break;
+    }
+    return 0;
+}
+
+template<typename T>
+void BasicOutOfCoreSolver<T>::add_stats( TileCache& cache )
+{
+    TileCacheStats s = cache.stats();
+    _stats.hits += s.hits;
+    _stats.misses += s.misses;
+    _stats.prefetches += s.prefetches;
+    _stats.reads += s.reads;
+    _stats.writes += s.writes;
+}
+
+template<typename T>
+int BasicOutOfCoreSolver<T>::set_matrix( const char* tile_file, const MatrixType& mat, int nb )
+{
+    auto [row, col] = mat.size();
+    assert( row>0 && row==col );
+    assert( nb>0 );
+    status = EMPTY;
+    if( _file.create( tile_file, MatrixDTypeOf<T>::value, row, std::min( nb, row ) )!=0 ) return -1;
+    for( int i=0; i<_file.n_tile(); i++ )
+    {
+        if( _file.write_tile_row( i, mat.data() + (std::size_t)i*_file.nb()*row )!=0 )
+        {
+            std::cerr << "Error: cannot write " << tile_file << std::endl;
+            return -1;
+        }
+    }
+    return open_tiles();
+}
+
+template<typename T>
+int BasicOutOfCoreSolver<T>::import_file( const char* tile_file, const char* matrix_file, int nb )
+{
+    assert( nb>0 );
+    status = EMPTY;
+    if( is_binary_matrix_file( matrix_file ) )
+    {
+        /// binary rows are used straight from the mapping, the pages are dropped behind
+        MatrixFileHeader header;
+        if( read_matrix_header( matrix_file, header )!=0 ) return -1;
+        if( header.dtype!=MatrixDTypeOf<T>::value || header.layout!=ROW_MAJOR || header.n_row!=header.n_col )
+        {
+            std::cerr << "Error: " << matrix_file << ": only square row-major files of the solver's dtype can be imported" << std::endl;
+            return -1;
+        }
+        MappedFile map;
+        if( map.open( matrix_file )!=0 )
+        {
+            std::cerr << "Cannot map file: " << matrix_file << std::endl;
+            return -1;
+        }
+        int n = (int)header.n_row;
+        if( _file.create( tile_file, header.dtype, n, std::min( nb, n ) )!=0 ) return -1;
+        const char* data = static_cast<const char*>( map.data() ) + header.data_offset;
+        std::size_t block_bytes = (std::size_t)_file.nb() * n * sizeof(T);
+        for( int i=0; i<_file.n_tile(); i++ )
+        {
+            if( _file.write_tile_row( i, data + i*block_bytes )!=0 ) return -1;
+            map.release( header.data_offset + (i+1)*block_bytes );
+        }
+        return open_tiles();
+    }
+
+    DenseReader reader;
+    if( reader.open( matrix_file )!=0 ) return -1;
+    if( reader.n_row()!=reader.n_col() )
+    {
+        std::cerr << "Error: " << matrix_file << ": the matrix is not square" << std::endl;
+        return -1;
+    }
+    int n = reader.n_row();
+    if( _file.create( tile_file, MatrixDTypeOf<T>::value, n, std::min( nb, n ) )!=0 ) return -1;
+    std::vector<T> rows( (std::size_t)_file.nb() * n );
+    for( int i=0; i<_file.n_tile(); i++ )
+    {
+        if( reader.read_rows( rows.data(), _file.nb() )!=_file.tile_dim( i ) ) return -1;
+        if( _file.write_tile_row( i, rows.data() )!=0 ) return -1;
+    }
+    return open_tiles();
+}
+
+template<typename T>
+int BasicOutOfCoreSolver<T>::open( const char* tile_file )
+{
+    status = EMPTY;
+    if( _file.open( tile_file )!=0 ) return -1;
+    return open_tiles();
+}
+
+template<typename T>
+int BasicOutOfCoreSolver<T>::lu_decomp_partial()
+{
+    /// left-looking LU with partial pivoting over tile columns: column j is read into
+    /// a buffer, the swaps and TRSM / GEMM updates of every factored column k < j are
+    /// replayed on it, then the panel below the diagonal is factored and written back
+    assert( status==MAT_SET );
+    int n = _file.n();
+    int nb = _file.nb();
+    int nt = _file.n_tile();
+    auto tile = [nt]( int i, int j ){ return (long)i*nt + j; };
+    auto reads = [&]( int j )
+    {
+        std::vector<long> order;
+        for( int i=0; i<nt; i++ ) order.push_back( tile(i,j) );
+        for( int k=0; k<j; k++ )
+            for( int i=k; i<nt; i++ ) order.push_back( tile(i,k) );
+        return order;
+    };
+
+    TileCache cache( _file, _cache_bytes );
+    TileSchedule schedule( cache );
+    std::vector<T> col( (std::size_t)n*nb );
+    int ret = 0;
+    schedule.reset( reads(0) );
+    for( int j=0; j<nt && ret==0; j++ )
+    {
+        int j0 = j*nb, jb = _file.tile_dim(j);
+        T* c = col.data();
+        for( int i=0; i<nt && ret==0; i++ )
+        {
+            const T* t = schedule.next<T>( tile(i,j) );
+            if( !t ) { ret = -1; break; }
+            std::memcpy( c + (std::size_t)i*nb*nb, t, sizeof(T)*_file.tile_dim(i)*nb );
+            cache.release( tile(i,j), false );
+        }
+
+        for( int k=0; k<j && ret==0; k++ )
+        {
+            int k0 = k*nb, kb = nb;
+            lu_swap_rows( n, c, nb, perm.data(), k0, kb, 0, jb );
+            for( int i=k; i<nt; i++ )
+            {
+                const T* t = schedule.next<T>( tile(i,k) );
+                if( !t ) { ret = -1; break; }
+                int i0 = i*nb, ib = _file.tile_dim(i);
+                if( i==k )
+                    trsm_left( true, false, true, kb, jb, t, nb, c + k0*nb, nb );
+                else
+                    gemm( false, false, ib, jb, kb, T(-1), t, nb, c + (std::size_t)k0*nb, nb, T(1), c + (std::size_t)i0*nb, nb );
+                cache.release( tile(i,k), false );
+            }
+        }
+        if( ret!=0 ) break;
+
+        /// the next column starts loading while this panel is factored
+        if( j+1<nt ) schedule.reset( reads(j+1) );
+        if( lu_panel_partial( n-j0, c + (std::size_t)j0*nb, nb, perm.data()+j0, 0, jb, true )!=0 )
+        {
+            ret = -1;
+            break;
+        }
+        for( int k=j0; k<j0+jb; k++ )
+            perm[k] += j0;
+
+        for( int i=0; i<nt; i++ )
+        {
+            T* t = static_cast<T*>( cache.acquire( tile(i,j), TileCache::OVERWRITE ) );
+            if( !t ) { ret = -1; break; }
+            std::memcpy( t, c + (std::size_t)i*nb*nb, sizeof(T)*_file.tile_dim(i)*nb );
+            cache.release( tile(i,j), true );
+            cache.write_back( tile(i,j) );
+        }
+    }
+    if( !cache.flush() ) ret = -1;
+    add_stats( cache );
+    if( ret!=0 ) return -1;
+
+    if( _file.write_perm( perm.data() )!=0 || _file.set_state( TILES_LU )!=0 ) return -1;
+    status = LU_SUCCESS;
+    mode = PARTIAL_LU;
+    return 0;
+}
+
+template<typename T>
+int BasicOutOfCoreSolver<T>::chole_decomp()
+{
+    /// left-looking Cholesky over tile columns: the lower part of column j is updated
+    /// by SYRK / GEMM with the factored tiles of row j and below, then POTRF on the
+    /// diagonal tile and TRSM under it
+    assert( status==MAT_SET );
+    int n = _file.n();
+    int nb = _file.nb();
+    int nt = _file.n_tile();
+    auto tile = [nt]( int i, int j ){ return (long)i*nt + j; };
+    auto reads = [&]( int j )
+    {
+        std::vector<long> order;
+        for( int i=j; i<nt; i++ ) order.push_back( tile(i,j) );
+        for( int k=0; k<j; k++ )
+            for( int i=j; i<nt; i++ ) order.push_back( tile(i,k) );
+        return order;
+    };
+
+    TileCache cache( _file, _cache_bytes );
+    TileSchedule schedule( cache );
+    std::vector<T> col( (std::size_t)n*nb );
+    int ret = 0;
+    schedule.reset( reads(0) );
+    for( int j=0; j<nt && ret==0; j++ )
+    {
+        int j0 = j*nb, jb = _file.tile_dim(j);
+        T* c = col.data();
+        for( int i=j; i<nt; i++ )
+        {
+            const T* t = schedule.next<T>( tile(i,j) );
+            if( !t ) { ret = -1; break; }
+            std::memcpy( c + (std::size_t)i*nb*nb, t, sizeof(T)*_file.tile_dim(i)*nb );
+            cache.release( tile(i,j), false );
+        }
+
+        for( int k=0; k<j && ret==0; k++ )
+        {
+            /// L_jk stays pinned for the whole tile column k
+            const T* ljk = schedule.next<T>( tile(j,k) );
+            if( !ljk ) { ret = -1; break; }
+            syrk_lower( jb, nb, T(-1), ljk, nb, T(1), c + (std::size_t)j0*nb, nb );
+            for( int i=j+1; i<nt; i++ )
+            {
+                const T* t = schedule.next<T>( tile(i,k) );
+                if( !t ) { ret = -1; break; }
+                int i0 = i*nb, ib = _file.tile_dim(i);
+                gemm( false, true, ib, jb, nb, T(-1), t, nb, ljk, nb, T(1), c + (std::size_t)i0*nb, nb );
+                cache.release( tile(i,k), false );
+            }
+            cache.release( tile(j,k), false );
+        }
+        if( ret!=0 ) break;
+
+        if( j+1<nt ) schedule.reset( reads(j+1) );
+        if( chole_block( jb, c + (std::size_t)j0*nb, nb )!=0 )
+        {
+            ret = -1;
+            break;
+        }
+        if( n-j0-jb>0 )
+            trsm_right( true, true, false, n-j0-jb, jb, c + (std::size_t)j0*nb, nb, c + (std::size_t)(j0+jb)*nb, nb );
+
+        for( int i=j; i<nt; i++ )
+        {
+            T* t = static_cast<T*>( cache.acquire( tile(i,j), TileCache::OVERWRITE ) );
+            if( !t ) { ret = -1; break; }
+            std::memcpy( t, c + (std::size_t)i*nb*nb, sizeof(T)*_file.tile_dim(i)*nb );
+            cache.release( tile(i,j), true );
+            cache.write_back( tile(i,j) );
+        }
+    }
+    if( !cache.flush() ) ret = -1;
+    add_stats( cache );
+    if( ret!=0 ) return -1;
+
+    if( _file.set_state( TILES_CHOLE )!=0 ) return -1;
+    status = CHOLE_SUCCESS;
+    mode = CHOLE;
+    return 0;
+}
+
+template<typename T>
+int BasicOutOfCoreSolver<T>::solve_inplace( MatrixType& b )
+{
+    /// one forward and one backward sweep over the tiles, the block B stays in memory
+    assert( status==LU_SUCCESS || status==CHOLE_SUCCESS );
+    assert( b.n_row()==_file.n() );
+    int n = _file.n();
+    int nb = _file.nb();
+    int nt = _file.n_tile();
+    int m = b.n_col();
+    if( m==0 ) return 0;
+    T* x = b.data();
+    bool lu = ( status==LU_SUCCESS );
+    auto tile = [nt]( int i, int j ){ return (long)i*nt + j; };
+
+    /// forward: tile column k of L, diagonal tile first
+    std::vector<long> order;
+    for( int k=0; k<nt; k++ )
+        for( int i=k; i<nt; i++ ) order.push_back( tile(i,k) );
+    /// backward: the diagonal tile, then U_ik above it, or L_ki^H left of it
+    for( int k=nt-1; k>=0; k-- )
+    {
+        order.push_back( tile(k,k) );
+        for( int i=0; i<k; i++ ) order.push_back( lu ? tile(i,k) : tile(k,i) );
+    }
+
+    TileCache cache( _file, _cache_bytes );
+    TileSchedule schedule( cache );
+    schedule.reset( std::move( order ) );
+    int ret = 0;
+    for( int k=0; k<nt && ret==0; k++ )
+    {
+        int k0 = k*nb, kb = _file.tile_dim(k);
+        if( lu )
+        {
+            for( int r=k0; r<k0+kb && r<n-1; r++ )
+                if( perm[r]!=r )
+                    std::swap_ranges( x + (std::size_t)r*m, x + (std::size_t)r*m + m, x + (std::size_t)perm[r]*m );
+        }
+        for( int i=k; i<nt; i++ )
+        {
+            const T* t = schedule.next<T>( tile(i,k) );
+            if( !t ) { ret = -1; break; }
+            int i0 = i*nb, ib = _file.tile_dim(i);
+            if( i==k )
+                trsm_left( true, false, lu, kb, m, t, nb, x + (std::size_t)k0*m, m );
+            else
+                gemm( false, false, ib, m, kb, T(-1), t, nb, x + (std::size_t)k0*m, m, T(1), x + (std::size_t)i0*m, m );
+            cache.release( tile(i,k), false );
+        }
+    }
+    for( int k=nt-1; k>=0 && ret==0; k-- )
+    {
+        int k0 = k*nb, kb = _file.tile_dim(k);
+        const T* d = schedule.next<T>( tile(k,k) );
+        if( !d ) { ret = -1; break; }
+        trsm_left( !lu, !lu, false, kb, m, d, nb, x + (std::size_t)k0*m, m );
+        cache.release( tile(k,k), false );
+        for( int i=0; i<k; i++ )
+        {
+            long id = lu ? tile(i,k) : tile(k,i);
+            const T* t = schedule.next<T>( id );
+            if( !t ) { ret = -1; break; }
+            int i0 = i*nb;
+            gemm( !lu, false, nb, m, kb, T(-1), t, nb, x + (std::size_t)k0*m, m, T(1), x + (std::size_t)i0*m, m );
+            cache.release( id, false );
+        }
+    }
+    add_stats( cache );
+    return ret;
+}
+
+template<typename T>
+typename BasicOutOfCoreSolver<T>::MatrixType BasicOutOfCoreSolver<T>::solve( const MatrixType& b )
+{
+    MatrixType x = b;
+    int ret = solve_inplace( x );
+    assert( ret==0 && "Out-of-core solve failed" );
+    (void)ret;
+    return x;
+}
+
+template<typename T>
+typename BasicOutOfCoreSolver<T>::MatrixType BasicOutOfCoreSolver<T>::load_matrix()
+{
+    assert( status!=EMPTY );
+    int n = _file.n();
+    int nb = _file.nb();
+    int nt = _file.n_tile();
+    MatrixType res( n, n );
+    std::vector<T> t( (std::size_t)nb*nb );
+    for( int i=0; i<nt; i++ )
+    {
+        for( int j=0; j<nt; j++ )
+        {
+            int ret = _file.read_tile( (long)i*nt + j, t.data() );
+            assert( ret==0 && "Failed to read tile" );
+            (void)ret;
+            for( int r=0; r<_file.tile_dim(i); r++ )
+                std::copy( t.data() + r*nb, t.data() + r*nb + _file.tile_dim(j), &res( i*nb + r, j*nb ) );
+        }
+    }
+    return res;
+}
+
+template class BasicOutOfCoreSolver<float>;
+template class BasicOutOfCoreSolver<double>;
+template class BasicOutOfCoreSolver< std::complex<float> >;
+template class BasicOutOfCoreSolver< std::complex<double> >;
+
+}
@@ -0,0 +1,79 @@
+#ifndef _MX_OUT_OF_CORE_H
+#define _MX_OUT_OF_CORE_H
+
+#include <vector>
+
+#include "matrix.h"
+#include "lu.h"
+#include "scalar.h"
+#include "tile_file.h"
+
+namespace mx
+{
+
+/// LU with partial pivoting / Cholesky of a matrix that lives in a TileFile instead of
+/// memory: left-looking over tile columns, so each column is read, updated by the
+/// factored columns left of it, factored and written once; the factored tiles stream
+/// through a TileCache of cache_bytes with prefetch and write-back. Memory use is the
+/// cache, one n x nb tile column and the pivots.
+///
+/// The factors overwrite the tile file and follow LinearSolver: perm[k] is the row
+/// swapped with row k, L has a unit diagonal, Cholesky keeps L in the lower triangle.
+/// The rows of L below a panel are stored in the order they had when that panel was
+/// factored, later swaps are replayed by the solve instead of rewriting L on disk.
+template<typename T>
+class BasicOutOfCoreSolver
+{
+public:
+    typedef BasicMatrix<T> MatrixType;
+    typedef RealType<T> real_type;
+
+private:
+    TileFile _file;
+    std::size_t _cache_bytes;
+    LinearSolverStatus status;
+    LinearSolverMode mode;
+    std::vector<int> perm;
+    TileCacheStats _stats;
+
+    int open_tiles();
+    void add_stats( TileCache& cache );
+
+public:
+    BasicOutOfCoreSolver();
+    BasicOutOfCoreSolver( std::size_t cache_bytes );
+    void set_cache_bytes( std::size_t bytes ) { _cache_bytes = bytes; }
+    std::size_t get_cache_bytes() const { return _cache_bytes; }
+
+    /// write mat into a new tile file of nb x nb tiles, 0 on success and -1 otherwise
+    int set_matrix( const char* tile_file, const MatrixType& mat, int nb );
+    /// stream a DENSE text or row-major binary matrix file of the same dtype into a new
+    /// tile file, one tile row at a time
+    int import_file( const char* tile_file, const char* matrix_file, int nb );
+    /// reopen a tile file written before, holding a matrix or its factors
+    int open( const char* tile_file );
+
+    int n() const { return _file.n(); }
+    LinearSolverStatus get_status() const { return status; }
+    /// tile traffic summed over the factorizations and solves so far
+    const TileCacheStats& get_cache_stats() const { return _stats; }
+
+    /// 0 on success, -1 on a zero pivot / non positive definite matrix or an I/O error
+    int lu_decomp_partial();
+    int chole_decomp();
+
+    /// solve A X = B in place for the n x k block B held in memory, 0 or -1 on an I/O error
+    int solve_inplace( MatrixType& b );
+    MatrixType solve( const MatrixType& b );
+    /// the whole tile file gathered into memory, the matrix or its packed factors
+    MatrixType load_matrix();
+};
+
+typedef BasicOutOfCoreSolver<double> OutOfCoreSolver;
+typedef BasicOutOfCoreSolver<float> OutOfCoreSolverF;
+typedef BasicOutOfCoreSolver< std::complex<double> > OutOfCoreSolverZ;
+typedef BasicOutOfCoreSolver< std::complex<float> > OutOfCoreSolverC;
+
+}
+
+#endif
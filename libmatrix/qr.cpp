@@ -0,0 +1,315 @@
+#include "libmatrix/blas.h"
+#include "libmatrix/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace mx
+{
+
+namespace
+{
+
+/// below this many entries a level-2 sweep of the pivoted QR stays on the calling thread
+constexpr std::size_t QR_PARALLEL_WORK = 1 << 16;
+
+/// the reflector H = I - tau v v^* with H^* ( alpha, x ) = ( beta, 0 ) and beta real:
+/// alpha becomes beta and x, of stride incx, the tail of v below its implied unit head
+template<typename T>
+T householder( int n, T& alpha, T* x, int incx )
+{
+    typedef RealType<T> real_type;
+    real_type x_sq = 0;
+    for( int i=0; i<n; i++ )
+        x_sq += scalar_abs2( x[(std::size_t)i*incx] );
+    if( x_sq==0 && std::imag( alpha )==0 ) return T(0);
+    real_type beta = std::sqrt( scalar_abs2( alpha ) + x_sq );
+    if( scalar_real( alpha )>=0 ) beta = -beta;
+    T tau = ( T(beta) - alpha ) / T(beta);
+    T scal = T(1) / ( alpha - T(beta) );
+    for( int i=0; i<n; i++ )
+        x[(std::size_t)i*incx] *= scal;
+    alpha = T(beta);
+    return tau;
+}
+
+/// fn( c0, c1 ) over blocks of the columns [0, nc), concurrently when rows x nc is large
+template<typename F>
+void for_columns( int rows, int nc, F fn )
+{
+    ThreadPool& pool = thread_pool();
+    int parts = ( (std::size_t)rows*nc<QR_PARALLEL_WORK ) ? 1 : std::min( nc/16, 4*pool.size() );
+    if( parts<=1 )
+    {
+        fn( 0, nc );
+        return;
+    }
+    pool.parallel_for( parts, [&]( int t ){
+        fn( (int)( (long)nc*t/parts ), (int)( (long)nc*(t+1)/parts ) );
+    } );
+}
+
+/// unblocked QR of the panel a[ j0:m, j0:j0+jb ], each reflector applied to the panel
+/// columns right of it as w = v^* A, A -= conj(tau) v w row by row
+template<typename T>
+void qr_panel( int m, T* a, int lda, T* tau, int j0, int jb, std::vector<T>& w )
+{
+    int c1 = j0+jb;
+    for( int j=j0; j<c1; j++ )
+    {
+        tau[j] = householder( m-j-1, a[(std::size_t)j*lda+j], a + (std::size_t)(j+1)*lda + j, lda );
+        int nc = c1-j-1;
+        if( nc<=0 || tau[j]==T(0) ) continue;
+        T* row = a + (std::size_t)j*lda + j+1;
+        w.assign( row, row+nc );
+        for( int i=j+1; i<m; i++ )
+        {
+            T vi = scalar_conj( a[(std::size_t)i*lda+j] );
+            const T* ai = a + (std::size_t)i*lda + j+1;
+            for( int c=0; c<nc; c++ )
+                w[c] += vi * ai[c];
+        }
+        T ct = scalar_conj( tau[j] );
+        for( int c=0; c<nc; c++ )
+            row[c] -= ct * w[c];
+        for( int i=j+1; i<m; i++ )
+        {
+            T vi = ct * a[(std::size_t)i*lda+j];
+            T* ai = a + (std::size_t)i*lda + j+1;
+            for( int c=0; c<nc; c++ )
+                ai[c] -= vi * w[c];
+        }
+    }
+}
+
+/// the compact WY form H_j0 ... H_{j0+kb-1} = I - V T V^* of kb reflectors stored below
+/// the diagonal from column j0: V is the explicit (m-j0) x kb block with its unit
+/// diagonal and zeros above, T is kb x kb upper triangular with
+/// T(0:i, i) = -tau_i T(0:i, 0:i) V(:, 0:i)^* v_i, the products V^* V taken by one GEMM
+template<typename T>
+void qr_block_wy( int m, const T* a, int lda, const T* tau, int j0, int kb, std::vector<T>& v, std::vector<T>& t )
+{
+    int mr = m-j0;
+    v.assign( (std::size_t)mr*kb, T(0) );
+    for( int r=0; r<mr; r++ )
+    {
+        const T* ar = a + (std::size_t)(j0+r)*lda + j0;
+        T* vr = v.data() + (std::size_t)r*kb;
+        for( int l=0; l<kb && l<=r; l++ )
+            vr[l] = ( l==r ) ? T(1) : ar[l];
+    }
+    std::vector<T> g( (std::size_t)kb*kb );
+    gemm( true, false, kb, kb, mr, T(1), v.data(), kb, v.data(), kb, T(0), g.data(), kb );
+    t.assign( (std::size_t)kb*kb, T(0) );
+    std::vector<T> col( kb );
+    for( int i=0; i<kb; i++ )
+    {
+        for( int l=0; l<i; l++ )
+            col[l] = -tau[j0+i] * g[(std::size_t)l*kb+i];
+        for( int l=0; l<i; l++ )
+        {
+            T s = T(0);
+            for( int q=l; q<i; q++ )
+                s += t[(std::size_t)l*kb+q] * col[q];
+            t[(std::size_t)l*kb+i] = s;
+        }
+        t[(std::size_t)i*kb+i] = tau[j0+i];
+    }
+}
+
+/// C = ( I - V T V^* ) C, or its adjoint with T^*, for the mr x nc block C: three GEMMs
+template<typename T>
+void qr_block_apply( bool adjoint, int mr, int nc, int kb, const T* v, const T* t, T* c, int ldc )
+{
+    std::vector<T> w( (std::size_t)kb*nc ), tw( (std::size_t)kb*nc );
+    gemm( true, false, kb, nc, mr, T(1), v, kb, c, ldc, T(0), w.data(), nc );
+    gemm( adjoint, false, kb, nc, kb, T(1), t, kb, w.data(), nc, T(0), tw.data(), nc );
+    gemm( false, false, mr, nc, kb, T(-1), v, kb, tw.data(), nc, T(1), c, ldc );
+}
+
+/// kb pivoted steps of QR from column j0, with F = A^* V T accumulated so that the
+/// matrix as updated so far is A - V F^*. Only the chosen column and the pivot row are
+/// brought up to date at each step, the rest of the trailing matrix by one GEMM at the
+/// end. A norm downdate that lost too many digits ends the block early, the norm is
+/// then recomputed after the GEMM. Returns the number of steps taken
+template<typename T>
+int qr_pivoted_block( int m, int n, T* a, int lda, T* tau, int* jpvt, int j0, int kb,
+                      std::vector< RealType<T> >& vn1, std::vector< RealType<T> >& vn2,
+                      std::vector<T>& f, int nb )
+{
+    typedef RealType<T> real_type;
+    const real_type tol3z = std::sqrt( std::numeric_limits<real_type>::epsilon() );
+    int nc = n-j0;
+    auto at = [&]( int i, int j ) -> T& { return a[(std::size_t)i*lda+j]; };
+    auto fat = [&]( int c, int l ) -> T& { return f[(std::size_t)c*nb+l]; };
+    std::fill( f.begin(), f.begin() + (std::size_t)nc*nb, T(0) );
+    std::vector<T> w( nc ), aux( kb );
+    std::vector<int> stale;
+
+    int k = 0;
+    while( k<kb && stale.empty() )
+    {
+        int rk = j0+k;
+        int p = rk;
+        for( int c=rk+1; c<n; c++ )
+            if( vn1[c]>vn1[p] ) p = c;
+        if( p!=rk )
+        {
+            for( int i=0; i<m; i++ )
+                std::swap( at( i, p ), at( i, rk ) );
+            std::swap_ranges( &fat( p-j0, 0 ), &fat( p-j0, 0 )+nb, &fat( k, 0 ) );
+            std::swap( vn1[p], vn1[rk] );
+            std::swap( vn2[p], vn2[rk] );
+            std::swap( jpvt[p], jpvt[rk] );
+        }
+
+        /// column rk below the pivot rows: A(rk:m, rk) -= V(rk:m, 0:k) F(k, 0:k)^*
+        if( k>0 )
+            for( int i=rk; i<m; i++ )
+            {
+                T s = T(0);
+                for( int l=0; l<k; l++ )
+                    s += at( i, j0+l ) * scalar_conj( fat( k, l ) );
+                at( i, rk ) -= s;
+            }
+
+        tau[rk] = householder( m-rk-1, at( rk, rk ), &at( rk+1, rk ), lda );
+        T akk = at( rk, rk );
+        at( rk, rk ) = T(1);
+
+        /// F(:, k) = tau ( A^* v - F(:, 0:k) V(:, 0:k)^* v ), the rows past k only matter.
+        /// One sweep over the rows gives A^* v for the block's own columns, which hold
+        /// V^* v, and for the trailing ones
+        for( int c=0; c<nc; c++ )
+            fat( c, k ) = T(0);
+        if( tau[rk]!=T(0) )
+        {
+            for_columns( m-rk, nc, [&]( int c0, int c1 ){
+                std::fill( w.begin()+c0, w.begin()+c1, T(0) );
+                for( int i=rk; i<m; i++ )
+                {
+                    T vi = at( i, rk );
+                    const T* ai = &at( i, j0 );
+                    for( int c=c0; c<c1; c++ )
+                        w[c] += scalar_conj( ai[c] ) * vi;
+                }
+            } );
+            for( int l=0; l<k; l++ )
+                aux[l] = -tau[rk] * w[l];
+            for( int c=k+1; c<nc; c++ )
+            {
+                T s = tau[rk] * w[c];
+                for( int l=0; l<k; l++ )
+                    s += fat( c, l ) * aux[l];
+                fat( c, k ) = s;
+            }
+        }
+
+        /// the pivot row: A(rk, rk+1:n) -= V(rk, 0:k+1) F(k+1:nc, 0:k+1)^*, V(rk, k) = 1
+        for( int c=k+1; c<nc; c++ )
+        {
+            T s = T(0);
+            for( int l=0; l<=k; l++ )
+                s += at( rk, j0+l ) * scalar_conj( fat( c, l ) );
+            at( rk, j0+c ) -= s;
+        }
+
+        /// downdate the norms of the columns below row rk
+        for( int c=rk+1; c<n; c++ )
+        {
+            if( vn1[c]==0 ) continue;
+            real_type r = std::abs( at( rk, c ) ) / vn1[c];
+            r = std::max( real_type(0), ( 1+r )*( 1-r ) );
+            real_type q = vn1[c] / vn2[c];
+            if( r*q*q<=tol3z ) stale.push_back( c );
+            else vn1[c] *= std::sqrt( r );
+        }
+        at( rk, rk ) = akk;
+        k++;
+    }
+
+    int r0 = j0+k;
+    if( r0<m && r0<n )
+        gemm( false, true, m-r0, n-r0, k, T(-1), a + (std::size_t)r0*lda + j0, lda,
+              f.data() + (std::size_t)k*nb, nb, T(1), a + (std::size_t)r0*lda + r0, lda );
+    for( int c : stale )
+    {
+        real_type s = 0;
+        for( int i=r0; i<m; i++ )
+            s += scalar_abs2( at( i, c ) );
+        vn1[c] = vn2[c] = std::sqrt( s );
+    }
+    return k;
+}
+
+}
+
+template<typename T>
+void qr_blocked( int m, int n, T* a, int lda, T* tau, int block_size )
+{
+    int kmax = std::min( m, n );
+    int nb = ( block_size>1 ) ? block_size : std::max( kmax, 1 );
+    std::vector<T> w, v, t;
+    for( int j0=0; j0<kmax; j0+=nb )
+    {
+        int kb = std::min( nb, kmax-j0 );
+        qr_panel( m, a, lda, tau, j0, kb, w );
+        if( j0+kb<n )
+        {
+            qr_block_wy( m, a, lda, tau, j0, kb, v, t );
+            qr_block_apply( true, m-j0, n-j0-kb, kb, v.data(), t.data(), a + (std::size_t)j0*lda + j0+kb, lda );
+        }
+    }
+}
+
+template<typename T>
+void qr_pivoted( int m, int n, T* a, int lda, T* tau, int* jpvt, int block_size )
+{
+    typedef RealType<T> real_type;
+    int kmax = std::min( m, n );
+    int nb = std::max( block_size, 1 );
+    std::vector<real_type> vn1( n, 0 ), vn2;
+    for( int i=0; i<m; i++ )
+        for( int j=0; j<n; j++ )
+            vn1[j] += scalar_abs2( a[(std::size_t)i*lda+j] );
+    for( int j=0; j<n; j++ )
+    {
+        vn1[j] = std::sqrt( vn1[j] );
+        jpvt[j] = j;
+    }
+    vn2 = vn1;
+    std::vector<T> f( (std::size_t)n*nb );
+    for( int j0=0; j0<kmax; )
+        j0 += qr_pivoted_block( m, n, a, lda, tau, jpvt, j0, std::min( nb, kmax-j0 ), vn1, vn2, f, nb );
+}
+
+template<typename T>
+void qr_apply( bool adjoint, int m, int kq, const T* a, int lda, const T* tau, T* b, int k, int ldb, int block_size )
+{
+    if( kq<=0 || k<=0 ) return;
+    int nb = ( block_size>1 ) ? block_size : kq;
+    int n_blocks = ( kq+nb-1 ) / nb;
+    std::vector<T> v, t;
+    /// Q^* b applies the blocks first to last, Q b last to first
+    for( int s=0; s<n_blocks; s++ )
+    {
+        int j0 = ( adjoint ? s : n_blocks-1-s )*nb;
+        int kb = std::min( nb, kq-j0 );
+        qr_block_wy( m, a, lda, tau, j0, kb, v, t );
+        qr_block_apply( adjoint, m-j0, k, kb, v.data(), t.data(), b + (std::size_t)j0*ldb, ldb );
+    }
+}
+
+#define MX_INSTANTIATE_QR(T) \
+    template void qr_blocked<T>( int, int, T*, int, T*, int ); \
+    template void qr_pivoted<T>( int, int, T*, int, T*, int*, int ); \
+    template void qr_apply<T>( bool, int, int, const T*, int, const T*, T*, int, int, int );
+
+MX_INSTANTIATE_QR(float)
+MX_INSTANTIATE_QR(double)
+MX_INSTANTIATE_QR(std::complex<float>)
+MX_INSTANTIATE_QR(std::complex<double>)
+
+}
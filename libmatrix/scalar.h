@@ -0,0 +1,59 @@
+#ifndef _MX_SCALAR_H
+#define _MX_SCALAR_H
+
+#include <complex>
+#include <cmath>
+
+namespace mx
+{
+
+/// properties of the entry types a matrix can hold: float, double and their complex forms
+template<typename T>
+struct ScalarTraits
+{
+    typedef T real_type;
+    /// half precision counterpart used by the mixed-precision solver
+    typedef float low_type;
+    static constexpr bool is_complex = false;
+};
+
+template<typename T>
+struct ScalarTraits< std::complex<T> >
+{
+    typedef T real_type;
+    typedef std::complex<float> low_type;
+    static constexpr bool is_complex = true;
+};
+
+template<typename T>
+using RealType = typename ScalarTraits<T>::real_type;
+
+/// keeps a parameter out of template argument deduction, so that a double literal
+/// can be passed as the scalar of a float routine
+template<typename T>
+struct NoDeduceHelper { typedef T type; };
+template<typename T>
+using NoDeduce = typename NoDeduceHelper<T>::type;
+
+template<typename T>
+inline T scalar_conj( const T& x ) { return x; }
+template<typename T>
+inline std::complex<T> scalar_conj( const std::complex<T>& x ) { return std::conj( x ); }
+
+template<typename T>
+inline T scalar_real( const T& x ) { return x; }
+template<typename T>
+inline T scalar_real( const std::complex<T>& x ) { return x.real(); }
+
+/// |x|^2 without the square root of std::abs
+template<typename T>
+inline T scalar_abs2( const T& x ) { return x * x; }
+template<typename T>
+inline T scalar_abs2( const std::complex<T>& x ) { return std::norm( x ); }
+
+template<typename T>
+inline bool scalar_isfinite( const T& x ) { return std::isfinite( std::abs( x ) ); }
+
+}
+
+#endif
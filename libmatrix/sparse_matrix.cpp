@@ -0,0 +1,438 @@
+#include "libmatrix/sparse_matrix.h"
+#include "libmatrix/matrix_file.h"
+#include "libmatrix/thread_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace mx
+{
+
+namespace
+{
+
+/// below this many entries plus outer indices a kernel runs on the calling thread
+constexpr std::size_t PARALLEL_WORK = 1 << 15;
+
+/// parts+1 outer indices splitting [0, n) into parts with about equal nnz + outer
+/// counts, so that long rows and many empty rows are both shared out
+std::vector<int> balanced_cuts( const std::vector<int>& ptr, int parts )
+{
+    int n = (int)ptr.size() - 1;
+    std::size_t work = (std::size_t)ptr[n] + n;
+    std::vector<int> cut( parts+1, n );
+    cut[0] = 0;
+    for( int t=1; t<parts; t++ )
+    {
+        std::size_t target = work*t/parts;
+        int lo = cut[t-1], hi = n;
+        while( lo<hi )
+        {
+            int mid = lo + (hi-lo)/2;
+            if( (std::size_t)ptr[mid] + mid < target ) lo = mid+1;
+            else hi = mid;
+        }
+        cut[t] = lo;
+    }
+    return cut;
+}
+
+int parts_for( const std::vector<int>& ptr, int per_thread )
+{
+    std::size_t work = (std::size_t)ptr.back() + ptr.size() - 1;
+    return work<PARALLEL_WORK ? 1 : per_thread*thread_pool().size();
+}
+
+/// fn( o0, o1 ) over blocks of outer indices, concurrently on thread_pool() when the
+/// matrix is large enough
+template<typename F>
+void for_each_block( const std::vector<int>& ptr, F fn )
+{
+    int parts = parts_for( ptr, 4 );
+    if( parts<=1 )
+    {
+        fn( 0, (int)ptr.size()-1 );
+        return;
+    }
+    std::vector<int> cut = balanced_cuts( ptr, parts );
+    thread_pool().parallel_for( parts, [&]( int t ){
+        if( cut[t]<cut[t+1] ) fn( cut[t], cut[t+1] );
+    } );
+}
+
+/// fn( i0, i1 ) over equal blocks of [0, n) whose total work is given
+template<typename F>
+void for_each_range( int n, std::size_t work, F fn )
+{
+    ThreadPool& pool = thread_pool();
+    int parts = ( work<PARALLEL_WORK ) ? 1 : std::min( n, 4*pool.size() );
+    if( parts<=1 )
+    {
+        fn( 0, n );
+        return;
+    }
+    pool.parallel_for( parts, [&]( int t ){
+        fn( (int)( (long)n*t/parts ), (int)( (long)n*(t+1)/parts ) );
+    } );
+}
+
+}
+
+template<typename T>
+BasicSparseMatrix<T>::BasicSparseMatrix( const char* file_name, SparseLayout layout )
+:   BasicSparseMatrix()
+{
+    read_from_file( file_name, layout );
+}
+
+template<typename T>
+BasicSparseMatrix<T>::BasicSparseMatrix( const MatrixType& mat, SparseLayout layout, real_type drop_tol )
+:   _n_row( mat.n_row() ),
+    _n_col( mat.n_col() ),
+    _layout( CSR ),
+    _ptr( mat.n_row()+1, 0 )
+{
+    /// row counts, their prefix sum, then each row filled where the prefix puts it
+    const T* a = mat.data();
+    std::size_t nc = _n_col, work = (std::size_t)_n_row*nc;
+    for_each_range( _n_row, work, [&]( int i0, int i1 ){
+        for( int i=i0; i<i1; i++ )
+        {
+            int cnt = 0;
+            for( std::size_t j=0; j<nc; j++ )
+                cnt += std::abs( a[i*nc+j] )>drop_tol;
+            _ptr[i+1] = cnt;
+        }
+    } );
+    for( int i=0; i<_n_row; i++ )
+        _ptr[i+1] += _ptr[i];
+    _idx.resize( _ptr[_n_row] );
+    _val.resize( _ptr[_n_row] );
+    for_each_range( _n_row, work, [&]( int i0, int i1 ){
+        for( int i=i0; i<i1; i++ )
+        {
+            int p = _ptr[i];
+            for( std::size_t j=0; j<nc; j++ )
+                if( std::abs( a[i*nc+j] )>drop_tol )
+                {
+                    _idx[p] = (int)j;
+                    _val[p++] = a[i*nc+j];
+                }
+        }
+    } );
+    if( layout==CSC )
+        *this = to_layout( CSC );
+}
+
+template<typename T>
+BasicSparseMatrix<T> BasicSparseMatrix<T>::from_triplets( int n_row, int n_col, const std::vector<int>& rows,
+                                                          const std::vector<int>& cols, const std::vector<T>& vals,
+                                                          SparseLayout layout )
+{
+    assert( rows.size()==cols.size() && rows.size()==vals.size() );
+    const std::vector<int>& outer = ( layout==CSR ) ? rows : cols;
+    const std::vector<int>& inner = ( layout==CSR ) ? cols : rows;
+    BasicSparseMatrix res( n_row, n_col, layout );
+    int n_out = res.n_outer();
+    std::size_t nnz = vals.size();
+
+    /// counting sort by outer index
+    std::vector<int> start( n_out+1, 0 );
+    for( std::size_t e=0; e<nnz; e++ )
+    {
+        assert( outer[e]>=0 && outer[e]<n_out && inner[e]>=0 && inner[e]<res.n_inner() );
+        start[outer[e]+1]++;
+    }
+    for( int o=0; o<n_out; o++ )
+        start[o+1] += start[o];
+    std::vector<int> idx( nnz ), next( start.begin(), start.end()-1 );
+    std::vector<T> val( nnz );
+    for( std::size_t e=0; e<nnz; e++ )
+    {
+        int p = next[outer[e]]++;
+        idx[p] = inner[e];
+        val[p] = vals[e];
+    }
+
+    /// each outer index sorted by inner index with duplicates summed, then compacted
+    std::vector<int> len( n_out );
+    for_each_block( start, [&]( int o0, int o1 ){
+        std::vector< std::pair<int,T> > buf;
+        for( int o=o0; o<o1; o++ )
+        {
+            buf.clear();
+            for( int p=start[o]; p<start[o+1]; p++ )
+                buf.emplace_back( idx[p], val[p] );
+            std::sort( buf.begin(), buf.end(), []( const std::pair<int,T>& x, const std::pair<int,T>& y ){
+                return x.first<y.first;
+            } );
+            int m = start[o];
+            for( std::size_t q=0; q<buf.size(); q++ )
+            {
+                if( m>start[o] && idx[m-1]==buf[q].first )
+                    val[m-1] += buf[q].second;
+                else
+                {
+                    idx[m] = buf[q].first;
+                    val[m++] = buf[q].second;
+                }
+            }
+            len[o] = m - start[o];
+        }
+    } );
+    for( int o=0; o<n_out; o++ )
+        res._ptr[o+1] = res._ptr[o] + len[o];
+    res._idx.resize( res._ptr[n_out] );
+    res._val.resize( res._ptr[n_out] );
+    for( int o=0; o<n_out; o++ )
+    {
+        std::copy( idx.begin()+start[o], idx.begin()+start[o]+len[o], res._idx.begin()+res._ptr[o] );
+        std::copy( val.begin()+start[o], val.begin()+start[o]+len[o], res._val.begin()+res._ptr[o] );
+    }
+    return res;
+}
+
+template<typename T>
+int BasicSparseMatrix<T>::read_from_file( const char* file_name, SparseLayout layout )
+{
+    int n_row, n_col;
+    std::vector<int> rows, cols;
+    std::vector<T> vals;
+    if( read_sparse_file( file_name, n_row, n_col, rows, cols, vals )!=0 ) return -1;
+    *this = from_triplets( n_row, n_col, rows, cols, vals, layout );
+    return 0;
+}
+
+template<typename T>
+int BasicSparseMatrix<T>::write_to_file( const char* file_name, int precision ) const
+{
+    if( _n_row<=0 || _n_col<=0 ) return -1;
+    return write_sparse_file( file_name, _n_row, _n_col, _ptr.data(), _idx.data(), _val.data(), _layout==CSC, precision );
+}
+
+template<typename T>
+T BasicSparseMatrix<T>::operator()( int row, int col ) const
+{
+    assert( row>=0 && row<_n_row && col>=0 && col<_n_col );
+    int o = ( _layout==CSR ) ? row : col;
+    int i = ( _layout==CSR ) ? col : row;
+    auto beg = _idx.begin() + _ptr[o], end = _idx.begin() + _ptr[o+1];
+    auto it = std::lower_bound( beg, end, i );
+    return ( it!=end && *it==i ) ? _val[ it - _idx.begin() ] : T(0);
+}
+
+template<typename T>
+typename BasicSparseMatrix<T>::MatrixType BasicSparseMatrix<T>::to_matrix() const
+{
+    /// every entry is written once, so blocks of rows or of columns run concurrently
+    MatrixType res( _n_row, _n_col );
+    T* a = res.data();
+    std::size_t nc = _n_col;
+    bool csr = _layout==CSR;
+    for_each_block( _ptr, [&]( int o0, int o1 ){
+        for( int o=o0; o<o1; o++ )
+            for( int p=_ptr[o]; p<_ptr[o+1]; p++ )
+            {
+                if( csr ) a[o*nc + _idx[p]] = _val[p];
+                else a[_idx[p]*nc + o] = _val[p];
+            }
+    } );
+    return res;
+}
+
+template<typename T>
+BasicSparseMatrix<T> BasicSparseMatrix<T>::to_layout( SparseLayout layout ) const
+{
+    if( layout==_layout ) return *this;
+    /// scattered in outer order, so every new outer index comes out sorted
+    BasicSparseMatrix res( _n_row, _n_col, layout );
+    int n_in = n_inner();
+    for( int i : _idx )
+        res._ptr[i+1]++;
+    for( int i=0; i<n_in; i++ )
+        res._ptr[i+1] += res._ptr[i];
+    res._idx.resize( nnz() );
+    res._val.resize( nnz() );
+    std::vector<int> next( res._ptr.begin(), res._ptr.end()-1 );
+    for( int o=0; o<n_outer(); o++ )
+        for( int p=_ptr[o]; p<_ptr[o+1]; p++ )
+        {
+            int q = next[_idx[p]]++;
+            res._idx[q] = o;
+            res._val[q] = _val[p];
+        }
+    return res;
+}
+
+template<typename T>
+BasicSparseMatrix<T> BasicSparseMatrix<T>::transpose() const
+{
+    BasicSparseMatrix res( *this );
+    std::swap( res._n_row, res._n_col );
+    res._layout = ( _layout==CSR ) ? CSC : CSR;
+    return res;
+}
+
+template<typename T>
+typename BasicSparseMatrix<T>::MatrixType BasicSparseMatrix<T>::multiply( const ConstViewType& x ) const
+{
+    MatrixType y;
+    multiply( x, y );
+    return y;
+}
+
+template<typename T>
+void BasicSparseMatrix<T>::multiply( const ConstViewType& x, MatrixType& y ) const
+{
+    assert( x.n_row()==_n_col );
+    int k = x.n_col();
+    if( y.n_row()!=_n_row || y.n_col()!=k ) y.resize( _n_row, k );
+    multiply( x.data(), x.ld(), k, y.data() );
+}
+
+template<typename T>
+void BasicSparseMatrix<T>::multiply( const T* xd, std::size_t ldx, int k, T* yd ) const
+{
+    if( _layout==CSR )
+    {
+        /// y(i,:) = sum_p a_ip x(idx_p,:), each row of y written by one task
+        for_each_block( _ptr, [&]( int i0, int i1 ){
+            for( int i=i0; i<i1; i++ )
+            {
+                T* yi = yd + (std::size_t)i*k;
+                if( k==1 )
+                {
+                    T s = T(0);
+                    for( int p=_ptr[i]; p<_ptr[i+1]; p++ )
+                        s += _val[p] * xd[_idx[p]*ldx];
+                    yi[0] = s;
+                    continue;
+                }
+                std::fill( yi, yi+k, T(0) );
+                for( int p=_ptr[i]; p<_ptr[i+1]; p++ )
+                {
+                    T a = _val[p];
+                    const T* xj = xd + _idx[p]*ldx;
+                    for( int c=0; c<k; c++ )
+                        yi[c] += a * xj[c];
+                }
+            }
+        } );
+        return;
+    }
+
+    /// CSC scatters column j into all of y: each task sums its block of columns into
+    /// its own buffer, the first one into y, and the buffers are added up by rows
+    int parts = std::min( parts_for( _ptr, 1 ), std::max( 1, _n_col ) );
+    std::size_t len = (std::size_t)_n_row*k;
+    std::vector<T> partial( (std::size_t)( parts-1 )*len );
+    std::vector<int> cut = balanced_cuts( _ptr, parts );
+    auto scatter = [&]( int t ){
+        T* yt = ( t==0 ) ? yd : partial.data() + (t-1)*len;
+        std::fill( yt, yt+len, T(0) );
+        for( int j=cut[t]; j<cut[t+1]; j++ )
+        {
+            const T* xj = xd + j*ldx;
+            for( int p=_ptr[j]; p<_ptr[j+1]; p++ )
+            {
+                T a = _val[p];
+                T* yi = yt + (std::size_t)_idx[p]*k;
+                for( int c=0; c<k; c++ )
+                    yi[c] += a * xj[c];
+            }
+        }
+    };
+    if( parts<=1 )
+    {
+        scatter( 0 );
+        return;
+    }
+    ThreadPool& pool = thread_pool();
+    pool.parallel_for( parts, scatter );
+    int n_blocks = 4*pool.size();
+    pool.parallel_for( n_blocks, [&]( int b ){
+        std::size_t e0 = len*b/n_blocks, e1 = len*(b+1)/n_blocks;
+        for( int t=1; t<parts; t++ )
+        {
+            const T* yt = partial.data() + (t-1)*len;
+            for( std::size_t e=e0; e<e1; e++ )
+                yd[e] += yt[e];
+        }
+    } );
+}
+
+template<typename T>
+BasicSparseMatrix<T> BasicSparseMatrix<T>::multiply( const BasicSparseMatrix& other ) const
+{
+    assert( _n_col==other._n_row );
+    BasicSparseMatrix a_csr, b_csr;
+    const BasicSparseMatrix& a = ( _layout==CSR ) ? *this : ( a_csr = to_layout( CSR ) );
+    const BasicSparseMatrix& b = ( other._layout==CSR ) ? other : ( b_csr = other.to_layout( CSR ) );
+    int n = _n_row, m = other._n_col;
+    BasicSparseMatrix c( n, m, CSR );
+
+    /// symbolic pass: distinct columns of each row of C, marked with the row index
+    std::vector<int> row_nnz( n );
+    for_each_block( a._ptr, [&]( int i0, int i1 ){
+        std::vector<int> mark( m, -1 );
+        for( int i=i0; i<i1; i++ )
+        {
+            int cnt = 0;
+            for( int p=a._ptr[i]; p<a._ptr[i+1]; p++ )
+            {
+                int j = a._idx[p];
+                for( int q=b._ptr[j]; q<b._ptr[j+1]; q++ )
+                    if( mark[b._idx[q]]!=i )
+                    {
+                        mark[b._idx[q]] = i;
+                        cnt++;
+                    }
+            }
+            row_nnz[i] = cnt;
+        }
+    } );
+    for( int i=0; i<n; i++ )
+        c._ptr[i+1] = c._ptr[i] + row_nnz[i];
+    c._idx.resize( c._ptr[n] );
+    c._val.resize( c._ptr[n] );
+
+    /// numeric pass: a dense accumulator per task, the columns of a row sorted at the end
+    for_each_block( a._ptr, [&]( int i0, int i1 ){
+        std::vector<int> mark( m, -1 );
+        std::vector<T> acc( m );
+        for( int i=i0; i<i1; i++ )
+        {
+            int* ci = c._idx.data() + c._ptr[i];
+            int cnt = 0;
+            for( int p=a._ptr[i]; p<a._ptr[i+1]; p++ )
+            {
+                int j = a._idx[p];
+                T aij = a._val[p];
+                for( int q=b._ptr[j]; q<b._ptr[j+1]; q++ )
+                {
+                    int col = b._idx[q];
+                    if( mark[col]!=i )
+                    {
+                        mark[col] = i;
+                        ci[cnt++] = col;
+                        acc[col] = aij * b._val[q];
+                    }
+                    else
+                        acc[col] += aij * b._val[q];
+                }
+            }
+            std::sort( ci, ci+cnt );
+            T* cv = c._val.data() + c._ptr[i];
+            for( int q=0; q<cnt; q++ )
+                cv[q] = acc[ci[q]];
+        }
+    } );
+    return c;
+}
+
+template class BasicSparseMatrix<float>;
+template class BasicSparseMatrix<double>;
+template class BasicSparseMatrix< std::complex<float> >;
+template class BasicSparseMatrix< std::complex<double> >;
+
+}
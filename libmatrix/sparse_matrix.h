@@ -0,0 +1,107 @@
+#ifndef _MX_SPARSE_MATRIX_H
+#define _MX_SPARSE_MATRIX_H
+
+#include <cassert>
+#include <vector>
+
+#include "matrix.h"
+#include "scalar.h"
+
+namespace mx
+{
+
+enum SparseLayout{
+    CSR,    /// compressed rows: ptr() has n_row+1 entries, idx() holds column indices
+    CSC     /// compressed columns: ptr() has n_col+1 entries, idx() holds row indices
+};
+
+/// n_row x n_col sparse matrix in compressed row or column storage: the entries of
+/// outer index o (a row for CSR, a column for CSC) are ptr()[o] .. ptr()[o+1]-1 of
+/// idx() and val(), sorted by inner index without duplicates. Explicit zeros are kept
+/// where a product or a file puts them.
+/// Instantiated in sparse_matrix.cpp for float, double and their complex forms
+template<typename T>
+class BasicSparseMatrix
+{
+public:
+    typedef T value_type;
+    typedef RealType<T> real_type;
+    typedef BasicMatrix<T> MatrixType;
+    typedef BasicConstMatrixView<T> ConstViewType;
+
+private:
+    int _n_row;
+    int _n_col;
+    SparseLayout _layout;
+    std::vector<int> _ptr;
+    std::vector<int> _idx;
+    std::vector<T> _val;
+
+    int n_outer() const { return _layout==CSR ? _n_row : _n_col; }
+    int n_inner() const { return _layout==CSR ? _n_col : _n_row; }
+
+public:
+    BasicSparseMatrix() : _n_row(0), _n_col(0), _layout(CSR), _ptr( 1, 0 ) {}
+    /// all zero
+    BasicSparseMatrix( int n_row, int n_col, SparseLayout layout=CSR )
+    :   _n_row(n_row), _n_col(n_col), _layout(layout), _ptr( ( layout==CSR ? n_row : n_col ) + 1, 0 ) {}
+
+    int n_row() const { return _n_row; }
+    int n_col() const { return _n_col; }
+    std::size_t nnz() const { return _idx.size(); }
+    SparseLayout layout() const { return _layout; }
+    const std::vector<int>& ptr() const { return _ptr; }
+    const std::vector<int>& idx() const { return _idx; }
+    const std::vector<T>& val() const { return _val; }
+    /// the values can change in place, the pattern cannot
+    std::vector<T>& val() { return _val; }
+
+    /* in sparse_matrix.cpp */
+    /// a SPARSE or MatrixMarket file, see read_sparse_file
+    explicit BasicSparseMatrix( const char* file_name, SparseLayout layout=CSR );
+    /// the entries of mat with |a_ij| > drop_tol, so exact zeros are dropped by default
+    explicit BasicSparseMatrix( const MatrixType& mat, SparseLayout layout=CSR, real_type drop_tol=0 );
+    /// from coordinate triplets in any order, duplicates are summed
+    static BasicSparseMatrix from_triplets( int n_row, int n_col, const std::vector<int>& rows,
+                                            const std::vector<int>& cols, const std::vector<T>& vals,
+                                            SparseLayout layout=CSR );
+    /// 0 on success, -1 on an unreadable file, which leaves the matrix unchanged
+    int read_from_file( const char* file_name, SparseLayout layout=CSR );
+    /// a SPARSE text file, 0 or -1
+    int write_to_file( const char* file_name, int precision=17 ) const;
+
+    /// a_ij by a binary search of its row / column, 0 if not stored
+    T operator()( int row, int col ) const;
+    MatrixType to_matrix() const;
+    /// the same matrix compressed the other way, O(nnz)
+    BasicSparseMatrix to_layout( SparseLayout layout ) const;
+    /// A^t, no data moves: the CSR arrays of A are the CSC arrays of A^t
+    BasicSparseMatrix transpose() const;
+
+    /// A x for the n_col x k block x; rows split over thread_pool() by equal nonzero
+    /// counts for CSR, column blocks into per-thread sums for CSC
+    MatrixType multiply( const ConstViewType& x ) const;
+    /// allocation-free form, y is resized only if its shape differs
+    void multiply( const ConstViewType& x, MatrixType& y ) const;
+    /// the same on raw storage: x is n_col x k with leading dimension ldx, y is a
+    /// dense n_row x k block
+    void multiply( const T* x, std::size_t ldx, int k, T* y ) const;
+    /// A B, Gustavson's row by row product in two passes over thread_pool(): the
+    /// pattern sizes of the rows of C, then C itself; CSR result, CSC operands are
+    /// converted first
+    BasicSparseMatrix multiply( const BasicSparseMatrix& b ) const;
+};
+
+template<typename T>
+BasicMatrix<T> operator*( const BasicSparseMatrix<T>& a, const BasicMatrix<T>& x ) { return a.multiply( x ); }
+template<typename T>
+BasicSparseMatrix<T> operator*( const BasicSparseMatrix<T>& a, const BasicSparseMatrix<T>& b ) { return a.multiply( b ); }
+
+typedef BasicSparseMatrix<double> SparseMatrix;
+typedef BasicSparseMatrix<float> SparseMatrixF;
+typedef BasicSparseMatrix< std::complex<double> > SparseMatrixZ;
+typedef BasicSparseMatrix< std::complex<float> > SparseMatrixC;
+
+}
+
+#endif
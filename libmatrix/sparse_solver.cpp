@@ -0,0 +1,988 @@
+#include "libmatrix/sparse_solver.h"
+#include "libmatrix/blas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace mx
+{
+
+namespace
+{
+
+/// nested dissection orders parts this small by minimum degree
+constexpr int ND_LEAF = 256;
+/// subtrees of the elimination tree up to this many columns become one supernode
+constexpr int RELAX_SUBTREE = 8;
+/// panel width of the front factorizations
+constexpr int FRONT_BLOCK = 32;
+/// refinement steps of a solve after a static pivoting LU
+constexpr int SPARSE_REFINE_ITERS = 10;
+
+/// adjacency lists of an undirected graph, no self loops
+struct Graph
+{
+    int n = 0;
+    std::vector<int> xadj;
+    std::vector<int> adj;
+};
+
+/// the pattern of A + A^t without the diagonal, from compressed columns
+Graph symmetric_graph( int n, const std::vector<int>& ptr, const std::vector<int>& idx )
+{
+    Graph g;
+    g.n = n;
+    std::vector<int> start( n+1, 0 );
+    for( int j=0; j<n; j++ )
+        for( int p=ptr[j]; p<ptr[j+1]; p++ )
+            if( idx[p]!=j )
+            {
+                start[idx[p]+1]++;
+                start[j+1]++;
+            }
+    for( int i=0; i<n; i++ )
+        start[i+1] += start[i];
+    std::vector<int> adj( start[n] ), next( start.begin(), start.end()-1 );
+    for( int j=0; j<n; j++ )
+        for( int p=ptr[j]; p<ptr[j+1]; p++ )
+            if( idx[p]!=j )
+            {
+                adj[next[idx[p]]++] = j;
+                adj[next[j]++] = idx[p];
+            }
+
+    /// both triangles of a symmetric A give every edge twice
+    g.xadj.assign( n+1, 0 );
+    g.adj.reserve( adj.size()/2 );
+    for( int i=0; i<n; i++ )
+    {
+        std::sort( adj.begin()+start[i], adj.begin()+start[i+1] );
+        auto end = std::unique( adj.begin()+start[i], adj.begin()+start[i+1] );
+        g.adj.insert( g.adj.end(), adj.begin()+start[i], end );
+        g.xadj[i+1] = (int)g.adj.size();
+    }
+    return g;
+}
+
+/// approximate minimum degree: variables are eliminated from the quotient graph of
+/// variables and elements (eliminated variables standing for the clique they
+/// created), the degree of each variable next to the pivot bounded as in AMD by
+/// |A_i| + |L_p \ i| + sum over its other elements e of |L_e \ L_p|; elements
+/// inside L_p are absorbed. Returns the elimination order, new to old
+std::vector<int> amd_order( const Graph& g )
+{
+    int n = g.n;
+    std::vector< std::vector<int> > var_adj( n ), var_elem( n ), elem_vars( n );
+    std::vector<int> degree( n ), head( n+1, -1 ), next( n, -1 ), prev( n, -1 );
+    std::vector<int> mark( n, -1 ), w( n, 0 ), w_mark( n, -1 );
+    std::vector<char> eliminated( n, 0 ), absorbed( n, 0 );
+
+    auto insert = [&]( int i ){
+        int d = degree[i];
+        prev[i] = -1;
+        next[i] = head[d];
+        if( head[d]!=-1 ) prev[head[d]] = i;
+        head[d] = i;
+    };
+    auto remove = [&]( int i ){
+        if( prev[i]!=-1 ) next[prev[i]] = next[i];
+        else head[degree[i]] = next[i];
+        if( next[i]!=-1 ) prev[next[i]] = prev[i];
+    };
+
+    int min_deg = n;
+    for( int i=0; i<n; i++ )
+    {
+        var_adj[i].assign( g.adj.begin()+g.xadj[i], g.adj.begin()+g.xadj[i+1] );
+        degree[i] = (int)var_adj[i].size();
+        min_deg = std::min( min_deg, degree[i] );
+        insert( i );
+    }
+
+    std::vector<int> order;
+    order.reserve( n );
+    std::vector<int> lp;
+    for( int k=0; k<n; k++ )
+    {
+        while( head[min_deg]==-1 ) min_deg++;
+        int p = head[min_deg];
+        remove( p );
+        eliminated[p] = 1;
+        order.push_back( p );
+
+        /// L_p: the variables next to p and those of the elements p belongs to
+        lp.clear();
+        mark[p] = k;
+        for( int j : var_adj[p] )
+            if( !eliminated[j] && mark[j]!=k )
+            {
+                mark[j] = k;
+                lp.push_back( j );
+            }
+        for( int e : var_elem[p] )
+        {
+            if( absorbed[e] ) continue;
+            for( int j : elem_vars[e] )
+                if( !eliminated[j] && mark[j]!=k )
+                {
+                    mark[j] = k;
+                    lp.push_back( j );
+                }
+            absorbed[e] = 1;
+            std::vector<int>().swap( elem_vars[e] );
+        }
+        elem_vars[p] = lp;
+        std::vector<int>().swap( var_adj[p] );
+        std::vector<int>().swap( var_elem[p] );
+        int size_p = (int)lp.size();
+
+        /// w[e] = |L_e \ L_p| for the elements next to L_p
+        for( int i : lp )
+            for( int e : var_elem[i] )
+            {
+                if( absorbed[e] ) continue;
+                if( w_mark[e]!=k )
+                {
+                    w_mark[e] = k;
+                    w[e] = (int)elem_vars[e].size();
+                }
+                w[e]--;
+            }
+
+        for( int i : lp )
+        {
+            remove( i );
+            /// elements: drop the absorbed ones and those inside L_p, then add p
+            int d_elem = 0, m = 0;
+            std::vector<int>& ei = var_elem[i];
+            for( int e : ei )
+            {
+                if( absorbed[e] ) continue;
+                if( w[e]<=0 )
+                {
+                    absorbed[e] = 1;
+                    std::vector<int>().swap( elem_vars[e] );
+                    continue;
+                }
+                d_elem += w[e];
+                ei[m++] = e;
+            }
+            ei.resize( m );
+            ei.push_back( p );
+            /// variables: those in L_p are reached through p now
+            std::vector<int>& ai = var_adj[i];
+            m = 0;
+            for( int j : ai )
+                if( !eliminated[j] && mark[j]!=k )
+                    ai[m++] = j;
+            ai.resize( m );
+
+            int d = m + size_p - 1 + d_elem;
+            d = std::min( d, degree[i] + size_p - 1 );
+            d = std::min( d, n - k - 2 );
+            degree[i] = std::max( d, 0 );
+            insert( i );
+            min_deg = std::min( min_deg, degree[i] );
+        }
+    }
+    return order;
+}
+
+/// the subgraph induced by the vertices of region id, ordered by minimum degree
+void order_region( const Graph& g, const std::vector<int>& verts, const std::vector<int>& region, int id,
+                   std::vector<int>& local, std::vector<int>& order )
+{
+    Graph sub;
+    sub.n = (int)verts.size();
+    for( int a=0; a<sub.n; a++ )
+        local[verts[a]] = a;
+    sub.xadj.assign( sub.n+1, 0 );
+    for( int a=0; a<sub.n; a++ )
+    {
+        int v = verts[a];
+        for( int p=g.xadj[v]; p<g.xadj[v+1]; p++ )
+            if( region[g.adj[p]]==id )
+                sub.adj.push_back( local[g.adj[p]] );
+        sub.xadj[a+1] = (int)sub.adj.size();
+    }
+    for( int a : amd_order( sub ) )
+        order.push_back( verts[a] );
+}
+
+/// nested dissection of the vertices verts: a breadth-first level structure from a
+/// pseudo-peripheral vertex, the middle level split off as separator and numbered
+/// after both halves; region marks the vertices of the current call
+void nested_dissection( const Graph& g, std::vector<int>& verts, std::vector<int>& region, int& n_regions,
+                        std::vector<int>& level, std::vector<int>& local, std::vector<int>& order )
+{
+    if( verts.empty() ) return;
+    int id = n_regions++;
+    for( int v : verts )
+        region[v] = id;
+
+    if( (int)verts.size()<=ND_LEAF )
+    {
+        order_region( g, verts, region, id, local, order );
+        return;
+    }
+
+    std::vector<int> queue;
+    auto bfs = [&]( int root ){
+        for( int v : verts )
+            level[v] = -1;
+        queue.clear();
+        queue.push_back( root );
+        level[root] = 0;
+        for( std::size_t q=0; q<queue.size(); q++ )
+        {
+            int v = queue[q];
+            for( int p=g.xadj[v]; p<g.xadj[v+1]; p++ )
+            {
+                int u = g.adj[p];
+                if( region[u]==id && level[u]==-1 )
+                {
+                    level[u] = level[v] + 1;
+                    queue.push_back( u );
+                }
+            }
+        }
+    };
+    bfs( verts[0] );
+    bfs( queue.back() );
+
+    std::vector<int> part_a, part_b, sep;
+    if( queue.size()<verts.size() )
+    {
+        /// not connected: all components labelled in one pass, the ones up to ND_LEAF
+        /// vertices ordered together by minimum degree, the others dissected each on
+        /// its own, so isolated rows cost O(1) and add no recursion depth
+        std::vector<int> small;
+        std::vector< std::vector<int> > large;
+        for( int v : verts )
+            level[v] = -1;
+        for( int root : verts )
+        {
+            if( level[root]!=-1 ) continue;
+            queue.clear();
+            queue.push_back( root );
+            level[root] = 0;
+            for( std::size_t q=0; q<queue.size(); q++ )
+            {
+                int v = queue[q];
+                for( int p=g.xadj[v]; p<g.xadj[v+1]; p++ )
+                {
+                    int u = g.adj[p];
+                    if( region[u]==id && level[u]==-1 )
+                    {
+                        level[u] = 0;
+                        queue.push_back( u );
+                    }
+                }
+            }
+            if( (int)queue.size()<=ND_LEAF ) small.insert( small.end(), queue.begin(), queue.end() );
+            else large.push_back( queue );
+        }
+        std::vector<int>().swap( verts );
+        if( !small.empty() )
+        {
+            int small_id = n_regions++;
+            for( int v : small )
+                region[v] = small_id;
+            order_region( g, small, region, small_id, local, order );
+        }
+        for( std::vector<int>& comp : large )
+            nested_dissection( g, comp, region, n_regions, level, local, order );
+        return;
+    }
+    else
+    {
+        int depth = level[queue.back()];
+        std::vector<int> count( depth+1, 0 );
+        for( int v : verts )
+            count[level[v]]++;
+        int mid = 0, seen = 0;
+        while( mid<depth && seen + count[mid] < (int)verts.size()/2 )
+            seen += count[mid++];
+        if( mid==0 || mid>=depth )
+        {
+            /// too few levels to split
+            order_region( g, verts, region, id, local, order );
+            return;
+        }
+        /// the vertices of the middle level next to the level above separate the halves
+        for( int v : verts )
+        {
+            if( level[v]<mid ) part_a.push_back( v );
+            else if( level[v]>mid ) part_b.push_back( v );
+            else
+            {
+                bool cut = false;
+                for( int p=g.xadj[v]; p<g.xadj[v+1] && !cut; p++ )
+                    cut = region[g.adj[p]]==id && level[g.adj[p]]==mid+1;
+                ( cut ? sep : part_a ).push_back( v );
+            }
+        }
+    }
+    std::vector<int>().swap( verts );
+    nested_dissection( g, part_a, region, n_regions, level, local, order );
+    nested_dissection( g, part_b, region, n_regions, level, local, order );
+    order.insert( order.end(), sep.begin(), sep.end() );
+}
+
+/// L11, L21 of the first k columns of the m x m front f (lower triangle, row-major)
+/// and the Schur complement left in f[k:m, k:m]: a panel at a time, each column
+/// scaled and applied within the panel, the trailing lower triangle updated by syrk
+template<typename T>
+int front_chole( int m, int k, T* f )
+{
+    for( int j0=0; j0<k; j0+=FRONT_BLOCK )
+    {
+        int j1 = std::min( k, j0+FRONT_BLOCK );
+        for( int j=j0; j<j1; j++ )
+        {
+            RealType<T> d = scalar_real( f[(std::size_t)j*m+j] );
+            if( !( d>0 ) ) return -1;
+            d = std::sqrt( d );
+            f[(std::size_t)j*m+j] = T(d);
+            for( int i=j+1; i<m; i++ )
+                f[(std::size_t)i*m+j] /= d;
+            for( int c=j+1; c<j1; c++ )
+            {
+                T lc = scalar_conj( f[(std::size_t)c*m+j] );
+                for( int i=c; i<m; i++ )
+                    f[(std::size_t)i*m+c] -= f[(std::size_t)i*m+j] * lc;
+            }
+        }
+        if( j1<m )
+            syrk_lower( m-j1, j1-j0, T(-1), f + (std::size_t)j1*m + j0, m, T(1), f + (std::size_t)j1*m + j1, m );
+    }
+    return 0;
+}
+
+/// L U of the first k columns of the m x m front f with the pivot of column j taken
+/// from rows [j, k) only, so that the rows below, which belong to other supernodes,
+/// keep their place; a pivot below tau becomes tau with the sign of the entry.
+/// Returns the number of pivots replaced, the Schur complement is left in f[k:m, k:m]
+template<typename T>
+int front_lu( int m, int k, T* f, int* piv, RealType<T> tau )
+{
+    int perturbed = 0;
+    for( int j0=0; j0<k; j0+=FRONT_BLOCK )
+    {
+        int j1 = std::min( k, j0+FRONT_BLOCK );
+        for( int j=j0; j<j1; j++ )
+        {
+            int p = j;
+            for( int i=j+1; i<k; i++ )
+                if( std::abs( f[(std::size_t)i*m+j] ) > std::abs( f[(std::size_t)p*m+j] ) ) p = i;
+            piv[j] = p;
+            if( p!=j )
+                std::swap_ranges( f + (std::size_t)j*m, f + (std::size_t)(j+1)*m, f + (std::size_t)p*m );
+            T& d = f[(std::size_t)j*m+j];
+            if( std::abs( d ) < tau )
+            {
+                d = ( d==T(0) ) ? T(tau) : d * ( tau/std::abs( d ) );
+                perturbed++;
+            }
+            for( int i=j+1; i<m; i++ )
+                f[(std::size_t)i*m+j] /= d;
+            for( int c=j+1; c<j1; c++ )
+            {
+                T u = f[(std::size_t)j*m+c];
+                for( int i=j+1; i<m; i++ )
+                    f[(std::size_t)i*m+c] -= f[(std::size_t)i*m+j] * u;
+            }
+        }
+        if( j1<m )
+        {
+            trsm_left( true, false, true, j1-j0, m-j1, f + (std::size_t)j0*m + j0, m, f + (std::size_t)j0*m + j1, m );
+            gemm( false, false, m-j1, m-j1, j1-j0, T(-1), f + (std::size_t)j1*m + j0, m,
+                  f + (std::size_t)j0*m + j1, m, T(1), f + (std::size_t)j1*m + j1, m );
+        }
+    }
+    return perturbed;
+}
+
+/// the update matrix of a supernode waiting for its parent
+template<typename T>
+struct FrontUpdate
+{
+    int sn;
+    std::vector<T> val;
+};
+
+}
+
+template<typename T>
+BasicSparseLinearSolver<T>::BasicSparseLinearSolver()
+:   status( EMPTY ),
+    _ordering( AMD_ORDER ),
+    _analyzed( false ),
+    _perturbed( 0 ),
+    refine_iters( 0 ),
+    _norm_a( 0 )
+{
+}
+
+template<typename T>
+BasicSparseLinearSolver<T>::BasicSparseLinearSolver( const SparseMatrixType& mat )
+:   BasicSparseLinearSolver()
+{
+    set_matrix( mat );
+}
+
+template<typename T>
+void BasicSparseLinearSolver<T>::set_matrix( const SparseMatrixType& mat )
+{
+    if( mat.n_row()<=0 || mat.n_row()!=mat.n_col() ) return;
+    _a = mat.to_layout( CSC );
+    if( _analyzed && ( _a.ptr()!=_pattern_ptr || _a.idx()!=_pattern_idx ) )
+        _analyzed = false;
+    clear_factors();
+    _norm_a = 0;
+    for( T v : _a.val() )
+        _norm_a = std::max( _norm_a, (real_type)std::abs( v ) );
+    status = MAT_SET;
+}
+
+template<typename T>
+void BasicSparseLinearSolver<T>::set_ordering( SparseOrdering ordering )
+{
+    if( ordering!=_ordering ) _analyzed = false;
+    _ordering = ordering;
+}
+
+template<typename T>
+void BasicSparseLinearSolver<T>::clear_factors()
+{
+    std::vector<T>().swap( _lval );
+    std::vector<T>().swap( _uval );
+    _piv.clear();
+    _perturbed = 0;
+    refine_iters = 0;
+}
+
+template<typename T>
+std::size_t BasicSparseLinearSolver<T>::factor_nnz() const
+{
+    std::size_t nnz = 0;
+    for( int s=0; s<n_supernodes(); s++ )
+    {
+        std::size_t k = _sn_first[s+1] - _sn_first[s], m = _sn_rptr[s+1] - _sn_rptr[s];
+        nnz += k*m - k*(k-1)/2;
+    }
+    return nnz;
+}
+
+template<typename T>
+void BasicSparseLinearSolver<T>::analyze()
+{
+    assert( status!=EMPTY );
+    int n = _a.n_col();
+    Graph g = symmetric_graph( n, _a.ptr(), _a.idx() );
+
+    /// fill-reducing order
+    if( _ordering==AMD_ORDER )
+        perm = amd_order( g );
+    else if( _ordering==NESTED_DISSECTION )
+    {
+        std::vector<int> verts( n ), region( n, -1 ), level( n ), local( n );
+        for( int i=0; i<n; i++ )
+            verts[i] = i;
+        int n_regions = 0;
+        perm.clear();
+        perm.reserve( n );
+        nested_dissection( g, verts, region, n_regions, level, local, perm );
+    }
+    else
+    {
+        perm.resize( n );
+        for( int i=0; i<n; i++ )
+            perm[i] = i;
+    }
+    iperm.resize( n );
+    for( int k=0; k<n; k++ )
+        iperm[perm[k]] = k;
+
+    /// elimination tree of P (A + A^t) P^t, ancestors compressed as the tree is built
+    std::vector<int> parent( n, -1 ), ancestor( n, -1 );
+    for( int k=0; k<n; k++ )
+    {
+        int v = perm[k];
+        for( int p=g.xadj[v]; p<g.xadj[v+1]; p++ )
+        {
+            int i = iperm[g.adj[p]];
+            if( i>=k ) continue;
+            while( ancestor[i]!=-1 && ancestor[i]!=k )
+            {
+                int t = ancestor[i];
+                ancestor[i] = k;
+                i = t;
+            }
+            if( ancestor[i]==-1 )
+            {
+                ancestor[i] = k;
+                parent[i] = k;
+            }
+        }
+    }
+
+    /// postorder, so that every subtree and so every supernode is a range of columns
+    std::vector<int> child_head( n, -1 ), sibling( n, -1 ), post;
+    post.reserve( n );
+    for( int j=n-1; j>=0; j-- )
+        if( parent[j]!=-1 )
+        {
+            sibling[j] = child_head[parent[j]];
+            child_head[parent[j]] = j;
+        }
+    std::vector<int> stack;
+    for( int r=0; r<n; r++ )
+    {
+        if( parent[r]!=-1 ) continue;
+        stack.push_back( r );
+        while( !stack.empty() )
+        {
+            int v = stack.back();
+            if( child_head[v]!=-1 )
+            {
+                int c = child_head[v];
+                child_head[v] = sibling[c];
+                stack.push_back( c );
+            }
+            else
+            {
+                post.push_back( v );
+                stack.pop_back();
+            }
+        }
+    }
+    std::vector<int> ipost( n ), new_perm( n ), new_parent( n, -1 );
+    for( int k=0; k<n; k++ )
+        ipost[post[k]] = k;
+    for( int k=0; k<n; k++ )
+    {
+        new_perm[k] = perm[post[k]];
+        if( parent[post[k]]!=-1 ) new_parent[k] = ipost[parent[post[k]]];
+    }
+    perm.swap( new_perm );
+    parent.swap( new_parent );
+    for( int k=0; k<n; k++ )
+        iperm[perm[k]] = k;
+
+    /// column counts of L: row i of L is the subtree of the etree spanned by the
+    /// nonzeros A(i, j<i) and their paths up to i
+    std::vector<int> count( n, 1 ), mark( n, -1 ), n_child( n, 0 );
+    for( int i=0; i<n; i++ )
+    {
+        mark[i] = i;
+        int v = perm[i];
+        for( int p=g.xadj[v]; p<g.xadj[v+1]; p++ )
+        {
+            int j = iperm[g.adj[p]];
+            if( j>=i ) continue;
+            while( mark[j]!=i )
+            {
+                count[j]++;
+                mark[j] = i;
+                j = parent[j];
+            }
+        }
+        if( parent[i]!=-1 ) n_child[parent[i]]++;
+    }
+
+    /// supernodes: a subtree of at most RELAX_SUBTREE columns hanging off a larger
+    /// one is taken whole, its few explicit zeros buying dense kernels on a wider
+    /// block; elsewhere j joins the supernode of j-1 when it is the only child of j
+    /// and column j-1 is column j plus the diagonal
+    std::vector<int> desc( n, 1 ), relax_first( n, -1 );
+    for( int j=0; j<n; j++ )
+        if( parent[j]!=-1 ) desc[parent[j]] += desc[j];
+    for( int j=0; j<n; j++ )
+        if( desc[j]<=RELAX_SUBTREE && ( parent[j]==-1 || desc[parent[j]]>RELAX_SUBTREE ) )
+            for( int c=j-desc[j]+1; c<=j; c++ )
+                relax_first[c] = j-desc[j]+1;
+    _sn_first.assign( 1, 0 );
+    for( int j=1; j<n; j++ )
+    {
+        bool start;
+        if( relax_first[j]!=-1 ) start = relax_first[j]==j;
+        else start = relax_first[j-1]!=-1 || !( parent[j-1]==j && count[j-1]==count[j]+1 && n_child[j]==1 );
+        if( start ) _sn_first.push_back( j );
+    }
+    _sn_first.push_back( n );
+    int n_sn = n_supernodes();
+    std::vector<int> col_sn( n );
+    for( int s=0; s<n_sn; s++ )
+        for( int j=_sn_first[s]; j<_sn_first[s+1]; j++ )
+            col_sn[j] = s;
+
+    /// rows of each supernode: its columns, the entries of A below them and the rows
+    /// its children pass up; children come first in postorder
+    _sn_parent.assign( n_sn, -1 );
+    _sn_rptr.assign( 1, 0 );
+    _sn_rows.clear();
+    std::vector< std::vector<int> > kids( n_sn );
+    std::fill( mark.begin(), mark.end(), -1 );
+    std::vector<int> below;
+    for( int s=0; s<n_sn; s++ )
+    {
+        int f = _sn_first[s], l = _sn_first[s+1];
+        below.clear();
+        for( int j=f; j<l; j++ )
+        {
+            int v = perm[j];
+            for( int p=g.xadj[v]; p<g.xadj[v+1]; p++ )
+            {
+                int i = iperm[g.adj[p]];
+                if( i>=l && mark[i]!=s )
+                {
+                    mark[i] = s;
+                    below.push_back( i );
+                }
+            }
+        }
+        for( int c : kids[s] )
+        {
+            int kc = _sn_first[c+1] - _sn_first[c];
+            for( int r=_sn_rptr[c]+kc; r<_sn_rptr[c+1]; r++ )
+            {
+                int i = _sn_rows[r];
+                if( i>=l && mark[i]!=s )
+                {
+                    mark[i] = s;
+                    below.push_back( i );
+                }
+            }
+        }
+        std::sort( below.begin(), below.end() );
+        for( int j=f; j<l; j++ )
+            _sn_rows.push_back( j );
+        _sn_rows.insert( _sn_rows.end(), below.begin(), below.end() );
+        _sn_rptr.push_back( (int)_sn_rows.size() );
+        assert( relax_first[f]!=-1 || (int)below.size() + l - f == count[f] );
+        if( !below.empty() )
+        {
+            _sn_parent[s] = col_sn[below[0]];
+            kids[_sn_parent[s]].push_back( s );
+        }
+    }
+
+    _pattern_ptr = _a.ptr();
+    _pattern_idx = _a.idx();
+    _analyzed = true;
+}
+
+template<typename T>
+typename BasicSparseLinearSolver<T>::SparseMatrixType BasicSparseLinearSolver<T>::permuted( bool lower ) const
+{
+    int n = _a.n_col();
+    std::vector<int> rows, cols;
+    std::vector<T> vals;
+    rows.reserve( _a.nnz() );
+    cols.reserve( _a.nnz() );
+    vals.reserve( _a.nnz() );
+    for( int j=0; j<n; j++ )
+        for( int p=_a.ptr()[j]; p<_a.ptr()[j+1]; p++ )
+        {
+            int i = _a.idx()[p];
+            if( lower && i<j ) continue;
+            int ni = iperm[i], nj = iperm[j];
+            if( lower && ni<nj )
+            {
+                rows.push_back( nj );
+                cols.push_back( ni );
+                vals.push_back( scalar_conj( _a.val()[p] ) );
+            }
+            else
+            {
+                rows.push_back( ni );
+                cols.push_back( nj );
+                vals.push_back( _a.val()[p] );
+            }
+        }
+    return SparseMatrixType::from_triplets( n, n, rows, cols, vals, CSC );
+}
+
+template<typename T>
+int BasicSparseLinearSolver<T>::chole_decomp()
+{
+    assert( status!=EMPTY );
+    if( !_analyzed ) analyze();
+    clear_factors();
+    int n = _a.n_col(), n_sn = n_supernodes();
+    SparseMatrixType b = permuted( true );
+
+    _sn_lptr.assign( n_sn+1, 0 );
+    for( int s=0; s<n_sn; s++ )
+        _sn_lptr[s+1] = _sn_lptr[s] + (std::size_t)( _sn_first[s+1]-_sn_first[s] )*( _sn_rptr[s+1]-_sn_rptr[s] );
+    _lval.assign( _sn_lptr[n_sn], T(0) );
+
+    std::vector<int> relpos( n );
+    std::vector< FrontUpdate<T> > updates;
+    std::vector<T> f;
+    for( int s=0; s<n_sn; s++ )
+    {
+        int c0 = _sn_first[s], k = _sn_first[s+1] - c0, m = _sn_rptr[s+1] - _sn_rptr[s];
+        const int* rows = _sn_rows.data() + _sn_rptr[s];
+        for( int r=0; r<m; r++ )
+            relpos[rows[r]] = r;
+
+        /// the front: lower triangle of A in the supernode's columns, then the update
+        /// matrices of its children, which sit on top of the stack
+        f.assign( (std::size_t)m*m, T(0) );
+        for( int j=c0; j<c0+k; j++ )
+            for( int p=b.ptr()[j]; p<b.ptr()[j+1]; p++ )
+                f[(std::size_t)relpos[b.idx()[p]]*m + j-c0] += b.val()[p];
+        while( !updates.empty() && _sn_parent[updates.back().sn]==s )
+        {
+            const FrontUpdate<T>& u = updates.back();
+            int c = u.sn, kc = _sn_first[c+1] - _sn_first[c];
+            const int* crows = _sn_rows.data() + _sn_rptr[c] + kc;
+            int mu = _sn_rptr[c+1] - _sn_rptr[c] - kc;
+            for( int a=0; a<mu; a++ )
+            {
+                T* fa = f.data() + (std::size_t)relpos[crows[a]]*m;
+                for( int e=0; e<=a; e++ )
+                    fa[relpos[crows[e]]] += u.val[(std::size_t)a*mu+e];
+            }
+            updates.pop_back();
+        }
+
+        if( front_chole( m, k, f.data() )!=0 )
+        {
+            clear_factors();
+            status = MAT_SET;
+            return -1;
+        }
+        T* l = _lval.data() + _sn_lptr[s];
+        for( int r=0; r<m; r++ )
+            std::copy( f.data() + (std::size_t)r*m, f.data() + (std::size_t)r*m + k, l + (std::size_t)r*k );
+        if( m>k && _sn_parent[s]!=-1 )
+        {
+            int mu = m-k;
+            FrontUpdate<T> u;
+            u.sn = s;
+            u.val.resize( (std::size_t)mu*mu );
+            for( int a=0; a<mu; a++ )
+                std::copy( f.data() + (std::size_t)(k+a)*m + k, f.data() + (std::size_t)(k+a)*m + k+a+1,
+                           u.val.data() + (std::size_t)a*mu );
+            updates.push_back( std::move( u ) );
+        }
+    }
+    status = CHOLE_SUCCESS;
+    return 0;
+}
+
+template<typename T>
+int BasicSparseLinearSolver<T>::lu_decomp()
+{
+    assert( status!=EMPTY );
+    if( _norm_a==0 ) return -1;
+    if( !_analyzed ) analyze();
+    clear_factors();
+    int n = _a.n_col(), n_sn = n_supernodes();
+    SparseMatrixType b = permuted( false );
+    SparseMatrixType b_rows = b.to_layout( CSR );
+    real_type tau = std::sqrt( std::numeric_limits<real_type>::epsilon() ) * _norm_a;
+
+    _sn_uptr.assign( n_sn+1, 0 );
+    _sn_lptr.assign( n_sn+1, 0 );
+    for( int s=0; s<n_sn; s++ )
+    {
+        std::size_t k = _sn_first[s+1] - _sn_first[s], m = _sn_rptr[s+1] - _sn_rptr[s];
+        _sn_uptr[s+1] = _sn_uptr[s] + k*m;
+        _sn_lptr[s+1] = _sn_lptr[s] + ( m-k )*k;
+    }
+    _uval.assign( _sn_uptr[n_sn], T(0) );
+    _lval.assign( _sn_lptr[n_sn], T(0) );
+    _piv.assign( n, 0 );
+
+    std::vector<int> relpos( n );
+    std::vector< FrontUpdate<T> > updates;
+    std::vector<T> f;
+    for( int s=0; s<n_sn; s++ )
+    {
+        int c0 = _sn_first[s], c1 = _sn_first[s+1], k = c1 - c0, m = _sn_rptr[s+1] - _sn_rptr[s];
+        const int* rows = _sn_rows.data() + _sn_rptr[s];
+        for( int r=0; r<m; r++ )
+            relpos[rows[r]] = r;
+
+        /// the front: the supernode's columns of A from row c0 down and its rows of A
+        /// right of the diagonal block, then the children's update matrices
+        f.assign( (std::size_t)m*m, T(0) );
+        for( int j=c0; j<c1; j++ )
+            for( int p=b.ptr()[j]; p<b.ptr()[j+1]; p++ )
+                if( b.idx()[p]>=c0 )
+                    f[(std::size_t)relpos[b.idx()[p]]*m + j-c0] += b.val()[p];
+        for( int i=c0; i<c1; i++ )
+            for( int p=b_rows.ptr()[i]; p<b_rows.ptr()[i+1]; p++ )
+                if( b_rows.idx()[p]>=c1 )
+                    f[(std::size_t)(i-c0)*m + relpos[b_rows.idx()[p]]] += b_rows.val()[p];
+        while( !updates.empty() && _sn_parent[updates.back().sn]==s )
+        {
+            const FrontUpdate<T>& u = updates.back();
+            int c = u.sn, kc = _sn_first[c+1] - _sn_first[c];
+            const int* crows = _sn_rows.data() + _sn_rptr[c] + kc;
+            int mu = _sn_rptr[c+1] - _sn_rptr[c] - kc;
+            for( int a=0; a<mu; a++ )
+            {
+                T* fa = f.data() + (std::size_t)relpos[crows[a]]*m;
+                const T* ua = u.val.data() + (std::size_t)a*mu;
+                for( int e=0; e<mu; e++ )
+                    fa[relpos[crows[e]]] += ua[e];
+            }
+            updates.pop_back();
+        }
+
+        _perturbed += front_lu( m, k, f.data(), _piv.data() + c0, tau );
+        std::copy( f.data(), f.data() + (std::size_t)k*m, _uval.data() + _sn_uptr[s] );
+        T* l = _lval.data() + _sn_lptr[s];
+        for( int r=k; r<m; r++ )
+            std::copy( f.data() + (std::size_t)r*m, f.data() + (std::size_t)r*m + k, l + (std::size_t)(r-k)*k );
+        if( m>k && _sn_parent[s]!=-1 )
+        {
+            int mu = m-k;
+            FrontUpdate<T> u;
+            u.sn = s;
+            u.val.resize( (std::size_t)mu*mu );
+            for( int a=0; a<mu; a++ )
+                std::copy( f.data() + (std::size_t)(k+a)*m + k, f.data() + (std::size_t)(k+a+1)*m,
+                           u.val.data() + (std::size_t)a*mu );
+            updates.push_back( std::move( u ) );
+        }
+    }
+    status = LU_SUCCESS;
+    return 0;
+}
+
+template<typename T>
+void BasicSparseLinearSolver<T>::solve_block( T* y, int nrhs )
+{
+    /// y is n x nrhs in the new order; forward over the supernodes then backward, the
+    /// rows below a diagonal block gathered into tmp for the gemm with L21
+    int n_sn = n_supernodes();
+    std::vector<T> tmp;
+    bool lu = status==LU_SUCCESS;
+    for( int s=0; s<n_sn; s++ )
+    {
+        int c0 = _sn_first[s], k = _sn_first[s+1] - c0, m = _sn_rptr[s+1] - _sn_rptr[s];
+        const int* rows = _sn_rows.data() + _sn_rptr[s];
+        T* ys = y + (std::size_t)c0*nrhs;
+        const T* l21;
+        if( lu )
+        {
+            for( int j=0; j<k; j++ )
+                if( _piv[c0+j]!=j )
+                    std::swap_ranges( ys + (std::size_t)j*nrhs, ys + (std::size_t)(j+1)*nrhs, ys + (std::size_t)_piv[c0+j]*nrhs );
+            trsm_left( true, false, true, k, nrhs, _uval.data() + _sn_uptr[s], m, ys, nrhs );
+            l21 = _lval.data() + _sn_lptr[s];
+        }
+        else
+        {
+            trsm_left( true, false, false, k, nrhs, _lval.data() + _sn_lptr[s], k, ys, nrhs );
+            l21 = _lval.data() + _sn_lptr[s] + (std::size_t)k*k;
+        }
+        if( m==k ) continue;
+        tmp.assign( (std::size_t)(m-k)*nrhs, T(0) );
+        gemm( false, false, m-k, nrhs, k, T(1), l21, k, ys, nrhs, T(0), tmp.data(), nrhs );
+        for( int r=k; r<m; r++ )
+        {
+            T* yr = y + (std::size_t)rows[r]*nrhs;
+            for( int c=0; c<nrhs; c++ )
+                yr[c] -= tmp[(std::size_t)(r-k)*nrhs+c];
+        }
+    }
+    for( int s=n_sn-1; s>=0; s-- )
+    {
+        int c0 = _sn_first[s], k = _sn_first[s+1] - c0, m = _sn_rptr[s+1] - _sn_rptr[s];
+        const int* rows = _sn_rows.data() + _sn_rptr[s];
+        T* ys = y + (std::size_t)c0*nrhs;
+        if( m>k )
+        {
+            tmp.resize( (std::size_t)(m-k)*nrhs );
+            for( int r=k; r<m; r++ )
+                std::copy( y + (std::size_t)rows[r]*nrhs, y + (std::size_t)(rows[r]+1)*nrhs, tmp.data() + (std::size_t)(r-k)*nrhs );
+            if( lu )
+                gemm( false, false, k, nrhs, m-k, T(-1), _uval.data() + _sn_uptr[s] + k, m,
+                      tmp.data(), nrhs, T(1), ys, nrhs );
+            else
+                gemm( true, false, k, nrhs, m-k, T(-1), _lval.data() + _sn_lptr[s] + (std::size_t)k*k, k,
+                      tmp.data(), nrhs, T(1), ys, nrhs );
+        }
+        if( lu )
+            trsm_left( false, false, false, k, nrhs, _uval.data() + _sn_uptr[s], m, ys, nrhs );
+        else
+            trsm_left( true, true, false, k, nrhs, _lval.data() + _sn_lptr[s], k, ys, nrhs );
+    }
+}
+
+template<typename T>
+typename BasicSparseLinearSolver<T>::MatrixType BasicSparseLinearSolver<T>::solve_vec( const ConstViewType& b )
+{
+    MatrixType x;
+    solve_vec( b, x );
+    return x;
+}
+
+template<typename T>
+typename BasicSparseLinearSolver<T>::MatrixType BasicSparseLinearSolver<T>::solve( const ConstViewType& b )
+{
+    MatrixType x;
+    solve_vec( b, x );
+    return x;
+}
+
+template<typename T>
+void BasicSparseLinearSolver<T>::solve_vec( const ConstViewType& b, MatrixType& x )
+{
+    assert( status==LU_SUCCESS || status==CHOLE_SUCCESS );
+    int n = _a.n_col(), k = b.n_col();
+    assert( b.n_row()==n );
+    if( x.n_row()!=n || x.n_col()!=k ) x.resize( n, k );
+
+    std::vector<T> y( (std::size_t)n*k );
+    auto solve_into = [&]( const ConstViewType& rhs, T* out ){
+        for( int i=0; i<n; i++ )
+            std::copy( rhs.data() + (std::size_t)perm[i]*rhs.ld(), rhs.data() + (std::size_t)perm[i]*rhs.ld() + k,
+                       y.data() + (std::size_t)i*k );
+        solve_block( y.data(), k );
+        for( int i=0; i<n; i++ )
+            std::copy( y.data() + (std::size_t)i*k, y.data() + (std::size_t)(i+1)*k, out + (std::size_t)perm[i]*k );
+    };
+    solve_into( b, x.data() );
+    refine_iters = 0;
+    if( _perturbed==0 ) return;
+
+    /// the perturbed pivots made L U a nearby matrix: x += (L U)^-1 (b - A x) while
+    /// the residual keeps halving
+    real_type eps = std::numeric_limits<real_type>::epsilon();
+    real_type prev = std::numeric_limits<real_type>::infinity();
+    MatrixType r, d( n, k );
+    for( ; refine_iters<SPARSE_REFINE_ITERS; refine_iters++ )
+    {
+        _a.multiply( x, r );
+        real_type r_max = 0, x_max = 0;
+        for( int i=0; i<n; i++ )
+            for( int c=0; c<k; c++ )
+            {
+                r(i,c) = b(i,c) - r(i,c);
+                r_max = std::max( r_max, (real_type)std::abs( r(i,c) ) );
+                x_max = std::max( x_max, (real_type)std::abs( x(i,c) ) );
+            }
+        if( !( r_max > eps*_norm_a*x_max ) || !( r_max < 0.5*prev ) ) break;
+        prev = r_max;
+        solve_into( r, d.data() );
+        for( int i=0; i<n; i++ )
+            for( int c=0; c<k; c++ )
+                x(i,c) += d(i,c);
+    }
+}
+
+template class BasicSparseLinearSolver<float>;
+template class BasicSparseLinearSolver<double>;
+template class BasicSparseLinearSolver< std::complex<float> >;
+template class BasicSparseLinearSolver< std::complex<double> >;
+
+}
@@ -0,0 +1,112 @@
+#ifndef _MX_SPARSE_SOLVER_H
+#define _MX_SPARSE_SOLVER_H
+
+#include <vector>
+
+#include "lu.h"
+#include "matrix.h"
+#include "scalar.h"
+#include "sparse_matrix.h"
+
+namespace mx
+{
+
+enum SparseOrdering{
+    NATURAL_ORDER,
+    /// approximate minimum degree on the quotient graph of A + A^t
+    AMD_ORDER,
+    /// recursive level-set bisection of A + A^t, the parts below a few hundred
+    /// vertices ordered by AMD_ORDER
+    NESTED_DISSECTION
+};
+
+/// direct solves with a sparse square matrix, the sparse counterpart of
+/// BasicLinearSolver with the same set_matrix / decomposition / solve_vec lifecycle.
+/// analyze() orders A + A^t to reduce fill, builds the elimination tree in postorder,
+/// counts the columns of L and groups columns with the same structure into supernodes;
+/// it is kept by set_matrix for any matrix with the same pattern. The numeric
+/// factorizations are multifrontal: each supernode assembles a dense front from A and
+/// its children's update matrices and factors it with the dense kernels of blas.h.
+/// Instantiated in sparse_solver.cpp for float, double and their complex forms
+template<typename T>
+class BasicSparseLinearSolver
+{
+public:
+    typedef BasicSparseMatrix<T> SparseMatrixType;
+    typedef BasicMatrix<T> MatrixType;
+    typedef BasicConstMatrixView<T> ConstViewType;
+    typedef RealType<T> real_type;
+
+private:
+    /// A in compressed columns
+    SparseMatrixType _a;
+    LinearSolverStatus status;
+    SparseOrdering _ordering;
+    bool _analyzed;
+    /// the pattern the analysis was made for
+    std::vector<int> _pattern_ptr, _pattern_idx;
+    /// new index k is row / column perm[k] of A, iperm is the inverse
+    std::vector<int> perm;
+    std::vector<int> iperm;
+    /// supernode s holds columns [_sn_first[s], _sn_first[s+1]) of L and the rows
+    /// _sn_rows[ _sn_rptr[s] .. _sn_rptr[s+1] ), its own columns first
+    std::vector<int> _sn_first;
+    std::vector<int> _sn_parent;
+    std::vector<int> _sn_rptr;
+    std::vector<int> _sn_rows;
+    /// CHOLE: the m x k block of L per supernode. LU: the k x m rows of the front
+    /// (L11 below the diagonal, U11 and U12) in _uval and the (m-k) x k block L21 in _lval
+    std::vector<std::size_t> _sn_lptr, _sn_uptr;
+    std::vector<T> _lval, _uval;
+    /// LU: row swaps inside the diagonal block of each supernode, front-local
+    std::vector<int> _piv;
+    int _perturbed;
+    int refine_iters;
+    real_type _norm_a;
+
+    void clear_factors();
+    /// P A P^t with P from perm, compressed by columns; lower keeps its lower triangle
+    /// only, the upper triangle of A read as the conjugate of the lower
+    SparseMatrixType permuted( bool lower ) const;
+    void solve_block( T* y, int k );
+
+public:
+    BasicSparseLinearSolver();
+    BasicSparseLinearSolver( const SparseMatrixType& mat );
+    /// a square matrix in either layout; the analysis is kept if the pattern is unchanged
+    void set_matrix( const SparseMatrixType& mat );
+    void set_ordering( SparseOrdering ordering );
+    /// ordering, elimination tree, column counts and supernodes; called by the
+    /// decompositions when needed
+    void analyze();
+    bool is_analyzed() const { return _analyzed; }
+    /// L L^* of a symmetric / Hermitian positive definite A, from its lower triangle;
+    /// -1 if A is not positive definite
+    int chole_decomp();
+    /// L U with static pivoting: rows are exchanged only inside the diagonal block of a
+    /// supernode, a pivot still below sqrt(eps) |A| is replaced by that value, and the
+    /// solves refine against A when any was; -1 if A has no entries
+    int lu_decomp();
+    LinearSolverStatus get_status() { return status; }
+    MatrixType solve_vec( const ConstViewType& b );
+    void solve_vec( const ConstViewType& b, MatrixType& x );
+    MatrixType solve( const ConstViewType& b );
+
+    const std::vector<int>& get_perm() const { return perm; }
+    int n_supernodes() const { return (int)_sn_first.size() - 1; }
+    /// entries of L, counting the diagonal, from the analysis
+    std::size_t factor_nnz() const;
+    /// pivots replaced by the last lu_decomp
+    int get_perturbed_pivots() const { return _perturbed; }
+    /// refinement steps of the last solve, 0 without perturbed pivots
+    int get_refine_iterations() const { return refine_iters; }
+};
+
+typedef BasicSparseLinearSolver<double> SparseLinearSolver;
+typedef BasicSparseLinearSolver<float> SparseLinearSolverF;
+typedef BasicSparseLinearSolver< std::complex<double> > SparseLinearSolverZ;
+typedef BasicSparseLinearSolver< std::complex<float> > SparseLinearSolverC;
+
+}
+
+#endif
@@ -0,0 +1,74 @@
+#include "libmatrix/sym_matrix.h"
+
+namespace mx
+{
+
+template<typename T>
+BasicSymMatrix<T>::BasicSymMatrix( const BasicMatrix<T>& mat )
+:   _n( mat.n_row() ),
+    _packed( packed_size( mat.n_row() ) )
+{
+    assert( mat.n_row()==mat.n_col() );
+    for( int i=0; i<_n; i++ )
+        std::copy( mat.data() + (std::size_t)i*_n, mat.data() + (std::size_t)i*_n + i+1, row( i ) );
+}
+
+template<typename T>
+void BasicSymMatrix<T>::resize( int n, T val )
+{
+    _n = n;
+    _packed.assign( packed_size( n ), val );
+}
+
+template<typename T>
+BasicMatrix<T> BasicSymMatrix<T>::to_matrix() const
+{
+    BasicMatrix<T> res( _n, _n );
+    for( int i=0; i<_n; i++ )
+    {
+        const T* ri = row( i );
+        for( int j=0; j<=i; j++ )
+        {
+            res(i,j) = ri[j];
+            res(j,i) = scalar_conj( ri[j] );
+        }
+    }
+    return res;
+}
+
+template<typename T>
+BasicMatrix<T> BasicSymMatrix<T>::multiply( const BasicConstMatrixView<T>& x ) const
+{
+    /// one pass over the triangle: row i of it gives y(i) += L(i,:) x and, through the
+    /// mirrored entries, y(:) += conj( L(i,:) ) x(i)
+    assert( x.n_row()==_n );
+    int k = x.n_col();
+    BasicMatrix<T> y( _n, k );
+    for( int i=0; i<_n; i++ )
+    {
+        const T* ri = row( i );
+        const T* xi = x.data() + (std::size_t)i*x.ld();
+        T* yi = y.data() + (std::size_t)i*k;
+        for( int j=0; j<i; j++ )
+        {
+            const T* xj = x.data() + (std::size_t)j*x.ld();
+            T* yj = y.data() + (std::size_t)j*k;
+            T a = ri[j], ac = scalar_conj( ri[j] );
+            for( int c=0; c<k; c++ )
+            {
+                yi[c] += a * xj[c];
+                yj[c] += ac * xi[c];
+            }
+        }
+        for( int c=0; c<k; c++ )
+            yi[c] += ri[i] * xi[c];
+    }
+    return y;
+}
+
+template class BasicSymMatrix<float>;
+template class BasicSymMatrix<double>;
+template class BasicSymMatrix< std::complex<float> >;
+template class BasicSymMatrix< std::complex<double> >;
+
+}
@@ -0,0 +1,73 @@
+#ifndef _MX_SYM_MATRIX_H
+#define _MX_SYM_MATRIX_H
+
+#include <cassert>
+#include <vector>
+
+#include "matrix.h"
+#include "scalar.h"
+
+namespace mx
+{
+
+/// n x n symmetric (Hermitian for complex T) matrix holding only its lower triangle,
+/// packed by rows: entry (i,j), j<=i, is data()[ i*(i+1)/2 + j ], so each row of the
+/// triangle is contiguous and the matrix takes n(n+1)/2 entries instead of n^2.
+/// Entries above the diagonal read as the conjugate of their mirror.
+/// Instantiated in sym_matrix.cpp for float, double and their complex forms
+template<typename T>
+class BasicSymMatrix
+{
+public:
+    typedef T value_type;
+    typedef RealType<T> real_type;
+
+private:
+    int _n;
+    std::vector<T> _packed;
+
+public:
+    BasicSymMatrix() : _n(0) {}
+    BasicSymMatrix( int n, T val=T(0) ) : _n(n), _packed( packed_size( n ), val ) {}
+
+    /// start of row i of the triangle, its i+1 entries follow each other
+    static std::size_t row_offset( int i ) { return (std::size_t)i*(i+1)/2; }
+    static std::size_t packed_size( int n ) { return row_offset( n ); }
+
+    /// (i,j) of the lower triangle, j<=i
+    T& operator()( int row, int col )
+    {
+        assert( col>=0 && col<=row && row<_n && "write to the lower triangle only" );
+        return _packed[ row_offset( row ) + col ];
+    }
+    T operator()( int row, int col ) const
+    {
+        assert( row>=0 && row<_n && col>=0 && col<_n );
+        return ( col<=row ) ? _packed[ row_offset( row ) + col ] : scalar_conj( _packed[ row_offset( col ) + row ] );
+    }
+    int n() const { return _n; }
+    int n_row() const { return _n; }
+    int n_col() const { return _n; }
+    T* data() { return _packed.data(); }
+    const T* data() const { return _packed.data(); }
+    T* row( int i ) { return _packed.data() + row_offset( i ); }
+    const T* row( int i ) const { return _packed.data() + row_offset( i ); }
+
+    /* in sym_matrix.cpp */
+    /// the lower triangle of mat, the part above the diagonal is not read
+    explicit BasicSymMatrix( const BasicMatrix<T>& mat );
+    void resize( int n, T val=T(0) );
+    /// the full matrix with both triangles
+    BasicMatrix<T> to_matrix() const;
+    /// A x for the n x k block x
+    BasicMatrix<T> multiply( const BasicConstMatrixView<T>& x ) const;
+};
+
+typedef BasicSymMatrix<double> SymMatrix;
+typedef BasicSymMatrix<float> SymMatrixF;
+typedef BasicSymMatrix< std::complex<double> > SymMatrixZ;
+typedef BasicSymMatrix< std::complex<float> > SymMatrixC;
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+#include "libmatrix/task_graph.h"
+#include "libmatrix/thread_pool.h"
+
+#include <algorithm>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+
+namespace mx
+{
+
+int TaskGraph::add_task( std::function<void()> fn,
+                         std::initializer_list<long> reads,
+                         std::initializer_list<long> writes,
+                         int priority )
+{
+    return add_task( std::move(fn), std::vector<long>(reads), std::vector<long>(writes), priority );
+}
+
+int TaskGraph::add_task( std::function<void()> fn,
+                         const std::vector<long>& reads,
+                         const std::vector<long>& writes,
+                         int priority )
+{
+    int id = (int)_tasks.size();
+    std::vector<int> deps;
+
+    /// read after write
+    for( long d : reads )
+    {
+        DataState& state = _data[d];
+        if( state.last_writer>=0 ) deps.push_back( state.last_writer );
+    }
+    /// write after write and write after read
+    for( long d : writes )
+    {
+        DataState& state = _data[d];
+        if( state.last_writer>=0 ) deps.push_back( state.last_writer );
+        deps.insert( deps.end(), state.readers.begin(), state.readers.end() );
+    }
+
+    for( long d : reads )
+        _data[d].readers.push_back( id );
+    for( long d : writes )
+    {
+        DataState& state = _data[d];
+        state.last_writer = id;
+        state.readers.clear();
+    }
+
+    std::sort( deps.begin(), deps.end() );
+    deps.erase( std::unique( deps.begin(), deps.end() ), deps.end() );
+    if( !deps.empty() && deps.back()==id ) deps.pop_back();
+
+    _tasks.push_back( { std::move(fn), priority, (int)deps.size(), {} } );
+    for( int d : deps )
+        _tasks[d].succ.push_back( id );
+    return id;
+}
+
+void TaskGraph::execute()
+{
+    int n_tasks = size();
+    if( n_tasks==0 ) return;
+
+    auto lower_priority = [this]( int a, int b )
+    {
+        if( _tasks[a].priority!=_tasks[b].priority ) return _tasks[a].priority < _tasks[b].priority;
+        return a > b;
+    };
+    std::priority_queue< int, std::vector<int>, decltype(lower_priority) > ready( lower_priority );
+    for( int i=0; i<n_tasks; i++ )
+        if( _tasks[i].n_deps==0 ) ready.push( i );
+
+    std::mutex lock;
+    std::condition_variable cv;
+    int n_done = 0;
+
+    /// every worker pulls ready tasks until the whole graph is done; a worker only
+    /// waits while another one is running a task, so running them one by one is safe
+    ThreadPool& pool = thread_pool();
+    pool.parallel_for( pool.size(), [&]( int )
+    {
+        std::unique_lock<std::mutex> guard( lock );
+        while( true )
+        {
+            cv.wait( guard, [&]{ return !ready.empty() || n_done==n_tasks; } );
+            if( n_done==n_tasks ) break;
+
+            int t = ready.top();
+            ready.pop();
+            guard.unlock();
+            _tasks[t].fn();
+            guard.lock();
+
+            n_done++;
+            for( int s : _tasks[t].succ )
+                if( --_tasks[s].n_deps==0 ) ready.push( s );
+            cv.notify_all();
+        }
+    } );
+
+    clear();
+}
+
+void TaskGraph::clear()
+{
+    _tasks.clear();
+    _data.clear();
+}
+
+}
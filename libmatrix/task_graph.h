@@ -0,0 +1,51 @@
+#ifndef _MX_TASK_GRAPH_H
+#define _MX_TASK_GRAPH_H
+
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <initializer_list>
+
+namespace mx
+{
+
+/// DAG of tasks whose edges come from the data they declare to read and write:
+/// a task runs after the last writer of everything it touches, and a writer also
+/// waits for the readers before it. Ready tasks run highest priority first.
+class TaskGraph
+{
+    struct Task
+    {
+        std::function<void()> fn;
+        int priority;
+        int n_deps;
+        std::vector<int> succ;
+    };
+
+    struct DataState
+    {
+        int last_writer = -1;
+        std::vector<int> readers;
+    };
+
+    std::vector<Task> _tasks;
+    std::unordered_map<long, DataState> _data;
+
+public:
+    int add_task( std::function<void()> fn,
+                  std::initializer_list<long> reads,
+                  std::initializer_list<long> writes,
+                  int priority=0 );
+    int add_task( std::function<void()> fn,
+                  const std::vector<long>& reads,
+                  const std::vector<long>& writes,
+                  int priority=0 );
+    int size() const { return (int)_tasks.size(); }
+    /// run every task on thread_pool(), returns once all are done
+    void execute();
+    void clear();
+};
+
+}
+
+#endif
@@ -0,0 +1,194 @@
+#include "libmatrix/thread_pool.h"
+
+#include <cstdlib>
+
+namespace mx
+{
+
+namespace
+{
+
+/// set on pool workers and on the submitting thread while a job runs,
+/// nested parallel_for calls then run inline instead of deadlocking
+thread_local bool in_parallel_region = false;
+
+int default_num_threads()
+{
+    const char* env = std::getenv( "MX_NUM_THREADS" );
+    if( env && std::atoi( env )>0 ) return std::atoi( env );
+    int n = std::thread::hardware_concurrency();
+    return n>0 ? n : 1;
+}
+
+}
+
+ThreadPool::ThreadPool( int n_threads )
+:   _job(nullptr),
+    _generation(0),
+    _n_busy(0),
+    _stop(false)
+{
+    start( n_threads );
+}
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+void ThreadPool::start( int n_threads )
+{
+    if( n_threads<1 ) n_threads = 1;
+    _stop = false;
+    _ranges.clear();
+    for( int i=0; i<n_threads; i++ )
+        _ranges.push_back( std::make_unique<TaskRange>() );
+
+    /// worker 0 is whichever thread calls parallel_for
+    for( int i=1; i<n_threads; i++ )
+        _workers.emplace_back( &ThreadPool::worker_loop, this, i );
+}
+
+void ThreadPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        _stop = true;
+    }
+    _wake.notify_all();
+    for( auto& t : _workers )
+        t.join();
+    _workers.clear();
+}
+
+void ThreadPool::resize( int n_threads )
+{
+    std::lock_guard<std::mutex> guard( _submit );
+    if( n_threads<1 ) n_threads = 1;
+    if( n_threads==size() ) return;
+    stop();
+    start( n_threads );
+}
+
+void ThreadPool::worker_loop( int id )
+{
+    in_parallel_region = true;
+    long seen = 0;
+    while( true )
+    {
+        {
+            std::unique_lock<std::mutex> guard( _lock );
+            _wake.wait( guard, [&]{ return _stop || _generation!=seen; } );
+            if( _stop ) return;
+            seen = _generation;
+        }
+
+        run_tasks( id );
+
+        std::lock_guard<std::mutex> guard( _lock );
+        if( --_n_busy==0 ) _done.notify_one();
+    }
+}
+
+void ThreadPool::run_tasks( int id )
+{
+    const std::function<void(int)>& task = *_job;
+    int t;
+    do
+    {
+        while( pop_task( id, t ) )
+            task( t );
+    } while( steal_tasks( id ) );
+}
+
+bool ThreadPool::pop_task( int id, int& task )
+{
+    TaskRange& own = *_ranges[id];
+    std::lock_guard<std::mutex> guard( own.lock );
+    if( own.begin>=own.end ) return false;
+    task = own.begin++;
+    return true;
+}
+
+bool ThreadPool::steal_tasks( int id )
+{
+    /// take the back half of the next non-empty range, false once all are drained
+    int n = size();
+    for( int k=1; k<n; k++ )
+    {
+        TaskRange& victim = *_ranges[ (id+k)%n ];
+        int beg, end;
+        {
+            std::lock_guard<std::mutex> guard( victim.lock );
+            int left = victim.end - victim.begin;
+            if( left<=0 ) continue;
+            beg = victim.end - (left+1)/2;
+            end = victim.end;
+            victim.end = beg;
+        }
+        TaskRange& own = *_ranges[id];
+        std::lock_guard<std::mutex> guard( own.lock );
+        own.begin = beg;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::parallel_for( int n_tasks, const std::function<void(int)>& task )
+{
+    /// run task(0..n_tasks-1) on all workers, returns when every task is done
+    if( n_tasks<=0 ) return;
+
+    bool serial = in_parallel_region || size()==1 || n_tasks==1;
+    std::unique_lock<std::mutex> submit( _submit, std::defer_lock );
+    /// another thread owns the pool: do the work here rather than wait for it
+    if( !serial && !submit.try_lock() ) serial = true;
+    if( serial )
+    {
+        for( int i=0; i<n_tasks; i++ )
+            task( i );
+        return;
+    }
+
+    int n = size();
+    for( int w=0; w<n; w++ )
+    {
+        std::lock_guard<std::mutex> guard( _ranges[w]->lock );
+        _ranges[w]->begin = (long)n_tasks*w/n;
+        _ranges[w]->end = (long)n_tasks*(w+1)/n;
+    }
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        _job = &task;
+        _n_busy = n-1;
+        _generation++;
+    }
+    _wake.notify_all();
+
+    in_parallel_region = true;
+    run_tasks( 0 );
+    in_parallel_region = false;
+
+    std::unique_lock<std::mutex> guard( _lock );
+    _done.wait( guard, [&]{ return _n_busy==0; } );
+    _job = nullptr;
+}
+
+ThreadPool& thread_pool()
+{
+    static ThreadPool pool( default_num_threads() );
+    return pool;
+}
+
+void set_num_threads( int n_threads )
+{
+    thread_pool().resize( n_threads );
+}
+
+int get_num_threads()
+{
+    return thread_pool().size();
+}
+
+}
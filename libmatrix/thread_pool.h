@@ -0,0 +1,60 @@
+#ifndef _MX_THREAD_POOL_H
+#define _MX_THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+namespace mx
+{
+
+class ThreadPool
+{
+    /// a contiguous range of task ids owned by one worker, thieves take its back half
+    struct TaskRange
+    {
+        std::mutex lock;
+        int begin = 0;
+        int end = 0;
+    };
+
+    std::vector< std::thread > _workers;
+    std::vector< std::unique_ptr<TaskRange> > _ranges;
+    std::mutex _submit;
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const std::function<void(int)>* _job;
+    long _generation;
+    int _n_busy;
+    bool _stop;
+
+public:
+    ThreadPool( int n_threads );
+    ~ThreadPool();
+    ThreadPool( const ThreadPool& ) = delete;
+    ThreadPool& operator=( const ThreadPool& ) = delete;
+    int size() const { return (int)_ranges.size(); }
+    void resize( int n_threads );
+    void parallel_for( int n_tasks, const std::function<void(int)>& task );
+private:
+    void start( int n_threads );
+    void stop();
+    void worker_loop( int id );
+    void run_tasks( int id );
+    bool pop_task( int id, int& task );
+    bool steal_tasks( int id );
+};
+
+    /* in thread_pool.cpp */
+/// the library-owned pool, sized by MX_NUM_THREADS or the hardware concurrency
+ThreadPool& thread_pool();
+void set_num_threads( int n_threads );
+int get_num_threads();
+
+}
+
+#endif
@@ -0,0 +1,452 @@
+#include "libmatrix/tile_file.h"
+#include "libmatrix/matrix_file.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MX_HAVE_PREAD
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mx
+{
+
+namespace
+{
+
+constexpr std::uint64_t TILE_FILE_ALIGN = 4096;
+constexpr std::align_val_t TILE_ALIGN{ 64 };
+
+std::uint64_t align_up( std::uint64_t x ) { return ( x + TILE_FILE_ALIGN - 1 ) / TILE_FILE_ALIGN * TILE_FILE_ALIGN; }
+
+/// whole-buffer positional I/O, retried on short transfers
+int read_at( int fd, void* buf, std::size_t bytes, std::uint64_t offset )
+{
+#ifdef MX_HAVE_PREAD
+    char* p = static_cast<char*>( buf );
+    while( bytes>0 )
+    {
+        ssize_t got = pread( fd, p, bytes, offset );
+        if( got<=0 ) return -1;
+        p += got;
+        bytes -= got;
+        offset += got;
+    }
+    return 0;
+#else
+    (void)fd; (void)buf; (void)bytes; (void)offset;
+    return -1;
+#endif
+}
+
+int write_at( int fd, const void* buf, std::size_t bytes, std::uint64_t offset )
+{
+#ifdef MX_HAVE_PREAD
+    const char* p = static_cast<const char*>( buf );
+    while( bytes>0 )
+    {
+        ssize_t put = pwrite( fd, p, bytes, offset );
+        if( put<=0 ) return -1;
+        p += put;
+        bytes -= put;
+        offset += put;
+    }
+    return 0;
+#else
+    (void)fd; (void)buf; (void)bytes; (void)offset;
+    return -1;
+#endif
+}
+
+}
+
+TileFile::TileFile() : _fd(-1), _n_tile(0), _tile_bytes(0)
+{
+    std::memset( &_header, 0, sizeof(_header) );
+}
+
+TileFile::~TileFile()
+{
+    close();
+}
+
+void TileFile::close()
+{
+#ifdef MX_HAVE_PREAD
+    if( _fd>=0 ) ::close( _fd );
+#endif
+    _fd = -1;
+}
+
+int TileFile::write_header()
+{
+    _header.header_checksum = checksum64( &_header, offsetof( TileFileHeader, header_checksum ) );
+    return write_at( _fd, &_header, sizeof(_header), 0 );
+}
+
+int TileFile::create( const char* file_name, std::uint32_t dtype, std::int64_t n, int nb )
+{
+    assert( n>0 && nb>0 && dtype_size( dtype )>0 );
+    close();
+#ifdef MX_HAVE_PREAD
+    _fd = ::open( file_name, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+#endif
+    if( _fd<0 )
+    {
+        std::cerr << "Cannot open file: " << file_name << std::endl;
+        return -1;
+    }
+
+    std::memset( &_header, 0, sizeof(_header) );
+    std::memcpy( _header.magic, TILE_FILE_MAGIC, 8 );
+    _header.version = TILE_FILE_VERSION;
+    _header.byte_order = MATRIX_FILE_BYTE_ORDER;
+    _header.dtype = dtype;
+    _header.state = TILES_MATRIX;
+    _header.n = n;
+    _header.nb = nb;
+    _header.perm_offset = TILE_FILE_ALIGN;
+    _header.data_offset = TILE_FILE_ALIGN + align_up( n*sizeof(std::int32_t) );
+    _n_tile = (int)( ( n + nb - 1 ) / nb );
+    _tile_bytes = (std::size_t)nb * nb * dtype_size( dtype );
+
+    /// the tiles start out as a hole in the file, read back as zeros
+    std::vector<int> perm( n );
+    for( std::int64_t i=0; i<n; i++ )
+        perm[i] = (int)i;
+    std::uint64_t length = _header.data_offset + (std::uint64_t)_n_tile*_n_tile*_tile_bytes;
+#ifdef MX_HAVE_PREAD
+    if( ftruncate( _fd, length )!=0 || write_header()!=0 || write_perm( perm.data() )!=0 )
+#endif
+    {
+        std::cerr << "Error: cannot write " << file_name << std::endl;
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+int TileFile::open( const char* file_name )
+{
+    close();
+#ifdef MX_HAVE_PREAD
+    _fd = ::open( file_name, O_RDWR );
+#endif
+    if( _fd<0 )
+    {
+        std::cerr << "Cannot open file: " << file_name << std::endl;
+        return -1;
+    }
+
+    const char* error = nullptr;
+    if( read_at( _fd, &_header, sizeof(_header), 0 )!=0 )
+        error = "too short for a tile file header";
+    else if( std::memcmp( _header.magic, TILE_FILE_MAGIC, 8 )!=0 )
+        error = "not a tile file";
+    else if( _header.header_checksum!=checksum64( &_header, offsetof( TileFileHeader, header_checksum ) ) )
+        error = "header checksum mismatch";
+    else if( _header.byte_order!=MATRIX_FILE_BYTE_ORDER )
+        error = "file was written with the other byte order";
+    else if( _header.version!=TILE_FILE_VERSION )
+        error = "unsupported file version";
+    else if( dtype_size( _header.dtype )==0 )
+        error = "unknown dtype";
+    else if( _header.state>TILES_CHOLE )
+        error = "unknown state";
+    else if( _header.n<=0 || _header.n>INT32_MAX || _header.nb<=0 || _header.nb>_header.n )
+        error = "bad dimensions";
+    else if( _header.perm_offset % TILE_FILE_ALIGN!=0 || _header.data_offset % TILE_FILE_ALIGN!=0
+             || _header.data_offset < _header.perm_offset + _header.n*sizeof(std::int32_t) )
+        error = "bad offsets";
+    if( !error )
+    {
+        _n_tile = (int)( ( _header.n + _header.nb - 1 ) / _header.nb );
+        _tile_bytes = (std::size_t)_header.nb * _header.nb * dtype_size( _header.dtype );
+#ifdef MX_HAVE_PREAD
+        struct stat st;
+        if( fstat( _fd, &st )!=0 || (std::uint64_t)st.st_size < _header.data_offset + (std::uint64_t)_n_tile*_n_tile*_tile_bytes )
+            error = "file is shorter than its tiles";
+#endif
+    }
+    if( error )
+    {
+        std::cerr << "Error: " << file_name << ": " << error << std::endl;
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+int TileFile::read_tile( long id, void* buf ) const
+{
+    return read_at( _fd, buf, _tile_bytes, _header.data_offset + (std::uint64_t)id*_tile_bytes );
+}
+
+int TileFile::write_tile( long id, const void* buf ) const
+{
+    return write_at( _fd, buf, _tile_bytes, _header.data_offset + (std::uint64_t)id*_tile_bytes );
+}
+
+int TileFile::write_tile_row( int i, const void* rows )
+{
+    std::size_t entry = dtype_size( _header.dtype );
+    int nb = this->nb();
+    int ib = tile_dim( i );
+    std::vector<char> tile( _tile_bytes, 0 );
+    for( int j=0; j<_n_tile; j++ )
+    {
+        int jb = tile_dim( j );
+        for( int r=0; r<ib; r++ )
+            std::memcpy( tile.data() + (std::size_t)r*nb*entry,
+                         static_cast<const char*>( rows ) + ( (std::size_t)r*_header.n + (std::size_t)j*nb )*entry,
+                         jb*entry );
+        if( write_tile( (long)i*_n_tile + j, tile.data() )!=0 ) return -1;
+    }
+    return 0;
+}
+
+int TileFile::read_perm( int* perm ) const
+{
+    static_assert( sizeof(int)==sizeof(std::int32_t), "pivots are stored as int32" );
+    return read_at( _fd, perm, _header.n*sizeof(std::int32_t), _header.perm_offset );
+}
+
+int TileFile::write_perm( const int* perm )
+{
+    return write_at( _fd, perm, _header.n*sizeof(std::int32_t), _header.perm_offset );
+}
+
+int TileFile::set_state( std::uint32_t state )
+{
+    _header.state = state;
+    return write_header();
+}
+
+TileCache::TileCache( TileFile& file, std::size_t capacity_bytes )
+:   _file(file),
+    _max_tiles( std::max<std::size_t>( 4, capacity_bytes / file.tile_bytes() ) ),
+    _stop(false),
+    _error(false)
+{
+    _io = std::thread( &TileCache::io_loop, this );
+}
+
+TileCache::~TileCache()
+{
+    flush();
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        _stop = true;
+    }
+    _cond.notify_all();
+    _io.join();
+    for( auto& e : _entries )
+        ::operator delete( e.second.data, TILE_ALIGN );
+    for( char* p : _free )
+        ::operator delete( p, TILE_ALIGN );
+}
+
+void TileCache::io_loop()
+{
+    std::unique_lock<std::mutex> lock( _lock );
+    while( true )
+    {
+        _cond.wait( lock, [this]{ return _stop || !_jobs.empty(); } );
+        if( _jobs.empty() ) return;
+        Job job = _jobs.front();
+        _jobs.pop_front();
+
+        /// the entry cannot go away while it is loading or writing
+        lock.unlock();
+        int ret = job.write ? _file.write_tile( job.id, job.data ) : _file.read_tile( job.id, job.data );
+        lock.lock();
+        Entry& e = _entries.at( job.id );
+        if( job.write )
+        {
+            e.writing = false;
+            e.dirty = e.dirty && ret!=0;
+            _stats.writes++;
+        }
+        else
+        {
+            e.loading = false;
+            _stats.reads++;
+        }
+        if( ret!=0 )
+        {
+            std::cerr << "Error: tile I/O failed" << std::endl;
+            _error = true;
+        }
+        _cond.notify_all();
+    }
+}
+
+char* TileCache::new_buffer()
+{
+    if( _free.empty() )
+        return static_cast<char*>( ::operator new( _file.tile_bytes(), TILE_ALIGN ) );
+    char* p = _free.back();
+    _free.pop_back();
+    return p;
+}
+
+bool TileCache::make_room( std::unique_lock<std::mutex>& lock, bool wait )
+{
+    /// drop the least recently used clean tile; dirty ones met on the way are
+    /// handed to the I/O thread and dropped on a later call once written
+    while( _entries.size()>=_max_tiles )
+    {
+        bool dropped = false;
+        for( auto it=_lru.rbegin(); it!=_lru.rend(); ++it )
+        {
+            Entry& e = _entries.at( *it );
+            if( e.pins>0 || e.loading || e.writing ) continue;
+            if( e.dirty )
+            {
+                if( !wait ) continue;
+                e.writing = true;
+                _jobs.push_back( { *it, e.data, true } );
+                _cond.notify_all();
+                continue;
+            }
+            _free.push_back( e.data );
+            _entries.erase( *it );
+            _lru.erase( std::next( it ).base() );
+            dropped = true;
+            break;
+        }
+        if( dropped ) continue;
+        if( !wait || _error ) return false;
+        _cond.wait( lock );
+    }
+    return true;
+}
+
+void* TileCache::acquire( long id, Access access )
+{
+    std::unique_lock<std::mutex> lock( _lock );
+    while( !_error )
+    {
+        auto it = _entries.find( id );
+        if( it==_entries.end() ) break;
+        Entry& e = it->second;
+        if( e.loading || ( access!=READ && e.writing ) )
+        {
+            _cond.wait( lock );
+            continue;
+        }
+        e.pins++;
+        _lru.splice( _lru.begin(), _lru, e.lru );
+        _stats.hits++;
+        return e.data;
+    }
+
+    if( _error || !make_room( lock, true ) ) return nullptr;
+    Entry& e = _entries[id];
+    e.data = new_buffer();
+    e.pins = 1;
+    e.loading = ( access!=OVERWRITE );
+    e.writing = false;
+    e.dirty = false;
+    _lru.push_front( id );
+    e.lru = _lru.begin();
+    _stats.misses++;
+    if( !e.loading ) return e.data;
+
+    char* data = e.data;
+    lock.unlock();
+    int ret = _file.read_tile( id, data );
+    lock.lock();
+    _entries.at( id ).loading = false;
+    _stats.reads++;
+    _cond.notify_all();
+    if( ret!=0 )
+    {
+        std::cerr << "Error: tile I/O failed" << std::endl;
+        _error = true;
+        return nullptr;
+    }
+    return data;
+}
+
+void TileCache::release( long id, bool dirty )
+{
+    {
+        std::lock_guard<std::mutex> guard( _lock );
+        Entry& e = _entries.at( id );
+        assert( e.pins>0 );
+        e.pins--;
+        e.dirty = e.dirty || dirty;
+    }
+    _cond.notify_all();
+}
+
+void TileCache::prefetch( long id )
+{
+    std::unique_lock<std::mutex> lock( _lock );
+    if( _entries.count( id ) || !make_room( lock, false ) ) return;
+    Entry& e = _entries[id];
+    e.data = new_buffer();
+    e.pins = 0;
+    e.loading = true;
+    e.writing = false;
+    e.dirty = false;
+    _lru.push_front( id );
+    e.lru = _lru.begin();
+    _jobs.push_back( { id, e.data, false } );
+    _stats.prefetches++;
+    lock.unlock();
+    _cond.notify_all();
+}
+
+void TileCache::write_back( long id )
+{
+    std::unique_lock<std::mutex> lock( _lock );
+    auto it = _entries.find( id );
+    if( it==_entries.end() ) return;
+    Entry& e = it->second;
+    if( !e.dirty || e.pins>0 || e.loading || e.writing ) return;
+    e.writing = true;
+    _jobs.push_back( { id, e.data, true } );
+    lock.unlock();
+    _cond.notify_all();
+}
+
+bool TileCache::flush()
+{
+    std::unique_lock<std::mutex> lock( _lock );
+    while( true )
+    {
+        bool busy = false;
+        for( auto& kv : _entries )
+        {
+            Entry& e = kv.second;
+            if( e.loading || e.writing )
+                busy = true;
+            else if( e.dirty && e.pins==0 )
+            {
+                e.writing = true;
+                _jobs.push_back( { kv.first, e.data, true } );
+                busy = true;
+            }
+        }
+        if( !busy || _error ) break;
+        _cond.notify_all();
+        _cond.wait( lock );
+    }
+    return !_error;
+}
+
+TileCacheStats TileCache::stats()
+{
+    std::lock_guard<std::mutex> guard( _lock );
+    return _stats;
+}
+
+}
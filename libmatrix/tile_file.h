@@ -0,0 +1,180 @@
+#ifndef _MX_TILE_FILE_H
+#define _MX_TILE_FILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace mx
+{
+
+/// tile file, version 1: an n x n matrix cut into nb x nb tiles for the out-of-core solvers
+///   bytes [0, 64)                 TileFileHeader, native byte order
+///   bytes [perm_offset, ..)       n int32 row pivots of an LU factorization
+///   bytes [data_offset, ..)       n_tile^2 tiles, tile (i,j) at index i*n_tile + j
+/// every tile is stored whole, nb x nb row-major, edge tiles are padded with zeros;
+/// both offsets are multiples of 4096 and the file is changed in place by the solvers
+
+enum TileFileState : std::uint32_t
+{
+    TILES_MATRIX = 0,
+    TILES_LU = 1,
+    TILES_CHOLE = 2
+};
+
+struct TileFileHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t dtype;
+    std::uint32_t state;
+    std::int64_t n;
+    std::int64_t nb;
+    std::uint64_t perm_offset;
+    std::uint64_t data_offset;
+    std::uint64_t header_checksum;
+};
+static_assert( sizeof(TileFileHeader)==64, "TileFileHeader must be 64 bytes" );
+
+constexpr char TILE_FILE_MAGIC[8] = { 'M', 'X', 'T', 'I', 'L', 'E', 'S', 0 };
+constexpr std::uint32_t TILE_FILE_VERSION = 1;
+
+    /* in tile_file.cpp */
+/// a tile file opened for reading and writing whole tiles, safe to use from several
+/// threads at once as long as they touch different tiles
+class TileFile
+{
+    int _fd;
+    TileFileHeader _header;
+    int _n_tile;
+    std::size_t _tile_bytes;
+
+    int write_header();
+
+public:
+    TileFile();
+    ~TileFile();
+    TileFile( const TileFile& ) = delete;
+    TileFile& operator=( const TileFile& ) = delete;
+    /// new file of zero tiles in state TILES_MATRIX, 0 on success and -1 otherwise
+    int create( const char* file_name, std::uint32_t dtype, std::int64_t n, int nb );
+    /// open and validate an existing file, 0 on success and -1 otherwise
+    int open( const char* file_name );
+    void close();
+    bool is_open() const { return _fd>=0; }
+
+    int n() const { return (int)_header.n; }
+    int nb() const { return (int)_header.nb; }
+    int n_tile() const { return _n_tile; }
+    std::uint32_t dtype() const { return _header.dtype; }
+    std::uint32_t state() const { return _header.state; }
+    std::size_t tile_bytes() const { return _tile_bytes; }
+    /// rows or columns of tile row / tile column i, nb except for the last one
+    int tile_dim( int i ) const { return (int)std::min<std::int64_t>( _header.nb, _header.n - (std::int64_t)i*_header.nb ); }
+
+    /// whole tiles, 0 or -1 on an I/O error
+    int read_tile( long id, void* buf ) const;
+    int write_tile( long id, const void* buf ) const;
+    /// scatter rows [i*nb, i*nb + tile_dim(i)) of a row-major block with n columns
+    /// into the tiles of tile row i
+    int write_tile_row( int i, const void* rows );
+    int read_perm( int* perm ) const;
+    int write_perm( const int* perm );
+    /// record what the tiles hold, the header is rewritten
+    int set_state( std::uint32_t state );
+};
+
+struct TileCacheStats
+{
+    long hits = 0;
+    long misses = 0;
+    long prefetches = 0;
+    long reads = 0;
+    long writes = 0;
+};
+
+/// a bounded set of tiles of a TileFile kept in memory, least recently used first out;
+/// one I/O thread loads prefetched tiles and writes dirty tiles back while the caller
+/// computes, a demand miss is read by the caller itself
+class TileCache
+{
+public:
+    enum Access
+    {
+        READ,       /// read only
+        WRITE,      /// read and modify
+        OVERWRITE   /// every byte will be written, nothing is read from the file
+    };
+
+private:
+    struct Entry
+    {
+        char* data;
+        int pins;
+        bool loading;
+        bool writing;
+        bool dirty;
+        std::list<long>::iterator lru;
+    };
+
+    struct Job
+    {
+        long id;
+        char* data;
+        bool write;
+    };
+
+    TileFile& _file;
+    std::size_t _max_tiles;
+    std::unordered_map<long, Entry> _entries;
+    /// most recently used at the front
+    std::list<long> _lru;
+    std::vector<char*> _free;
+    std::deque<Job> _jobs;
+    std::mutex _lock;
+    std::condition_variable _cond;
+    std::thread _io;
+    bool _stop;
+    bool _error;
+    TileCacheStats _stats;
+
+    void io_loop();
+    bool make_room( std::unique_lock<std::mutex>& lock, bool wait );
+    char* new_buffer();
+
+public:
+    /// holds at most max(capacity_bytes / tile_bytes, 4) tiles
+    TileCache( TileFile& file, std::size_t capacity_bytes );
+    /// writes back every dirty tile
+    ~TileCache();
+    TileCache( const TileCache& ) = delete;
+    TileCache& operator=( const TileCache& ) = delete;
+    std::size_t capacity() const { return _max_tiles; }
+
+    /// pin tile id in memory and return its nb x nb buffer, blocks until it is loaded;
+    /// nullptr on an I/O error
+    void* acquire( long id, Access access );
+    /// unpin, dirty marks the tile for write-back
+    void release( long id, bool dirty );
+    /// start loading tile id in the background if there is room without waiting
+    void prefetch( long id );
+    /// start writing tile id back in the background, it stays cached and readable
+    void write_back( long id );
+    /// write back every dirty tile that is not pinned and wait for the I/O thread,
+    /// false after an I/O error
+    bool flush();
+    bool error() const { return _error; }
+    TileCacheStats stats();
+};
+
+}
+
+#endif
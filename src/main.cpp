@@ -1,9 +1,76 @@
 
 #include "matrix.h"
 #include "lu.h"
+#include "fixed_matrix.h"
+#include "batched.h"
+#include "out_of_core.h"
+#include "factor_cache.h"
+#include "sparse_matrix.h"
+#include "sparse_solver.h"
+#include "krylov.h"
+#include "blas.h"
+#include "thread_pool.h"
 #include "third_party/Eigen/Dense"
 
 #include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+/// global allocation counter for the allocation-free benchmarks, counting only while
+/// an AllocCounter is alive; every form of global new / delete is replaced so that
+/// they all pair up over malloc / free, aligned_alloc included
+static std::atomic<long> n_allocs( 0 );
+static std::atomic<bool> counting_allocs( false );
+
+static void* counted_alloc( std::size_t size, std::size_t align ) noexcept
+{
+    if( counting_allocs ) n_allocs++;
+    if( size==0 ) size = 1;
+    if( align<=alignof(std::max_align_t) ) return std::malloc( size );
+    /// aligned_alloc wants the size in whole multiples of the alignment
+    return std::aligned_alloc( align, ( size + align - 1 )/align*align );
+}
+
+static void* counted_alloc_or_throw( std::size_t size, std::size_t align )
+{
+    if( void* p = counted_alloc( size, align ) ) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new( std::size_t n ) { return counted_alloc_or_throw( n, 0 ); }
+void* operator new[]( std::size_t n ) { return counted_alloc_or_throw( n, 0 ); }
+void* operator new( std::size_t n, std::align_val_t a ) { return counted_alloc_or_throw( n, (std::size_t)a ); }
+void* operator new[]( std::size_t n, std::align_val_t a ) { return counted_alloc_or_throw( n, (std::size_t)a ); }
+void* operator new( std::size_t n, const std::nothrow_t& ) noexcept { return counted_alloc( n, 0 ); }
+void* operator new[]( std::size_t n, const std::nothrow_t& ) noexcept { return counted_alloc( n, 0 ); }
+void* operator new( std::size_t n, std::align_val_t a, const std::nothrow_t& ) noexcept { return counted_alloc( n, (std::size_t)a ); }
+void* operator new[]( std::size_t n, std::align_val_t a, const std::nothrow_t& ) noexcept { return counted_alloc( n, (std::size_t)a ); }
+
+void operator delete( void* p ) noexcept { std::free( p ); }
+void operator delete[]( void* p ) noexcept { std::free( p ); }
+void operator delete( void* p, std::size_t ) noexcept { std::free( p ); }
+void operator delete[]( void* p, std::size_t ) noexcept { std::free( p ); }
+void operator delete( void* p, std::align_val_t ) noexcept { std::free( p ); }
+void operator delete[]( void* p, std::align_val_t ) noexcept { std::free( p ); }
+void operator delete( void* p, std::size_t, std::align_val_t ) noexcept { std::free( p ); }
+void operator delete[]( void* p, std::size_t, std::align_val_t ) noexcept { std::free( p ); }
+void operator delete( void* p, const std::nothrow_t& ) noexcept { std::free( p ); }
+void operator delete[]( void* p, const std::nothrow_t& ) noexcept { std::free( p ); }
+void operator delete( void* p, std::align_val_t, const std::nothrow_t& ) noexcept { std::free( p ); }
+void operator delete[]( void* p, std::align_val_t, const std::nothrow_t& ) noexcept { std::free( p ); }
+
+/// counts the allocations made between its construction and count()
+class AllocCounter
+{
+public:
+    AllocCounter() { n_allocs = 0; counting_allocs = true; }
+    ~AllocCounter() { counting_allocs = false; }
+    long count() const { return n_allocs; }
+};
 
 static bool apprx_equal( double x, double y, double err=1e-6 )
 {
@@ -21,6 +88,38 @@ static Eigen::MatrixXd mx_to_eigen( mx::Matrix mat )
     return eig_mat;
 }
 
+static double wall_time()
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+/// 5-point Laplacian of a g x g grid plus shift on the diagonal, conv the
+/// nonsymmetric part of a convection term
+static mx::SparseMatrix grid_laplacian( int g, double shift, double conv )
+{
+    std::vector<int> rows, cols;
+    std::vector<double> vals;
+    auto add = [&]( int i, int j, double v ){ rows.push_back( i ); cols.push_back( j ); vals.push_back( v ); };
+    for( int y=0; y<g; y++ )
+        for( int x=0; x<g; x++ )
+        {
+            int i = y*g + x;
+            add( i, i, 4.0 + shift );
+            if( x>0 ) add( i, i-1, -1.0 - conv );
+            if( x<g-1 ) add( i, i+1, -1.0 + conv );
+            if( y>0 ) add( i, i-g, -1.0 );
+            if( y<g-1 ) add( i, i+g, -1.0 );
+        }
+    return mx::SparseMatrix::from_triplets( g*g, g*g, rows, cols, vals );
+}
+
+/// |A x - b| / |b| of a sparse solve
+static double sparse_residual( const mx::SparseMatrix& a, const mx::Matrix& x, const mx::Matrix& b )
+{
+    mx::Matrix r = a*x;
+    return ( r - b ).norm() / ( mx::Matrix( b ).norm() + 1e-300 );
+}
+
 static int bench_LU_error()
 {
     /// test LU error |PA-LU| in random matrices
@@ -62,7 +161,7 @@ static int bench_LU_solve_partial()
     double mae = 0.0;
     for( int i=0; i<1; i++ )
     {
-        mx::Matrix b = b_vecs.submatrix(0,-1,i,i);
+        mx::Matrix b = b_vecs.submatrix(0,-1,i,i).eval();
         mx::Matrix x = ls.solve_vec( b );
 
         Eigen::VectorXd bb = mx_to_eigen( b );
@@ -139,7 +238,7 @@ static int bench_LU_solve_complete()
     double error;
     for( int i=0; i<size; i++ )
     {
-        mx::Matrix b = b_vecs.submatrix( 0,-1, i, i );
+        mx::Matrix b = b_vecs.submatrix( 0,-1, i, i ).eval();
         mx::Matrix x = ls.solve_vec(b);
 
         Eigen::VectorXd bb = mx_to_eigen(b);
@@ -243,6 +342,2071 @@ static int bench_Chole_decomp_pivot()
     return 0;
 }
 
+static int bench_GEMM()
+{
+    /// test GEMM against Eigen on odd shapes, then compare the speed
+    std::cout << "[GEMM benchmark] kernel = " << mx::gemm_kernel_name() << std::endl;
+
+    mx::Matrix src = mx::Rand(600);
+    int shapes[][3] = { {1,1,1}, {7,5,3}, {3,40,9}, {37,53,29}, {130,97,300}, {301,517,263}, {600,600,600} };
+    for( auto& s : shapes )
+    {
+        int m = s[0], n = s[1], k = s[2];
+        mx::Matrix a = src.submatrix( 0, m-1, 0, k-1 ).eval();
+        mx::Matrix b = src.submatrix( 0, k-1, 0, n-1 ).eval();
+        mx::Matrix at = a.transpose(), bt = b.transpose();
+        Eigen::MatrixXd eig_c = mx_to_eigen(a) * mx_to_eigen(b);
+        double scale = eig_c.lpNorm<Eigen::Infinity>() * k;
+
+        mx::Matrix c = a*b;
+        mx::Matrix ct( m, n, 1.0 );
+        mx::gemm( true, true, m, n, k, 0.5, at.data(), m, bt.data(), k, 0.5, ct.data(), n );
+        for( int i=0; i<m; i++ )
+        {
+            for( int j=0; j<n; j++ )
+            {
+                if( std::abs( c(i,j) - eig_c(i,j) ) > 1e-15*scale ) return -1;
+                if( std::abs( ct(i,j) - 0.5*eig_c(i,j) - 0.5 ) > 1e-15*scale ) return -1;
+            }
+        }
+    }
+
+    int size = 1000;
+    mx::Matrix a = mx::Rand(size), b = mx::Rand(size);
+    Eigen::MatrixXd eig_a = mx_to_eigen(a), eig_b = mx_to_eigen(b);
+    double flops = 2.0*size*size*size;
+
+    double t = wall_time();
+    mx::Matrix c = a*b;
+    double t_mx = wall_time() - t;
+
+    t = wall_time();
+    Eigen::MatrixXd eig_c = eig_a * eig_b;
+    double t_eig = wall_time() - t;
+
+    std::cout << "n = " << size << ": mx " << flops/t_mx*1e-9 << " GFLOP/s, Eigen "
+              << flops/t_eig*1e-9 << " GFLOP/s" << std::endl;
+    return 0;
+}
+
+static int bench_GEMM_threads()
+{
+    /// GFLOP/s of a large product against the thread count
+    std::cout << "[GEMM_threads benchmark]" << std::endl;
+
+    int size = 1200;
+    mx::Matrix a = mx::Rand(size), b = mx::Rand(size);
+    double flops = 2.0*size*size*size;
+    int n_threads = mx::get_num_threads();
+    int max_threads = std::max( 4, (int)std::thread::hardware_concurrency() );
+
+    mx::set_num_threads( 1 );
+    mx::Matrix c_ref = a*b;
+    double scale = c_ref.norm_inf() * size;
+
+    int status = 0;
+    for( int t=1; t<=max_threads; t*=2 )
+    {
+        mx::set_num_threads( t );
+        double best = 1e30;
+        mx::Matrix c;
+        for( int run=0; run<2; run++ )
+        {
+            double t0 = wall_time();
+            c = a*b;
+            best = std::min( best, wall_time() - t0 );
+        }
+        std::cout << "threads = " << t << ": " << flops/best*1e-9 << " GFLOP/s" << std::endl;
+
+        for( int i=0; i<size; i++ )
+            for( int j=0; j<size; j++ )
+                if( std::abs( c(i,j) - c_ref(i,j) ) > 1e-15*scale ) status = -1;
+    }
+
+    mx::set_num_threads( n_threads );
+    return status;
+}
+
+static int bench_LU_blocked()
+{
+    /// blocked partial LU against the unblocked one: same pivots, same factors, speed
+    std::cout << "[LU_blocked benchmark]" << std::endl;
+
+    int size = 1000;
+    mx::Matrix mat = mx::Rand(size);
+    mx::LinearSolver ls_ref( mat ), ls( mat );
+    ls_ref.set_block_size( 0 );
+
+    double t = wall_time();
+    if( ls_ref.lu_decomp_partial()!=0 ) return -1;
+    double t_ref = wall_time() - t;
+
+    t = wall_time();
+    if( ls.lu_decomp_partial()!=0 ) return -1;
+    double t_blk = wall_time() - t;
+
+    t = wall_time();
+    mx::Matrix prod = mat*mat;
+    double t_gemm = wall_time() - t;
+
+    double flops = 2.0/3.0*size*size*size;
+    std::cout << "unblocked " << flops/t_ref*1e-9 << " GFLOP/s, blocked(nb=" << ls.get_block_size() << ") "
+              << flops/t_blk*1e-9 << " GFLOP/s, GEMM " << 3.0*flops/t_gemm*1e-9 << " GFLOP/s" << std::endl;
+
+    if( (ls.permute() - ls_ref.permute()).norm()!=0.0 ) return -1;
+    double error = (ls.matrix_lu() - ls_ref.matrix_lu()).norm();
+    std::cout << "|LU_blocked - LU| = " << error << std::endl;
+    if( error > 1e-9*size ) return -1;
+    return 0;
+}
+
+static int bench_tiled_factor()
+{
+    /// tiled task-DAG LU / Cholesky against the scalar routines
+    std::cout << "[tiled_factor benchmark] threads = " << mx::get_num_threads() << std::endl;
+
+    int size = 1000;
+    mx::Matrix mat = mx::Rand(size);
+    mx::Matrix spd = mx::RandSPD(size);
+
+    mx::LinearSolver lu_ref( mat ), lu( mat );
+    lu_ref.set_block_size( 0 );
+    double t = wall_time();
+    if( lu_ref.lu_decomp_partial()!=0 ) return -1;
+    double t_lu_ref = wall_time() - t;
+    t = wall_time();
+    if( lu.lu_decomp_partial_tiled()!=0 ) return -1;
+    double t_lu = wall_time() - t;
+
+    mx::LinearSolver ch_ref( spd ), ch( spd );
+    t = wall_time();
+    if( ch_ref.chole_decomp()!=0 ) return -1;
+    double t_ch_ref = wall_time() - t;
+    t = wall_time();
+    if( ch.chole_decomp_tiled()!=0 ) return -1;
+    double t_ch = wall_time() - t;
+
+    std::cout << "LU: scalar " << t_lu_ref << " s, tiled " << t_lu << " s, speedup " << t_lu_ref/t_lu << std::endl;
+    std::cout << "Cholesky: scalar " << t_ch_ref << " s, tiled " << t_ch << " s, speedup " << t_ch_ref/t_ch << std::endl;
+
+    if( (lu.permute() - lu_ref.permute()).norm()!=0.0 ) return -1;
+    double lu_error = (lu.matrix_lu() - lu_ref.matrix_lu()).norm();
+    /// RandSPD is badly conditioned, so the factors are checked through LL^* rather than entrywise
+    mx::Matrix L = ch.get_chole();
+    double ch_error = (L*L.transpose() - spd).norm() / spd.norm();
+    std::cout << "|LU_tiled - LU| = " << lu_error << ", |LL^* - A|/|A| = " << ch_error << std::endl;
+    if( lu_error > 1e-9*size || ch_error > 1e-14*size ) return -1;
+    return 0;
+}
+
+static int bench_solve_multi()
+{
+    /// solve with all right-hand sides at once against one solve_vec per column
+    std::cout << "[solve_multi benchmark]" << std::endl;
+
+    int size = 300;
+    mx::Matrix mat = mx::Rand(size);
+    mx::Matrix spd = mx::RandSPD(size);
+    mx::Matrix b_vecs = mx::Rand(size);
+
+    mx::LinearSolver ls_partial( mat ), ls_complete( mat ), ls_chole( spd );
+    ls_partial.lu_decomp_partial();
+    ls_complete.lu_decomp();
+    ls_chole.chole_decomp_pivoting();
+
+    const char* names[] = { "partial LU", "complete LU", "Cholesky" };
+    mx::LinearSolver* solvers[] = { &ls_partial, &ls_complete, &ls_chole };
+    for( int s=0; s<3; s++ )
+    {
+        mx::LinearSolver& ls = *solvers[s];
+        double t = wall_time();
+        mx::Matrix x_cols( size, size );
+        for( int i=0; i<size; i++ )
+        {
+            mx::Matrix x = ls.solve_vec( b_vecs.submatrix(0,-1,i,i) );
+            for( int k=0; k<size; k++ )
+                x_cols(k,i) = x(k);
+        }
+        double t_cols = wall_time() - t;
+
+        t = wall_time();
+        mx::Matrix x_block = ls.solve( b_vecs );
+        double t_block = wall_time() - t;
+
+        double error = (x_block - x_cols).norm() / x_cols.norm();
+        std::cout << names[s] << ": per column " << t_cols << " s, block " << t_block
+                  << " s, relative difference " << error << std::endl;
+        if( !(error < 1e-10) ) return -1;
+    }
+    return 0;
+}
+
+static int bench_solve_inplace()
+{
+    /// solve_vec into a reused buffer: no heap allocation, same answer
+    std::cout << "[solve_inplace benchmark]" << std::endl;
+
+    int size = 500;
+    int runs = 200;
+    mx::Matrix mat = mx::Rand(size);
+    mx::Matrix spd = mx::RandSPD(size);
+    mx::Matrix b_vecs = mx::Rand(size);
+    mx::Matrix b = b_vecs.submatrix(0,-1,0,0).eval();
+
+    mx::LinearSolver ls_lu( mat ), ls_chole( spd );
+    ls_lu.lu_decomp_partial();
+    ls_chole.chole_decomp_pivoting();
+
+    const char* names[] = { "partial LU", "Cholesky" };
+    mx::LinearSolver* solvers[] = { &ls_lu, &ls_chole };
+    for( int s=0; s<2; s++ )
+    {
+        mx::LinearSolver& ls = *solvers[s];
+        double t = wall_time();
+        mx::Matrix x_ref;
+        for( int i=0; i<runs; i++ )
+            x_ref = ls.solve_vec( b );
+        double t_ref = wall_time() - t;
+
+        mx::Matrix x( size, 1 );
+        ls.solve_vec( b, x );
+        long allocs;
+        t = wall_time();
+        {
+            AllocCounter counter;
+            for( int i=0; i<runs; i++ )
+                ls.solve_vec( b, x );
+            allocs = counter.count();
+        }
+        double t_buf = wall_time() - t;
+
+        double error = (x - x_ref).norm();
+        std::cout << names[s] << ": returning " << t_ref/runs*1e6 << " us, into buffer "
+                  << t_buf/runs*1e6 << " us, allocations " << allocs << ", difference " << error << std::endl;
+        if( allocs!=0 || error!=0.0 ) return -1;
+    }
+    return 0;
+}
+
+static int bench_LU_mixed()
+{
+    /// float factorization plus refinement against the double factorization:
+    /// time to solution, backward error, and the double fallback on a hard matrix
+    std::cout << "[LU_mixed benchmark]" << std::endl;
+
+    int size = 1500;
+    mx::Matrix mat = mx::Rand(size);
+    mx::Matrix b_vecs = mx::Rand(size);
+    mx::Matrix b = b_vecs.submatrix(0,-1,0,0).eval();
+    auto backward_error = [&]( mx::Matrix a, mx::Matrix x, mx::Matrix rhs )
+    {
+        return (rhs - a*x).norm() / ( a.norm() * x.norm() );
+    };
+
+    mx::LinearSolver ls_ref( mat ), ls( mat );
+    double t = wall_time();
+    if( ls_ref.lu_decomp_partial()!=0 ) return -1;
+    mx::Matrix x_ref = ls_ref.solve_vec( b );
+    double t_ref = wall_time() - t;
+
+    t = wall_time();
+    if( ls.lu_decomp_mixed()!=0 ) return -1;
+    mx::Matrix x = ls.solve_vec( b );
+    double t_mixed = wall_time() - t;
+
+    double err_ref = backward_error( mat, x_ref, b );
+    double err = backward_error( mat, x, b );
+    std::cout << "double " << t_ref << " s, mixed " << t_mixed << " s (" << ls.get_refine_iterations()
+              << " refinement steps), speedup " << t_ref/t_mixed << std::endl;
+    std::cout << "backward error: double " << err_ref << ", mixed " << err << std::endl;
+    /// refinement stops at the LAPACK dsgesv criterion, eps * sqrt(n) in the inf-norm
+    if( ls.get_refine_iterations()<0 || !(err < 1e-16*size) ) return -1;
+
+    /// RandSPD is far too ill-conditioned for float, the solve has to fall back to double
+    int hard_size = 300;
+    mx::Matrix hard = mx::RandSPD(hard_size);
+    mx::Matrix hard_b_vecs = mx::Rand(hard_size);
+    mx::Matrix hard_b = hard_b_vecs.submatrix(0,-1,0,0).eval();
+    mx::LinearSolver ls_hard_ref( hard ), ls_hard( hard );
+    ls_hard_ref.lu_decomp_partial();
+    ls_hard.lu_decomp_mixed();
+    double hard_err_ref = backward_error( hard, ls_hard_ref.solve_vec( hard_b ), hard_b );
+    double hard_err = backward_error( hard, ls_hard.solve_vec( hard_b ), hard_b );
+    std::cout << "ill-conditioned: refinement steps " << ls_hard.get_refine_iterations()
+              << ", backward error: double " << hard_err_ref << ", mixed " << hard_err << std::endl;
+    if( !(hard_err < 1e-16*hard_size) ) return -1;
+    return 0;
+}
+
+static int bench_scalar_types()
+{
+    /// the same factorizations in float, double and complex: float at half the
+    /// footprint of double, complex systems solved through LU and Hermitian Cholesky
+    std::cout << "[scalar_types benchmark]" << std::endl;
+
+    int size = 1000;
+    mx::Matrix mat = mx::Rand(size);
+    mx::Matrix b_vecs = mx::Rand(size);
+    mx::Matrix b = b_vecs.submatrix(0,-1,0,0).eval();
+    mx::MatrixF mat_f( mat ), b_f( b );
+
+    mx::LinearSolver ls( mat );
+    mx::LinearSolverF ls_f( mat_f );
+    double t = wall_time();
+    if( ls.lu_decomp_partial()!=0 ) return -1;
+    double t_d = wall_time() - t;
+    t = wall_time();
+    if( ls_f.lu_decomp_partial()!=0 ) return -1;
+    double t_f = wall_time() - t;
+
+    mx::Matrix x = ls.solve_vec( b );
+    mx::MatrixF x_f = ls_f.solve_vec( b_f );
+    double err = (b - mat*x).norm() / ( mat.norm()*x.norm() );
+    float err_f = (b_f - mat_f*x_f).norm() / ( mat_f.norm()*x_f.norm() );
+    std::cout << "LU double " << t_d << " s, float " << t_f << " s, speedup " << t_d/t_f
+              << ", backward error " << err << " / " << err_f << std::endl;
+    if( !(err < 1e-15*size) || !(err_f < 1e-6f*size) ) return -1;
+
+    /// the rank cutoff follows the scalar's epsilon, a float rank 30 matrix is not full rank
+    const int m = 60, r = 30;
+    mx::Matrix rnd_x = mx::Rand(m), rnd_y = mx::Rand(m);
+    mx::MatrixF low_f( mx::Matrix( rnd_x.submatrix( 0, -1, 0, r-1 ).eval() * rnd_y.submatrix( 0, r-1, 0, -1 ).eval() ) );
+    mx::LinearSolverF ls_low_f( low_f ), ls_low_f_rook( low_f );
+    ls_low_f.lu_decomp();
+    ls_low_f_rook.lu_decomp_rook();
+    std::cout << "float rank " << r << " matrix: complete rank " << ls_low_f.rank()
+              << ", rook rank " << ls_low_f_rook.rank() << std::endl;
+    if( ls_low_f.rank()!=r || ls_low_f_rook.rank()!=r ) return -1;
+
+    /// complex general and Hermitian positive definite systems
+    int n = 200;
+    mx::Matrix re = mx::Rand(n), im = mx::Rand(n);
+    mx::MatrixZ a( n, n ), h( n, n ), rhs( n, 1 );
+    for( int i=0; i<n; i++ )
+    {
+        rhs(i) = std::complex<double>( re(i,0), im(i,0) );
+        for( int j=0; j<n; j++ )
+            a(i,j) = std::complex<double>( re(i,j), im(i,j) );
+    }
+    for( int i=0; i<n; i++ )
+        for( int j=0; j<n; j++ )
+        {
+            std::complex<double> sum = 0.0;
+            for( int k=0; k<n; k++ )
+                sum += a(i,k) * std::conj( a(j,k) );
+            h(i,j) = sum;
+        }
+
+    mx::LinearSolverZ lu_z( a ), ch_z( h ), ch_z_tiled( h );
+    ch_z_tiled.set_block_size( 64 );
+    if( lu_z.lu_decomp_partial()!=0 || ch_z.chole_decomp()!=0 || ch_z_tiled.chole_decomp_tiled()!=0 ) return -1;
+    mx::MatrixZ x_lu = lu_z.solve_vec( rhs );
+    mx::MatrixZ x_ch = ch_z.solve_vec( rhs );
+    mx::MatrixZ x_ch_tiled = ch_z_tiled.solve_vec( rhs );
+    double err_lu = (rhs - a*x_lu).norm() / ( a.norm()*x_lu.norm() );
+    double err_ch = (rhs - h*x_ch).norm() / ( h.norm()*x_ch.norm() );
+    double err_ch_tiled = (rhs - h*x_ch_tiled).norm() / ( h.norm()*x_ch_tiled.norm() );
+    std::cout << "complex backward error: LU " << err_lu << ", Cholesky " << err_ch
+              << ", tiled Cholesky " << err_ch_tiled << std::endl;
+    if( !(err_lu < 1e-15*n) || !(err_ch < 1e-15*n) || !(err_ch_tiled < 1e-15*n) ) return -1;
+    return 0;
+}
+
+template<int N>
+static int bench_fixed_size( int n_systems )
+{
+    /// per-solve latency of LU + solve for many N x N systems
+    std::vector< mx::FixedMatrix<double,N,N> > mats( n_systems );
+    std::vector< mx::FixedMatrix<double,N,1> > rhs( n_systems );
+    for( int s=0; s<n_systems; s++ )
+    {
+        mx::Matrix a = mx::Rand(N);
+        mats[s] = mx::FixedMatrix<double,N,N>( a );
+        for( int i=0; i<N; i++ )
+            rhs[s](i) = a(i,0) + 1.0;
+    }
+
+    double max_error = 0.0;
+    double t = wall_time();
+    mx::LinearSolver ls;
+    mx::Matrix x_dyn( N, 1 );
+    for( int s=0; s<n_systems; s++ )
+    {
+        ls.set_matrix( mats[s] );
+        ls.lu_decomp_partial();
+        ls.solve_vec( rhs[s], x_dyn );
+    }
+    double t_dyn = wall_time() - t;
+
+    std::vector< mx::FixedMatrix<double,N,1> > x_fixed( n_systems );
+    t = wall_time();
+    for( int s=0; s<n_systems; s++ )
+    {
+        mx::FixedLinearSolver<double,N> fls( mats[s] );
+        fls.lu_decomp_partial();
+        x_fixed[s] = fls.solve_vec( rhs[s] );
+    }
+    double t_fixed = wall_time() - t;
+    for( int s=0; s<n_systems; s++ )
+    {
+        const mx::FixedMatrix<double,N,1>& x = x_fixed[s];
+        max_error = std::max( max_error, (mats[s]*x - rhs[s]).norm() / ( mats[s].norm()*x.norm() ) );
+    }
+
+    double check = 0.0;
+    t = wall_time();
+    for( int s=0; s<n_systems; s++ )
+    {
+        Eigen::Matrix<double,N,N> a;
+        Eigen::Matrix<double,N,1> b;
+        for( int i=0; i<N; i++ )
+        {
+            b(i) = rhs[s](i);
+            for( int j=0; j<N; j++ )
+                a(i,j) = mats[s](i,j);
+        }
+        Eigen::Matrix<double,N,1> x = a.partialPivLu().solve( b );
+        check += x(0);
+    }
+    double t_eigen = wall_time() - t;
+
+    std::cout << N << "x" << N << ": dynamic " << t_dyn/n_systems*1e9 << " ns, fixed "
+              << t_fixed/n_systems*1e9 << " ns, Eigen fixed " << t_eigen/n_systems*1e9
+              << " ns per solve, max backward error " << max_error << ( check==0.0 ? " " : "" ) << std::endl;
+    return ( max_error < 1e-14*N ) ? 0 : -1;
+}
+
+static int bench_fixed_small()
+{
+    /// FixedMatrix / FixedLinearSolver against LinearSolver and Eigen on tiny systems
+    std::cout << "[fixed_small benchmark]" << std::endl;
+
+    int status = 0;
+    status = status || bench_fixed_size<3>( 100000 );
+    status = status || bench_fixed_size<4>( 100000 );
+    status = status || bench_fixed_size<8>( 50000 );
+    status = status || bench_fixed_size<16>( 20000 );
+
+    /// the same system through the fixed and the dynamic Cholesky
+    mx::Matrix spd = mx::RandSPD(6);
+    mx::FixedMatrix<double,6,6> f_spd( spd );
+    mx::FixedLinearSolver<double,6> f_ch( f_spd );
+    mx::LinearSolver ch( f_spd );
+    if( f_ch.chole_decomp()!=0 || ch.chole_decomp()!=0 ) return -1;
+    /// RandSPD is badly conditioned, so both factors are checked through LL^*
+    mx::FixedMatrix<double,6,6> f_l = f_ch.get_chole();
+    mx::Matrix l = ch.get_chole();
+    double error = ( f_l*f_l.transpose() - f_spd ).norm() / f_spd.norm();
+    double error_ref = ( l*l.transpose() - spd ).norm() / spd.norm();
+    std::cout << "|LL^* - A|/|A|: fixed " << error << ", dynamic " << error_ref << std::endl;
+    if( !(error < 1e-14) ) return -1;
+    return status;
+}
+
+static int bench_batched()
+{
+    /// lockstep factor + solve of many 8 x 8 systems against one FixedLinearSolver per system
+    std::cout << "[batched benchmark] " << mx::gemm_kernel_name() << " lanes, "
+              << mx::get_num_threads() << " threads" << std::endl;
+    const int N = 8;
+    const int n_systems = 4001;
+    const int n_reps = 10;
+
+    std::vector<mx::Matrix> mats( n_systems );
+    std::vector<mx::Matrix> spds( n_systems );
+    mx::BatchedMatrix rhs( n_systems, N, 1 );
+    for( int s=0; s<n_systems; s++ )
+    {
+        mats[s] = mx::Rand(N);
+        spds[s] = mats[s].transpose()*mats[s] + N*mx::Matrix( mx::Eye(N) );
+        for( int i=0; i<N; i++ )
+            rhs( s, i, 0 ) = mats[s](i,0) + 1.0;
+    }
+    /// one singular system must be reported without spoiling its neighbours
+    const int bad = 1234;
+    mats[bad] = mx::Matrix( N, N );
+    mx::BatchedMatrix batch( mats );
+    mx::BatchedMatrix batch_spd( spds );
+
+    /// repeated over a batch that stays in cache, the first pass pays the page faults
+    mx::BatchedLinearSolver bls;
+    mx::BatchedMatrix x;
+    int ret = 0;
+    double t = wall_time();
+    for( int r=0; r<n_reps; r++ )
+    {
+        bls.set_matrix( batch );
+        ret = bls.lu_decomp_partial();
+        x = bls.solve( rhs );
+    }
+    double t_batched = ( wall_time() - t )/n_reps;
+
+    std::vector< mx::FixedMatrix<double,N,N> > f_mats( mats.begin(), mats.end() );
+    std::vector< mx::FixedMatrix<double,N,1> > f_rhs( n_systems );
+    for( int s=0; s<n_systems; s++ )
+        f_rhs[s] = mx::FixedMatrix<double,N,1>( rhs.get( s ) );
+    std::vector< mx::FixedMatrix<double,N,1> > x_fixed( n_systems );
+    t = wall_time();
+    for( int r=0; r<n_reps; r++ )
+        for( int s=0; s<n_systems; s++ )
+        {
+            mx::FixedLinearSolver<double,N> fls( f_mats[s] );
+            if( fls.lu_decomp_partial()==0 )
+                x_fixed[s] = fls.solve_vec( f_rhs[s] );
+        }
+    double t_fixed = ( wall_time() - t )/n_reps;
+
+    double max_error = 0.0;
+    double max_diff = 0.0;
+    for( int s=0; s<n_systems; s++ )
+    {
+        if( s==bad ) continue;
+        mx::Matrix xs = x.get( s );
+        max_error = std::max( max_error, (mats[s]*xs - rhs.get( s )).norm() / ( mats[s].norm()*xs.norm() ) );
+        max_diff = std::max( max_diff, ( xs - mx::Matrix( x_fixed[s] ) ).norm() / xs.norm() );
+    }
+    int n_failed = std::count( bls.get_info().begin(), bls.get_info().end(), -1 );
+    std::cout << "LU: batched " << t_batched/n_systems*1e9 << " ns, fixed " << t_fixed/n_systems*1e9
+              << " ns per solve, max backward error " << max_error << ", max diff to fixed " << max_diff
+              << ", failed " << n_failed << std::endl;
+    if( ret!=-1 || n_failed!=1 || bls.get_info()[bad]!=-1 ) return -1;
+    if( !(max_error < 1e-14*N) ) return -1;
+
+    mx::BatchedLinearSolver bch;
+    t = wall_time();
+    for( int r=0; r<n_reps; r++ )
+    {
+        bch.set_matrix( batch_spd );
+        ret = bch.chole_decomp();
+        x = bch.solve( rhs );
+    }
+    double t_chole = ( wall_time() - t )/n_reps;
+    max_error = 0.0;
+    for( int s=0; s<n_systems; s++ )
+    {
+        mx::Matrix xs = x.get( s );
+        max_error = std::max( max_error, (spds[s]*xs - rhs.get( s )).norm() / ( spds[s].norm()*xs.norm() ) );
+    }
+    std::cout << "Cholesky: batched " << t_chole/n_systems*1e9 << " ns per solve, max backward error "
+              << max_error << std::endl;
+    if( ret!=0 || !(max_error < 1e-14*N) ) return -1;
+
+    /// float lanes are twice as many per register
+    mx::BatchedMatrixF batch_f( n_systems, N, N );
+    mx::BatchedMatrixF rhs_f( n_systems, N, 1 );
+    for( int s=0; s<n_systems; s++ )
+    {
+        batch_f.set( s, mx::MatrixF( spds[s] ) );
+        rhs_f.set( s, mx::MatrixF( rhs.get( s ) ) );
+    }
+    mx::BatchedLinearSolverF bls_f;
+    mx::BatchedMatrixF x_f;
+    t = wall_time();
+    for( int r=0; r<n_reps; r++ )
+    {
+        bls_f.set_matrix( batch_f );
+        ret = bls_f.lu_decomp_partial();
+        x_f = bls_f.solve( rhs_f );
+    }
+    double t_float = ( wall_time() - t )/n_reps;
+    max_error = 0.0;
+    for( int s=0; s<n_systems; s++ )
+    {
+        mx::MatrixF a = batch_f.get( s );
+        mx::MatrixF xs = x_f.get( s );
+        max_error = std::max( max_error, (double)( (a*xs - rhs_f.get( s )).norm() / ( a.norm()*xs.norm() ) ) );
+    }
+    std::cout << "float LU: batched " << t_float/n_systems*1e9 << " ns per solve, max backward error "
+              << max_error << std::endl;
+    if( ret!=0 || !(max_error < 1e-6*N) ) return -1;
+    return 0;
+}
+
+static int bench_binary_io()
+{
+    /// DENSE text against the binary format: write, load, map, and the checks on the header
+    std::cout << "[binary_io benchmark]" << std::endl;
+    const int n = 2000;
+    const char* text_file = "bench_io.txt";
+    const char* bin_file = "bench_io.mxb";
+    const char* col_file = "bench_io_col.mxb";
+    mx::Matrix mat = mx::Rand(n);
+    double mbytes = 8.0*n*n/1e6;
+
+    double t = wall_time();
+    mat.write_to_file( text_file, 17 );
+    double t_text_write = wall_time() - t;
+    t = wall_time();
+    mx::Matrix mat_text( text_file );
+    double t_text_read = wall_time() - t;
+
+    t = wall_time();
+    mat.write_to_binary( bin_file );
+    double t_bin_write = wall_time() - t;
+    t = wall_time();
+    mx::Matrix mat_bin( bin_file );
+    double t_bin_read = wall_time() - t;
+    t = wall_time();
+    mx::Matrix mat_map( bin_file, mx::FILE_MAP );
+    double t_map = wall_time() - t;
+
+    std::cout << "text: write " << mbytes/t_text_write << " MB/s, read " << mbytes/t_text_read << " MB/s" << std::endl;
+    std::cout << "binary: write " << mbytes/t_bin_write << " MB/s, read " << mbytes/t_bin_read
+              << " MB/s, map " << t_map*1e6 << " us" << std::endl;
+
+    /// the binary round trip is bitwise, the text one only at 17 digits
+    size_t bytes = sizeof(double)*n*n;
+    if( std::memcmp( mat_bin.data(), mat.data(), bytes )!=0 ) return -1;
+    if( !mat_map.is_mapped() || std::memcmp( mat_map.data(), mat.data(), bytes )!=0 ) return -1;
+    if( !( (mat_text-mat).norm() <= 1e-12*mat.norm() ) ) return -1;
+    if( mx::check_matrix_file( bin_file )!=0 ) return -1;
+
+    /// writes to a mapped matrix stay private, copies own their entries
+    mat_map(0,0) = -1.0;
+    mx::Matrix copy = mat_map;
+    copy(0,1) = -2.0;
+    if( copy.is_mapped() || mat_map(0,1)!=mat(0,1) ) return -1;
+    if( mx::Matrix( bin_file )(0,0)!=mat(0,0) ) return -1;
+
+    /// column-major files and other dtypes go through load
+    mat.write_to_binary( col_file, mx::COL_MAJOR );
+    mx::Matrix mat_col( col_file, mx::FILE_MAP );
+    if( mat_col.is_mapped() || std::memcmp( mat_col.data(), mat.data(), bytes )!=0 ) return -1;
+    mx::MatrixF mat_f( bin_file );
+    if( !( (mx::Matrix( mat_f )-mat).norm() <= 1e-6*mat.norm() ) ) return -1;
+
+    /// a flipped data byte is caught by the checksum
+    {
+        std::fstream fs( bin_file, std::ios::in | std::ios::out | std::ios::binary );
+        fs.seekp( mx::MATRIX_FILE_ALIGN + 12345 );
+        fs.put( 0x5a );
+    }
+    std::cout << "corrupted file: ";
+    if( mx::check_matrix_file( bin_file )==0 ) return -1;
+
+    /// past INT_MAX entries: a sparse 10 GB float file is mapped and indexed in size_t,
+    /// a header whose data would not fit in the address space is refused
+    auto write_header = [&]( std::uint32_t dtype, std::int64_t n_row, std::int64_t n_col ){
+        mx::MatrixFileHeader header;
+        std::memset( &header, 0, sizeof(header) );
+        std::memcpy( header.magic, mx::MATRIX_FILE_MAGIC, 8 );
+        header.version = mx::MATRIX_FILE_VERSION;
+        header.byte_order = mx::MATRIX_FILE_BYTE_ORDER;
+        header.dtype = dtype;
+        header.layout = mx::ROW_MAJOR;
+        header.n_row = n_row;
+        header.n_col = n_col;
+        header.data_offset = mx::MATRIX_FILE_ALIGN;
+        header.header_checksum = mx::checksum64( &header, offsetof( mx::MatrixFileHeader, header_checksum ) );
+        std::ofstream ofs( bin_file, std::ios::binary | std::ios::trunc );
+        ofs.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+    };
+    const int big = 50000;
+    write_header( mx::DTYPE_FLOAT32, big, big );
+    std::filesystem::resize_file( bin_file, mx::MATRIX_FILE_ALIGN + sizeof(float)*(std::uint64_t)big*big );
+    {
+        mx::MatrixF mat_big( bin_file, mx::FILE_MAP );
+        if( !mat_big.is_mapped() || mat_big.n_row()!=big || mat_big(big-1,big-1)!=0.0f ) return -1;
+        mat_big(big-1,big-1) = 1.0f;
+        if( mat_big.data()[ (size_t)big*big-1 ]!=1.0f ) return -1;
+    }
+    write_header( mx::DTYPE_COMPLEX128, INT32_MAX, INT32_MAX );
+    mx::MatrixFileHeader header;
+    std::cout << "oversized header: ";
+    if( mx::read_matrix_header( bin_file, header )==0 ) return -1;
+
+    std::remove( text_file );
+    std::remove( bin_file );
+    std::remove( col_file );
+    return 0;
+}
+
+static int bench_dense_io()
+{
+    /// the parallel DENSE reader and writer against plain iostream, the round trip
+    /// at 17 digits, and reading the file back in row blocks
+    std::cout << "[dense_io benchmark]" << std::endl;
+    const int n = 2000;
+    const char* file = "bench_dense.txt";
+    const char* bad_file = "bench_dense_bad.txt";
+    mx::Matrix mat = mx::Rand(n);
+    double mbytes = 8.0*n*n/1e6;
+
+    double t = wall_time();
+    {
+        std::ofstream ofs( file );
+        ofs << n << " " << n << " DENSE\n" << std::setprecision( 17 );
+        for( int i=0; i<n; i++ )
+        {
+            for( int j=0; j<n; j++ )
+                ofs << mat(i,j) << " ";
+            ofs << "\n";
+        }
+    }
+    double t_ios_write = wall_time() - t;
+    t = wall_time();
+    {
+        std::ifstream ifs( file );
+        int row, col;
+        std::string type;
+        ifs >> row >> col >> type;
+        std::vector<double> buf( (size_t)row*col );
+        for( size_t k=0; k<buf.size(); k++ )
+            ifs >> buf[k];
+    }
+    double t_ios_read = wall_time() - t;
+
+    t = wall_time();
+    mat.write_to_file( file, 17 );
+    double t_write = wall_time() - t;
+    t = wall_time();
+    mx::Matrix mat_read( file );
+    double t_read = wall_time() - t;
+
+    std::cout << "iostream: write " << mbytes/t_ios_write << " MB/s, read " << mbytes/t_ios_read << " MB/s" << std::endl;
+    std::cout << "parallel: write " << mbytes/t_write << " MB/s, read " << mbytes/t_read
+              << " MB/s on " << mx::thread_pool().size() << " threads" << std::endl;
+
+    /// 17 significant digits and a correctly rounded parser give back every bit
+    if( std::memcmp( mat_read.data(), mat.data(), sizeof(double)*n*n )!=0 ) return -1;
+
+    /// row blocks of an odd size add up to the whole matrix
+    {
+        mx::DenseReader reader;
+        if( reader.open( file )!=0 || reader.n_row()!=n || reader.n_col()!=n ) return -1;
+        const int block = 333;
+        std::vector<double> buf( (size_t)block*n );
+        int rows;
+        while( ( rows = reader.read_rows( buf.data(), block ) )>0 )
+        {
+            int r0 = reader.rows_read() - rows;
+            if( std::memcmp( buf.data(), mat.data() + (size_t)r0*n, sizeof(double)*rows*n )!=0 ) return -1;
+        }
+        if( rows<0 || reader.rows_read()!=n ) return -1;
+    }
+
+    /// complex entries as (re,im)
+    {
+        mx::MatrixZ z( 50, 70 );
+        for( int i=0; i<50; i++ )
+            for( int j=0; j<70; j++ )
+                z(i,j) = std::complex<double>( mat(i,j), -mat(j,i) );
+        z.write_to_file( file, 17 );
+        mx::MatrixZ z_read( file );
+        if( std::memcmp( z_read.data(), z.data(), sizeof(std::complex<double>)*50*70 )!=0 ) return -1;
+    }
+
+    /// a truncated file and a malformed entry are reported, not read past
+    std::vector<double> buf( 9 );
+    {
+        std::ofstream ofs( bad_file );
+        ofs << "3 3 DENSE\n1 2 3\n4 5 6\n7 8\n";
+    }
+    {
+        mx::DenseReader reader;
+        std::cout << "truncated file: ";
+        if( reader.open( bad_file )!=0 || reader.read_rows( buf.data(), 3 )!=-1 ) return -1;
+    }
+    {
+        std::ofstream ofs( bad_file );
+        ofs << "2 2 DENSE\n1 2\n3 x4\n";
+    }
+    {
+        mx::DenseReader reader;
+        std::cout << "malformed file: ";
+        if( reader.open( bad_file )!=0 || reader.read_rows( buf.data(), 2 )!=-1 ) return -1;
+    }
+
+    std::remove( file );
+    std::remove( bad_file );
+    return 0;
+}
+
+static int bench_out_of_core()
+{
+    /// tiled LU / Cholesky through a tile cache that holds about a tenth of the matrix,
+    /// against the in-memory solver on the same systems
+    std::cout << "[out_of_core benchmark]" << std::endl;
+    const int n = 1000;
+    const int nb = 96;
+    const int k = 3;
+    const std::size_t cache_bytes = 1 << 20;
+    const char* tile_file = "bench_ooc.tiles";
+    const char* text_file = "bench_ooc.txt";
+    const char* bin_file = "bench_ooc.mxb";
+
+    auto rel_diff = []( mx::Matrix a, mx::Matrix b ){ return (a-b).norm() / b.norm(); };
+    mx::Matrix a = mx::Rand(n);
+    mx::Matrix b( n, k );
+    for( int i=0; i<n; i++ )
+        for( int j=0; j<k; j++ )
+            b(i,j) = a(i,j) + 1.0;
+
+    double t = wall_time();
+    mx::LinearSolver ls( a );
+    ls.lu_decomp_partial();
+    mx::Matrix x_ref = ls.solve( b );
+    double t_in_core = wall_time() - t;
+
+    mx::OutOfCoreSolver ooc( cache_bytes );
+    if( ooc.set_matrix( tile_file, a, nb )!=0 ) return -1;
+    t = wall_time();
+    if( ooc.lu_decomp_partial()!=0 ) return -1;
+    mx::Matrix x = ooc.solve( b );
+    double t_ooc = wall_time() - t;
+    const mx::TileCacheStats& s = ooc.get_cache_stats();
+    std::cout << "LU: in-core " << t_in_core*1e3 << " ms, out-of-core " << t_ooc*1e3 << " ms, "
+              << s.reads << " tile reads (" << s.prefetches << " prefetched), " << s.writes
+              << " tile writes of " << ((n+nb-1)/nb)*((n+nb-1)/nb) << " tiles" << std::endl;
+    std::cout << "LU: |x - x_ref| / |x_ref| = " << rel_diff( x, x_ref ) << std::endl;
+    if( !( rel_diff( x, x_ref ) < 1e-8 ) ) return -1;
+    if( !( (a*x-b).norm() < 1e-9*a.norm()*x.norm() ) ) return -1;
+
+    /// the factors and pivots are in the file, a later solver solves with them
+    {
+        mx::OutOfCoreSolver reopened( cache_bytes );
+        if( reopened.open( tile_file )!=0 || reopened.get_status()!=mx::LU_SUCCESS ) return -1;
+        if( !( rel_diff( reopened.solve( b ), x_ref ) < 1e-8 ) ) return -1;
+    }
+
+    /// Cholesky, and a matrix that is not positive definite
+    mx::Matrix spd = mx::Matrix( mx::RandSPD(n) ) + n*mx::Matrix( mx::Eye(n) );
+    mx::LinearSolver ls_spd( spd );
+    ls_spd.chole_decomp();
+    mx::Matrix x_spd_ref = ls_spd.solve( b );
+    if( ooc.set_matrix( tile_file, spd, nb )!=0 || ooc.chole_decomp()!=0 ) return -1;
+    mx::Matrix x_spd = ooc.solve( b );
+    std::cout << "Cholesky: |x - x_ref| / |x_ref| = " << rel_diff( x_spd, x_spd_ref ) << std::endl;
+    if( !( rel_diff( x_spd, x_spd_ref ) < 1e-8 ) ) return -1;
+    if( !( (spd*x_spd-b).norm() < 1e-9*spd.norm()*x_spd.norm() ) ) return -1;
+    if( ooc.set_matrix( tile_file, a, nb )!=0 || ooc.chole_decomp()!=-1 ) return -1;
+
+    /// tile files streamed from DENSE text and binary files hold the same matrix
+    a.write_to_file( text_file, 17 );
+    a.write_to_binary( bin_file );
+    if( ooc.import_file( tile_file, text_file, nb )!=0 ) return -1;
+    if( std::memcmp( ooc.load_matrix().data(), a.data(), sizeof(double)*n*n )!=0 ) return -1;
+    if( ooc.import_file( tile_file, bin_file, nb )!=0 ) return -1;
+    if( std::memcmp( ooc.load_matrix().data(), a.data(), sizeof(double)*n*n )!=0 ) return -1;
+
+    /// complex entries with an edge tile
+    {
+        const int nz = 150;
+        mx::MatrixZ z( nz, nz ), bz( nz, 1 );
+        for( int i=0; i<nz; i++ )
+        {
+            for( int j=0; j<nz; j++ )
+                z(i,j) = std::complex<double>( a(i,j), a(j,i) );
+            bz(i,0) = std::complex<double>( 1.0, -1.0*i );
+        }
+        mx::OutOfCoreSolverZ ooc_z( cache_bytes );
+        if( ooc_z.set_matrix( tile_file, z, 64 )!=0 || ooc_z.lu_decomp_partial()!=0 ) return -1;
+        mx::MatrixZ xz = ooc_z.solve( bz );
+        if( !( (z*xz-bz).norm() < 1e-9*z.norm()*xz.norm() ) ) return -1;
+    }
+
+    std::remove( tile_file );
+    std::remove( text_file );
+    std::remove( bin_file );
+    return 0;
+}
+
+static int bench_views()
+{
+    /// submatrix views against copies: indexing, writes through a view, the operators
+    /// on strided blocks, and per-column solves that no longer copy the column
+    std::cout << "[views benchmark]" << std::endl;
+    const int n = 600;
+    mx::Matrix mat = mx::Rand(n);
+    mx::Matrix b_vecs = mx::Rand(n);
+
+    auto blk = mat.submatrix( 100, 299, 50, -101 );
+    mx::Matrix blk_copy = blk.eval();
+    if( blk.n_row()!=200 || blk.n_col()!=n-150 || blk.ld()!=n || blk.is_contiguous() ) return -1;
+    for( int i=0; i<blk.n_row(); i++ )
+        for( int j=0; j<blk.n_col(); j++ )
+            if( blk(i,j)!=mat(100+i,50+j) || blk_copy(i,j)!=blk(i,j) ) return -1;
+    if( blk.submatrix( 10, 10, 20, 20 )(0,0)!=mat(110,70) ) return -1;
+
+    /// writes land in the matrix, the evaluated copy keeps its own entries
+    blk(0,0) = 42.0;
+    blk.submatrix( 1, 1, 0, -1 ).fill( -1.0 );
+    if( mat(100,50)!=42.0 || mat(101,n-101)!=-1.0 || mat(101,49)==-1.0 ) return -1;
+    if( blk_copy(0,0)==42.0 ) return -1;
+    blk.assign( blk_copy );
+    if( mat(100,50)!=blk_copy(0,0) ) return -1;
+
+    /// a block of a temporary is a matrix of its own, not a view into freed storage
+    auto tmp_blk = mx::Matrix( mat ).submatrix( 100, 299, 50, -101 );
+    static_assert( std::is_same<decltype(tmp_blk), mx::Matrix>::value, "block of a temporary must own its entries" );
+    if( (tmp_blk - blk_copy).norm()!=0.0 ) return -1;
+
+    /// operators on views give the same results as on the copies
+    const mx::Matrix& cmat = mat;
+    mx::ConstMatrixView a = cmat.submatrix( 0, 199, 0, 299 );
+    mx::ConstMatrixView c = cmat.submatrix( 300, -1, 0, 199 );
+    mx::Matrix a_copy = a.eval(), c_copy = c.eval();
+    if( (a*c - a_copy*c_copy).norm()!=0.0 ) return -1;
+    if( (blk + blk_copy - 2.0*blk_copy).norm()!=0.0 ) return -1;
+    if( (-blk - (-blk_copy)).norm()!=0.0 || (blk/2.0 - blk_copy*0.5).norm()!=0.0 ) return -1;
+    if( (a.transpose() - a_copy.transpose()).norm()!=0.0 ) return -1;
+    if( a.norm()!=a_copy.norm() || a.norm_1()!=a_copy.norm_1() || a.norm_inf()!=a_copy.norm_inf() ) return -1;
+    blk += blk_copy;
+    blk *= 0.5;
+    blk -= blk_copy;
+    if( blk.norm()!=0.0 ) return -1;
+    blk.assign( blk_copy );
+
+    /// one solve per right-hand-side column, from a view and from a copied column
+    mx::LinearSolver ls( mat );
+    ls.lu_decomp_partial();
+    mx::Matrix x;
+    double t = wall_time();
+    for( int i=0; i<n; i++ )
+    {
+        mx::Matrix b = b_vecs.submatrix( 0, -1, i, i ).eval();
+        ls.solve_vec( b, x );
+    }
+    double t_copy = wall_time() - t;
+    t = wall_time();
+    for( int i=0; i<n; i++ )
+        ls.solve_vec( b_vecs.submatrix( 0, -1, i, i ), x );
+    double t_view = wall_time() - t;
+    std::cout << "column solves: copied " << t_copy*1e3 << " ms, views " << t_view*1e3 << " ms" << std::endl;
+    double norm_a = mat.norm();
+    for( int i=0; i<n; i+=37 )
+    {
+        auto b = b_vecs.submatrix( 0, -1, i, i );
+        ls.solve_vec( b, x );
+        if( !( ( mat*x - b ).norm() < 1e-12*norm_a*x.norm() ) ) return -1;
+    }
+
+    /// a whole block of columns from a view
+    mx::Matrix xs = ls.solve( b_vecs.submatrix( 0, -1, 10, 19 ) );
+    if( !( ( mat*xs - b_vecs.submatrix( 0, -1, 10, 19 ) ).norm() < 1e-12*norm_a*xs.norm() ) ) return -1;
+    return 0;
+}
+
+static int bench_expression()
+{
+    /// element-wise chains fused by the expression templates against the same chain
+    /// with every intermediate materialised, plus aliasing and products in expressions
+    std::cout << "[expression benchmark]" << std::endl;
+    const int n = 1000, reps = 10;
+    mx::Matrix a = mx::Rand(n), b = mx::Rand(n), c = mx::Rand(n), d = mx::Rand(n);
+    mx::Matrix res, ref;
+
+    double t = wall_time();
+    for( int r=0; r<reps; r++ )
+    {
+        mx::Matrix t1 = 2.0*a;
+        mx::Matrix t2 = t1 + b;
+        mx::Matrix t3 = c/3.0;
+        mx::Matrix t4 = t2 - t3;
+        mx::Matrix t5 = -d;
+        ref = t4 + t5;
+    }
+    double t_tmp = wall_time() - t;
+    t = wall_time();
+    for( int r=0; r<reps; r++ )
+        res = 2.0*a + b - c/3.0 + -d;
+    double t_fused = wall_time() - t;
+    std::cout << "a chain of 5 operations: temporaries " << t_tmp*1e3/reps << " ms, fused "
+              << t_fused*1e3/reps << " ms" << std::endl;
+    if( (res - ref).norm()!=0.0 ) return -1;
+    for( int i=0; i<n; i+=97 )
+        for( int j=0; j<n; j+=89 )
+            if( res(i,j)!=2.0*a(i,j) + b(i,j) - c(i,j)/3.0 + -d(i,j) ) return -1;
+
+    /// norms reduce straight off the expression
+    if( std::abs( (a - b).norm() - mx::Matrix( a - b ).norm() ) > 1e-12*ref.norm() ) return -1;
+    if( (a - b).norm_1()!=mx::Matrix( a - b ).norm_1() || (a - b).norm_inf()!=mx::Matrix( a - b ).norm_inf() ) return -1;
+    if( (a - b).norm( 3 )!=mx::Matrix( a - b ).norm( 3 ) ) return -1;
+
+    /// the destination as an operand: entry by entry in place, or through a temporary
+    /// when a product or a shifted block reads it
+    mx::Matrix e = a;
+    e = e + b;
+    if( (e - (a + b)).norm()!=0.0 ) return -1;
+    const int m = 200;
+    mx::Matrix f = a.submatrix( 0, m-1, 0, m-1 ).eval(), g = b.submatrix( 0, m-1, 0, m-1 ).eval();
+    mx::Matrix fg = f*g;
+    mx::Matrix h = f;
+    h = h*g;
+    if( (h - fg).norm()!=0.0 ) return -1;
+    h = f;
+    h = 2.0*(h*g) - h;
+    if( (h - (2.0*fg - f)).norm()!=0.0 ) return -1;
+    mx::Matrix k = f;
+    k = k.submatrix( 1, -1, 0, -1 ) + k.submatrix( 0, -2, 0, -1 );
+    if( k.n_row()!=m-1 || (k - (f.submatrix( 1, -1, 0, -1 ) + f.submatrix( 0, -2, 0, -1 ))).norm()!=0.0 ) return -1;
+
+    /// products go through GEMM once, wherever they sit in the expression
+    mx::Matrix p = f*g + f - g*f;
+    mx::Matrix gf = g*f;
+    if( (p - (fg + f - gf)).norm()!=0.0 ) return -1;
+    if( (f*g)(3,4)!=fg(3,4) || (f*g - fg).norm()!=0.0 ) return -1;
+
+    /// complex entries
+    mx::MatrixZ za( m, m ), zb( m, m );
+    for( int i=0; i<m; i++ )
+        for( int j=0; j<m; j++ )
+        {
+            za(i,j) = std::complex<double>( f(i,j), g(i,j) );
+            zb(i,j) = std::complex<double>( g(i,j), -f(i,j) );
+        }
+    std::complex<double> s( 0.5, 2.0 );
+    mx::MatrixZ zc = s*za - zb/s;
+    for( int i=0; i<m; i++ )
+        for( int j=0; j<m; j++ )
+            if( zc(i,j)!=s*za(i,j) - zb(i,j)/s ) return -1;
+    double zn = 0.0;
+    for( int i=0; i<m; i++ )
+        for( int j=0; j<m; j++ )
+            zn += std::norm( za(i,j) + zb(i,j) );
+    if( std::abs( (za + zb).norm() - std::sqrt( zn ) ) > 1e-12*std::sqrt( zn ) ) return -1;
+    return 0;
+}
+
+static int bench_LU_pivoting()
+{
+    /// complete pivoting on index maps against the physical row / column swaps and
+    /// full rescans it replaced, rook pivoting, and rank() of a low rank matrix
+    std::cout << "[LU_pivoting benchmark]" << std::endl;
+    const int n = 400;
+    mx::Matrix mat = mx::Rand(n);
+
+    double t = wall_time();
+    mx::Matrix ref = mat;
+    for( int k=0; k<n-1; k++ )
+    {
+        int m = k, q = k;
+        double max_val = std::abs( ref(k,k) );
+        for( int i=k; i<n; i++ )
+            for( int j=k; j<n; j++ )
+                if( std::abs( ref(i,j) ) > max_val )
+                {
+                    max_val = std::abs( ref(i,j) );
+                    m = i;
+                    q = j;
+                }
+        ref.swap_row( k, m );
+        ref.swap_col( k, q );
+        for( int i=k+1; i<n; i++ )
+            ref(i,k) = ref(i,k) / ref(k,k);
+        for( int i=k+1; i<n; i++ )
+            for( int j=k+1; j<n; j++ )
+                ref(i,j) = ref(i,j) - ref(i,k)*ref(k,j);
+    }
+    double t_swap = wall_time() - t;
+
+    mx::LinearSolver ls_complete( mat ), ls_rook( mat ), ls_partial( mat );
+    t = wall_time();
+    if( ls_complete.lu_decomp()!=0 ) return -1;
+    double t_complete = wall_time() - t;
+    t = wall_time();
+    if( ls_rook.lu_decomp_rook()!=0 ) return -1;
+    double t_rook = wall_time() - t;
+    t = wall_time();
+    if( ls_partial.lu_decomp_partial()!=0 ) return -1;
+    double t_partial = wall_time() - t;
+    std::cout << "n = " << n << ": complete with swaps " << t_swap*1e3 << " ms, complete with index maps "
+              << t_complete*1e3 << " ms, rook " << t_rook*1e3 << " ms, partial " << t_partial*1e3 << " ms" << std::endl;
+
+    /// the same pivots, so the same factors
+    if( (ls_complete.matrix_lu() - ref).norm()!=0.0 ) return -1;
+    double norm_a = mat.norm();
+    mx::Matrix lu_rook = ls_rook.get_lower()*ls_rook.get_upper();
+    if( !( (ls_rook.permute( mat ) - lu_rook).norm() < 1e-13*norm_a ) ) return -1;
+    mx::Matrix u_rook = ls_rook.get_upper(), l_rook = ls_rook.get_lower();
+    for( int i=0; i<n; i++ )
+        for( int j=0; j<i; j++ )
+            if( !( std::abs( l_rook(i,j) ) <= 1.0 ) ) return -1;
+    mx::Matrix b_vecs = mx::Rand(n);
+    mx::Matrix b = b_vecs.submatrix( 0, -1, 0, 0 ).eval();
+    for( mx::LinearSolver* ls : { &ls_complete, &ls_rook } )
+    {
+        mx::Matrix x = ls->solve_vec( b );
+        if( ls->rank()!=n || !( (mat*x - b).norm() < 1e-10*norm_a*x.norm() ) ) return -1;
+    }
+
+    /// rank r = x y^t, both pivotings find it and solve consistent systems
+    const int m = 120, r = 70;
+    mx::Matrix rnd_x = mx::Rand(m), rnd_y = mx::Rand(m);
+    mx::Matrix x_low = rnd_x.submatrix( 0, -1, 0, r-1 ).eval();
+    mx::Matrix y_low = rnd_y.submatrix( 0, r-1, 0, -1 ).eval();
+    mx::Matrix low = x_low*y_low;
+    mx::Matrix b_low = x_low*rnd_y.submatrix( 0, r-1, 0, 0 );
+    mx::LinearSolver ls_low_complete( low ), ls_low_rook( low );
+    ls_low_complete.lu_decomp();
+    ls_low_rook.lu_decomp_rook();
+    std::cout << "rank " << r << " matrix: complete rank " << ls_low_complete.rank()
+              << ", rook rank " << ls_low_rook.rank() << std::endl;
+    for( mx::LinearSolver* ls : { &ls_low_complete, &ls_low_rook } )
+    {
+        if( ls->rank()!=r ) return -1;
+        mx::Matrix x = ls->solve_vec( b_low );
+        if( !( (low*x - b_low).norm() < 1e-8*low.norm()*x.norm() ) ) return -1;
+    }
+
+    /// a matrix that becomes exactly zero stops at its rank
+    mx::Matrix ones( 5, 5, 1.0 );
+    mx::LinearSolver ls_ones( ones );
+    if( ls_ones.lu_decomp()!=0 || ls_ones.rank()!=1 ) return -1;
+    return 0;
+}
+
+static int bench_LU_calu()
+{
+    /// tournament pivoted LU against the classic partial pivoting: runtime, growth
+    /// factor max|U| / max|A| and backward error, for two panel widths
+    std::cout << "[LU_calu benchmark]" << std::endl;
+    const int n = 1000;
+    mx::Matrix mat = mx::Rand(n);
+    mx::Matrix b_vecs = mx::Rand(n);
+    mx::Matrix b = b_vecs.submatrix( 0, -1, 0, 3 ).eval();
+    double norm_a = mat.norm();
+    double max_a = mat.norm_inf();
+
+    for( int nb : { 128, 32 } )
+    {
+        mx::LinearSolver ls_partial( mat ), ls_calu( mat );
+        ls_partial.set_block_size( nb );
+        ls_calu.set_block_size( nb );
+        double t = wall_time();
+        if( ls_partial.lu_decomp_partial()!=0 ) return -1;
+        double t_partial = wall_time() - t;
+        t = wall_time();
+        if( ls_calu.lu_decomp_calu()!=0 ) return -1;
+        double t_calu = wall_time() - t;
+
+        mx::Matrix u_partial = ls_partial.get_upper(), u_calu = ls_calu.get_upper();
+        double growth_partial = u_partial.norm_inf() / max_a;
+        double growth_calu = u_calu.norm_inf() / max_a;
+        double err_calu = ( ls_calu.permute( mat ) - ls_calu.get_lower()*u_calu ).norm() / norm_a;
+        std::cout << "nb = " << nb << ": partial " << t_partial*1e3 << " ms, growth " << growth_partial
+                  << "; CALU " << t_calu*1e3 << " ms, growth " << growth_calu
+                  << ", |PA - LU| / |A| = " << err_calu << std::endl;
+        if( !( err_calu < 1e-13 ) || !( growth_calu < 10*growth_partial ) ) return -1;
+
+        /// multipliers stay bounded in practice, and the solve uses perm unchanged
+        mx::Matrix l_calu = ls_calu.get_lower();
+        if( !( l_calu.norm_inf() < 10.0 ) ) return -1;
+        mx::Matrix x = ls_calu.solve( b );
+        if( !( ( mat*x - b ).norm() < 1e-10*norm_a*x.norm() ) ) return -1;
+    }
+
+    /// a single panel of a tiny matrix and a singular one
+    mx::Matrix small = mx::Rand(7);
+    mx::LinearSolver ls_small( small );
+    if( ls_small.lu_decomp_calu()!=0 ) return -1;
+    if( !( ( ls_small.permute( small ) - ls_small.get_lower()*ls_small.get_upper() ).norm() < 1e-12*small.norm() ) ) return -1;
+    mx::Matrix zeros( 50, 50, 0.0 );
+    mx::LinearSolver ls_zero( zeros );
+    if( ls_zero.lu_decomp_calu()==0 ) return -1;
+    return 0;
+}
+
+static int bench_sym_packed()
+{
+    /// Cholesky of an SPD matrix kept as a packed lower triangle against the full
+    /// storage: memory, time, identical factors and solves
+    std::cout << "[sym_packed benchmark]" << std::endl;
+    const int n = 800;
+    mx::Matrix spd = mx::Matrix( mx::RandSPD(n) ) + n*mx::Matrix( mx::Eye(n) );
+    mx::SymMatrix sym( spd );
+    if( sym.n()!=n || (sym.to_matrix() - spd).norm()!=0.0 ) return -1;
+    std::cout << "storage: full " << sizeof(double)*n*n/1024 << " KiB, packed "
+              << sizeof(double)*mx::SymMatrix::packed_size( n )/1024 << " KiB" << std::endl;
+
+    mx::LinearSolver ls_full( spd ), ls_packed( sym );
+    double t = wall_time();
+    if( ls_full.chole_decomp()!=0 ) return -1;
+    double t_full = wall_time() - t;
+    t = wall_time();
+    if( ls_packed.chole_decomp()!=0 || !ls_packed.is_packed() ) return -1;
+    double t_packed = wall_time() - t;
+    std::cout << "chole_decomp: full " << t_full*1e3 << " ms, packed " << t_packed*1e3 << " ms" << std::endl;
+    mx::Matrix l_full = ls_full.get_chole();
+    if( (l_full - ls_packed.get_chole()).norm() > 1e-14*l_full.norm() ) return -1;
+
+    mx::Matrix b_vecs = mx::Rand(n);
+    mx::Matrix b = b_vecs.submatrix( 0, -1, 0, 0 ).eval();
+    mx::Matrix x = ls_packed.solve_vec_chole( b );
+    if( (x - ls_full.solve_vec_chole( b )).norm() > 1e-14*x.norm() ) return -1;
+    if( !( (sym.multiply( x ) - b).norm() < 1e-12*spd.norm()*x.norm() ) ) return -1;
+    mx::Matrix xs = ls_packed.solve( b_vecs );
+    if( !( (spd*xs - b_vecs).norm() < 1e-12*spd.norm()*xs.norm() ) ) return -1;
+    if( (sym.multiply( b_vecs ) - spd*b_vecs).norm() > 1e-12*spd.norm()*b_vecs.norm() ) return -1;
+
+    /// Hermitian entries and a matrix that is not positive definite
+    const int m = 40;
+    mx::MatrixZ herm( m, m );
+    for( int i=0; i<m; i++ )
+        for( int j=0; j<=i; j++ )
+        {
+            std::complex<double> v( spd(i,j), i==j ? 0.0 : 0.1*spd(j+1,i) );
+            herm(i,j) = v;
+            herm(j,i) = std::conj( v );
+        }
+    mx::SymMatrixZ sym_herm( herm );
+    mx::LinearSolverZ ls_herm( sym_herm );
+    if( ls_herm.chole_decomp()!=0 ) return -1;
+    mx::MatrixZ l = ls_herm.get_chole(), lh( m, m );
+    for( int i=0; i<m; i++ )
+        for( int j=0; j<m; j++ )
+            lh(i,j) = std::conj( l(j,i) );
+    if( !( (l*lh - herm).norm() < 1e-12*herm.norm() ) ) return -1;
+    mx::MatrixZ bz( m, 1, std::complex<double>( 1.0, -2.0 ) );
+    mx::MatrixZ xz = ls_herm.solve_vec_chole( bz );
+    if( !( (herm*xz - bz).norm() < 1e-10*herm.norm()*xz.norm() ) ) return -1;
+
+    mx::SymMatrix indef( 3 );
+    indef(0,0) = 1.0; indef(1,1) = -1.0; indef(2,2) = 1.0;
+    mx::LinearSolver ls_indef( indef );
+    if( ls_indef.chole_decomp()==0 ) return -1;
+    return 0;
+}
+
+static int bench_chole_rank()
+{
+    /// blocked pivoted Cholesky on a low rank kernel matrix: early termination at the
+    /// numerical rank against running to the end, and against the unblocked algorithm
+    /// with full row / column swaps and a second n x n factor it replaced
+    std::cout << "[chole_rank benchmark]" << std::endl;
+    const int n = 1000, r = 50;
+    mx::Matrix rnd = mx::Rand(n);
+    mx::Matrix x_low = rnd.submatrix( 0, -1, 0, r-1 ).eval();
+    mx::Matrix kern = x_low*x_low.transpose();
+    double norm_k = kern.norm();
+
+    mx::LinearSolver ls( kern );
+    double t = wall_time();
+    if( ls.chole_decomp_pivoting()!=0 ) return -1;
+    double t_early = wall_time() - t;
+    mx::LinearSolver ls_all( kern );
+    t = wall_time();
+    if( ls_all.chole_decomp_pivoting( 0.0 )!=0 ) return -1;
+    double t_all = wall_time() - t;
+
+    const int m = 400;
+    mx::Matrix ref = kern.submatrix( 0, m-1, 0, m-1 ).eval();
+    t = wall_time();
+    mx::Matrix res = mx::Zeros(m);
+    for( int k=0; k<m; k++ )
+    {
+        int q = k;
+        for( int j=k+1; j<m; j++ )
+            if( ref(j,j)>ref(q,q) ) q = j;
+        if( ref(q,q)<=0 ) break;
+        res.swap_col( k, q );
+        ref.swap_col( k, q );
+        ref.swap_row( k, q );
+        res(k,k) = std::sqrt( ref(k,k) );
+        for( int j=k+1; j<m; j++ )
+            res(k,j) = ref(k,j)/res(k,k);
+        for( int i=k+1; i<m; i++ )
+            for( int j=k+1; j<m; j++ )
+                ref(i,j) -= res(k,i)*res(k,j);
+    }
+    double t_swap = wall_time() - t;
+    mx::LinearSolver ls_m( kern.submatrix( 0, m-1, 0, m-1 ).eval() );
+    t = wall_time();
+    ls_m.chole_decomp_pivoting();
+    double t_m = wall_time() - t;
+
+    std::cout << "n = " << n << ", rank " << r << ": stop at tolerance " << t_early*1e3 << " ms (rank "
+              << ls.rank() << "), tolerance 0 " << t_all*1e3 << " ms (rank " << ls_all.rank() << ")" << std::endl;
+    std::cout << "n = " << m << ": swaps and a second factor " << t_swap*1e3 << " ms, blocked in place "
+              << t_m*1e3 << " ms" << std::endl;
+    if( ls.rank()!=r || ls_m.rank()!=r ) return -1;
+
+    mx::Matrix l = ls.get_chole();
+    if( !( (ls.permute_chole( kern ) - l*l.transpose()).norm() < 1e-12*norm_k ) ) return -1;
+    for( int i=0; i<n; i++ )
+        for( int j=r; j<n; j++ )
+            if( l(i,j)!=0.0 ) return -1;
+
+    /// a consistent right-hand side is solved on the rank r block
+    mx::Matrix b = x_low*rnd.submatrix( 0, r-1, r, r );
+    mx::Matrix x = ls.solve_vec_chole( b );
+    if( !( (kern*x - b).norm() < 1e-8*norm_k*x.norm() ) ) return -1;
+
+    /// full rank with and without blocking
+    mx::Matrix spd = mx::Matrix( mx::RandSPD(300) ) + 300*mx::Matrix( mx::Eye(300) );
+    mx::LinearSolver ls_blk( spd ), ls_unblk( spd );
+    ls_unblk.set_block_size( 1 );
+    ls_blk.chole_decomp_pivoting();
+    ls_unblk.chole_decomp_pivoting();
+    if( ls_blk.rank()!=300 || ls_unblk.rank()!=300 ) return -1;
+    if( (ls_blk.get_chole() - ls_unblk.get_chole()).norm() > 1e-12*spd.norm() ) return -1;
+    mx::Matrix bs = rnd.submatrix( 0, 299, 0, 4 ).eval();
+    mx::Matrix xs = ls_blk.solve( bs );
+    if( !( (spd*xs - bs).norm() < 1e-12*spd.norm()*xs.norm() ) ) return -1;
+    return 0;
+}
+
+static int bench_factor_update()
+{
+    /// rank-1 Cholesky updates / downdates and low rank LU updates against
+    /// refactoring the modified matrix
+    std::cout << "[factor_update benchmark]" << std::endl;
+    const int n = 800;
+    mx::Matrix spd = mx::Matrix( mx::RandSPD(n) ) + n*mx::Matrix( mx::Eye(n) );
+    mx::Matrix rnd = mx::Rand(n);
+    mx::Matrix x = rnd.submatrix( 0, -1, 0, 0 ) / 100.0;
+    mx::Matrix b = rnd.submatrix( 0, -1, 1, 1 ).eval();
+
+    mx::LinearSolver ls( spd );
+    ls.chole_decomp_tiled();
+    double t = wall_time();
+    if( ls.chole_update( x )!=0 ) return -1;
+    double t_update = wall_time() - t;
+    mx::Matrix spd_up = spd + x*x.transpose();
+    mx::LinearSolver ls_ref( spd_up );
+    t = wall_time();
+    ls_ref.chole_decomp_tiled();
+    double t_refactor = wall_time() - t;
+    std::cout << "Cholesky rank-1 update " << t_update*1e3 << " ms, refactor " << t_refactor*1e3 << " ms" << std::endl;
+    mx::Matrix l_ref = ls_ref.get_chole();
+    if( !( (ls.get_chole() - l_ref).norm() < 1e-12*l_ref.norm() ) ) return -1;
+
+    /// the downdate brings back the original factor; one that would leave A
+    /// indefinite is refused and changes nothing
+    if( ls.chole_downdate( x )!=0 ) return -1;
+    mx::LinearSolver ls_orig( spd );
+    ls_orig.chole_decomp();
+    mx::Matrix l_orig = ls_orig.get_chole();
+    if( !( (ls.get_chole() - l_orig).norm() < 1e-12*l_orig.norm() ) ) return -1;
+    mx::Matrix big = 100.0*spd.submatrix( 0, -1, 0, 0 );
+    if( ls.chole_downdate( big )==0 || (ls.get_chole() - l_orig).norm() > 1e-12*l_orig.norm() ) return -1;
+
+    /// packed storage and a pivoted factor take the same updates
+    mx::SymMatrix sym( spd );
+    mx::LinearSolver ls_packed( sym ), ls_piv( spd );
+    ls_packed.chole_decomp();
+    ls_piv.chole_decomp_pivoting();
+    if( ls_packed.chole_update( x )!=0 || ls_piv.chole_update( x )!=0 ) return -1;
+    for( mx::LinearSolver* s : { &ls_packed, &ls_piv } )
+    {
+        mx::Matrix y = s->solve_vec_chole( b );
+        if( !( (spd_up*y - b).norm() < 1e-12*spd_up.norm()*y.norm() ) ) return -1;
+    }
+
+    /// LU: A + u v^t solved through Sherman-Morrison-Woodbury
+    mx::Matrix a = mx::Rand(n);
+    mx::LinearSolver lu( a );
+    lu.lu_decomp_partial();
+    mx::Matrix u = rnd.submatrix( 0, -1, 2, 3 ).eval(), v = rnd.submatrix( 0, -1, 4, 5 ).eval();
+    t = wall_time();
+    if( lu.lu_update( u, v )!=0 ) return -1;
+    mx::Matrix y = lu.solve_vec( b );
+    t_update = wall_time() - t;
+    mx::Matrix a_up = a + u*v.transpose();
+    mx::LinearSolver lu_ref( a_up );
+    t = wall_time();
+    lu_ref.lu_decomp_partial();
+    mx::Matrix y_ref = lu_ref.solve_vec( b );
+    t_refactor = wall_time() - t;
+    std::cout << "LU rank-2 update + solve " << t_update*1e3 << " ms, refactor + solve " << t_refactor*1e3 << " ms" << std::endl;
+    if( lu.get_update_rank()!=2 ) return -1;
+    std::cout << "save with updates pending: ";
+    if( lu.save_factors( "bench_update.mxf" )==0 ) return -1;
+    if( !( (a_up*y - b).norm() < 1e-10*a_up.norm()*y.norm() ) ) return -1;
+    if( !( (a_up*y_ref - b).norm() < 1e-10*a_up.norm()*y_ref.norm() ) ) return -1;
+    mx::Matrix ys = lu.solve( rnd.submatrix( 0, -1, 0, 9 ) );
+    if( !( (a_up*ys - rnd.submatrix( 0, -1, 0, 9 )).norm() < 1e-9*a_up.norm()*ys.norm() ) ) return -1;
+
+    /// past the update limit the updates are folded into a new factorization
+    lu.set_update_limit( 4 );
+    mx::Matrix a_cur = a_up;
+    int status = 0;
+    for( int i=6; i<10 && status==0; i++ )
+    {
+        mx::Matrix ui = rnd.submatrix( 0, -1, i, i ) / 10.0, vi = rnd.submatrix( 0, -1, i+10, i+10 ).eval();
+        status = lu.lu_update( ui, vi );
+        a_cur = a_cur + ui*vi.transpose();
+    }
+    if( status!=1 || lu.get_update_rank()!=0 ) return -1;
+    y = lu.solve_vec( b );
+    if( !( (a_cur*y - b).norm() < 1e-9*a_cur.norm()*y.norm() ) ) return -1;
+
+    /// an update that nearly cancels a column makes the capacitance matrix useless,
+    /// so the factors are rebuilt instead
+    mx::Matrix e0( n, 1 ), col0 = a_cur.submatrix( 0, -1, 0, 0 ) * ( -1.0 + 1e-10 );
+    e0(0) = 1.0;
+    mx::Matrix a_near = a_cur + col0*e0.transpose();
+    if( lu.lu_update( col0, e0 )!=1 ) return -1;
+    y = lu.solve_vec( b );
+    if( !( (a_near*y - b).norm() < 1e-6*a_near.norm()*y.norm() ) ) return -1;
+    return 0;
+}
+
+static int bench_factor_cache()
+{
+    /// repeated solves with the same matrix: a hit costs two checksums of the entries
+    /// instead of a factorization
+    std::cout << "[factor_cache benchmark]" << std::endl;
+    const int n = 600;
+    mx::Matrix a = mx::Rand(n);
+    mx::Matrix spd = mx::Matrix( mx::RandSPD(n) ) + n*mx::Matrix( mx::Eye(n) );
+    mx::Matrix rnd = mx::Rand(n);
+    mx::Matrix b = rnd.submatrix( 0, -1, 0, 0 ).eval();
+
+    mx::FactorCache cache( std::size_t(64) << 20 );
+    double t = wall_time();
+    mx::FactorCache::SolverPtr miss = cache.get( a );
+    double t_miss = wall_time() - t;
+    t = wall_time();
+    mx::FactorCache::SolverPtr hit = cache.get( a );
+    double t_hit = wall_time() - t;
+    std::cout << "miss " << t_miss*1e3 << " ms, hit " << t_hit*1e3 << " ms" << std::endl;
+    if( !miss || hit!=miss ) return -1;
+    mx::Matrix y = hit->solve_vec( b );
+    if( !( (a*y - b).norm() < 1e-10*a.norm()*y.norm() ) ) return -1;
+
+    /// the mode is part of the key, the tolerance only where the mode reads it;
+    /// one changed entry is a different matrix
+    if( cache.get( a, mx::PARTIAL_LU, 1e-3 )!=miss || cache.get( a, mx::COMPLETE_LU )==miss ) return -1;
+    mx::Matrix a2 = a;
+    a2(n-1,n-1) += 1.0;
+    if( cache.get( a2 )==miss ) return -1;
+    if( cache.get( mx::Matrix( n, n+1 ) ) || cache.get( a, mx::NONE ) ) return -1;
+    mx::FactorCacheStats st = cache.stats();
+    if( st.hits!=2 || st.misses!=3 || st.entries!=3 || st.evictions!=0 ) return -1;
+
+    /// a budget of two solvers evicts the least recently used one
+    std::size_t one = miss->memory_bytes();
+    cache.set_max_bytes( 2*one + one/2 );
+    st = cache.stats();
+    if( st.entries!=2 || st.evictions!=1 || st.bytes>2*one + one/2 ) return -1;
+    cache.get( spd, mx::CHOLE );
+    st = cache.stats();
+    if( st.entries!=2 || st.evictions!=2 ) return -1;
+
+    /// threads asking for the same matrix at once share one factorization
+    cache.clear();
+    std::vector<mx::FactorCache::SolverPtr> got( 4 );
+    std::vector<std::thread> threads;
+    for( int i=0; i<4; i++ )
+        threads.emplace_back( [&cache, &spd, &got, i](){ got[i] = cache.get( spd, mx::CHOLE ); } );
+    for( auto& th : threads )
+        th.join();
+    mx::FactorCacheStats st2 = cache.stats();
+    if( st2.misses-st.misses!=1 || st2.hits-st.hits!=3 ) return -1;
+    for( int i=0; i<4; i++ )
+        if( !got[i] || got[i]!=got[0] ) return -1;
+
+    /// factors written to a directory are read back by a new cache
+    const char* dir = "bench_factor_cache";
+    std::filesystem::create_directory( dir );
+    {
+        mx::FactorCache writer( std::size_t(64) << 20 );
+        writer.set_directory( dir );
+        writer.get( a );
+        writer.get( spd, mx::CHOLE, 1e-12 );
+        writer.get( a, mx::MIXED_LU );
+        if( writer.stats().disk_writes!=3 ) return -1;
+    }
+    mx::FactorCache reader( std::size_t(64) << 20 );
+    reader.set_directory( dir );
+    t = wall_time();
+    mx::FactorCache::SolverPtr loaded = reader.get( a );
+    double t_load = wall_time() - t;
+    std::cout << "load from disk " << t_load*1e3 << " ms" << std::endl;
+    mx::FactorCache::SolverPtr loaded_chole = reader.get( spd, mx::CHOLE, 1e-12 );
+    mx::FactorCache::SolverPtr loaded_mixed = reader.get( a, mx::MIXED_LU );
+    st = reader.stats();
+    if( st.disk_loads!=3 || st.disk_writes!=0 ) return -1;
+    if( !loaded || !loaded_chole || !loaded_mixed ) return -1;
+    y = loaded->solve_vec( b );
+    if( !( (a*y - b).norm() < 1e-10*a.norm()*y.norm() ) ) return -1;
+    y = loaded_mixed->solve_vec( b );
+    if( !( (a*y - b).norm() < 1e-10*a.norm()*y.norm() ) ) return -1;
+    y = loaded_chole->solve_vec_chole( b );
+    if( !( (spd*y - b).norm() < 1e-10*spd.norm()*y.norm() ) ) return -1;
+    std::filesystem::remove_all( dir );
+    return 0;
+}
+
+static int bench_sparse()
+{
+    /// CSR / CSC against dense storage: conversion, SpMV, SpGEMM and the SPARSE and
+    /// MatrixMarket readers
+    std::cout << "[sparse benchmark]" << std::endl;
+    auto same = []( const mx::Matrix& p, const mx::Matrix& q ){
+        return p.n_row()==q.n_row() && p.n_col()==q.n_col()
+            && std::memcmp( p.data(), q.data(), p.n_row()*p.n_col()*sizeof(double) )==0;
+    };
+
+    /// duplicates are summed, rows come out sorted
+    mx::SparseMatrix t = mx::SparseMatrix::from_triplets( 3, 4, { 2, 0, 2, 0, 1 }, { 3, 1, 0, 1, 2 },
+                                                          { 1.0, 2.0, 3.0, 4.0, 5.0 } );
+    if( t.nnz()!=4 || t(0,1)!=6.0 || t(2,0)!=3.0 || t(2,3)!=1.0 || t(1,1)!=0.0 ) return -1;
+    if( t.idx()[2]!=0 || t.idx()[3]!=3 ) return -1;
+
+    /// 0.5% dense, every row with its diagonal
+    const int n = 2000, per_row = 10;
+    std::vector<int> rows, cols;
+    std::vector<double> vals;
+    for( int i=0; i<n; i++ )
+    {
+        rows.push_back( i );
+        cols.push_back( i );
+        vals.push_back( per_row );
+        for( int k=1; k<per_row; k++ )
+        {
+            rows.push_back( i );
+            cols.push_back( std::rand()%n );
+            vals.push_back( (double)std::rand()/RAND_MAX - 0.5 );
+        }
+    }
+    mx::SparseMatrix a = mx::SparseMatrix::from_triplets( n, n, rows, cols, vals );
+    mx::SparseMatrix a_csc = mx::SparseMatrix::from_triplets( n, n, rows, cols, vals, mx::CSC );
+    mx::Matrix dense = a.to_matrix();
+    if( !same( dense, a_csc.to_matrix() ) || !same( dense, mx::SparseMatrix( dense ).to_matrix() ) ) return -1;
+    if( mx::SparseMatrix( dense, mx::CSC ).nnz()!=a.nnz() ) return -1;
+    if( !same( a.transpose().to_matrix(), dense.transpose() ) ) return -1;
+    if( a.to_layout( mx::CSC ).idx()!=a_csc.idx() || a_csc.to_layout( mx::CSR ).ptr()!=a.ptr() ) return -1;
+
+    mx::Matrix rnd = mx::Rand(n);
+    mx::Matrix x = rnd.submatrix( 0, -1, 0, 3 ).eval();
+    mx::Matrix x1 = x.submatrix( 0, -1, 0, 0 ).eval();
+    const int reps = 20;
+    mx::Matrix y, y_csc, y_dense;
+    double tm = wall_time();
+    for( int r=0; r<reps; r++ )
+        y_dense = dense*x1;
+    double t_dense = ( wall_time() - tm )/reps;
+    tm = wall_time();
+    for( int r=0; r<reps; r++ )
+        a.multiply( x1, y );
+    double t_sparse = ( wall_time() - tm )/reps;
+    std::cout << "SpMV n=" << n << " nnz=" << a.nnz() << ": dense " << t_dense*1e3 << " ms, CSR "
+              << t_sparse*1e3 << " ms" << std::endl;
+    if( !( (y - y_dense).norm() < 1e-12*y_dense.norm() ) ) return -1;
+    y = a*x;
+    a_csc.multiply( x, y_csc );
+    y_dense = dense*x;
+    if( !( (y - y_dense).norm() < 1e-12*y_dense.norm() && (y_csc - y_dense).norm() < 1e-12*y_dense.norm() ) ) return -1;
+
+    /// SpGEMM against the dense product, CSC operands included
+    tm = wall_time();
+    mx::SparseMatrix c = a*a;
+    double t_spgemm = wall_time() - tm;
+    tm = wall_time();
+    mx::Matrix c_dense = dense*dense;
+    t_dense = wall_time() - tm;
+    std::cout << "SpGEMM nnz(C)=" << c.nnz() << ": dense " << t_dense*1e3 << " ms, sparse " << t_spgemm*1e3 << " ms" << std::endl;
+    if( !( (c.to_matrix() - c_dense).norm() < 1e-12*c_dense.norm() ) ) return -1;
+    if( !( (a_csc.multiply( a ).to_matrix() - c_dense).norm() < 1e-12*c_dense.norm() ) ) return -1;
+    for( int i=0; i<n; i++ )
+        for( int p=c.ptr()[i]+1; p<c.ptr()[i+1]; p++ )
+            if( c.idx()[p-1]>=c.idx()[p] ) return -1;
+
+    /// SPARSE files round trip; a MatrixMarket file is read by SparseMatrix and by Matrix
+    const char* sparse_file = "bench_sparse.txt";
+    const char* mm_file = "bench_sparse.mtx";
+    if( a_csc.write_to_file( sparse_file )!=0 ) return -1;
+    mx::SparseMatrix back( sparse_file );
+    if( back.ptr()!=a.ptr() || back.idx()!=a.idx() || back.val()!=a.val() ) return -1;
+    if( !same( mx::Matrix( sparse_file ), dense ) ) return -1;
+    {
+        std::ofstream ofs( mm_file );
+        ofs << "%%MatrixMarket matrix coordinate real symmetric\n% a comment\n%\n3 3 4\n"
+            << "1 1 2.0\n2 1 -1\n3 2 -1e0\n3 3 +2.5\n";
+    }
+    mx::SparseMatrix mm( mm_file, mx::CSC );
+    mx::Matrix mm_dense( mm_file );
+    if( mm.nnz()!=6 || mm(0,1)!=-1.0 || mm(1,0)!=-1.0 || mm(1,2)!=-1.0 || mm(2,2)!=2.5 || mm(1,1)!=0.0 ) return -1;
+    if( !same( mm_dense, mm.to_matrix() ) ) return -1;
+    {
+        std::ofstream ofs( mm_file );
+        ofs << "%%MatrixMarket matrix coordinate complex hermitian\n2 2 2\n1 1 1 0\n2 1 0.5 -2\n";
+    }
+    mx::SparseMatrixZ mz( mm_file );
+    if( mz(0,1)!=std::complex<double>( 0.5, 2 ) || mz(1,0)!=std::complex<double>( 0.5, -2 ) ) return -1;
+    std::cout << "complex file into a real matrix: ";
+    mx::SparseMatrix rejected;
+    if( rejected.read_from_file( mm_file )==0 ) return -1;
+    std::remove( sparse_file );
+    std::remove( mm_file );
+    return 0;
+}
+
+static int bench_sparse_direct()
+{
+    /// supernodal multifrontal Cholesky / LU of 2D grid problems: fill of the
+    /// orderings, the dense solver for scale, reuse of the analysis, static pivoting
+    std::cout << "[sparse_direct benchmark]" << std::endl;
+
+
+    const int g = 120, n = g*g;
+    mx::SparseMatrix a = grid_laplacian( g, 0.0, 0.0 );
+    mx::Matrix b( n, 3 );
+    for( int i=0; i<n; i++ )
+        for( int c=0; c<3; c++ )
+            b(i,c) = (double)std::rand()/RAND_MAX - 0.5;
+    std::size_t nnz_l[3];
+    const char* names[3] = { "natural", "AMD", "nested dissection" };
+    for( int o=0; o<3; o++ )
+    {
+        mx::SparseLinearSolver ls( a );
+        ls.set_ordering( (mx::SparseOrdering)o );
+        double t = wall_time();
+        ls.analyze();
+        double t_analyze = wall_time() - t;
+        t = wall_time();
+        if( ls.chole_decomp()!=0 ) return -1;
+        double t_factor = wall_time() - t;
+        nnz_l[o] = ls.factor_nnz();
+        std::cout << "Laplacian n=" << n << ", " << names[o] << ": nnz(L)=" << nnz_l[o] << " in "
+                  << ls.n_supernodes() << " supernodes, analyze " << t_analyze*1e3 << " ms, factor "
+                  << t_factor*1e3 << " ms" << std::endl;
+        mx::Matrix x = ls.solve( b );
+        if( !( sparse_residual( a, x, b ) < 1e-12 ) ) return -1;
+    }
+    if( !( nnz_l[1]*2 < nnz_l[0] && nnz_l[2]*2 < nnz_l[0] ) ) return -1;
+
+    /// against the dense Cholesky on a smaller grid
+    {
+        mx::SparseMatrix a_small = grid_laplacian( 40, 0.0, 0.0 );
+        mx::Matrix dense = a_small.to_matrix();
+        mx::LinearSolver dls( dense );
+        double t = wall_time();
+        dls.chole_decomp_tiled();
+        double t_dense = wall_time() - t;
+        mx::SparseLinearSolver sls( a_small );
+        t = wall_time();
+        sls.chole_decomp();
+        double t_sparse = wall_time() - t;
+        std::cout << "n=1600: dense Cholesky " << t_dense*1e3 << " ms, sparse " << t_sparse*1e3 << " ms" << std::endl;
+    }
+
+    /// new values on the same pattern keep the analysis, a new pattern does not
+    mx::SparseLinearSolver ls( a );
+    ls.chole_decomp();
+    mx::SparseMatrix a2 = grid_laplacian( g, 1.0, 0.0 );
+    ls.set_matrix( a2 );
+    if( !ls.is_analyzed() || ls.chole_decomp()!=0 ) return -1;
+    if( !( sparse_residual( a2, ls.solve_vec( b ), b ) < 1e-12 ) ) return -1;
+    mx::SparseMatrix indef = grid_laplacian( g, -8.0, 0.0 );
+    ls.set_matrix( indef );
+    if( ls.chole_decomp()==0 || ls.get_status()!=mx::MAT_SET ) return -1;
+    ls.set_matrix( grid_laplacian( g-1, 0.0, 0.0 ) );
+    if( ls.is_analyzed() ) return -1;
+
+    /// nonsymmetric convection-diffusion by LU
+    mx::SparseMatrix cd = grid_laplacian( g, 0.0, 0.4 );
+    mx::SparseLinearSolver lu( cd );
+    double t = wall_time();
+    if( lu.lu_decomp()!=0 ) return -1;
+    std::cout << "convection-diffusion LU " << ( wall_time() - t )*1e3 << " ms, perturbed pivots "
+              << lu.get_perturbed_pivots() << std::endl;
+    if( !( sparse_residual( cd, lu.solve( b ), b ) < 1e-12 ) ) return -1;
+
+    /// a saddle point matrix [K B^t; B 0] has zero pivots, static pivoting replaces
+    /// them and refinement recovers the solution
+    {
+        const int gk = 20, nk = gk*gk, nc = 30, nt = nk + nc;
+        mx::SparseMatrix k = grid_laplacian( gk, 0.0, 0.0 );
+        std::vector<int> rows, cols;
+        std::vector<double> vals;
+        for( int j=0; j<nk; j++ )
+            for( int p=k.ptr()[j]; p<k.ptr()[j+1]; p++ )
+            {
+                rows.push_back( j );
+                cols.push_back( k.idx()[p] );
+                vals.push_back( k.val()[p] );
+            }
+        for( int c=0; c<nc; c++ )
+            for( int e=0; e<3; e++ )
+            {
+                int j = ( c*13 + e*7 ) % nk;
+                double v = 1.0 + e;
+                rows.push_back( nk+c ); cols.push_back( j ); vals.push_back( v );
+                rows.push_back( j ); cols.push_back( nk+c ); vals.push_back( v );
+            }
+        mx::SparseMatrix kkt = mx::SparseMatrix::from_triplets( nt, nt, rows, cols, vals );
+        mx::SparseLinearSolver ls_kkt( kkt );
+        if( ls_kkt.lu_decomp()!=0 ) return -1;
+        mx::Matrix bk = b.submatrix( 0, nt-1, 0, 0 ).eval();
+        mx::Matrix xk = ls_kkt.solve_vec( bk );
+        std::cout << "saddle point: " << ls_kkt.get_perturbed_pivots() << " perturbed pivots, "
+                  << ls_kkt.get_refine_iterations() << " refinement steps, residual " << sparse_residual( kkt, xk, bk ) << std::endl;
+        if( !( sparse_residual( kkt, xk, bk ) < 1e-10 ) ) return -1;
+    }
+
+    /// Hermitian positive definite complex matrix
+    {
+        const int gz = 30, nz = gz*gz;
+        std::vector<int> rows, cols;
+        std::vector< std::complex<double> > vals;
+        for( int i=0; i<nz; i++ )
+        {
+            rows.push_back( i ); cols.push_back( i ); vals.push_back( 5.0 );
+            for( int j : { i+1, i+gz } )
+                if( j<nz && ( j!=i+1 || (i+1)%gz!=0 ) )
+                {
+                    rows.push_back( j ); cols.push_back( i ); vals.push_back( { -1.0, 0.3 } );
+                    rows.push_back( i ); cols.push_back( j ); vals.push_back( { -1.0, -0.3 } );
+                }
+        }
+        mx::SparseMatrixZ az = mx::SparseMatrixZ::from_triplets( nz, nz, rows, cols, vals );
+        mx::SparseLinearSolverZ lz( az );
+        lz.set_ordering( mx::NESTED_DISSECTION );
+        if( lz.chole_decomp()!=0 ) return -1;
+        mx::MatrixZ bz( nz, 1 );
+        for( int i=0; i<nz; i++ )
+            bz(i) = std::complex<double>( b(i,0), b(i,1) );
+        mx::MatrixZ xz = lz.solve_vec( bz );
+        mx::MatrixZ rz = az*xz;
+        if( !( ( rz - bz ).norm() < 1e-12*bz.norm() ) ) return -1;
+    }
+
+    /// identity rows as from Dirichlet conditions next to a grid: nested dissection
+    /// orders the disconnected graph component by component, linear in n
+    {
+        const int gd = 60, n_grid = gd*gd, n_id = 200000, nd = n_grid + n_id;
+        mx::SparseMatrix a_grid = grid_laplacian( gd, 0.0, 0.0 );
+        std::vector<int> rows, cols;
+        std::vector<double> vals;
+        for( int j=0; j<n_grid; j++ )
+            for( int p=a_grid.ptr()[j]; p<a_grid.ptr()[j+1]; p++ )
+            {
+                rows.push_back( a_grid.idx()[p] ); cols.push_back( j ); vals.push_back( a_grid.val()[p] );
+            }
+        for( int i=n_grid; i<nd; i++ )
+        {
+            rows.push_back( i ); cols.push_back( i ); vals.push_back( 2.0 );
+        }
+        mx::SparseMatrix ad = mx::SparseMatrix::from_triplets( nd, nd, rows, cols, vals );
+        mx::Matrix bd( nd, 1 );
+        for( int i=0; i<nd; i++ )
+            bd(i) = 1.0 + i%7;
+        mx::SparseLinearSolver ld( ad );
+        ld.set_ordering( mx::NESTED_DISSECTION );
+        double t = wall_time();
+        if( ld.chole_decomp()!=0 ) return -1;
+        t = wall_time() - t;
+        double res = sparse_residual( ad, ld.solve_vec( bd ), bd );
+        std::cout << "grid + " << n_id << " identity rows, nested dissection: " << t*1e3
+                  << " ms, residual " << res << std::endl;
+        if( !( res < 1e-12 ) || !( t < 10.0 ) ) return -1;
+    }
+    return 0;
+}
+
+static int bench_krylov()
+{
+    /// CG / PCG and GMRES against their residuals on sparse grid problems, a dense
+    /// matrix and a matrix-free operator
+    std::cout << "[krylov benchmark]" << std::endl;
+
+    auto rand_vec = []( int n, int k ){
+        mx::Matrix b( n, k );
+        for( int i=0; i<n; i++ )
+            for( int c=0; c<k; c++ )
+                b(i,c) = (double)std::rand()/RAND_MAX - 0.5;
+        return b;
+    };
+
+    /// Laplacian on a 200 x 200 grid, long enough for the threaded vector kernels
+    const int g = 200, n = g*g;
+    mx::SparseMatrix a = grid_laplacian( g, 0.0, 0.0 );
+    mx::Matrix b = rand_vec( n, 2 );
+    mx::KrylovSolver ks( a );
+    ks.set_max_iterations( 5000 );
+    int iters[3];
+    const char* names[3] = { "CG", "CG + Jacobi", "CG + IC(0)" };
+    for( int m=0; m<3; m++ )
+    {
+        double t = wall_time();
+        if( m==1 ) ks.set_preconditioner( mx::jacobi_preconditioner( a ) );
+        if( m==2 ) ks.set_preconditioner( mx::ichol_preconditioner( a ) );
+        mx::Matrix x;
+        if( ks.cg( b, x )!=0 ) return -1;
+        iters[m] = ks.get_iterations();
+        std::cout << "Laplacian n=" << n << ", " << names[m] << ": " << iters[m] << " iterations, "
+                  << ( wall_time() - t )*1e3 << " ms, residual " << sparse_residual( a, x, b ) << std::endl;
+        if( !( sparse_residual( a, x, b ) < 1e-7 ) ) return -1;
+    }
+    if( !( iters[2]*2 < iters[0] ) ) return -1;
+    {
+        mx::SparseLinearSolver ls( a );
+        double t = wall_time();
+        ls.chole_decomp();
+        mx::Matrix x = ls.solve( b );
+        std::cout << "sparse Cholesky for scale: " << ( wall_time() - t )*1e3 << " ms" << std::endl;
+    }
+
+    /// a starting guess that already solves the system costs no iteration
+    {
+        mx::Matrix x;
+        ks.cg( b, x );
+        if( ks.cg( b, x )!=0 || ks.get_iterations()!=0 ) return -1;
+    }
+
+    /// nonsymmetric convection-diffusion by GMRES(30), alone and with block Jacobi
+    {
+        mx::SparseMatrix cd = grid_laplacian( 100, 0.0, 0.4 );
+        mx::Matrix bc = rand_vec( cd.n_row(), 1 );
+        mx::KrylovSolver gm( cd );
+        gm.set_max_iterations( 5000 );
+        for( int m=0; m<2; m++ )
+        {
+            if( m==1 ) gm.set_preconditioner( mx::block_jacobi_preconditioner( cd, 100 ) );
+            double t = wall_time();
+            mx::Matrix x = gm.solve_gmres( bc );
+            iters[m] = gm.get_iterations();
+            std::cout << "convection-diffusion GMRES(30)" << ( m ? " + block Jacobi" : "" ) << ": " << iters[m]
+                      << " iterations, " << ( wall_time() - t )*1e3 << " ms, residual " << sparse_residual( cd, x, bc ) << std::endl;
+            if( !( sparse_residual( cd, x, bc ) < 1e-7 ) ) return -1;
+        }
+        if( !( iters[1] < iters[0] ) ) return -1;
+    }
+
+    /// dense SPD with a bounded condition number against the dense Cholesky
+    {
+        const int nd = 1000;
+        mx::Matrix c = rand_vec( nd, nd );
+        mx::Matrix ad = c * c.transpose();
+        for( int i=0; i<nd; i++ )
+            ad(i,i) += nd;
+        mx::Matrix bd = rand_vec( nd, 1 );
+        mx::KrylovSolver kd( ad );
+        kd.set_preconditioner( mx::block_jacobi_preconditioner( ad, 50 ) );
+        double t = wall_time();
+        mx::Matrix x = kd.solve_cg( bd );
+        double t_cg = wall_time() - t;
+        mx::LinearSolver ls( ad );
+        t = wall_time();
+        ls.chole_decomp_tiled();
+        mx::Matrix xd = ls.solve_vec_chole( bd );
+        double t_chole = wall_time() - t;
+        mx::Matrix r = ad*x - bd;
+        std::cout << "dense n=" << nd << ": PCG " << kd.get_iterations() << " iterations " << t_cg*1e3
+                  << " ms, Cholesky " << t_chole*1e3 << " ms" << std::endl;
+        if( kd.get_residual() > 1e-8 || !( r.norm() < 1e-7*bd.norm() ) ) return -1;
+        if( !( ( x - xd ).norm() < 1e-6*xd.norm() ) ) return -1;
+    }
+
+    /// matrix-free: 1D Laplacian plus identity through a callback
+    {
+        const int nf = 50000;
+        mx::LinearOperator op( nf, [nf]( const double* x, double* y ){
+            for( int i=0; i<nf; i++ )
+                y[i] = 3.0*x[i] - ( i>0 ? x[i-1] : 0.0 ) - ( i<nf-1 ? x[i+1] : 0.0 );
+        } );
+        mx::Matrix bf = rand_vec( nf, 1 );
+        mx::KrylovSolver kf( op );
+        mx::Matrix x = kf.solve_cg( bf );
+        double err = 0;
+        for( int i=0; i<nf; i++ )
+        {
+            double y = 3.0*x(i,0) - ( i>0 ? x(i-1,0) : 0.0 ) - ( i<nf-1 ? x(i+1,0) : 0.0 );
+            err += ( y - bf(i,0) )*( y - bf(i,0) );
+        }
+        std::cout << "matrix-free CG: " << kf.get_iterations() << " iterations" << std::endl;
+        if( !( std::sqrt( err ) < 1e-7*bf.norm() ) ) return -1;
+        mx::Matrix xg = kf.solve_gmres( bf );
+        if( !( ( xg - x ).norm() < 1e-6*x.norm() ) ) return -1;
+    }
+
+    /// complex Hermitian positive definite: PCG with IC(0) and plain GMRES
+    {
+        const int gz = 30, nz = gz*gz;
+        std::vector<int> rows, cols;
+        std::vector< std::complex<double> > vals;
+        for( int i=0; i<nz; i++ )
+        {
+            rows.push_back( i ); cols.push_back( i ); vals.push_back( 5.0 );
+            for( int j : { i+1, i+gz } )
+                if( j<nz && ( j!=i+1 || (i+1)%gz!=0 ) )
+                {
+                    rows.push_back( j ); cols.push_back( i ); vals.push_back( { -1.0, 0.3 } );
+                    rows.push_back( i ); cols.push_back( j ); vals.push_back( { -1.0, -0.3 } );
+                }
+        }
+        mx::SparseMatrixZ az = mx::SparseMatrixZ::from_triplets( nz, nz, rows, cols, vals );
+        mx::MatrixZ bz( nz, 1 );
+        for( int i=0; i<nz; i++ )
+            bz(i) = std::complex<double>( b(i,0), b(i,1) );
+        mx::KrylovSolverZ kz( az );
+        kz.set_preconditioner( mx::ichol_preconditioner( az ) );
+        mx::MatrixZ xz = kz.solve_cg( bz );
+        mx::MatrixZ rz = az*xz;
+        if( !( ( rz - bz ).norm() < 1e-7*bz.norm() ) ) return -1;
+        kz.set_preconditioner( mx::LinearOperatorZ() );
+        xz = kz.solve_gmres( bz );
+        rz = az*xz;
+        if( !( ( rz - bz ).norm() < 1e-7*bz.norm() ) ) return -1;
+    }
+    return 0;
+}
+
+static int bench_qr()
+{
+    /// blocked and column pivoted Householder QR: the factors, least squares
+    /// solutions against the normal equations and Eigen, rank revelation
+    std::cout << "[qr benchmark]" << std::endl;
+
+    auto rand_mat = []( int m, int n ){
+        mx::Matrix a( m, n );
+        for( int i=0; i<m; i++ )
+            for( int j=0; j<n; j++ )
+                a(i,j) = (double)std::rand()/RAND_MAX - 0.5;
+        return a;
+    };
+    /// ||A P - Q R|| / ||A|| and ||Q^t Q - I|| of a QR factored solver
+    auto check_factors = []( mx::LinearSolver& ls, mx::Matrix a ){
+        auto [m, n] = a.size();
+        mx::Matrix q = ls.get_q(), r = ls.get_r();
+        const std::vector<int>& p = ls.get_col_perm();
+        mx::Matrix ap( m, n );
+        for( int i=0; i<m; i++ )
+            for( int j=0; j<n; j++ )
+                ap(i,j) = a(i,p[j]);
+        mx::Matrix qr = q*r;
+        double err = ( ap - qr ).norm() / a.norm();
+        mx::Matrix qtq = q.transpose()*q;
+        for( int i=0; i<qtq.n_row(); i++ )
+            qtq(i,i) -= 1.0;
+        return std::max( err, qtq.norm() );
+    };
+
+    /// tall, square and wide, several panels and unblocked
+    for( auto [m, n, nb] : { std::tuple<int,int,int>{ 500, 120, 32 }, { 200, 200, 48 }, { 90, 260, 16 }, { 150, 60, 1 } } )
+    {
+        mx::Matrix a = rand_mat( m, n );
+        mx::LinearSolver ls( a );
+        ls.set_block_size( nb );
+        if( ls.qr_decomp()!=0 ) return -1;
+        double err = check_factors( ls, a );
+        mx::LinearSolver lp( a );
+        lp.set_block_size( nb );
+        lp.qr_decomp_pivoting();
+        double err_p = check_factors( lp, a );
+        std::cout << m << " x " << n << " block " << nb << ": QR error " << err << ", pivoted " << err_p
+                  << ", rank " << lp.rank() << std::endl;
+        if( !( err < 1e-13 && err_p < 1e-13 ) || lp.rank()!=std::min( m, n ) ) return -1;
+        mx::Matrix r = lp.get_r();
+        for( int i=1; i<std::min( m, n ); i++ )
+            if( std::abs( r(i,i) ) > std::abs( r(i-1,i-1) )*( 1 + 1e-12 ) ) return -1;
+    }
+
+    /// overdetermined regression with 8 right-hand sides, against Eigen's Householder QR
+    /// including the copy into Eigen
+    {
+        const int m = 4000, n = 400, k = 8;
+        mx::Matrix a = rand_mat( m, n ), b = rand_mat( m, k );
+        double t = wall_time();
+        mx::LinearSolver ls( a );
+        mx::Matrix x = ls.solve_least_squares( b );
+        double t_mx = wall_time() - t;
+        t = wall_time();
+        Eigen::MatrixXd ea = mx_to_eigen( a ), eb = mx_to_eigen( b );
+        Eigen::MatrixXd ex = ea.householderQr().solve( eb );
+        double t_eigen = wall_time() - t;
+        /// the residual is orthogonal to the columns of A
+        mx::Matrix res = a*x - b;
+        mx::Matrix normal = a.transpose()*res;
+        double orth = normal.norm() / ( a.norm()*res.norm() );
+        double diff = 0;
+        for( int i=0; i<n; i++ )
+            for( int c=0; c<k; c++ )
+                diff = std::max( diff, std::abs( x(i,c) - ex(i,c) ) );
+        std::cout << m << " x " << n << " least squares, " << k << " rhs: " << t_mx*1e3 << " ms, Eigen "
+                  << t_eigen*1e3 << " ms, |A^t r| / |A||r| " << orth << ", max diff " << diff << std::endl;
+        if( !( orth < 1e-12 && diff < 1e-10 ) ) return -1;
+        /// solve and solve_vec of a QR factored solver are the least squares ones
+        mx::Matrix x1 = ls.solve_vec( b.submatrix( 0, m-1, 0, 0 ) );
+        for( int i=0; i<n; i++ )
+            if( std::abs( x1(i,0) - x(i,0) ) > 1e-12 ) return -1;
+    }
+
+    /// rank 40 product of 400 x 40 and 40 x 250 factors, a basic solution
+    {
+        const int m = 400, n = 250, r = 40;
+        mx::Matrix a = rand_mat( m, r )*rand_mat( r, n ), b = rand_mat( m, 2 );
+        mx::LinearSolver ls( a );
+        double t = wall_time();
+        ls.qr_decomp_pivoting();
+        std::cout << "rank deficient " << m << " x " << n << ": rank " << ls.rank() << " in "
+                  << ( wall_time() - t )*1e3 << " ms" << std::endl;
+        if( ls.rank()!=r || !( check_factors( ls, a ) < 1e-13 ) ) return -1;
+        mx::Matrix x = ls.solve_least_squares( b );
+        mx::Matrix res = a*x - b;
+        mx::Matrix normal = a.transpose()*res;
+        if( !( normal.norm() < 1e-10*a.norm()*res.norm() ) ) return -1;
+        int zeros = 0;
+        for( int j=0; j<n; j++ )
+            zeros += ( x(j,0)==0.0 && x(j,1)==0.0 );
+        if( zeros!=n-r ) return -1;
+    }
+
+    /// an exactly zero column fails unpivoted QR and leaves the solver unfactored
+    {
+        mx::Matrix a = rand_mat( 40, 10 );
+        for( int i=0; i<40; i++ )
+            a(i,3) = 0.0;
+        mx::LinearSolver ls( a ), lp( a );
+        if( ls.qr_decomp()!=-1 || ls.get_status()!=mx::MAT_SET ) return -1;
+        lp.qr_decomp_pivoting();
+        if( lp.get_status()!=mx::QR_SUCCESS || lp.rank()!=9 ) return -1;
+    }
+
+    /// square: QR solves like LU
+    {
+        const int n = 300;
+        mx::Matrix a = rand_mat( n, n ), b = rand_mat( n, 3 );
+        mx::LinearSolver lq( a ), lu( a );
+        lq.qr_decomp();
+        lu.lu_decomp_partial();
+        mx::Matrix d = lq.solve( b ) - lu.solve( b );
+        if( !( d.norm() < 1e-9*lu.solve( b ).norm() ) ) return -1;
+    }
+
+    /// complex, both factorizations, residual orthogonal to the columns of A under A^*
+    {
+        const int m = 300, n = 70;
+        mx::MatrixZ a( m, n ), b( m, 1 );
+        for( int i=0; i<m; i++ )
+        {
+            for( int j=0; j<n; j++ )
+                a(i,j) = std::complex<double>( (double)std::rand()/RAND_MAX - 0.5, (double)std::rand()/RAND_MAX - 0.5 );
+            b(i,0) = std::complex<double>( (double)std::rand()/RAND_MAX, 0.5 );
+        }
+        for( int piv=0; piv<2; piv++ )
+        {
+            mx::LinearSolverZ lz( a );
+            lz.set_block_size( 32 );
+            if( piv ) lz.qr_decomp_pivoting();
+            else lz.qr_decomp();
+            mx::MatrixZ x = lz.solve_least_squares( b );
+            mx::MatrixZ res = a*x - b;
+            double worst = 0;
+            for( int j=0; j<n; j++ )
+            {
+                std::complex<double> s = 0;
+                for( int i=0; i<m; i++ )
+                    s += std::conj( a(i,j) )*res(i,0);
+                worst = std::max( worst, std::abs( s ) );
+            }
+            if( !( worst < 1e-10*res.norm() ) || lz.rank()!=n ) return -1;
+            mx::MatrixZ q = lz.get_q(), r = lz.get_r();
+            const std::vector<int>& p = lz.get_col_perm();
+            mx::MatrixZ qr = q*r;
+            double err = 0;
+            for( int i=0; i<m; i++ )
+                for( int j=0; j<n; j++ )
+                    err = std::max( err, std::abs( qr(i,j) - a(i,p[j]) ) );
+            if( !( err < 1e-12 ) ) return -1;
+        }
+    }
+    return 0;
+}
+
 static int run_benchmarks( int argc, char* argv[] )
 {
     int status = 0;
@@ -260,6 +2424,56 @@ static int run_benchmarks( int argc, char* argv[] )
             status = status || bench_Chole_decomp();
         else if( std::strcmp( argv[i], "-bench_Chole_decomp_pivot" ) == 0 )
             status = status || bench_Chole_decomp_pivot();
+        else if( std::strcmp( argv[i], "-bench_GEMM" ) == 0 )
+            status = status || bench_GEMM();
+        else if( std::strcmp( argv[i], "-bench_GEMM_threads" ) == 0 )
+            status = status || bench_GEMM_threads();
+        else if( std::strcmp( argv[i], "-bench_LU_blocked" ) == 0 )
+            status = status || bench_LU_blocked();
+        else if( std::strcmp( argv[i], "-bench_tiled_factor" ) == 0 )
+            status = status || bench_tiled_factor();
+        else if( std::strcmp( argv[i], "-bench_solve_multi" ) == 0 )
+            status = status || bench_solve_multi();
+        else if( std::strcmp( argv[i], "-bench_solve_inplace" ) == 0 )
+            status = status || bench_solve_inplace();
+        else if( std::strcmp( argv[i], "-bench_LU_mixed" ) == 0 )
+            status = status || bench_LU_mixed();
+        else if( std::strcmp( argv[i], "-bench_scalar_types" ) == 0 )
+            status = status || bench_scalar_types();
+        else if( std::strcmp( argv[i], "-bench_fixed_small" ) == 0 )
+            status = status || bench_fixed_small();
+        else if( std::strcmp( argv[i], "-bench_batched" ) == 0 )
+            status = status || bench_batched();
+        else if( std::strcmp( argv[i], "-bench_binary_io" ) == 0 )
+            status = status || bench_binary_io();
+        else if( std::strcmp( argv[i], "-bench_dense_io" ) == 0 )
+            status = status || bench_dense_io();
+        else if( std::strcmp( argv[i], "-bench_out_of_core" ) == 0 )
+            status = status || bench_out_of_core();
+        else if( std::strcmp( argv[i], "-bench_views" ) == 0 )
+            status = status || bench_views();
+        else if( std::strcmp( argv[i], "-bench_expression" ) == 0 )
+            status = status || bench_expression();
+        else if( std::strcmp( argv[i], "-bench_LU_pivoting" ) == 0 )
+            status = status || bench_LU_pivoting();
+        else if( std::strcmp( argv[i], "-bench_LU_calu" ) == 0 )
+            status = status || bench_LU_calu();
+        else if( std::strcmp( argv[i], "-bench_sym_packed" ) == 0 )
+            status = status || bench_sym_packed();
+        else if( std::strcmp( argv[i], "-bench_chole_rank" ) == 0 )
+            status = status || bench_chole_rank();
+        else if( std::strcmp( argv[i], "-bench_factor_update" ) == 0 )
+            status = status || bench_factor_update();
+        else if( std::strcmp( argv[i], "-bench_factor_cache" ) == 0 )
+            status = status || bench_factor_cache();
+        else if( std::strcmp( argv[i], "-bench_sparse" ) == 0 )
+            status = status || bench_sparse();
+        else if( std::strcmp( argv[i], "-bench_sparse_direct" ) == 0 )
+            status = status || bench_sparse_direct();
+        else if( std::strcmp( argv[i], "-bench_krylov" ) == 0 )
+            status = status || bench_krylov();
+        else if( std::strcmp( argv[i], "-bench_qr" ) == 0 )
+            status = status || bench_qr();
         else
         {
             std::cerr << "invalid command: " << argv[i] << std::endl;
@@ -307,7 +2521,7 @@ int main( int argc, char* argv[] )
     double abs_err = 0.0;
     for( int i=0; i<n; i++ )
     {
-        mx::Matrix vec = mat3.submatrix( 0,-1, i, i );
+        auto vec = mat3.submatrix( 0,-1, i, i );
         mx::Matrix sol = ls.solve_vec( vec );
         abs_err += ( mat7*sol - vec ).norm();
     }